@@ -0,0 +1,530 @@
+/*
+ * Copyright 2024 Collabora, Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Converts the 'timeline-binary' debug stream into the Chrome trace event
+ * JSON format, which both chrome://tracing and the Perfetto UI open.
+ *
+ * Points of an output go to a track of their own, points with a GPU
+ * timestamp to a separate GPU track of the output. Points named *_begin
+ * and *_end become slices, everything else instant events.
+ */
+
+#include "config.h"
+
+#include <getopt.h>
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "shared/helpers.h"
+#include "shared/timeline-binary.h"
+
+/* Track ids of GPU tracks are offset from the output ids */
+#define GPU_TRACK_OFFSET 0x10000
+
+struct timeline_object {
+	uint8_t type;
+	uint32_t main_surface;
+	char *str;
+};
+
+struct converter {
+	FILE *out;
+	bool first_event;
+
+	char **names;
+	uint32_t n_names;
+
+	struct timeline_object *objects;
+	uint32_t n_objects;
+};
+
+static void
+print_json_string(FILE *fp, const char *str)
+{
+	const unsigned char *c;
+
+	fputc('"', fp);
+	for (c = (const unsigned char *)str; *c; c++) {
+		if (*c == '"' || *c == '\\')
+			fprintf(fp, "\\%c", *c);
+		else if (*c < 0x20)
+			fprintf(fp, "\\u%04x", *c);
+		else
+			fputc(*c, fp);
+	}
+	fputc('"', fp);
+}
+
+static void
+print_timestamp(FILE *fp, uint64_t ns)
+{
+	/* microseconds */
+	fprintf(fp, "%" PRIu64 ".%03u", ns / 1000, (unsigned)(ns % 1000));
+}
+
+static void
+begin_event(struct converter *conv)
+{
+	fprintf(conv->out, conv->first_event ? "\n" : ",\n");
+	conv->first_event = false;
+}
+
+static void
+emit_track_name(struct converter *conv, uint32_t tid, const char *name)
+{
+	begin_event(conv);
+	fprintf(conv->out, "{\"ph\":\"M\",\"pid\":1,\"tid\":%u,"
+		"\"name\":\"thread_name\",\"args\":{\"name\":", tid);
+	print_json_string(conv->out, name);
+	fprintf(conv->out, "}}");
+}
+
+static bool
+store_string(char ***array, uint32_t *count, uint32_t id, const char *str)
+{
+	char **grown;
+
+	if (id >= *count) {
+		grown = realloc(*array, (id + 1) * sizeof *grown);
+		if (!grown)
+			return false;
+		memset(grown + *count, 0, (id + 1 - *count) * sizeof *grown);
+		*array = grown;
+		*count = id + 1;
+	}
+
+	free((*array)[id]);
+	(*array)[id] = strdup(str);
+
+	return (*array)[id] != NULL;
+}
+
+static struct timeline_object *
+get_object(struct converter *conv, uint32_t id, bool create)
+{
+	struct timeline_object *grown;
+
+	if (id < conv->n_objects)
+		return &conv->objects[id];
+
+	if (!create)
+		return NULL;
+
+	grown = realloc(conv->objects, (id + 1) * sizeof *grown);
+	if (!grown)
+		return NULL;
+	memset(grown + conv->n_objects, 0,
+	       (id + 1 - conv->n_objects) * sizeof *grown);
+	conv->objects = grown;
+	conv->n_objects = id + 1;
+
+	return &conv->objects[id];
+}
+
+static bool
+define_object(struct converter *conv, const struct weston_timeline_record *rec,
+	      const char *str)
+{
+	struct timeline_object *obj = get_object(conv, rec->id, true);
+
+	if (!obj)
+		return false;
+
+	free(obj->str);
+	obj->str = strdup(str);
+	obj->type = rec->type;
+	obj->main_surface = rec->surface;
+
+	if (rec->type == WESTON_TIMELINE_RECORD_OUTPUT) {
+		char gpu[256];
+
+		snprintf(gpu, sizeof gpu, "%s gpu", str);
+		emit_track_name(conv, rec->id, str);
+		emit_track_name(conv, rec->id + GPU_TRACK_OFFSET, gpu);
+	}
+
+	return obj->str != NULL;
+}
+
+/* Is there a point named 'base' (of 'len' bytes) followed by 'suffix'? */
+static bool
+has_name(struct converter *conv, const char *base, size_t len,
+	 const char *suffix)
+{
+	uint32_t i;
+
+	for (i = 0; i < conv->n_names; i++) {
+		const char *name = conv->names[i];
+
+		if (name && strncmp(name, base, len) == 0 &&
+		    strcmp(name + len, suffix) == 0)
+			return true;
+	}
+
+	return false;
+}
+
+static void
+emit_point(struct converter *conv, const struct weston_timeline_record *rec)
+{
+	const char *name = "unknown";
+	size_t len;
+	uint64_t ts = rec->time_ns;
+	uint32_t tid = rec->output;
+	char phase = 'i';
+
+	if (rec->id < conv->n_names && conv->names[rec->id])
+		name = conv->names[rec->id];
+	len = strlen(name);
+
+	if (rec->flags & WESTON_TIMELINE_POINT_GPU) {
+		ts = rec->aux;
+		tid += GPU_TRACK_OFFSET;
+	}
+
+	/* A slice needs both ends */
+	if (len > 6 && strcmp(name + len - 6, "_begin") == 0 &&
+	    has_name(conv, name, len - 6, "_end")) {
+		phase = 'B';
+		len -= 6;
+	} else if (len > 4 && strcmp(name + len - 4, "_end") == 0 &&
+		   has_name(conv, name, len - 4, "_begin")) {
+		phase = 'E';
+		len -= 4;
+	}
+
+	begin_event(conv);
+	fprintf(conv->out, "{\"ph\":\"%c\",\"pid\":1,\"tid\":%u,\"ts\":",
+		phase, tid);
+	print_timestamp(conv->out, ts);
+	fprintf(conv->out, ",\"name\":\"%.*s\"", (int)len, name);
+	if (phase == 'i')
+		fprintf(conv->out, ",\"s\":\"t\"");
+
+	if (rec->surface || (rec->flags & WESTON_TIMELINE_POINT_INPUT)) {
+		const char *sep = "";
+
+		fprintf(conv->out, ",\"args\":{");
+		if (rec->flags & WESTON_TIMELINE_POINT_INPUT) {
+			fprintf(conv->out, "\"input\":%u", rec->input);
+			sep = ",";
+		}
+		if (rec->surface) {
+			struct timeline_object *obj =
+				get_object(conv, rec->surface, false);
+
+			fprintf(conv->out, "%s\"surface\":%u", sep,
+				rec->surface);
+			if (obj && obj->str && obj->str[0]) {
+				fprintf(conv->out, ",\"desc\":");
+				print_json_string(conv->out, obj->str);
+			}
+			if (obj && obj->main_surface)
+				fprintf(conv->out, ",\"main_surface\":%u",
+					obj->main_surface);
+		}
+		fprintf(conv->out, "}");
+	}
+	fprintf(conv->out, "}");
+
+	if (rec->flags & WESTON_TIMELINE_POINT_VBLANK) {
+		begin_event(conv);
+		fprintf(conv->out, "{\"ph\":\"i\",\"pid\":1,\"tid\":%u,\"ts\":",
+			rec->output);
+		print_timestamp(conv->out, rec->aux);
+		fprintf(conv->out, ",\"name\":\"vblank\",\"s\":\"t\"}");
+	}
+}
+
+static void
+emit_lost(struct converter *conv, const struct weston_timeline_record *rec)
+{
+	begin_event(conv);
+	fprintf(conv->out, "{\"ph\":\"i\",\"pid\":1,\"tid\":0,\"ts\":");
+	print_timestamp(conv->out, rec->time_ns);
+	fprintf(conv->out, ",\"name\":\"lost\",\"s\":\"g\","
+		"\"args\":{\"records\":%" PRIu64 "}}", rec->aux);
+}
+
+/*
+ * With 'names_only', only collect the point names, so that emit_point()
+ * knows all of them from the start.
+ */
+/* Version 1 records end right before 'input' */
+#define TIMELINE_RECORD_V1_SIZE offsetof(struct weston_timeline_record, input)
+
+/* The fixed part of the records of a stream version, 0 if unsupported */
+static size_t
+record_size_for_version(uint64_t version)
+{
+	switch (version) {
+	case 1:
+		return TIMELINE_RECORD_V1_SIZE;
+	case WESTON_TIMELINE_BINARY_VERSION:
+		return sizeof(struct weston_timeline_record);
+	default:
+		return 0;
+	}
+}
+
+static bool
+convert(struct converter *conv, const uint8_t *data, size_t size,
+	bool names_only)
+{
+	size_t pos = 0;
+	bool seen_stream = false;
+	/* What all versions share, until the stream record tells */
+	size_t rec_size = TIMELINE_RECORD_V1_SIZE;
+
+	while (pos + rec_size <= size) {
+		struct weston_timeline_record rec = { 0 };
+		const char *str = NULL;
+
+		/* Fields missing from older versions stay zero */
+		memcpy(&rec, data + pos, rec_size);
+
+		if (!seen_stream) {
+			if (rec.type != WESTON_TIMELINE_RECORD_STREAM) {
+				fprintf(stderr, "Error: not a weston timeline "
+					"stream.\n");
+				return false;
+			}
+
+			rec_size = record_size_for_version(rec.aux);
+			if (rec_size == 0) {
+				fprintf(stderr, "Error: unsupported stream "
+					"version %" PRIu64 ".\n", rec.aux);
+				return false;
+			}
+			memcpy(&rec, data + pos, MIN(rec_size, size - pos));
+		}
+
+		if (rec.size < rec_size || rec.size % 8 != 0) {
+			fprintf(stderr, "Error: bad record at offset %zu.\n",
+				pos);
+			return false;
+		}
+
+		/* The capture was cut short */
+		if (rec.size > size - pos)
+			break;
+
+		if (rec.size > rec_size) {
+			str = (const char *)data + pos + rec_size;
+			if (!memchr(str, '\0', rec.size - rec_size)) {
+				fprintf(stderr, "Error: unterminated string "
+					"at offset %zu.\n", pos);
+				return false;
+			}
+		}
+
+		if (names_only && rec.type != WESTON_TIMELINE_RECORD_STREAM &&
+		    rec.type != WESTON_TIMELINE_RECORD_NAME) {
+			pos += rec.size;
+			continue;
+		}
+
+		switch (rec.type) {
+		case WESTON_TIMELINE_RECORD_STREAM:
+			if (!str || strcmp(str, WESTON_TIMELINE_BINARY_MAGIC)) {
+				fprintf(stderr, "Error: not a weston timeline "
+					"stream.\n");
+				return false;
+			}
+			seen_stream = true;
+			break;
+		case WESTON_TIMELINE_RECORD_NAME:
+			if (!store_string(&conv->names, &conv->n_names,
+					  rec.id, str ? str : ""))
+				return false;
+			break;
+		case WESTON_TIMELINE_RECORD_OUTPUT:
+		case WESTON_TIMELINE_RECORD_SURFACE:
+			if (!define_object(conv, &rec, str ? str : ""))
+				return false;
+			break;
+		case WESTON_TIMELINE_RECORD_POINT:
+			emit_point(conv, &rec);
+			break;
+		case WESTON_TIMELINE_RECORD_LOST:
+			emit_lost(conv, &rec);
+			break;
+		default:
+			/* newer record types are skipped */
+			break;
+		}
+
+		pos += rec.size;
+	}
+
+	if (!seen_stream && size > 0) {
+		fprintf(stderr, "Error: not a weston timeline stream.\n");
+		return false;
+	}
+
+	if (pos != size && !names_only)
+		fprintf(stderr, "Warning: %zu trailing bytes ignored.\n",
+			size - pos);
+
+	return true;
+}
+
+static uint8_t *
+read_all(FILE *fp, size_t *size)
+{
+	size_t alloc = 1 << 20;
+	uint8_t *data = malloc(alloc);
+	size_t len = 0;
+	size_t n;
+
+	while (data && (n = fread(data + len, 1, alloc - len, fp)) > 0) {
+		len += n;
+		if (len == alloc) {
+			uint8_t *grown = realloc(data, alloc * 2);
+
+			if (!grown) {
+				free(data);
+				return NULL;
+			}
+			data = grown;
+			alloc *= 2;
+		}
+	}
+
+	if (data && ferror(fp)) {
+		free(data);
+		return NULL;
+	}
+
+	*size = len;
+	return data;
+}
+
+static void
+print_help(void)
+{
+	fprintf(stderr,
+		"Usage: weston-timeline [options]\n"
+		"Converts a 'timeline-binary' debug stream into Chrome trace\n"
+		"JSON, which chrome://tracing and ui.perfetto.dev can open.\n"
+		"Where options may be:\n"
+		"  -h, --help\n"
+		"     This help text, and exit with success.\n"
+		"  -i FILE, --input FILE\n"
+		"     Read the stream from FILE. Stdin is the default.\n"
+		"  -o FILE, --output FILE\n"
+		"     Write the trace to FILE. Stdout is the default.\n"
+		"For example:\n"
+		"  weston-debug -o timeline.bin timeline-binary\n"
+		"  weston-timeline -i timeline.bin -o trace.json\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+	static const struct option opts[] = {
+		{ "help", no_argument, NULL, 'h' },
+		{ "input", required_argument, NULL, 'i' },
+		{ "output", required_argument, NULL, 'o' },
+		{ 0 }
+	};
+	struct converter conv = { .first_event = true };
+	const char *input = NULL;
+	const char *output = NULL;
+	FILE *in = stdin;
+	uint8_t *data;
+	size_t size;
+	bool ok;
+	uint32_t i;
+	int c;
+
+	while ((c = getopt_long(argc, argv, "hi:o:", opts, NULL)) != -1) {
+		switch (c) {
+		case 'h':
+			print_help();
+			return EXIT_SUCCESS;
+		case 'i':
+			input = optarg;
+			break;
+		case 'o':
+			output = optarg;
+			break;
+		default:
+			print_help();
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (input) {
+		in = fopen(input, "rb");
+		if (!in) {
+			fprintf(stderr, "Error: cannot open %s: %m\n", input);
+			return EXIT_FAILURE;
+		}
+	}
+
+	data = read_all(in, &size);
+	if (in != stdin)
+		fclose(in);
+	if (!data) {
+		fprintf(stderr, "Error: failed to read the input.\n");
+		return EXIT_FAILURE;
+	}
+
+	conv.out = stdout;
+	if (output) {
+		conv.out = fopen(output, "w");
+		if (!conv.out) {
+			fprintf(stderr, "Error: cannot open %s: %m\n", output);
+			free(data);
+			return EXIT_FAILURE;
+		}
+	}
+
+	fprintf(conv.out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+	emit_track_name(&conv, 0, "compositor");
+	ok = convert(&conv, data, size, true) &&
+	     convert(&conv, data, size, false);
+	fprintf(conv.out, "\n]}\n");
+
+	if (conv.out != stdout)
+		fclose(conv.out);
+	free(data);
+
+	for (i = 0; i < conv.n_names; i++)
+		free(conv.names[i]);
+	free(conv.names);
+	for (i = 0; i < conv.n_objects; i++)
+		free(conv.objects[i].str);
+	free(conv.objects);
+
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
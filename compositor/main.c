@@ -824,6 +824,18 @@ static int on_user2_signal(int signal_number, void *data)
 	return 1;
 }
 
+#ifdef ENABLE_PROFILER
+static int on_prof_signal(int signal_number, void *data)
+{
+	struct wet_compositor *wet = data;
+
+	if (wet->compositor)
+		weston_compositor_log_profile(wet->compositor);
+
+	return 1;
+}
+#endif
+
 static const char *
 clock_name(clockid_t clk_id)
 {
@@ -1113,6 +1125,7 @@ weston_compositor_init_config(struct weston_compositor *ec,
 	struct xkb_rule_names xkb_names;
 	struct weston_config_section *s;
 	int repaint_msec;
+	int memory_warning;
 	bool color_management;
 	bool cal;
 
@@ -1153,6 +1166,16 @@ weston_compositor_init_config(struct weston_compositor *ec,
 	weston_log("Output repaint window is %d ms maximum.\n",
 		   ec->repaint_msec);
 
+	weston_config_section_get_int(s, "memory-warning", &memory_warning, 0);
+	if (memory_warning < 0) {
+		weston_log("Invalid memory-warning value in config: %d\n",
+			   memory_warning);
+	} else {
+		weston_compositor_set_memory_warning(ec,
+						     (uint64_t)memory_warning *
+						     1024 * 1024);
+	}
+
 	weston_config_section_get_bool(s, "color-management",
 				       &color_management, false);
 	if (color_management) {
@@ -2102,6 +2125,7 @@ drm_backend_output_configure(struct weston_output *output,
 	char *modeline = NULL;
 	char *gbm_format = NULL;
 	char *content_type = NULL;
+	char *vrr_mode = NULL;
 	char *seat = NULL;
 
 	api = weston_drm_output_get_api(output->compositor);
@@ -2178,6 +2202,14 @@ drm_backend_output_configure(struct weston_output *output,
 		return -1;
 	free(content_type);
 
+	weston_config_section_get_string(section,
+					 "vrr-mode", &vrr_mode, NULL);
+	if (api->set_vrr_mode(output, vrr_mode) < 0) {
+		free(vrr_mode);
+		return -1;
+	}
+	free(vrr_mode);
+
 	weston_config_section_get_string(section, "seat", &seat, "");
 
 	api->set_seat(output, seat);
@@ -3922,6 +3954,32 @@ sigint_helper(int sig)
 	raise(SIGTERM);
 }
 
+static const int crash_signals[] = { SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT };
+
+/* Runs with the default action already restored, see
+ * flight_rec_catch_crashes() */
+static void
+flight_rec_crash_handler(int sig)
+{
+	weston_log_flight_recorder_dump_fd(STDERR_FILENO);
+	raise(sig);
+}
+
+/* Dump the flight recorder contents of all threads on a crash */
+static void
+flight_rec_catch_crashes(bool enable)
+{
+	struct sigaction action;
+	unsigned i;
+
+	action.sa_handler = enable ? flight_rec_crash_handler : SIG_DFL;
+	sigemptyset(&action.sa_mask);
+	action.sa_flags = enable ? SA_RESETHAND : 0;
+
+	for (i = 0; i < ARRAY_LENGTH(crash_signals); i++)
+		sigaction(crash_signals[i], &action, NULL);
+}
+
 WL_EXPORT int
 wet_main(int argc, char *argv[], const struct weston_testsuite_data *test_data)
 {
@@ -3929,6 +3987,9 @@ wet_main(int argc, char *argv[], const struct weston_testsuite_data *test_data)
 	char *cmdline;
 	struct wl_display *display;
 	struct wl_event_source *signals[3];
+#ifdef ENABLE_PROFILER
+	struct wl_event_source *prof_signal = NULL;
+#endif
 	struct wl_event_loop *loop;
 	int i, fd;
 	char *backend = NULL;
@@ -3964,6 +4025,7 @@ wet_main(int argc, char *argv[], const struct weston_testsuite_data *test_data)
 
 	bool wait_for_debugger = false;
 	struct wl_protocol_logger *protologger = NULL;
+	struct wet_proto_capture *proto_capture = NULL;
 
 	bool warm_up = false;
 
@@ -4022,13 +4084,20 @@ wet_main(int argc, char *argv[], const struct weston_testsuite_data *test_data)
 
 	weston_log_set_handler(vlog, vlog_continue);
 
-	logger = weston_log_subscriber_create_log(weston_logfile);
+	/* Keep a slow log file from stalling the compositor; on stderr,
+	 * prefer having every line out before a crash. */
+	if (weston_logfile != stderr)
+		logger = weston_log_subscriber_create_log_async(weston_logfile);
+	else
+		logger = weston_log_subscriber_create_log(weston_logfile);
 
 	if (!flight_rec_scopes)
 		flight_rec_scopes = DEFAULT_FLIGHT_REC_SCOPES;
 
 	if (flight_rec_scopes && strlen(flight_rec_scopes) > 0)
 		flight_rec = weston_log_subscriber_create_flight_rec(DEFAULT_FLIGHT_REC_SIZE);
+	if (flight_rec)
+		flight_rec_catch_crashes(true);
 
 	weston_log_subscribe_to_scopes(log_ctx, logger, flight_rec,
 				       log_scopes, flight_rec_scopes);
@@ -4080,6 +4149,12 @@ wet_main(int argc, char *argv[], const struct weston_testsuite_data *test_data)
 	if (!signals[0] || !signals[1] || !signals[2])
 		goto out_signals;
 
+#ifdef ENABLE_PROFILER
+	/* Dump the built-in profile into the log on SIGPROF */
+	prof_signal = wl_event_loop_add_signal(loop, SIGPROF, on_prof_signal,
+					       &wet);
+#endif
+
 	/* Xwayland uses SIGUSR1 for communicating with weston. Since some
 	   weston plugins may create additional threads, set up any necessary
 	   signal blocking early so that these threads can inherit the settings
@@ -4142,6 +4217,7 @@ wet_main(int argc, char *argv[], const struct weston_testsuite_data *test_data)
 	protologger = wl_display_add_protocol_logger(display,
 						     protocol_log_fn,
 						     NULL);
+	proto_capture = wet_proto_capture_create(display, log_ctx);
 	if (debug_protocol) {
 		weston_compositor_enable_debug_protocol(wet.compositor);
 		weston_compositor_add_screenshot_authority(wet.compositor,
@@ -4288,6 +4364,7 @@ out:
 
 	if (protologger)
 		wl_protocol_logger_destroy(protologger);
+	wet_proto_capture_destroy(proto_capture);
 
 	weston_compositor_destroy(wet.compositor);
 	wet_compositor_destroy_layout(&wet);
@@ -4295,6 +4372,10 @@ out:
 	protocol_scope = NULL;
 
 out_signals:
+#ifdef ENABLE_PROFILER
+	if (prof_signal)
+		wl_event_source_remove(prof_signal);
+#endif
 	for (i = ARRAY_LENGTH(signals) - 1; i >= 0; i--)
 		if (signals[i])
 			wl_event_source_remove(signals[i]);
@@ -4305,8 +4386,10 @@ out_display:
 	weston_log_scope_destroy(log_scope);
 	log_scope = NULL;
 	weston_log_subscriber_destroy(logger);
-	if (flight_rec)
+	if (flight_rec) {
+		flight_rec_catch_crashes(false);
 		weston_log_subscriber_destroy(flight_rec);
+	}
 	weston_log_ctx_destroy(log_ctx);
 	weston_log_file_close();
 
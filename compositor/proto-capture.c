@@ -0,0 +1,426 @@
+/*
+ * Copyright 2024 Collabora, Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <libweston/libweston.h>
+#include <libweston/weston-log.h>
+#include "weston-private.h"
+#include "shared/helpers.h"
+#include "shared/proto-capture.h"
+#include "shared/xalloc.h"
+
+/* Binary protocol capture
+ *
+ * Formatting every message as text, like the 'proto' scope does, is too
+ * slow to leave on. The 'proto-binary' scope records the same messages
+ * in the format of shared/proto-capture.h instead: a fixed header with
+ * interned ids, followed by the raw arguments. Turning a capture back into
+ * text is left to tools/weston-proto-decode.py, which reads the names and
+ * signatures of the messages from the protocol XML files.
+ *
+ * Interfaces are interned in an open-addressing table keyed by the
+ * wl_interface address, which also gives the interface ids. Clients get
+ * ids through a destroy listener. Both remember the generation they were
+ * last defined in; bumping the generation, for a new subscriber or every
+ * PROTO_CAPTURE_REDEFINE_RECORDS records, defines them again on next use.
+ */
+
+#define PROTO_CAPTURE_MAX_INTERFACES 1024	/* a power of two */
+#define PROTO_CAPTURE_REDEFINE_RECORDS 4096
+#define PROTO_CAPTURE_STACK_SIZE 4096
+
+struct proto_capture_interface {
+	const struct wl_interface *interface;
+	uint32_t generation;
+};
+
+struct proto_capture_client {
+	struct wl_listener destroy_listener;
+	uint64_t id;
+	uint32_t generation;
+};
+
+struct wet_proto_capture {
+	struct weston_log_scope *scope;
+	struct wl_protocol_logger *logger;
+	struct proto_capture_interface interfaces[PROTO_CAPTURE_MAX_INTERFACES];
+	uint32_t generation;
+	uint32_t records;
+	uint64_t next_client_id;
+};
+
+static size_t
+align(size_t size, size_t alignment)
+{
+	return (size + alignment - 1) & ~(alignment - 1);
+}
+
+static uint64_t
+proto_capture_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void
+proto_capture_write_stream(struct wet_proto_capture *capture)
+{
+	struct {
+		struct weston_proto_record rec;
+		char magic[16];
+	} stream = {
+		.rec = {
+			.type = WESTON_PROTO_RECORD_STREAM,
+			.size = sizeof stream,
+			.time_ns = proto_capture_now(),
+			.object = WESTON_PROTO_CAPTURE_VERSION,
+		},
+		.magic = WESTON_PROTO_CAPTURE_MAGIC,
+	};
+
+	weston_log_scope_write(capture->scope, (const char *)&stream,
+			       sizeof stream);
+}
+
+static uint32_t
+proto_capture_interface_id(struct wet_proto_capture *capture,
+			   const struct wl_interface *interface,
+			   uint64_t time_ns)
+{
+	struct proto_capture_interface *pci;
+	struct weston_proto_record *rec;
+	uint64_t buf[(sizeof(struct weston_proto_record) + 128) / 8] = {};
+	size_t name_len, size;
+	uint32_t slot, probe;
+
+	slot = ((uintptr_t)interface >> 4) * 2654435761u;
+
+	for (probe = 0; probe < PROTO_CAPTURE_MAX_INTERFACES; probe++) {
+		slot &= PROTO_CAPTURE_MAX_INTERFACES - 1;
+		pci = &capture->interfaces[slot];
+		if (pci->interface == interface)
+			break;
+		if (!pci->interface) {
+			pci->interface = interface;
+			pci->generation = capture->generation - 1;
+			break;
+		}
+		slot++;
+	}
+	if (probe == PROTO_CAPTURE_MAX_INTERFACES)
+		return 0;
+
+	if (pci->generation == capture->generation)
+		return slot + 1;
+	pci->generation = capture->generation;
+
+	/* Overlong names are truncated rather than left undefined, the
+	 * slot keeps its id either way. The buffer is zeroed, so the name
+	 * stays terminated. */
+	name_len = strlen(interface->name) + 1;
+	if (name_len > sizeof buf - sizeof *rec)
+		name_len = sizeof buf - sizeof *rec;
+
+	size = sizeof *rec + align(name_len, 8);
+	rec = (struct weston_proto_record *)buf;
+	rec->type = WESTON_PROTO_RECORD_INTERFACE;
+	rec->size = size;
+	rec->time_ns = time_ns;
+	rec->object = interface->version;
+	rec->interface = slot + 1;
+	memcpy((uint8_t *)buf + sizeof *rec, interface->name, name_len - 1);
+
+	weston_log_scope_write(capture->scope, (const char *)buf, size);
+
+	return slot + 1;
+}
+
+static void
+proto_capture_client_destroy(struct wl_listener *listener, void *data)
+{
+	struct proto_capture_client *pcc =
+		container_of(listener, struct proto_capture_client,
+			     destroy_listener);
+
+	wl_list_remove(&pcc->destroy_listener.link);
+	free(pcc);
+}
+
+static uint64_t
+proto_capture_client_id(struct wet_proto_capture *capture,
+			struct wl_client *client, uint64_t time_ns)
+{
+	struct proto_capture_client *pcc;
+	struct wl_listener *listener;
+	struct weston_proto_record rec = {};
+	pid_t pid = 0;
+
+	listener = wl_client_get_destroy_listener(client,
+						  proto_capture_client_destroy);
+	if (listener) {
+		pcc = container_of(listener, struct proto_capture_client,
+				   destroy_listener);
+	} else {
+		pcc = xzalloc(sizeof *pcc);
+		pcc->id = ++capture->next_client_id;
+		pcc->generation = capture->generation - 1;
+		pcc->destroy_listener.notify = proto_capture_client_destroy;
+		wl_client_add_destroy_listener(client, &pcc->destroy_listener);
+	}
+
+	if (pcc->generation == capture->generation)
+		return pcc->id;
+	pcc->generation = capture->generation;
+
+	wl_client_get_credentials(client, &pid, NULL, NULL);
+	rec.type = WESTON_PROTO_RECORD_CLIENT;
+	rec.size = sizeof rec;
+	rec.time_ns = time_ns;
+	rec.client = pcc->id;
+	rec.object = pid;
+	weston_log_scope_write(capture->scope, (const char *)&rec, sizeof rec);
+
+	return pcc->id;
+}
+
+static size_t
+proto_capture_args_size(const struct wl_protocol_logger_message *message)
+{
+	const char *signature = message->message->signature;
+	size_t size = 0;
+	int i = 0;
+
+	for (; *signature && i < message->arguments_count; signature++) {
+		const union wl_argument *arg = &message->arguments[i];
+
+		switch (*signature) {
+		case 'i':
+		case 'u':
+		case 'f':
+		case 'o':
+		case 'n':
+		case 'h':
+			size += 4;
+			break;
+		case 's':
+			size += 4 + (arg->s ? align(strlen(arg->s) + 1, 4) : 0);
+			break;
+		case 'a':
+			size += 4 + (arg->a ? align(arg->a->size, 4) : 0);
+			break;
+		default:
+			continue;
+		}
+		i++;
+	}
+
+	return size;
+}
+
+static void
+proto_capture_encode_args(const struct wl_protocol_logger_message *message,
+			  uint8_t *p)
+{
+	const char *signature = message->message->signature;
+	struct wl_resource *resource;
+	uint32_t word, len;
+	int i = 0;
+
+	for (; *signature && i < message->arguments_count; signature++) {
+		const union wl_argument *arg = &message->arguments[i];
+		const void *data = NULL;
+
+		switch (*signature) {
+		case 'i':
+			word = arg->i;
+			break;
+		case 'u':
+			word = arg->u;
+			break;
+		case 'f':
+			word = arg->f;
+			break;
+		case 'o':
+			resource = (struct wl_resource *)arg->o;
+			word = resource ? wl_resource_get_id(resource) : 0;
+			break;
+		case 'n':
+			word = arg->n;
+			break;
+		case 'h':
+			word = arg->h;
+			break;
+		case 's':
+			word = arg->s ? strlen(arg->s) + 1 : 0;
+			data = arg->s;
+			break;
+		case 'a':
+			word = arg->a ? arg->a->size : 0;
+			data = arg->a ? arg->a->data : NULL;
+			break;
+		default:
+			continue;
+		}
+		i++;
+
+		memcpy(p, &word, 4);
+		p += 4;
+
+		if (*signature != 's' && *signature != 'a')
+			continue;
+
+		len = align(word, 4);
+		if (word > 0)
+			memcpy(p, data, word);
+		memset(p + word, 0, len - word);
+		p += len;
+	}
+}
+
+static void
+proto_capture_log_fn(void *user_data,
+		     enum wl_protocol_logger_type direction,
+		     const struct wl_protocol_logger_message *message)
+{
+	struct wet_proto_capture *capture = user_data;
+	struct wl_resource *resource = message->resource;
+	struct weston_proto_record *rec;
+	uint64_t stack[PROTO_CAPTURE_STACK_SIZE / sizeof(uint64_t)];
+	uint8_t *buf = (uint8_t *)stack;
+	size_t args_size, size;
+	uint64_t time_ns;
+
+	if (!weston_log_scope_is_enabled(capture->scope))
+		return;
+
+	if (++capture->records >= PROTO_CAPTURE_REDEFINE_RECORDS) {
+		capture->records = 0;
+		capture->generation++;
+	}
+
+	time_ns = proto_capture_now();
+	args_size = proto_capture_args_size(message);
+	size = sizeof *rec + align(args_size, 8);
+	if (size > sizeof stack) {
+		buf = malloc(size);
+		if (!buf)
+			return;
+	}
+
+	rec = (struct weston_proto_record *)buf;
+	rec->type = direction == WL_PROTOCOL_LOGGER_REQUEST ?
+		    WESTON_PROTO_RECORD_REQUEST : WESTON_PROTO_RECORD_EVENT;
+	rec->opcode = message->message_opcode;
+	rec->size = size;
+	rec->time_ns = time_ns;
+	rec->client = proto_capture_client_id(capture,
+					      wl_resource_get_client(resource),
+					      time_ns);
+	rec->object = wl_resource_get_id(resource);
+	rec->interface =
+		proto_capture_interface_id(capture,
+					   wl_resource_get_interface(resource),
+					   time_ns);
+
+	proto_capture_encode_args(message, buf + sizeof *rec);
+	memset(buf + sizeof *rec + args_size, 0,
+	       size - sizeof *rec - args_size);
+
+	weston_log_scope_write(capture->scope, (const char *)buf, size);
+
+	if (buf != (uint8_t *)stack)
+		free(buf);
+}
+
+static void
+proto_capture_new_subscription(struct weston_log_subscription *sub,
+			       void *data)
+{
+	struct wet_proto_capture *capture = data;
+
+	/* Everyone gets the header and the definitions again, which the
+	 * stream format allows. */
+	capture->records = 0;
+	capture->generation++;
+	proto_capture_write_stream(capture);
+}
+
+/** Creates the 'proto-binary' log scope and starts feeding it
+ *
+ * \param display The display whose protocol to capture.
+ * \param log_ctx The log context to add the scope to.
+ * \return The capture, or NULL on failure.
+ */
+struct wet_proto_capture *
+wet_proto_capture_create(struct wl_display *display,
+			 struct weston_log_context *log_ctx)
+{
+	struct wet_proto_capture *capture;
+
+	capture = xzalloc(sizeof *capture);
+	capture->scope =
+		weston_log_ctx_add_log_scope(log_ctx, "proto-binary",
+					     "Wayland protocol capture for all "
+					     "clients, binary encoded for "
+					     "weston-proto-decode.py\n",
+					     proto_capture_new_subscription,
+					     NULL, capture);
+	if (!capture->scope)
+		goto err;
+
+	capture->logger = wl_display_add_protocol_logger(display,
+							 proto_capture_log_fn,
+							 capture);
+	if (!capture->logger)
+		goto err_scope;
+
+	return capture;
+
+err_scope:
+	weston_log_scope_destroy(capture->scope);
+err:
+	free(capture);
+	return NULL;
+}
+
+void
+wet_proto_capture_destroy(struct wet_proto_capture *capture)
+{
+	if (!capture)
+		return;
+
+	wl_protocol_logger_destroy(capture->logger);
+	weston_log_scope_destroy(capture->scope);
+	free(capture);
+}
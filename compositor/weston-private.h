@@ -36,6 +36,16 @@ bool
 get_renderer_from_string(const char *name,
 			 enum weston_renderer_type *renderer);
 
+struct weston_log_context;
+struct wet_proto_capture;
+
+struct wet_proto_capture *
+wet_proto_capture_create(struct wl_display *display,
+			 struct weston_log_context *log_ctx);
+
+void
+wet_proto_capture_destroy(struct wet_proto_capture *capture);
+
 int
 wet_output_set_color_characteristics(struct weston_output *output,
 				     struct weston_config *wc,
@@ -26,75 +26,85 @@
 #
 
 import gdb
+import struct
 
 class DisplayFlightRecorder(gdb.Command):
     def __init__(self):
 
-        self.rb = ''
+        self.fr = ''
         symbol_found = False
 
-        ring_buff =  gdb.lookup_global_symbol("weston_primary_flight_recorder_ring_buffer")
-        if ring_buff == None:
-            print("'weston_ring_buffer' symbol not found!")
+        flight_rec = gdb.lookup_global_symbol("weston_primary_flight_recorder")
+        if flight_rec == None:
+            print("'weston_primary_flight_recorder' symbol not found!")
             print("Either weston is too old or weston hasn't been loaded in memory")
         else:
-            self.rb = ring_buff
-            self.display_rb_data(self.rb)
+            self.fr = flight_rec
+            self.display_fr_data(self.fr)
             symbol_found = True
 
         if symbol_found:
             super(DisplayFlightRecorder, self).__init__("display_flight_rec",
                                                         gdb.COMMAND_DATA)
 
-    def display_rb_data(self, rb):
+    def rings(self):
+        rb = self.fr.value()['rings']
+        while rb != 0:
+            yield rb
+            rb = rb['next']
+
+    def display_fr_data(self, fr):
         print("Flight recorder data found. Use 'display_flight_rec' "
                 "to display its contents")
         # display this data (only) if symbol is not empty (happens if the program is not ran at all)
-        if rb.value():
-            print("Data at byte {append}, Size: {size}B, "
-                  "Overlapped: {overlap}".format(append=rb.value()['append_pos'],
-                                                size=rb.value()['size'],
-                                                overlap=rb.value()['overlap']))
+        if fr.value():
+            for rb in self.rings():
+                print("Thread {tid}: {used}B used, Size: {size}B".format(
+                      tid=rb['tid'],
+                      used=int(rb['head']) - int(rb['tail']),
+                      size=rb['size']))
 
-    # poor's man fwrite()
-    def gen_contents(self, start, stop):
-        _str = ''
-        for j in range(start, stop):
-            _str += chr(self.rb.value()['buf'][j])
-        return _str
+    # poor's man ring buffer read, wrapping around the end
+    def read_bytes(self, rb, pos, length):
+        size = int(rb['size'])
+        inferior = gdb.selected_inferior()
+        buf = int(rb['buf'].address)
+        data = b''
+        while length > 0:
+            offset = pos % size
+            chunk = min(length, size - offset)
+            data += bytes(inferior.read_memory(buf + offset, chunk))
+            pos += chunk
+            length -= chunk
+        return data
 
-    # mirrors C version, as to make sure we're not reading other parts...
+    # mirrors the C version: records of all threads, merged by timestamp
     def display_flight_rec_contents(self):
 
         # symbol is there but not loaded, we're not far enough
-        if self.rb.value() == 0x0:
+        if self.fr.value() == 0x0:
             print("Flight recorder found, but not loaded yet!")
             return
         else:
             print("Displaying flight recorder contents:")
 
-        append_pos = self.rb.value()['append_pos']
-        size = self.rb.value()['size']
-        overlap = self.rb.value()['overlap']
+        records = []
+        for rb in self.rings():
+            pos = int(rb['tail'])
+            head = int(rb['head'])
+            while pos < head:
+                time_ns, length, _ = struct.unpack("=QII",
+                                                   self.read_bytes(rb, pos, 16))
+                data = self.read_bytes(rb, pos + 16, length)
+                records.append((time_ns, data))
+                pos += 16 + ((length + 7) & ~7)
 
-        # if we haven't overflown and we're still at 0 means
-        # we still aren't far enough to be populated
-        if append_pos == 0 and not overlap:
+        if not records:
             print("Flight recorder doesn't have anything to display right now")
             return
 
-        # now we can print stuff
-        rb_data = ''
-        if not overlap:
-            if append_pos:
-                rb_data = self.gen_contents(0, append_pos)
-            else:
-                rb_data = self.gen_contents(0, size)
-        else:
-            rb_data = self.gen_contents(append_pos, size)
-            rb_data += self.gen_contents(0, append_pos)
-
-        print("{data}".format(data=rb_data))
+        records.sort(key=lambda record: record[0])
+        print("".join(data.decode(errors="replace") for _, data in records))
 
     # called when invoking 'display_flight_rec'
     def invoke(self, arg, from_tty):
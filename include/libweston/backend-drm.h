@@ -104,6 +104,20 @@ struct weston_drm_output_api {
 	 */
 	int (*set_content_type)(struct weston_output *output,
 				const char *content_type);
+
+	/** Variable refresh rate mode of the output. Valid values are:
+	 * - NULL or "none" - The output always runs at the mode refresh rate
+	 * - "game" - Adaptive sync is enabled if every head of the output
+	 *   advertises it, and repaints are paced by the content whenever a
+	 *   single opaque view covers the whole output (e.g. a fullscreen
+	 *   game or video player) instead of by the mode refresh rate.
+	 *
+	 * This can be set only while the output is disabled.
+	 *
+	 * Returns 0 on success, -1 on unknown mode.
+	 */
+	int (*set_vrr_mode)(struct weston_output *output,
+			    const char *vrr_mode);
 };
 
 static inline const struct weston_drm_output_api *
@@ -1513,8 +1513,24 @@ struct weston_compositor {
 	struct weston_log_context *weston_log_ctx;
 	struct weston_log_scope *debug_scene;
 	struct weston_log_scope *timeline;
+	struct weston_log_scope *timeline_binary;
 	struct weston_log_scope *libseat_debug;
 
+	/** Input to vblank latency tracking, see input-latency.c */
+	struct weston_input_latency *input_latency;
+
+	/** Per-output frame statistics, see frame-stats.c */
+	struct weston_frame_stats *frame_stats;
+
+	/** Hot path stage durations, see profiler.c */
+	struct weston_profiler *profiler;
+
+	/** Per-client activity counters, see client-stats.c */
+	struct weston_client_stats *client_stats;
+
+	/** Renderer and backend memory accounting, see memory-stats.c */
+	struct weston_memory_stats *memory_stats;
+
 	struct content_protection *content_protection;
 
 	struct weston_log_pacer unmapped_surface_or_view_pacer;
@@ -2083,6 +2099,8 @@ weston_layer_mask_is_infinite(struct weston_layer *layer);
 #define WP_PRESENTATION_FEEDBACK_INVALID (1U << 31)
 /* Steal another bit from presented_flags for tearing */
 #define WESTON_FINISH_FRAME_TEARING (1U << 30)
+/* And one for content-driven (variable refresh rate) presentation */
+#define WESTON_FINISH_FRAME_VRR (1U << 29)
 
 void
 weston_output_schedule_repaint(struct weston_output *output);
@@ -2331,6 +2349,11 @@ void
 weston_compositor_exit_with_code(struct weston_compositor *compositor,
 				 int exit_code);
 void
+weston_compositor_log_profile(struct weston_compositor *compositor);
+void
+weston_compositor_set_memory_warning(struct weston_compositor *compositor,
+				     uint64_t bytes);
+void
 weston_output_add_destroy_listener(struct weston_output *output,
 				   struct wl_listener *listener);
 struct wl_listener *
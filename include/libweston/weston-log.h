@@ -123,6 +123,9 @@ weston_log_subscribe(struct weston_log_context *log_ctx,
 struct weston_log_subscriber *
 weston_log_subscriber_create_log(FILE *dump_to);
 
+struct weston_log_subscriber *
+weston_log_subscriber_create_log_async(FILE *dump_to);
+
 struct weston_log_subscriber *
 weston_log_subscriber_create_flight_rec(size_t size);
 
@@ -136,6 +139,9 @@ weston_log_subscription_iterate(struct weston_log_scope *scope,
 void
 weston_log_flight_recorder_display_buffer(FILE *file);
 
+void
+weston_log_flight_recorder_dump_fd(int fd);
+
 #ifdef  __cplusplus
 }
 #endif
@@ -54,6 +54,7 @@
 #include <libweston/libweston.h>
 #include <libweston/backend-drm.h>
 #include <libweston/weston-log.h>
+#include "memory-stats.h"
 #include "output-capture.h"
 #include "shared/helpers.h"
 #include "shared/weston-drm-fourcc.h"
@@ -125,6 +126,10 @@
 
 #define DRM_MAX_BUFFERS		16
 
+/* Default bounds of the per-device dmabuf fb cache */
+#define DRM_FB_CACHE_MAX_ENTRIES	32
+#define DRM_FB_CACHE_MAX_MB		256
+
 /**
  * Represents the values of an enum-type KMS property
  */
@@ -231,6 +236,7 @@ enum wdrm_connector_property {
 	WDRM_CONNECTOR_HDR_OUTPUT_METADATA,
 	WDRM_CONNECTOR_MAX_BPC,
 	WDRM_CONNECTOR_CONTENT_TYPE,
+	WDRM_CONNECTOR_VRR_CAPABLE,
 	WDRM_CONNECTOR__COUNT
 };
 
@@ -334,6 +340,18 @@ struct drm_device {
 	 */
 	struct hash_table *gem_handle_refcnt;
 
+	/* KMS fbs imported from client dmabufs, kept alive across wl_buffer
+	 * destroy/recreate, see drm_fb_cache_lookup().
+	 */
+	struct {
+		/* drm_fb_cache_entry::link, most recently used first */
+		struct wl_list entry_list;
+		unsigned int num_entries;
+		unsigned int max_entries;
+		uint64_t size;
+		uint64_t max_size;
+	} fb_cache;
+
 	/* drm_crtc::link */
 	struct wl_list crtc_list;
 
@@ -472,6 +490,36 @@ struct drm_fb {
 
 	/* Used by dumb fbs */
 	void *map;
+
+	/* Accounted for the fbs allocated by the backend */
+	struct weston_memory_allocation mem;
+};
+
+/**
+ * Identity of an imported client dmabuf.
+ *
+ * A dmabuf is identified by the inode of its fds rather than by the fd
+ * numbers, which change each time the client re-sends the buffer. The
+ * cached fb holds a GEM reference on the dmabuf, so the inode cannot be
+ * recycled while the entry is alive.
+ */
+struct drm_fb_cache_key {
+	dev_t dev;
+	ino_t inodes[4];
+	uint32_t offsets[4];
+	uint32_t strides[4];
+	uint64_t modifier;
+	uint32_t format;
+	int32_t width, height;
+	int num_planes;
+	bool is_opaque;
+};
+
+struct drm_fb_cache_entry {
+	struct drm_fb_cache_key key;
+	struct drm_fb *fb;
+	uint64_t size;
+	struct wl_list link; /* drm_device::fb_cache::entry_list */
 };
 
 struct drm_buffer_fb {
@@ -515,6 +563,8 @@ struct drm_output_state {
 	enum weston_hdcp_protection protection;
 	struct wl_list plane_list;
 	bool tear;
+	/* content-driven (VRR) pacing, see drm_output_state_wants_vrr() */
+	bool vrr;
 };
 
 /**
@@ -746,11 +796,24 @@ struct drm_output {
 	struct weston_renderbuffer *renderbuffer[DRM_MAX_BUFFERS];
 	int next_image;
 	unsigned int num_images;
+	/* num_images the output starts with, before the pixman ring grows */
+	unsigned int min_images;
 
 	/* Wrap fb for scale/rotate usage */
 	struct drm_fb *wrap[DRM_MAX_BUFFERS];
 	int next_wrap;
 
+	/* Last accepted TEST_ONLY commit of a rotated scanout through the
+	 * plane rotation property, see drm_output_try_plane_transform() */
+	struct {
+		bool tested;
+		uint32_t plane_id;
+		uint32_t format;
+		uint64_t modifier;
+		uint64_t rotation;
+		int sw, sh, dw, dh;
+	} plane_transform;
+
 	struct vaapi_recorder *recorder;
 	struct wl_listener recorder_frame_listener;
 
@@ -763,6 +826,11 @@ struct drm_output {
 
 	enum wdrm_content_type content_type;
 
+	/* VRR requested from the configuration, see weston_drm_vrr_mode */
+	bool vrr_requested;
+	/* VRR_ENABLED programmed on the CRTC: requested and all heads capable */
+	bool vrr_enabled;
+
 	bool state_invalid;
 
 	/* The dummy framebuffer for SET_CRTC. */
@@ -966,6 +1034,11 @@ struct drm_fb *
 drm_fb_get_from_bo(struct gbm_bo *bo, struct drm_device *device,
 		   bool is_opaque, enum drm_fb_type type);
 
+void
+drm_fb_cache_init(struct drm_device *device);
+void
+drm_fb_cache_fini(struct drm_device *device);
+
 void
 drm_output_set_cursor_view(struct drm_output *output, struct weston_view *ev);
 
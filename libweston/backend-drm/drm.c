@@ -531,6 +531,9 @@ drm_output_update_complete(struct drm_output *output, uint32_t flags,
 	if (output->state_cur->tear)
 		flags |= WESTON_FINISH_FRAME_TEARING;
 
+	if (output->state_cur->vrr)
+		flags |= WESTON_FINISH_FRAME_VRR;
+
 	ts.tv_sec = sec;
 	ts.tv_nsec = usec * 1000;
 
@@ -546,19 +549,92 @@ drm_output_update_complete(struct drm_output *output, uint32_t flags,
 		weston_output_schedule_repaint(&output->base);
 }
 
+/**
+ * Create the dumb fb and matching pixman renderbuffer for ring slot idx
+ *
+ * The renderbuffer starts fully damaged; from then on the pixman renderer
+ * accumulates into it all the output damage since it was last drawn.
+ */
+static int
+drm_output_add_pixman_image(struct drm_output *output, unsigned int idx)
+{
+	const struct pixman_renderer_interface *pixman =
+		output->base.compositor->renderer->pixman;
+	int w = output->base.current_mode->width;
+	int h = output->base.current_mode->height;
+
+	output->dumb[idx] = drm_fb_create_dumb(output->device, w, h,
+					       output->format->format);
+	if (!output->dumb[idx])
+		return -1;
+
+	output->renderbuffer[idx] =
+		pixman->create_image_from_dma(&output->base,
+					      output->format, w, h,
+					      output->dumb[idx]->map,
+					      output->dumb[idx]->dma_fd,
+					      output->dumb[idx]->strides[0]);
+	if (!output->renderbuffer[idx]) {
+		drm_fb_unref(output->dumb[idx]);
+		output->dumb[idx] = NULL;
+		return -1;
+	}
+
+	pixman_region32_init_rect(&output->renderbuffer[idx]->damage,
+				  output->base.x, output->base.y,
+				  output->base.width,
+				  output->base.height);
+
+	return 0;
+}
+
+/**
+ * Pick the dumb buffer to render the next frame into
+ *
+ * A buffer is free once no plane state references it anymore: neither the
+ * state being scanned out, nor one still queued for flip, nor a mirror
+ * output sharing it. Starting from the oldest slot, take the first free
+ * one; if the whole ring is busy, grow it by one buffer (up to
+ * DRM_MAX_BUFFERS) rather than drawing into a buffer still on screen.
+ */
+static unsigned int
+drm_output_pick_pixman_image(struct drm_output *output)
+{
+	unsigned int i, idx;
+
+	for (i = 0; i < output->num_images; i++) {
+		idx = (output->next_image + i) % output->num_images;
+		if (output->dumb[idx]->refcnt == 1)
+			return idx;
+	}
+
+	idx = output->num_images;
+	if (idx < DRM_MAX_BUFFERS &&
+	    drm_output_add_pixman_image(output, idx) == 0) {
+		output->num_images++;
+		drm_debug(output->backend, "\t[repaint] all %u dumb buffers of "
+			  "output %s busy, growing ring\n", idx,
+			  output->base.name);
+		return idx;
+	}
+
+	return output->next_image;
+}
+
 static struct drm_fb *
 drm_output_render_pixman(struct drm_output_state *state,
 			 pixman_region32_t *damage)
 {
 	struct drm_output *output = state->output;
 	struct weston_compositor *ec = output->base.compositor;
+	unsigned int idx = drm_output_pick_pixman_image(output);
 	struct drm_fb *fb;
 
 	ec->renderer->repaint_output(&output->base, damage,
-				     output->renderbuffer[output->next_image]);
-	fb = drm_fb_ref(output->dumb[output->next_image]);
+				     output->renderbuffer[idx]);
+	fb = drm_fb_ref(output->dumb[idx]);
 
-	output->next_image = (output->next_image + 1) % output->num_images;
+	output->next_image = (idx + 1) % output->num_images;
 	return fb;
 }
 
@@ -611,11 +687,16 @@ drm_output_get_wrap_fb(struct drm_backend *b, struct drm_output *output,
 		drm_fb_unref(fb);
 	}
 
-	fb = drm_fb_create_dumb(b->drm, width, height, output->format->format);
+	/* Allocate on the mirror's own device, which may differ from the
+	 * one the source fb comes from. */
+	fb = drm_fb_create_dumb(output->device, width, height,
+				output->format->format);
 	if (!fb) {
 		weston_log("failed to create wrap fb\n");
 		return NULL;
 	}
+	weston_memory_track_output(&fb->mem, &output->base,
+				   WESTON_MEMORY_SCANOUT, fb->size);
 
 	output->wrap[output->next_wrap] = fb;
 out:
@@ -623,6 +704,153 @@ out:
 	return drm_fb_ref(fb);
 }
 
+/* The rotation of mirrors is clockwise, as done by drm_copy_fb(), while
+ * the KMS plane rotation (like wl_output transforms) is counter-clockwise. */
+static enum wl_output_transform
+drm_transform_from_rotation(int rotation)
+{
+	switch (rotation) {
+	case 90:
+		return WL_OUTPUT_TRANSFORM_270;
+	case 180:
+		return WL_OUTPUT_TRANSFORM_180;
+	case 270:
+		return WL_OUTPUT_TRANSFORM_90;
+	default:
+		return WL_OUTPUT_TRANSFORM_NORMAL;
+	}
+}
+
+/**
+ * Try to rotate (and scale) the scanout fb with the plane itself
+ *
+ * Rather than copying the fb into a rotated wrap fb, express the rotation
+ * through the plane rotation property and the src/dest rectangles, and
+ * check with a TEST_ONLY commit that the hardware accepts it.
+ *
+ * The test runs against the state built so far in this repaint, so only an
+ * acceptance is remembered for the given geometry, until a modeset or a
+ * failed commit. A rejection may come from other planes or outputs and is
+ * tested again on the next repaint.
+ *
+ * On success the scanout state rotation is set and true is returned; the
+ * caller is still responsible for filling in the fb and rectangles.
+ */
+static bool
+drm_output_try_plane_transform(struct drm_output_state *state,
+			       struct drm_plane_state *scanout_state,
+			       struct drm_fb *fb, int rotation,
+			       int sw, int sh, int dx, int dy, int dw, int dh)
+{
+	struct drm_output *output = state->output;
+	struct drm_device *device = output->device;
+	struct drm_plane *plane = output->scanout_plane;
+	uint64_t hw_rotation;
+	uint64_t old_rotation = scanout_state->rotation;
+	bool scaling;
+	int ret;
+
+	/* Nothing to test against without atomic KMS. */
+	if (!device->atomic_modeset)
+		return false;
+
+	hw_rotation = drm_rotation_from_output_transform(plane,
+							 drm_transform_from_rotation(rotation));
+	if (hw_rotation == 0)
+		return false;
+
+	if (rotation % 180)
+		scaling = sh != dw || sw != dh;
+	else
+		scaling = sw != dw || sh != dh;
+
+	if (scaling && !plane->can_scale)
+		return false;
+
+	if (output->state_invalid || device->state_invalid)
+		output->plane_transform.tested = false;
+
+	/* The verdict depends on the fb layout as much as on the geometry,
+	 * so key it on both. */
+	if (output->plane_transform.tested &&
+	    output->plane_transform.plane_id == plane->plane_id &&
+	    output->plane_transform.format == fb->format->format &&
+	    output->plane_transform.modifier == fb->modifier &&
+	    output->plane_transform.rotation == hw_rotation &&
+	    output->plane_transform.sw == sw &&
+	    output->plane_transform.sh == sh &&
+	    output->plane_transform.dw == dw &&
+	    output->plane_transform.dh == dh) {
+		scanout_state->rotation = hw_rotation;
+		return true;
+	}
+
+	/* Borrow the fb for the test only, the caller owns the reference. */
+	scanout_state->fb = fb;
+	scanout_state->output = output;
+	scanout_state->rotation = hw_rotation;
+	scanout_state->src_x = 0;
+	scanout_state->src_y = 0;
+	scanout_state->src_w = sw << 16;
+	scanout_state->src_h = sh << 16;
+	scanout_state->dest_x = dx;
+	scanout_state->dest_y = dy;
+	scanout_state->dest_w = dw;
+	scanout_state->dest_h = dh;
+
+	ret = drm_pending_state_test(state->pending_state);
+
+	scanout_state->fb = NULL;
+	if (ret != 0)
+		scanout_state->rotation = old_rotation;
+
+	output->plane_transform.tested = ret == 0;
+	output->plane_transform.plane_id = plane->plane_id;
+	output->plane_transform.format = fb->format->format;
+	output->plane_transform.modifier = fb->modifier;
+	output->plane_transform.rotation = hw_rotation;
+	output->plane_transform.sw = sw;
+	output->plane_transform.sh = sh;
+	output->plane_transform.dw = dw;
+	output->plane_transform.dh = dh;
+
+	drm_debug(output->backend, "\t[repaint] plane transform (rotation %d, "
+		  "%dx%d -> %dx%d) for output %s %s\n", rotation, sw, sh,
+		  dw, dh, output->base.name,
+		  ret == 0 ? "accepted" : "rejected, using wrap fb");
+
+	return ret == 0;
+}
+
+/**
+ * Check whether a mirror can scan out the primary output's fb directly
+ *
+ * The fb is then referenced by the planes of both CRTCs; as each plane
+ * state holds its own reference, the fb (and, for GBM surfaces, the bo
+ * behind it) is only released once both flips have retired it.
+ */
+static bool
+drm_output_can_share_fb(struct drm_output *output, struct drm_fb *fb)
+{
+	struct drm_plane *plane = output->scanout_plane;
+	struct weston_drm_format *fmt;
+
+	/* fb IDs are only valid on the KMS device that created them */
+	if (fb->fd != output->device->drm.fd)
+		return false;
+
+	fmt = weston_drm_format_array_find_format(&plane->formats,
+						  fb->format->format);
+	if (!fmt)
+		return false;
+
+	if (DRM_MOD_VALID(fb->modifier) &&
+	    !weston_drm_format_has_modifier(fmt, fb->modifier))
+		return false;
+
+	return true;
+}
+
 void
 drm_output_render(struct drm_output_state *state, pixman_region32_t *damage)
 {
@@ -642,6 +870,7 @@ drm_output_render(struct drm_output_state *state, pixman_region32_t *damage)
 	int sw, sh, dx, dy, dw, dh;
 	int rotation = 0;
 	bool scaling;
+	bool share_fb = true;
 
 	/* If we already have a client buffer promoted to scanout, then we don't
 	 * want to render. */
@@ -662,10 +891,16 @@ drm_output_render(struct drm_output_state *state, pixman_region32_t *damage)
 
 		rotation = drm_output_get_rotation(output);
 
+		/* The shared fb follows the primary output, so what was
+		 * tested for this mirror is stale after a modeset there too */
+		if (to_drm_output(b->primary_head->base.output)->state_invalid)
+			output->plane_transform.tested = false;
+
 		fb = drm_output_get_fb(state->pending_state,
 				       b->primary_head->base.output);
 		if (fb) {
 			drm_fb_ref(fb);
+			share_fb = drm_output_can_share_fb(output, fb);
 
 			pixman_region32_init(&scanout_damage);
 			wl_signal_emit(&output->base.frame_signal,
@@ -739,7 +974,15 @@ out:
 
 	scaling = sw != dw || sh != dh;
 
-	if (rotation || (scaling && !output->scanout_plane->can_scale)) {
+	/* Mirrors validate scaling of the shared fb as well, since the
+	 * primary fb size is not under their control. */
+	if ((rotation || (output->is_mirror && scaling)) && share_fb &&
+	    drm_output_try_plane_transform(state, scanout_state, fb, rotation,
+					   sw, sh, dx, dy, dw, dh)) {
+		/* The plane rotates/scales for us, no copy needed */
+		drm_output_try_destroy_wrap_fb(output);
+	} else if (rotation || !share_fb ||
+		   (scaling && !output->scanout_plane->can_scale)) {
 		struct drm_fb *wrap_fb =
 			drm_output_get_wrap_fb(b, output, dw, dh);
 		if (!wrap_fb) {
@@ -961,6 +1204,10 @@ drm_output_pick_writeback_capture_task(struct drm_output *output)
 		msg = "drm: failed to create dumb buffer for writeback state";
 		goto err_fb;
 	}
+	/* The capture target; the client's buffer is its own memory. */
+	weston_memory_track_output(&output->wb_state->fb->mem, &output->base,
+				   WESTON_MEMORY_SCANOUT,
+				   output->wb_state->fb->size);
 
 	output->wb_state->output = output;
 	output->wb_state->wb = wb;
@@ -1130,6 +1377,11 @@ drm_output_start_repaint_loop(struct weston_output *output_base)
 		goto finish_frame;
 	}
 
+	/* With content-driven pacing the next flip is not tied to the
+	 * vblank cadence, so let the core repaint as soon as it can. */
+	if (output->state_cur->vrr)
+		flags |= WESTON_FINISH_FRAME_VRR;
+
 	/* Try to get current msc and timestamp via instant query */
 	vbl.request.type |= drm_waitvblank_pipe(output->crtc);
 	ret = drmWaitVBlank(device->drm.fd, &vbl);
@@ -1894,7 +2146,6 @@ drm_output_init_pixman(struct drm_output *output, struct drm_backend *b)
 {
 	struct weston_renderer *renderer = output->base.compositor->renderer;
 	const struct pixman_renderer_interface *pixman = renderer->pixman;
-	struct drm_device *device = output->device;
 	int w = output->base.current_mode->width;
 	int h = output->base.current_mode->height;
 	unsigned int i;
@@ -1915,26 +2166,9 @@ drm_output_init_pixman(struct drm_output *output, struct drm_backend *b)
 	if (pixman->output_create(&output->base, &options) < 0)
 		goto err;
 
-	/* FIXME error checking */
 	for (i = 0; i < output->num_images; i++) {
-		output->dumb[i] = drm_fb_create_dumb(device, w, h,
-						     options.format->format);
-		if (!output->dumb[i])
-			goto err;
-
-		output->renderbuffer[i] =
-			pixman->create_image_from_dma(&output->base,
-						      options.format, w, h,
-						      output->dumb[i]->map,
-						      output->dumb[i]->dma_fd,
-						      output->dumb[i]->strides[0]);
-		if (!output->renderbuffer[i])
+		if (drm_output_add_pixman_image(output, i) < 0)
 			goto err;
-
-		pixman_region32_init_rect(&output->renderbuffer[i]->damage,
-					  output->base.x, output->base.y,
-					  output->base.width,
-					  output->base.height);
 	}
 
 	weston_log("DRM: output %s %s shadow framebuffer.\n", output->base.name,
@@ -1982,6 +2216,10 @@ drm_output_fini_pixman(struct drm_output *output)
 		output->renderbuffer[i] = NULL;
 	}
 
+	/* Start over from the configured ring size on the next enable. */
+	output->num_images = output->min_images;
+	output->next_image = 0;
+
 	renderer->pixman->output_destroy(&output->base);
 }
 
@@ -2175,6 +2413,52 @@ drm_output_set_content_type(struct weston_output *base,
 	return -1;
 }
 
+static int
+drm_output_set_vrr_mode(struct weston_output *base, const char *vrr_mode)
+{
+	struct drm_output *output = to_drm_output(base);
+
+	assert(output);
+	assert(!output->base.enabled);
+
+	if (vrr_mode == NULL || strcmp(vrr_mode, "none") == 0) {
+		output->vrr_requested = false;
+		return 0;
+	}
+
+	if (strcmp(vrr_mode, "game") == 0) {
+		output->vrr_requested = true;
+		return 0;
+	}
+
+	weston_log("Error: unknown vrr-mode for output %s: \"%s\"\n",
+		   base->name, vrr_mode);
+	output->vrr_requested = false;
+	return -1;
+}
+
+/* Adaptive sync needs the CRTC knob, atomic KMS, and every sink to cope. */
+static bool
+drm_output_can_vrr(struct drm_output *output)
+{
+	struct drm_device *device = output->device;
+	struct drm_head *head;
+
+	if (!device->atomic_modeset ||
+	    output->crtc->props_crtc[WDRM_CRTC_VRR_ENABLED].prop_id == 0)
+		return false;
+
+	wl_list_for_each(head, &output->base.head_list, base.output_link) {
+		struct drm_connector *conn = &head->connector;
+
+		if (!drm_property_get_value(&conn->props[WDRM_CONNECTOR_VRR_CAPABLE],
+					    conn->props_drm, 0))
+			return false;
+	}
+
+	return true;
+}
+
 static int
 drm_output_init_gamma_size(struct drm_output *output)
 {
@@ -2633,6 +2917,13 @@ drm_output_enable(struct weston_output *base)
 
 	output->original_transform = output->base.transform;
 
+	output->vrr_enabled = output->vrr_requested &&
+			      drm_output_can_vrr(output);
+	if (output->vrr_requested)
+		weston_log("Output %s: variable refresh rate %s\n",
+			   output->base.name,
+			   output->vrr_enabled ? "enabled" : "not supported");
+
 	output->state_invalid = true;
 
 	if (device->atomic_modeset)
@@ -3110,6 +3401,7 @@ drm_output_create(struct weston_backend *backend, const char *name)
 		output->num_images = atoi(env);
 
 	output->num_images = MIN(MAX(output->num_images, 2), DRM_MAX_BUFFERS);
+	output->min_images = output->num_images;
 	output->num_surfaces = (output->num_images + 1) / 2;
 	weston_log("%s using at least %d buffers\n", name, output->num_images);
 
@@ -3782,6 +4074,7 @@ drm_destroy(struct weston_backend *backend)
 	struct drm_backend *b = container_of(backend, struct drm_backend, base);
 	struct weston_compositor *ec = b->compositor;
 	struct drm_device *device = b->drm;
+	struct drm_device *kms_device;
 	struct weston_head *base, *next;
 	struct drm_crtc *crtc, *crtc_tmp;
 	struct drm_writeback *writeback, *writeback_tmp;
@@ -3818,6 +4111,10 @@ drm_destroy(struct weston_backend *backend)
 			      &b->drm->writeback_connector_list, link)
 		drm_writeback_destroy(writeback);
 
+	drm_fb_cache_fini(b->drm);
+	wl_list_for_each(kms_device, &b->kms_list, link)
+		drm_fb_cache_fini(kms_device);
+
 #ifdef BUILD_DRM_GBM
 	if (b->gbm)
 		gbm_device_destroy(b->gbm);
@@ -4226,6 +4523,7 @@ drm_device_create(struct drm_backend *backend, const char *name)
 	device->drm.fd = -1;
 	device->backend = backend;
 	device->gem_handle_refcnt = hash_table_create();
+	drm_fb_cache_init(device);
 
 	udev_device = open_specific_drm_device(backend, device, name);
 	if (!udev_device) {
@@ -4315,6 +4613,7 @@ static const struct weston_drm_output_api api = {
 	drm_output_set_seat,
 	drm_output_set_max_bpc,
 	drm_output_set_content_type,
+	drm_output_set_vrr_mode,
 };
 
 static void
@@ -4701,6 +5000,7 @@ drm_dummy_output_create(struct drm_device *device)
 
 	/* Single buffer for dummy output */
 	output->num_images = 1;
+	output->min_images = 1;
 	output->num_surfaces = 1;
 
 	weston_output_init(&output->base, b->compositor, "DUMMY");
@@ -4940,6 +5240,7 @@ drm_backend_create(struct weston_compositor *compositor,
 	device->drm.fd = -1;
 	device->backend = b;
 	device->gem_handle_refcnt = hash_table_create();
+	drm_fb_cache_init(device);
 
 	b->drm = device;
 	wl_list_init(&b->kms_list);
@@ -30,6 +30,7 @@
 #include "config.h"
 
 #include <stdint.h>
+#include <sys/stat.h>
 
 #include <xf86drm.h>
 #include <xf86drmMode.h>
@@ -40,6 +41,7 @@
 #include <libweston/linux-dmabuf.h>
 #include "shared/hash.h"
 #include "shared/helpers.h"
+#include "shared/string-helpers.h"
 #include "shared/weston-drm-fourcc.h"
 #include "drm-internal.h"
 #include "linux-dmabuf.h"
@@ -49,6 +51,7 @@ drm_fb_destroy(struct drm_fb *fb)
 {
 	if (fb->fb_id != 0)
 		drmModeRmFB(fb->fd, fb->fb_id);
+	weston_memory_untrack(&fb->mem);
 	free(fb);
 }
 
@@ -325,6 +328,9 @@ drm_fb_create_dumb(struct drm_device *device, int width, int height,
 
 	fb->dma_fd = prime_arg.fd;
 
+	weston_memory_track(&fb->mem, device->backend->compositor,
+			    WESTON_MEMORY_SCANOUT, fb->size);
+
 	return fb;
 
 err_unmap_fb:
@@ -347,6 +353,61 @@ drm_fb_ref(struct drm_fb *fb)
 	return fb;
 }
 
+static void
+drm_fb_cache_entry_destroy(struct drm_device *device,
+			   struct drm_fb_cache_entry *entry)
+{
+	device->fb_cache.num_entries--;
+	device->fb_cache.size -= entry->size;
+
+	wl_list_remove(&entry->link);
+	drm_fb_unref(entry->fb);
+	free(entry);
+}
+
+void
+drm_fb_cache_init(struct drm_device *device)
+{
+	const char *env;
+	int32_t value;
+
+	wl_list_init(&device->fb_cache.entry_list);
+	device->fb_cache.num_entries = 0;
+	device->fb_cache.size = 0;
+	device->fb_cache.max_entries = DRM_FB_CACHE_MAX_ENTRIES;
+	device->fb_cache.max_size = (uint64_t) DRM_FB_CACHE_MAX_MB << 20;
+
+	/* 0 disables the cache */
+	env = getenv("WESTON_DRM_FB_CACHE_SIZE");
+	if (env) {
+		if (safe_strtoint(env, &value) && value >= 0)
+			device->fb_cache.max_entries = value;
+		else
+			weston_log("Invalid WESTON_DRM_FB_CACHE_SIZE '%s', "
+				   "keeping %u entries.\n", env,
+				   device->fb_cache.max_entries);
+	}
+
+	env = getenv("WESTON_DRM_FB_CACHE_MB");
+	if (env) {
+		if (safe_strtoint(env, &value) && value >= 0)
+			device->fb_cache.max_size = (uint64_t) value << 20;
+		else
+			weston_log("Invalid WESTON_DRM_FB_CACHE_MB '%s', "
+				   "keeping %d MiB.\n", env,
+				   DRM_FB_CACHE_MAX_MB);
+	}
+}
+
+void
+drm_fb_cache_fini(struct drm_device *device)
+{
+	struct drm_fb_cache_entry *entry, *tmp;
+
+	wl_list_for_each_safe(entry, tmp, &device->fb_cache.entry_list, link)
+		drm_fb_cache_entry_destroy(device, entry);
+}
+
 #ifdef BUILD_DRM_GBM
 static void
 drm_fb_destroy_gbm(struct gbm_bo *bo, void *data)
@@ -514,6 +575,124 @@ err_free:
 #endif
 }
 
+static void
+drm_fb_cache_trim(struct drm_device *device)
+{
+	struct drm_fb_cache_entry *entry;
+
+	while (!wl_list_empty(&device->fb_cache.entry_list) &&
+	       (device->fb_cache.num_entries > device->fb_cache.max_entries ||
+		device->fb_cache.size > device->fb_cache.max_size)) {
+		entry = container_of(device->fb_cache.entry_list.prev,
+				     struct drm_fb_cache_entry, link);
+		drm_debug(device->backend, "[fb-cache] evicting fb %lu\n",
+			  (unsigned long) entry->fb->fb_id);
+		drm_fb_cache_entry_destroy(device, entry);
+	}
+}
+
+static bool
+drm_fb_cache_key_init(struct drm_fb_cache_key *key,
+		      struct linux_dmabuf_buffer *dmabuf, bool is_opaque)
+{
+	struct stat st;
+	int i;
+
+	/* Zero the padding too, keys are compared with memcmp() */
+	memset(key, 0, sizeof(*key));
+
+	for (i = 0; i < dmabuf->attributes.n_planes; i++) {
+		if (fstat(dmabuf->attributes.fd[i], &st) < 0)
+			return false;
+
+		/* All planes of one buffer are expected to come from the
+		 * same dmabuf filesystem. */
+		if (i > 0 && st.st_dev != key->dev)
+			return false;
+
+		key->dev = st.st_dev;
+		key->inodes[i] = st.st_ino;
+	}
+
+	ARRAY_COPY(key->offsets, dmabuf->attributes.offset);
+	ARRAY_COPY(key->strides, dmabuf->attributes.stride);
+	key->modifier = dmabuf->attributes.modifier[0];
+	key->format = dmabuf->attributes.format;
+	key->width = dmabuf->attributes.width;
+	key->height = dmabuf->attributes.height;
+	key->num_planes = dmabuf->attributes.n_planes;
+	key->is_opaque = is_opaque;
+
+	return true;
+}
+
+/**
+ * Get a KMS fb for a client dmabuf, reusing a previous import if any
+ *
+ * Clients usually cycle through a small swapchain and may destroy and
+ * recreate the wl_buffers wrapping it (e.g. on every video frame), which
+ * would otherwise cost a GEM import plus AddFB/RmFB each time. Imported fbs
+ * are kept in a per-device LRU cache keyed on the dmabuf identity, bounded
+ * both in number of entries and in (approximate) memory held alive.
+ */
+static struct drm_fb *
+drm_fb_cache_lookup(struct linux_dmabuf_buffer *dmabuf,
+		    struct drm_device *device, bool is_opaque,
+		    uint32_t *try_view_on_plane_failure_reasons)
+{
+	struct drm_fb_cache_entry *entry;
+	struct drm_fb_cache_key key;
+	struct drm_fb *fb;
+	int i;
+
+	/* A cached fb may have been imported from the same dmabuf without
+	 * flags; flagged buffers must still be rejected, see
+	 * drm_fb_get_from_dmabuf(). */
+	if (dmabuf->attributes.flags)
+		return NULL;
+
+	if (device->fb_cache.max_entries == 0 ||
+	    !drm_fb_cache_key_init(&key, dmabuf, is_opaque))
+		return drm_fb_get_from_dmabuf(dmabuf, device, is_opaque,
+					      try_view_on_plane_failure_reasons);
+
+	wl_list_for_each(entry, &device->fb_cache.entry_list, link) {
+		if (memcmp(&entry->key, &key, sizeof(key)) != 0)
+			continue;
+
+		wl_list_remove(&entry->link);
+		wl_list_insert(&device->fb_cache.entry_list, &entry->link);
+		return drm_fb_ref(entry->fb);
+	}
+
+	fb = drm_fb_get_from_dmabuf(dmabuf, device, is_opaque,
+				    try_view_on_plane_failure_reasons);
+	if (!fb)
+		return NULL;
+
+	entry = zalloc(sizeof(*entry));
+	if (!entry)
+		return fb;
+
+	entry->key = key;
+	entry->fb = drm_fb_ref(fb);
+	for (i = 0; i < fb->num_planes; i++)
+		entry->size += (uint64_t) fb->strides[i] * fb->height;
+
+	wl_list_insert(&device->fb_cache.entry_list, &entry->link);
+	device->fb_cache.num_entries++;
+	device->fb_cache.size += entry->size;
+
+	drm_debug(device->backend, "[fb-cache] added fb %lu, %u entries, "
+		  "%llu KiB\n", (unsigned long) fb->fb_id,
+		  device->fb_cache.num_entries,
+		  (unsigned long long) device->fb_cache.size >> 10);
+
+	drm_fb_cache_trim(device);
+
+	return fb;
+}
+
 struct drm_fb *
 drm_fb_get_from_bo(struct gbm_bo *bo, struct drm_device *device,
 		   bool is_opaque, enum drm_fb_type type)
@@ -585,6 +764,17 @@ drm_fb_get_from_bo(struct gbm_bo *bo, struct drm_device *device,
 
 	gbm_bo_set_user_data(bo, fb, drm_fb_destroy_gbm);
 
+	/* Client buffers are accounted to the client, not here */
+	if (type != BUFFER_CLIENT) {
+		uint64_t size = 0;
+		int plane;
+
+		for (plane = 0; plane < fb->num_planes; plane++)
+			size += (uint64_t)fb->strides[plane] * fb->height;
+		weston_memory_track(&fb->mem, device->backend->compositor,
+				    WESTON_MEMORY_SCANOUT, size);
+	}
+
 	return fb;
 
 err_free:
@@ -636,6 +826,7 @@ drm_can_scanout_dmabuf(struct weston_backend *backend,
 	bool ret = false;
 	uint32_t try_reason = 0x0;
 
+	/* Only a probe: don't let it pin the dmabuf in the fb cache. */
 	fb = drm_fb_get_from_dmabuf(dmabuf, device, true, &try_reason);
 	if (fb)
 		ret = true;
@@ -762,8 +953,8 @@ drm_fb_get_from_paint_node(struct drm_output_state *state,
 	}
 
 	if (buffer->type == WESTON_BUFFER_DMABUF) {
-		fb = drm_fb_get_from_dmabuf(buffer->dmabuf, device, is_opaque,
-					    &buf_fb->failure_reasons);
+		fb = drm_fb_cache_lookup(buffer->dmabuf, device, is_opaque,
+					 &buf_fb->failure_reasons);
 		if (!fb)
 			goto unsuitable;
 	} else if (buffer->type == WESTON_BUFFER_RENDERER_OPAQUE) {
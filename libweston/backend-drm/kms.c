@@ -40,9 +40,12 @@
 #include <libweston/backend-drm.h>
 #include <libweston/linux-dmabuf.h>
 #include "shared/helpers.h"
+#include "shared/timespec-util.h"
 #include "shared/weston-drm-fourcc.h"
 #include "drm-internal.h"
+#include "frame-stats.h"
 #include "pixel-formats.h"
+#include "profiler.h"
 #include "presentation-time-server-protocol.h"
 
 struct drm_property_enum_info plane_type_enums[] = {
@@ -207,6 +210,7 @@ const struct drm_property_info connector_props[] = {
 		.enum_values = content_type_enums,
 		.num_enum_values = WDRM_CONTENT_TYPE__COUNT,
 	},
+	[WDRM_CONNECTOR_VRR_CAPABLE] = { .name = "vrr_capable", },
 };
 
 const struct drm_property_info crtc_props[] = {
@@ -1310,7 +1314,8 @@ drm_output_apply_state_atomic(struct drm_output_state *state,
 						     WDRM_CRTC_DEGAMMA_LUT, 0);
 		}
 		ret |= crtc_add_prop_zero_ok(req, crtc, WDRM_CRTC_CTM, 0);
-		ret |= crtc_add_prop_zero_ok(req, crtc, WDRM_CRTC_VRR_ENABLED, 0);
+		ret |= crtc_add_prop_zero_ok(req, crtc, WDRM_CRTC_VRR_ENABLED,
+					     output->vrr_enabled);
 
 		/* No need for the DPMS property, since it is implicit in
 		 * routing and CRTC activity. */
@@ -1471,8 +1476,10 @@ drm_pending_state_apply_atomic(struct drm_pending_state *pending_state,
 	struct drm_plane *plane;
 	drmModeAtomicReq *req = drmModeAtomicAlloc();
 	struct timespec now;
+	struct timespec stats_begin;
 	uint32_t flags, tear_flag = 0;
 	bool may_tear = true;
+	bool stats = false;
 	int ret = 0;
 
 	if (!req)
@@ -1599,36 +1606,70 @@ drm_pending_state_apply_atomic(struct drm_pending_state *pending_state,
 	if (may_tear)
 		tear_flag = DRM_MODE_PAGE_FLIP_ASYNC;
 
-	ret = drmModeAtomicCommit(device->drm.fd, req, flags | tear_flag,
-				  device);
-	drm_debug(b, "[atomic] drmModeAtomicCommit\n");
-	if (ret != 0 && may_tear && mode == DRM_STATE_TEST_ONLY) {
-		/* If we failed trying to set up a tearing commit, try again
-		 * without tearing. If that succeeds, knock the tearing flag
-		 * out of our state in case we were testing for a later commit.
-		 */
-		drm_debug(b, "[atomic] drmModeAtomicCommit (no tear fallback)\n");
-		ret = drmModeAtomicCommit(device->drm.fd, req, flags, device);
-		if (ret == 0)
-			drm_pending_state_clear_tearing(pending_state);
-	}
-	/* Test commits do not take ownership of the state; return
-	 * without freeing here. */
 	if (mode == DRM_STATE_TEST_ONLY) {
+		ret = drmModeAtomicCommit(device->drm.fd, req,
+					  flags | tear_flag, device);
+		drm_debug(b, "[atomic] drmModeAtomicCommit\n");
+		if (ret != 0 && may_tear) {
+			/* If we failed trying to set up a tearing commit, try
+			 * again without tearing. If that succeeds, knock the
+			 * tearing flag out of our state in case we were
+			 * testing for a later commit.
+			 */
+			drm_debug(b, "[atomic] drmModeAtomicCommit (no tear fallback)\n");
+			ret = drmModeAtomicCommit(device->drm.fd, req, flags,
+						  device);
+			if (ret == 0)
+				drm_pending_state_clear_tearing(pending_state);
+		}
+		/* Test commits do not take ownership of the state; return
+		 * without freeing here. */
 		drmModeAtomicFree(req);
 		return ret;
 	}
 
+	/* Only real commits are timed, test commits would skew both the
+	 * frame stats and the profiler. */
+	stats = weston_frame_stats_start(b->compositor, &stats_begin);
+	WESTON_PROFILE_BEGIN(ATOMIC_COMMIT);
+
+	ret = drmModeAtomicCommit(device->drm.fd, req, flags | tear_flag,
+				  device);
+	drm_debug(b, "[atomic] drmModeAtomicCommit\n");
+
 	if (ret != 0) {
-		wl_list_for_each(output_state, &pending_state->output_list, link)
+		wl_list_for_each(output_state, &pending_state->output_list, link) {
+			/* The plane transform test passed but the real
+			 * commit did not, test again next time. */
+			output_state->output->plane_transform.tested = false;
 			if (drm_output_get_writeback_state(output_state->output) != DRM_OUTPUT_WB_SCREENSHOT_OFF)
 				drm_writeback_fail_screenshot(output_state->output->wb_state,
 							      "drm: atomic commit failed");
+		}
 		weston_log("atomic: couldn't commit new state: %s\n",
 			   strerror(errno));
 		goto out;
 	}
 
+	WESTON_PROFILE_END(b->compositor, ATOMIC_COMMIT);
+
+	/* The commit covers all outputs of the device at once */
+	if (stats) {
+		struct timespec end;
+		int64_t commit_nsec;
+
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		commit_nsec = timespec_sub_to_nsec(&end, &stats_begin);
+		wl_list_for_each(output_state, &pending_state->output_list,
+				 link) {
+			if (output_state->output->virtual)
+				continue;
+			weston_frame_stats_add(&output_state->output->base,
+					       WESTON_FRAME_STAT_COMMIT,
+					       commit_nsec);
+		}
+	}
+
 	weston_compositor_read_presentation_clock(b->compositor, &now);
 
 	wl_list_for_each_safe(output_state, tmp, &pending_state->output_list,
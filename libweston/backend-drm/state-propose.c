@@ -91,6 +91,36 @@ drm_output_check_plane_has_view_assigned(struct drm_plane *plane,
 	return false;
 }
 
+/**
+ * Decide whether the output should be paced by its content
+ *
+ * With VRR enabled on the CRTC we only let the content drive the refresh
+ * when the topmost view on the output is opaque and covers it entirely,
+ * i.e. a fullscreen client: its commits then directly determine when the
+ * next frame is shown. Anything else is paced at the mode refresh rate.
+ */
+static bool
+drm_output_state_wants_vrr(struct drm_output *output)
+{
+	struct weston_paint_node *pnode;
+
+	if (!output->vrr_enabled)
+		return false;
+
+	wl_list_for_each(pnode, &output->base.paint_node_z_order_list,
+			 z_order_link) {
+		struct weston_view *ev = pnode->view;
+
+		if (!(ev->output_mask & (1u << output->base.id)))
+			continue;
+
+		return weston_view_matches_output_entirely(ev, &output->base) &&
+		       weston_view_is_opaque(ev, &ev->transform.boundingbox);
+	}
+
+	return false;
+}
+
 static struct drm_plane_state *
 drm_output_try_paint_node_on_plane(struct drm_plane *plane,
 				   struct drm_output_state *output_state,
@@ -725,6 +755,8 @@ drm_output_propose_state(struct weston_output *output_base,
 	state->tear = device->tearing_supported &&
 		      mode == DRM_OUTPUT_PROPOSE_STATE_PLANES_ONLY;
 
+	state->vrr = drm_output_state_wants_vrr(output);
+
 	/* We implement mixed mode by progressively creating and testing
 	 * incremental states, of scanout + overlay + cursor. Since we
 	 * walk our views top to bottom, the scanout plane is last, however
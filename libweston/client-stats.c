@@ -0,0 +1,563 @@
+/*
+ * Copyright 2024 Collabora, Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "config.h"
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <libweston/libweston.h>
+#include <libweston/weston-log.h>
+#include "libweston-internal.h"
+#include "client-stats.h"
+#include "shared/helpers.h"
+#include "shared/timespec-util.h"
+#include "shared/xalloc.h"
+
+/* Per-client accounting
+ *
+ * While the 'clients' scope has subscribers, every client that does
+ * something gets counters, and every CLIENT_STATS_PERIOD_MSEC a top-like
+ * table of all connected clients, busiest first, is printed to the
+ * subscribers and the counters start over.
+ *
+ * Requests are counted by a protocol logger, which libwayland calls right
+ * before dispatching each request. The dispatch time of a request is
+ * wall-clock time: it lasts until the next request is about to be
+ * dispatched, until a repaint starts, or until the idle callbacks of the
+ * event loop iteration run. For the last request a client sent in an
+ * iteration, this can still include other event sources dispatched after
+ * that client's, so the time is an upper bound.
+ *
+ * The 'clients' scope sorts the table by dispatch time. Every other
+ * counter has a 'clients-by-<counter>' scope which sorts by that counter
+ * instead; all of them share the same counters and period.
+ *
+ * Without subscribers, the hooks only check the scopes and return, and no
+ * memory is kept for the clients.
+ */
+
+#define CLIENT_STATS_PERIOD_MSEC 2000
+
+static const struct {
+	const char *scope;
+	const char *description;
+} client_stats_keys[WESTON_CLIENT_STAT_COUNT] = {
+	[WESTON_CLIENT_STAT_DISPATCH] = {
+		"clients", "dispatch time" },
+	[WESTON_CLIENT_STAT_REQUESTS] = {
+		"clients-by-requests", "requests" },
+	[WESTON_CLIENT_STAT_COMMITS] = {
+		"clients-by-commits", "commits" },
+	[WESTON_CLIENT_STAT_DAMAGE] = {
+		"clients-by-damage", "committed damage" },
+	[WESTON_CLIENT_STAT_SHM_BYTES] = {
+		"clients-by-shm", "SHM bytes uploaded" },
+	[WESTON_CLIENT_STAT_DMABUF_IMPORTS] = {
+		"clients-by-dmabuf", "dmabuf imports" },
+	[WESTON_CLIENT_STAT_FRAME_CALLBACKS] = {
+		"clients-by-frames", "frame callbacks" },
+};
+
+struct client_stats_scope {
+	struct weston_client_stats *stats;
+	struct weston_log_scope *scope;
+	enum weston_client_stat key;
+};
+
+struct client_stats_client {
+	struct weston_client_stats *stats;
+	struct wl_list link;		/**< weston_client_stats::clients */
+	struct wl_listener destroy_listener;
+	uint64_t values[WESTON_CLIENT_STAT_COUNT];
+};
+
+struct weston_client_stats {
+	struct weston_compositor *compositor;
+	struct client_stats_scope scopes[WESTON_CLIENT_STAT_COUNT];
+	struct wl_protocol_logger *logger;
+	struct wl_event_source *timer;
+	bool timer_armed;
+	struct timespec period_begin;
+	struct wl_list clients;		/**< client_stats_client::link */
+
+	/* The request being dispatched, if any */
+	struct client_stats_client *dispatching;
+	struct timespec dispatch_begin;
+	struct wl_event_source *dispatch_idle;
+};
+
+struct client_stats_row {
+	pid_t pid;
+	char comm[32];
+	const uint64_t *values;
+	enum weston_client_stat key;
+};
+
+static const uint64_t client_stats_zero[WESTON_CLIENT_STAT_COUNT];
+
+static void
+client_stats_client_destroy(struct client_stats_client *csc)
+{
+	if (csc->stats->dispatching == csc)
+		csc->stats->dispatching = NULL;
+
+	wl_list_remove(&csc->destroy_listener.link);
+	wl_list_remove(&csc->link);
+	free(csc);
+}
+
+static void
+client_stats_client_handle_destroy(struct wl_listener *listener, void *data)
+{
+	struct client_stats_client *csc =
+		container_of(listener, struct client_stats_client,
+			     destroy_listener);
+
+	client_stats_client_destroy(csc);
+}
+
+static struct client_stats_client *
+client_stats_client_find(struct wl_client *client)
+{
+	struct wl_listener *listener;
+
+	listener = wl_client_get_destroy_listener(client,
+						  client_stats_client_handle_destroy);
+	if (!listener)
+		return NULL;
+
+	return container_of(listener, struct client_stats_client,
+			    destroy_listener);
+}
+
+static struct client_stats_client *
+client_stats_client_get(struct weston_client_stats *stats,
+			struct wl_client *client)
+{
+	struct client_stats_client *csc;
+
+	csc = client_stats_client_find(client);
+	if (csc)
+		return csc;
+
+	csc = xzalloc(sizeof *csc);
+	csc->stats = stats;
+	csc->destroy_listener.notify = client_stats_client_handle_destroy;
+	wl_client_add_destroy_listener(client, &csc->destroy_listener);
+	wl_list_insert(&stats->clients, &csc->link);
+
+	return csc;
+}
+
+static bool
+client_stats_any_enabled(struct weston_client_stats *stats)
+{
+	int i;
+
+	for (i = 0; i < WESTON_CLIENT_STAT_COUNT; i++) {
+		if (weston_log_scope_is_enabled(stats->scopes[i].scope))
+			return true;
+	}
+
+	return false;
+}
+
+static void
+client_stats_destroy_clients(struct weston_client_stats *stats)
+{
+	struct client_stats_client *csc, *tmp;
+
+	wl_list_for_each_safe(csc, tmp, &stats->clients, link)
+		client_stats_client_destroy(csc);
+}
+
+/** Whether per-client counters are being collected
+ *
+ * \param compositor The compositor.
+ * \return True if any of the 'clients' scopes has subscribers.
+ */
+WL_EXPORT bool
+weston_client_stats_enabled(struct weston_compositor *compositor)
+{
+	return compositor->client_stats &&
+	       client_stats_any_enabled(compositor->client_stats);
+}
+
+/** Adds to a counter of a client
+ *
+ * \param compositor The compositor.
+ * \param client The client to account the value to, may be NULL.
+ * \param stat The counter.
+ * \param value The amount to add, in the unit of the counter.
+ *
+ * Does nothing if nobody is subscribed to any of the 'clients' scopes.
+ */
+WL_EXPORT void
+weston_client_stats_add(struct weston_compositor *compositor,
+			struct wl_client *client,
+			enum weston_client_stat stat, uint64_t value)
+{
+	struct client_stats_client *csc;
+
+	if (!client || !weston_client_stats_enabled(compositor))
+		return;
+
+	csc = client_stats_client_get(compositor->client_stats, client);
+	csc->values[stat] += value;
+}
+
+static uint64_t
+region_area(pixman_region32_t *region)
+{
+	pixman_box32_t *rects;
+	uint64_t area = 0;
+	int n, i;
+
+	rects = pixman_region32_rectangles(region, &n);
+	for (i = 0; i < n; i++)
+		area += (uint64_t)(rects[i].x2 - rects[i].x1) *
+			(rects[i].y2 - rects[i].y1);
+
+	return area;
+}
+
+/** Counts a wl_surface.commit request and the damage it commits
+ *
+ * \param surface The surface being committed, with its pending state.
+ */
+void
+weston_client_stats_commit(struct weston_surface *surface)
+{
+	struct weston_compositor *compositor = surface->compositor;
+	struct client_stats_client *csc;
+
+	if (!surface->resource || !weston_client_stats_enabled(compositor))
+		return;
+
+	csc = client_stats_client_get(compositor->client_stats,
+				      wl_resource_get_client(surface->resource));
+	csc->values[WESTON_CLIENT_STAT_COMMITS]++;
+	csc->values[WESTON_CLIENT_STAT_DAMAGE] +=
+		region_area(&surface->pending.damage_surface) +
+		region_area(&surface->pending.damage_buffer);
+}
+
+static void
+client_stats_dispatch_end(struct weston_client_stats *stats)
+{
+	struct timespec now;
+
+	if (!stats->dispatching)
+		return;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	stats->dispatching->values[WESTON_CLIENT_STAT_DISPATCH] +=
+		timespec_sub_to_nsec(&now, &stats->dispatch_begin);
+	stats->dispatching = NULL;
+}
+
+/** Ends the dispatch time of the request dispatched last
+ *
+ * \param compositor The compositor.
+ *
+ * Called before repainting, so that the repaint in the same event loop
+ * iteration is not accounted to the client of that request.
+ */
+void
+weston_client_stats_dispatch_end(struct weston_compositor *compositor)
+{
+	if (!compositor->client_stats)
+		return;
+
+	client_stats_dispatch_end(compositor->client_stats);
+}
+
+static void
+client_stats_dispatch_idle(void *data)
+{
+	struct weston_client_stats *stats = data;
+
+	stats->dispatch_idle = NULL;
+	client_stats_dispatch_end(stats);
+}
+
+static void
+client_stats_protocol_log(void *user_data,
+			  enum wl_protocol_logger_type direction,
+			  const struct wl_protocol_logger_message *message)
+{
+	struct weston_client_stats *stats = user_data;
+	struct wl_client *client;
+	struct wl_event_loop *loop;
+	struct client_stats_client *csc;
+
+	if (direction != WL_PROTOCOL_LOGGER_REQUEST ||
+	    !client_stats_any_enabled(stats))
+		return;
+
+	client_stats_dispatch_end(stats);
+
+	client = wl_resource_get_client(message->resource);
+	csc = client_stats_client_get(stats, client);
+	csc->values[WESTON_CLIENT_STAT_REQUESTS]++;
+
+	stats->dispatching = csc;
+	clock_gettime(CLOCK_MONOTONIC, &stats->dispatch_begin);
+
+	if (!stats->dispatch_idle) {
+		loop = wl_display_get_event_loop(stats->compositor->wl_display);
+		stats->dispatch_idle =
+			wl_event_loop_add_idle(loop, client_stats_dispatch_idle,
+					       stats);
+	}
+}
+
+static void
+client_stats_comm(pid_t pid, char *buf, size_t len)
+{
+	char path[64];
+	ssize_t n = -1;
+	int fd;
+
+	snprintf(path, sizeof path, "/proc/%d/comm", (int)pid);
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd >= 0) {
+		n = read(fd, buf, len - 1);
+		close(fd);
+	}
+
+	if (n <= 0) {
+		snprintf(buf, len, "?");
+		return;
+	}
+
+	buf[n] = '\0';
+	buf[strcspn(buf, "\n")] = '\0';
+}
+
+static int
+compare_rows(const void *a, const void *b)
+{
+	const struct client_stats_row *ra = a;
+	const struct client_stats_row *rb = b;
+	int i;
+
+	/* Busiest first: by the sort key, then by each counter in turn */
+	if (ra->values[ra->key] != rb->values[rb->key])
+		return ra->values[ra->key] < rb->values[rb->key] ? 1 : -1;
+
+	for (i = 0; i < WESTON_CLIENT_STAT_COUNT; i++) {
+		if (ra->values[i] != rb->values[i])
+			return ra->values[i] < rb->values[i] ? 1 : -1;
+	}
+
+	return ra->pid - rb->pid;
+}
+
+static void
+client_stats_print(struct client_stats_scope *css, double period_s)
+{
+	struct weston_client_stats *stats = css->stats;
+	struct wl_list *client_list;
+	struct wl_client *client;
+	struct client_stats_client *csc;
+	struct client_stats_row *rows;
+	unsigned count = 0, i;
+
+	client_list = wl_display_get_client_list(stats->compositor->wl_display);
+	wl_client_for_each(client, client_list)
+		count++;
+
+	weston_log_scope_printf(css->scope,
+				"%u clients, rates over %.1f s\n",
+				count, period_s);
+	weston_log_scope_printf(css->scope,
+				"%7s %6s %8s %8s %8s %10s %10s %8s  %s\n",
+				"PID", "WALL%", "REQ/s", "COMMIT/s", "FRAME/s",
+				"DAMAGE/s", "SHM KiB/s", "DMABUF/s",
+				"COMMAND");
+
+	if (count == 0)
+		return;
+
+	rows = xcalloc(count, sizeof *rows);
+	i = 0;
+	wl_client_for_each(client, client_list) {
+		wl_client_get_credentials(client, &rows[i].pid, NULL, NULL);
+		client_stats_comm(rows[i].pid, rows[i].comm,
+				  sizeof rows[i].comm);
+		csc = client_stats_client_find(client);
+		rows[i].values = csc ? csc->values : client_stats_zero;
+		rows[i].key = css->key;
+		i++;
+	}
+
+	qsort(rows, count, sizeof *rows, compare_rows);
+
+	for (i = 0; i < count; i++) {
+		const uint64_t *v = rows[i].values;
+
+		weston_log_scope_printf(css->scope,
+					"%7d %6.1f %8.0f %8.0f %8.0f %10.0f "
+					"%10.0f %8.0f  %s\n",
+					(int)rows[i].pid,
+					v[WESTON_CLIENT_STAT_DISPATCH] / 1e7 /
+					period_s,
+					v[WESTON_CLIENT_STAT_REQUESTS] / period_s,
+					v[WESTON_CLIENT_STAT_COMMITS] / period_s,
+					v[WESTON_CLIENT_STAT_FRAME_CALLBACKS] /
+					period_s,
+					v[WESTON_CLIENT_STAT_DAMAGE] / period_s,
+					v[WESTON_CLIENT_STAT_SHM_BYTES] /
+					1024.0 / period_s,
+					v[WESTON_CLIENT_STAT_DMABUF_IMPORTS] /
+					period_s,
+					rows[i].comm);
+	}
+	weston_log_scope_printf(css->scope, "\n");
+
+	free(rows);
+}
+
+static int
+client_stats_timer_handler(void *data)
+{
+	struct weston_client_stats *stats = data;
+	struct timespec now;
+	double period_s;
+	int i;
+
+	if (!client_stats_any_enabled(stats)) {
+		client_stats_destroy_clients(stats);
+		stats->timer_armed = false;
+		return 0;
+	}
+
+	client_stats_dispatch_end(stats);
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	period_s = timespec_sub_to_nsec(&now, &stats->period_begin) / 1e9;
+	for (i = 0; i < WESTON_CLIENT_STAT_COUNT; i++) {
+		if (weston_log_scope_is_enabled(stats->scopes[i].scope))
+			client_stats_print(&stats->scopes[i], period_s);
+	}
+
+	/* Start the next period from scratch */
+	client_stats_destroy_clients(stats);
+	stats->period_begin = now;
+	wl_event_source_timer_update(stats->timer, CLIENT_STATS_PERIOD_MSEC);
+
+	return 0;
+}
+
+static void
+client_stats_new_subscription(struct weston_log_subscription *sub,
+			      void *data)
+{
+	struct client_stats_scope *css = data;
+	struct weston_client_stats *stats = css->stats;
+
+	weston_log_subscription_printf(sub,
+				       "Connected clients, most %s first, "
+				       "every %d ms\n",
+				       client_stats_keys[css->key].description,
+				       CLIENT_STATS_PERIOD_MSEC);
+
+	if (stats->timer_armed)
+		return;
+
+	clock_gettime(CLOCK_MONOTONIC, &stats->period_begin);
+	wl_event_source_timer_update(stats->timer, CLIENT_STATS_PERIOD_MSEC);
+	stats->timer_armed = true;
+}
+
+void
+weston_client_stats_init(struct weston_compositor *compositor)
+{
+	struct weston_client_stats *stats;
+	struct wl_event_loop *loop;
+	char desc[128];
+	int i;
+
+	stats = xzalloc(sizeof *stats);
+	stats->compositor = compositor;
+	wl_list_init(&stats->clients);
+
+	loop = wl_display_get_event_loop(compositor->wl_display);
+	stats->timer = wl_event_loop_add_timer(loop, client_stats_timer_handler,
+					       stats);
+	stats->logger =
+		wl_display_add_protocol_logger(compositor->wl_display,
+					       client_stats_protocol_log,
+					       stats);
+	for (i = 0; i < WESTON_CLIENT_STAT_COUNT; i++) {
+		struct client_stats_scope *css = &stats->scopes[i];
+
+		snprintf(desc, sizeof desc,
+			 "Per-client activity by %s, printed periodically\n",
+			 client_stats_keys[i].description);
+		css->stats = stats;
+		css->key = i;
+		css->scope =
+			weston_compositor_add_log_scope(compositor,
+							client_stats_keys[i].scope,
+							desc,
+							client_stats_new_subscription,
+							NULL, css);
+	}
+
+	compositor->client_stats = stats;
+}
+
+void
+weston_client_stats_fini(struct weston_compositor *compositor)
+{
+	struct weston_client_stats *stats = compositor->client_stats;
+
+	int i;
+
+	if (!stats)
+		return;
+
+	for (i = 0; i < WESTON_CLIENT_STAT_COUNT; i++)
+		weston_log_scope_destroy(stats->scopes[i].scope);
+	if (stats->logger)
+		wl_protocol_logger_destroy(stats->logger);
+	client_stats_destroy_clients(stats);
+	if (stats->dispatch_idle)
+		wl_event_source_remove(stats->dispatch_idle);
+	if (stats->timer)
+		wl_event_source_remove(stats->timer);
+
+	free(stats);
+	compositor->client_stats = NULL;
+}
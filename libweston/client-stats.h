@@ -0,0 +1,69 @@
+/*
+ * Copyright 2024 Collabora, Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef WESTON_CLIENT_STATS_H
+#define WESTON_CLIENT_STATS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct weston_compositor;
+struct weston_surface;
+struct wl_client;
+
+/** Per-client counters shown by the 'clients' debug scope */
+enum weston_client_stat {
+	WESTON_CLIENT_STAT_DISPATCH = 0,	/**< request dispatch time, ns */
+	WESTON_CLIENT_STAT_REQUESTS,		/**< requests dispatched */
+	WESTON_CLIENT_STAT_COMMITS,		/**< wl_surface.commit requests */
+	WESTON_CLIENT_STAT_DAMAGE,		/**< committed damage, pixels */
+	WESTON_CLIENT_STAT_SHM_BYTES,		/**< SHM bytes uploaded */
+	WESTON_CLIENT_STAT_DMABUF_IMPORTS,	/**< dmabufs imported */
+	WESTON_CLIENT_STAT_FRAME_CALLBACKS,	/**< wl_surface.frame requests */
+	WESTON_CLIENT_STAT_COUNT,
+};
+
+bool
+weston_client_stats_enabled(struct weston_compositor *compositor);
+
+void
+weston_client_stats_add(struct weston_compositor *compositor,
+			struct wl_client *client,
+			enum weston_client_stat stat, uint64_t value);
+
+void
+weston_client_stats_commit(struct weston_surface *surface);
+
+void
+weston_client_stats_dispatch_end(struct weston_compositor *compositor);
+
+void
+weston_client_stats_init(struct weston_compositor *compositor);
+
+void
+weston_client_stats_fini(struct weston_compositor *compositor);
+
+#endif /* WESTON_CLIENT_STATS_H */
@@ -0,0 +1,738 @@
+/*
+ * Copyright 2024 Collabora, Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libweston/libweston.h>
+
+#include "color.h"
+#include "color-cpu.h"
+#include "shared/helpers.h"
+
+/*
+ * CPU implementation of the weston_color_transform pipeline, for renderers
+ * without shaders.
+ *
+ * Pixels are processed in tiles of TILE_PIXELS. Each tile is unpacked into
+ * planar float arrays, every pipeline step is a plain loop over those arrays,
+ * and the result is packed back in place. The loops have no dependencies
+ * between pixels, so the compiler vectorizes them for the target. On x86-64
+ * the row function is additionally built for AVX2 and SSE4.2 and picked at
+ * load time, when the toolchain supports target_clones. Large images are
+ * split by rows over a small pool of threads.
+ */
+
+#define TILE_PIXELS 64
+#define POOL_ROWS_PER_CHUNK 8
+#define POOL_MIN_PIXELS (128 * 128)
+
+#if defined(HAVE_FUNC_ATTRIBUTE_TARGET_CLONES) && defined(__x86_64__)
+#define CPU_COLOR_CLONES __attribute__((target_clones("avx2", "sse4.2", "default")))
+#else
+#define CPU_COLOR_CLONES
+#endif
+
+struct cpu_color_curve {
+	bool identity;
+	unsigned len;
+	float *lut; /* 3 * len: red, green, blue */
+};
+
+struct weston_cpu_color_transform {
+	struct weston_color_transform *owner;
+	struct wl_listener destroy_listener;
+
+	enum weston_cpu_color_interp interp;
+
+	struct cpu_color_curve pre_curve;
+
+	enum weston_color_mapping_type mapping_type;
+	float matrix[9]; /* column-major */
+	unsigned lut3d_len;
+	float *lut3d;
+
+	struct cpu_color_curve post_curve;
+
+	/* The pre-curve evaluated at the 8-bit code points. */
+	float pre8[3][256];
+
+	/*
+	 * Without a mixing step each channel is a function of itself only,
+	 * and opaque pixels go through a plain table.
+	 */
+	bool separable;
+	uint8_t sep8[3][256];
+};
+
+struct cpu_color_job {
+	const struct weston_cpu_color_transform *cxf;
+	uint32_t *pixels;
+	int stride;
+	int width;
+	int height;
+	bool opaque;
+
+	int next_row;
+	int rows_done;
+};
+
+struct weston_cpu_color_pool {
+	pthread_mutex_t mutex;
+	pthread_cond_t work_cond;
+	pthread_cond_t done_cond;
+	bool stop;
+
+	struct cpu_color_job job;
+
+	unsigned n_threads;
+	pthread_t threads[];
+};
+
+static inline float
+clamp01(float x)
+{
+	return x < 0.0f ? 0.0f : (x > 1.0f ? 1.0f : x);
+}
+
+static inline void
+lut_coord(float x, unsigned len, unsigned *index, float *frac)
+{
+	float pos = clamp01(x) * (float)(len - 1);
+	unsigned i = (unsigned)pos;
+
+	if (i > len - 2)
+		i = len - 2;
+
+	*index = i;
+	*frac = pos - (float)i;
+}
+
+static inline float
+lut_1d(const float *lut, unsigned len, float x)
+{
+	unsigned i;
+	float f;
+
+	lut_coord(x, len, &i, &f);
+
+	return lut[i] + f * (lut[i + 1] - lut[i]);
+}
+
+static inline void
+lut_3d_tetrahedral(const float *lut, unsigned len,
+		   float *r, float *g, float *b)
+{
+	const unsigned sr = 3;
+	const unsigned sg = 3 * len;
+	const unsigned sb = 3 * len * len;
+	const float *c0, *c1, *c2, *c3;
+	unsigned ir, ig, ib;
+	unsigned o1, o2;
+	float fr, fg, fb;
+	float w1, w2, w3;
+	float out[3];
+	int c;
+
+	lut_coord(*r, len, &ir, &fr);
+	lut_coord(*g, len, &ig, &fg);
+	lut_coord(*b, len, &ib, &fb);
+
+	/* Pick the tetrahedron of the cube the point lies in. */
+	if (fr >= fg) {
+		if (fg >= fb) {
+			o1 = sr; o2 = sr + sg; w1 = fr; w2 = fg; w3 = fb;
+		} else if (fr >= fb) {
+			o1 = sr; o2 = sr + sb; w1 = fr; w2 = fb; w3 = fg;
+		} else {
+			o1 = sb; o2 = sr + sb; w1 = fb; w2 = fr; w3 = fg;
+		}
+	} else {
+		if (fr >= fb) {
+			o1 = sg; o2 = sr + sg; w1 = fg; w2 = fr; w3 = fb;
+		} else if (fg >= fb) {
+			o1 = sg; o2 = sg + sb; w1 = fg; w2 = fb; w3 = fr;
+		} else {
+			o1 = sb; o2 = sg + sb; w1 = fb; w2 = fg; w3 = fr;
+		}
+	}
+
+	c0 = lut + ir * sr + ig * sg + ib * sb;
+	c1 = c0 + o1;
+	c2 = c0 + o2;
+	c3 = c0 + sr + sg + sb;
+
+	for (c = 0; c < 3; c++)
+		out[c] = c0[c] + w1 * (c1[c] - c0[c]) +
+			 w2 * (c2[c] - c1[c]) + w3 * (c3[c] - c2[c]);
+
+	*r = out[0];
+	*g = out[1];
+	*b = out[2];
+}
+
+static inline float
+lerp(float a, float b, float f)
+{
+	return a + f * (b - a);
+}
+
+static inline void
+lut_3d_trilinear(const float *lut, unsigned len,
+		 float *r, float *g, float *b)
+{
+	const unsigned sr = 3;
+	const unsigned sg = 3 * len;
+	const unsigned sb = 3 * len * len;
+	const float *c000;
+	unsigned ir, ig, ib;
+	float fr, fg, fb;
+	float out[3];
+	int c;
+
+	lut_coord(*r, len, &ir, &fr);
+	lut_coord(*g, len, &ig, &fg);
+	lut_coord(*b, len, &ib, &fb);
+
+	c000 = lut + ir * sr + ig * sg + ib * sb;
+
+	for (c = 0; c < 3; c++) {
+		const float *p = c000 + c;
+		float x00 = lerp(p[0], p[sr], fr);
+		float x10 = lerp(p[sg], p[sg + sr], fr);
+		float x01 = lerp(p[sb], p[sb + sr], fr);
+		float x11 = lerp(p[sb + sg], p[sb + sg + sr], fr);
+
+		out[c] = lerp(lerp(x00, x10, fg), lerp(x01, x11, fg), fb);
+	}
+
+	*r = out[0];
+	*g = out[1];
+	*b = out[2];
+}
+
+static inline void
+curve_eval(const struct cpu_color_curve *curve, float *rgb)
+{
+	int c;
+
+	if (curve->identity)
+		return;
+
+	for (c = 0; c < 3; c++)
+		rgb[c] = lut_1d(curve->lut + c * curve->len, curve->len, rgb[c]);
+}
+
+static inline void
+matrix_eval(const float *m, float *rgb)
+{
+	float r = rgb[0], g = rgb[1], b = rgb[2];
+
+	rgb[0] = m[0] * r + m[3] * g + m[6] * b;
+	rgb[1] = m[1] * r + m[4] * g + m[7] * b;
+	rgb[2] = m[2] * r + m[5] * g + m[8] * b;
+}
+
+/** Evaluate the whole pipeline for one color
+ *
+ * \param cxf The CPU color transformation.
+ * \param rgb Straight alpha color, transformed in place.
+ *
+ * This is the reference for the tiled path, and good for solid colors.
+ */
+void
+weston_cpu_color_transform_eval(const struct weston_cpu_color_transform *cxf,
+				float rgb[3])
+{
+	curve_eval(&cxf->pre_curve, rgb);
+
+	switch (cxf->mapping_type) {
+	case WESTON_COLOR_MAPPING_TYPE_IDENTITY:
+		break;
+	case WESTON_COLOR_MAPPING_TYPE_MATRIX:
+		matrix_eval(cxf->matrix, rgb);
+		break;
+	case WESTON_COLOR_MAPPING_TYPE_3D_LUT:
+		if (cxf->interp == WESTON_CPU_COLOR_INTERP_TRILINEAR)
+			lut_3d_trilinear(cxf->lut3d, cxf->lut3d_len,
+					 &rgb[0], &rgb[1], &rgb[2]);
+		else
+			lut_3d_tetrahedral(cxf->lut3d, cxf->lut3d_len,
+					   &rgb[0], &rgb[1], &rgb[2]);
+		break;
+	}
+
+	curve_eval(&cxf->post_curve, rgb);
+}
+
+static inline void
+curve_eval_planar(const struct cpu_color_curve *curve,
+		  float *restrict r, float *restrict g, float *restrict b,
+		  int n)
+{
+	const float *lr = curve->lut;
+	const float *lg = curve->lut + curve->len;
+	const float *lb = curve->lut + 2 * curve->len;
+	const unsigned len = curve->len;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		r[i] = lut_1d(lr, len, r[i]);
+		g[i] = lut_1d(lg, len, g[i]);
+		b[i] = lut_1d(lb, len, b[i]);
+	}
+}
+
+static inline void
+matrix_eval_planar(const float *m,
+		   float *restrict r, float *restrict g, float *restrict b,
+		   int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++) {
+		float x = r[i], y = g[i], z = b[i];
+
+		r[i] = m[0] * x + m[3] * y + m[6] * z;
+		g[i] = m[1] * x + m[4] * y + m[7] * z;
+		b[i] = m[2] * x + m[5] * y + m[8] * z;
+	}
+}
+
+/* One tile of at most TILE_PIXELS pixels, transformed in place */
+static inline void
+process_tile(const struct weston_cpu_color_transform *cxf,
+	     uint32_t *px, int n, bool opaque)
+{
+	float r[TILE_PIXELS];
+	float g[TILE_PIXELS];
+	float b[TILE_PIXELS];
+	float a[TILE_PIXELS];
+	uint32_t alpha_and = 0xff;
+	int i;
+
+	if (!opaque) {
+		for (i = 0; i < n; i++)
+			alpha_and &= px[i] >> 24;
+		opaque = alpha_and == 0xff;
+	}
+
+	if (opaque && cxf->separable) {
+		for (i = 0; i < n; i++) {
+			uint32_t p = px[i];
+
+			px[i] = (p & 0xff000000) |
+				(uint32_t)cxf->sep8[0][(p >> 16) & 0xff] << 16 |
+				(uint32_t)cxf->sep8[1][(p >> 8) & 0xff] << 8 |
+				(uint32_t)cxf->sep8[2][p & 0xff];
+		}
+		return;
+	}
+
+	if (opaque) {
+		for (i = 0; i < n; i++) {
+			uint32_t p = px[i];
+
+			r[i] = cxf->pre8[0][(p >> 16) & 0xff];
+			g[i] = cxf->pre8[1][(p >> 8) & 0xff];
+			b[i] = cxf->pre8[2][p & 0xff];
+		}
+	} else {
+		for (i = 0; i < n; i++) {
+			uint32_t p = px[i];
+			float alpha = (float)(p >> 24) * (1.0f / 255.0f);
+			float inv = alpha > 0.0f ? 1.0f / (alpha * 255.0f) : 0.0f;
+
+			a[i] = alpha;
+			r[i] = (float)((p >> 16) & 0xff) * inv;
+			g[i] = (float)((p >> 8) & 0xff) * inv;
+			b[i] = (float)(p & 0xff) * inv;
+		}
+
+		if (!cxf->pre_curve.identity)
+			curve_eval_planar(&cxf->pre_curve, r, g, b, n);
+	}
+
+	switch (cxf->mapping_type) {
+	case WESTON_COLOR_MAPPING_TYPE_IDENTITY:
+		break;
+	case WESTON_COLOR_MAPPING_TYPE_MATRIX:
+		matrix_eval_planar(cxf->matrix, r, g, b, n);
+		break;
+	case WESTON_COLOR_MAPPING_TYPE_3D_LUT:
+		if (cxf->interp == WESTON_CPU_COLOR_INTERP_TRILINEAR) {
+			for (i = 0; i < n; i++)
+				lut_3d_trilinear(cxf->lut3d, cxf->lut3d_len,
+						 &r[i], &g[i], &b[i]);
+		} else {
+			for (i = 0; i < n; i++)
+				lut_3d_tetrahedral(cxf->lut3d, cxf->lut3d_len,
+						   &r[i], &g[i], &b[i]);
+		}
+		break;
+	}
+
+	if (!cxf->post_curve.identity)
+		curve_eval_planar(&cxf->post_curve, r, g, b, n);
+
+	if (!opaque) {
+		for (i = 0; i < n; i++) {
+			r[i] = clamp01(r[i]) * a[i];
+			g[i] = clamp01(g[i]) * a[i];
+			b[i] = clamp01(b[i]) * a[i];
+		}
+	}
+
+	for (i = 0; i < n; i++) {
+		uint32_t ir = (uint32_t)(clamp01(r[i]) * 255.0f + 0.5f);
+		uint32_t ig = (uint32_t)(clamp01(g[i]) * 255.0f + 0.5f);
+		uint32_t ib = (uint32_t)(clamp01(b[i]) * 255.0f + 0.5f);
+
+		px[i] = (px[i] & 0xff000000) | ir << 16 | ig << 8 | ib;
+	}
+}
+
+static void CPU_COLOR_CLONES
+process_rows(const struct weston_cpu_color_transform *cxf,
+	     uint32_t *pixels, int stride, int width, int height, bool opaque)
+{
+	int x, y;
+
+	for (y = 0; y < height; y++) {
+		uint32_t *row = pixels + (size_t)y * stride;
+
+		for (x = 0; x < width; x += TILE_PIXELS)
+			process_tile(cxf, row + x, MIN(TILE_PIXELS, width - x),
+				     opaque);
+	}
+}
+
+/* Called with the pool mutex locked, returns with it locked. */
+static void
+pool_do_work(struct weston_cpu_color_pool *pool)
+{
+	struct cpu_color_job *job = &pool->job;
+
+	while (job->next_row < job->height) {
+		int y = job->next_row;
+		int rows = MIN(POOL_ROWS_PER_CHUNK, job->height - y);
+
+		job->next_row += rows;
+		pthread_mutex_unlock(&pool->mutex);
+
+		process_rows(job->cxf, job->pixels + (size_t)y * job->stride,
+			     job->stride, job->width, rows, job->opaque);
+
+		pthread_mutex_lock(&pool->mutex);
+		job->rows_done += rows;
+		if (job->rows_done == job->height)
+			pthread_cond_signal(&pool->done_cond);
+	}
+}
+
+static void *
+pool_thread(void *data)
+{
+	struct weston_cpu_color_pool *pool = data;
+
+	pthread_mutex_lock(&pool->mutex);
+	while (!pool->stop) {
+		if (pool->job.cxf && pool->job.next_row < pool->job.height)
+			pool_do_work(pool);
+		else
+			pthread_cond_wait(&pool->work_cond, &pool->mutex);
+	}
+	pthread_mutex_unlock(&pool->mutex);
+
+	return NULL;
+}
+
+/** Create a pool of threads for transforming large images
+ *
+ * \param n_threads The number of helper threads. The calling thread
+ * always takes part in the work too.
+ * \return The pool, or NULL on failure.
+ */
+struct weston_cpu_color_pool *
+weston_cpu_color_pool_create(unsigned n_threads)
+{
+	struct weston_cpu_color_pool *pool;
+	unsigned i;
+
+	pool = zalloc(sizeof *pool + n_threads * sizeof pool->threads[0]);
+	if (!pool)
+		return NULL;
+
+	pthread_mutex_init(&pool->mutex, NULL);
+	pthread_cond_init(&pool->work_cond, NULL);
+	pthread_cond_init(&pool->done_cond, NULL);
+
+	for (i = 0; i < n_threads; i++) {
+		if (pthread_create(&pool->threads[i], NULL,
+				   pool_thread, pool) != 0)
+			break;
+	}
+	pool->n_threads = i;
+
+	return pool;
+}
+
+void
+weston_cpu_color_pool_destroy(struct weston_cpu_color_pool *pool)
+{
+	unsigned i;
+
+	if (!pool)
+		return;
+
+	pthread_mutex_lock(&pool->mutex);
+	pool->stop = true;
+	pthread_cond_broadcast(&pool->work_cond);
+	pthread_mutex_unlock(&pool->mutex);
+
+	for (i = 0; i < pool->n_threads; i++)
+		pthread_join(pool->threads[i], NULL);
+
+	pthread_cond_destroy(&pool->done_cond);
+	pthread_cond_destroy(&pool->work_cond);
+	pthread_mutex_destroy(&pool->mutex);
+	free(pool);
+}
+
+/** Transform 32-bit ARGB pixels in place
+ *
+ * \param cxf The CPU color transformation.
+ * \param pool Threads to share the work with, or NULL.
+ * \param pixels The first pixel, in PIXMAN_a8r8g8b8 or PIXMAN_x8r8g8b8.
+ * \param stride Distance between rows, in pixels.
+ * \param width Width of the area in pixels.
+ * \param height Height of the area in pixels.
+ * \param opaque True to ignore the alpha channel, false for premultiplied
+ * alpha.
+ *
+ * The alpha byte is always kept as is.
+ */
+void
+weston_cpu_color_transform_run(const struct weston_cpu_color_transform *cxf,
+			       struct weston_cpu_color_pool *pool,
+			       uint32_t *pixels, int stride,
+			       int width, int height, bool opaque)
+{
+	struct cpu_color_job *job;
+
+	if (width <= 0 || height <= 0)
+		return;
+
+	if (!pool || pool->n_threads == 0 ||
+	    (int64_t)width * height < POOL_MIN_PIXELS) {
+		process_rows(cxf, pixels, stride, width, height, opaque);
+		return;
+	}
+
+	pthread_mutex_lock(&pool->mutex);
+
+	job = &pool->job;
+	assert(!job->cxf);
+	*job = (struct cpu_color_job) {
+		.cxf = cxf,
+		.pixels = pixels,
+		.stride = stride,
+		.width = width,
+		.height = height,
+		.opaque = opaque,
+	};
+	pthread_cond_broadcast(&pool->work_cond);
+
+	pool_do_work(pool);
+	while (job->rows_done < job->height)
+		pthread_cond_wait(&pool->done_cond, &pool->mutex);
+	job->cxf = NULL;
+
+	pthread_mutex_unlock(&pool->mutex);
+}
+
+static bool
+cpu_color_curve_init(struct cpu_color_curve *curve,
+		     const struct weston_color_curve *src,
+		     struct weston_color_transform *xform)
+{
+	unsigned len;
+
+	switch (src->type) {
+	case WESTON_COLOR_CURVE_TYPE_IDENTITY:
+		curve->identity = true;
+		return true;
+	case WESTON_COLOR_CURVE_TYPE_LUT_3x1D:
+		len = MAX(src->u.lut_3x1d.optimal_len, 2u);
+		curve->lut = calloc(3 * len, sizeof *curve->lut);
+		if (!curve->lut)
+			return false;
+
+		src->u.lut_3x1d.fill_in(xform, curve->lut, len);
+		curve->len = len;
+		curve->identity = false;
+		return true;
+	}
+
+	return false;
+}
+
+static bool
+matrix_is_diagonal(const float *m)
+{
+	return m[1] == 0.0f && m[2] == 0.0f && m[3] == 0.0f &&
+	       m[5] == 0.0f && m[6] == 0.0f && m[7] == 0.0f;
+}
+
+static void
+cpu_color_transform_init_tables(struct weston_cpu_color_transform *cxf)
+{
+	unsigned v;
+	int c;
+
+	for (v = 0; v < 256; v++) {
+		float rgb[3] = { v / 255.0f, v / 255.0f, v / 255.0f };
+
+		curve_eval(&cxf->pre_curve, rgb);
+		for (c = 0; c < 3; c++)
+			cxf->pre8[c][v] = rgb[c];
+	}
+
+	cxf->separable =
+		cxf->mapping_type == WESTON_COLOR_MAPPING_TYPE_IDENTITY ||
+		(cxf->mapping_type == WESTON_COLOR_MAPPING_TYPE_MATRIX &&
+		 matrix_is_diagonal(cxf->matrix));
+	if (!cxf->separable)
+		return;
+
+	for (v = 0; v < 256; v++) {
+		float rgb[3] = { v / 255.0f, v / 255.0f, v / 255.0f };
+
+		weston_cpu_color_transform_eval(cxf, rgb);
+		for (c = 0; c < 3; c++)
+			cxf->sep8[c][v] = clamp01(rgb[c]) * 255.0f + 0.5f;
+	}
+}
+
+static void
+cpu_color_transform_destroy(struct weston_cpu_color_transform *cxf)
+{
+	wl_list_remove(&cxf->destroy_listener.link);
+	free(cxf->pre_curve.lut);
+	free(cxf->lut3d);
+	free(cxf->post_curve.lut);
+	free(cxf);
+}
+
+static void
+cpu_color_transform_destroy_handler(struct wl_listener *l, void *data)
+{
+	struct weston_cpu_color_transform *cxf;
+
+	cxf = wl_container_of(l, cxf, destroy_listener);
+	assert(cxf->owner == data);
+
+	cpu_color_transform_destroy(cxf);
+}
+
+static struct weston_cpu_color_transform *
+cpu_color_transform_create(struct weston_color_transform *xform)
+{
+	struct weston_cpu_color_transform *cxf;
+	unsigned len;
+
+	cxf = zalloc(sizeof *cxf);
+	if (!cxf)
+		return NULL;
+
+	cxf->owner = xform;
+	cxf->destroy_listener.notify = cpu_color_transform_destroy_handler;
+	wl_signal_add(&xform->destroy_signal, &cxf->destroy_listener);
+
+	if (!cpu_color_curve_init(&cxf->pre_curve, &xform->pre_curve, xform) ||
+	    !cpu_color_curve_init(&cxf->post_curve, &xform->post_curve, xform))
+		goto fail;
+
+	cxf->mapping_type = xform->mapping.type;
+	switch (xform->mapping.type) {
+	case WESTON_COLOR_MAPPING_TYPE_IDENTITY:
+		break;
+	case WESTON_COLOR_MAPPING_TYPE_MATRIX:
+		memcpy(cxf->matrix, xform->mapping.u.mat.matrix,
+		       sizeof cxf->matrix);
+		break;
+	case WESTON_COLOR_MAPPING_TYPE_3D_LUT:
+		len = MAX(xform->mapping.u.lut3d.optimal_len, 2u);
+		cxf->lut3d = calloc(3 * len * len * len, sizeof *cxf->lut3d);
+		if (!cxf->lut3d)
+			goto fail;
+
+		xform->mapping.u.lut3d.fill_in(xform, cxf->lut3d, len);
+		cxf->lut3d_len = len;
+		break;
+	default:
+		goto fail;
+	}
+
+	cpu_color_transform_init_tables(cxf);
+
+	return cxf;
+
+fail:
+	cpu_color_transform_destroy(cxf);
+	return NULL;
+}
+
+/** Get the CPU realization of a color transformation
+ *
+ * \param xform The color transformation.
+ * \return The CPU color transformation, or NULL on failure.
+ *
+ * The result is cached on \c xform and lives as long as it does.
+ */
+struct weston_cpu_color_transform *
+weston_cpu_color_transform_get(struct weston_color_transform *xform)
+{
+	struct wl_listener *l;
+
+	l = wl_signal_get(&xform->destroy_signal,
+			  cpu_color_transform_destroy_handler);
+	if (l)
+		return container_of(l, struct weston_cpu_color_transform,
+				    destroy_listener);
+
+	return cpu_color_transform_create(xform);
+}
+
+void
+weston_cpu_color_transform_set_interp(struct weston_cpu_color_transform *cxf,
+				      enum weston_cpu_color_interp interp)
+{
+	cxf->interp = interp;
+}
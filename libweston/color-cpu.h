@@ -0,0 +1,69 @@
+/*
+ * Copyright 2024 Collabora, Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef WESTON_COLOR_CPU_H
+#define WESTON_COLOR_CPU_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct weston_color_transform;
+
+/** Interpolation used for sampling a 3D LUT */
+enum weston_cpu_color_interp {
+	/** Four samples per pixel, the default */
+	WESTON_CPU_COLOR_INTERP_TETRAHEDRAL = 0,
+
+	/** Eight samples per pixel, matches GL texture sampling */
+	WESTON_CPU_COLOR_INTERP_TRILINEAR,
+};
+
+struct weston_cpu_color_transform;
+struct weston_cpu_color_pool;
+
+struct weston_cpu_color_transform *
+weston_cpu_color_transform_get(struct weston_color_transform *xform);
+
+void
+weston_cpu_color_transform_set_interp(struct weston_cpu_color_transform *cxf,
+				      enum weston_cpu_color_interp interp);
+
+void
+weston_cpu_color_transform_eval(const struct weston_cpu_color_transform *cxf,
+				float rgb[3]);
+
+void
+weston_cpu_color_transform_run(const struct weston_cpu_color_transform *cxf,
+			       struct weston_cpu_color_pool *pool,
+			       uint32_t *pixels, int stride,
+			       int width, int height, bool opaque);
+
+struct weston_cpu_color_pool *
+weston_cpu_color_pool_create(unsigned n_threads);
+
+void
+weston_cpu_color_pool_destroy(struct weston_cpu_color_pool *pool);
+
+#endif /* WESTON_COLOR_CPU_H */
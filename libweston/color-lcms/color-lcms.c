@@ -79,7 +79,7 @@ cmlcms_destroy_color_transform(struct weston_color_transform *xform_base)
 {
 	struct cmlcms_color_transform *xform = get_xform(xform_base);
 
-	cmlcms_color_transform_destroy(xform);
+	cmlcms_color_transform_release(xform);
 }
 
 static bool
@@ -101,11 +101,12 @@ cmlcms_get_surface_color_transform(struct weston_color_manager *cm_base,
 	param.intent_output = cmlcms_get_render_intent(param.category,
 						       surface, output);
 
-	xform = cmlcms_color_transform_get(cm, &param);
+	xform = cmlcms_color_transform_get_async(cm, &param);
 	if (!xform)
 		return false;
 
 	surf_xform->transform = &xform->base;
+
 	/*
 	 * When we introduce LCMS plug-in we can precisely answer this question
 	 * by examining the color pipeline using precision parameters. For now
@@ -119,6 +120,36 @@ cmlcms_get_surface_color_transform(struct weston_color_manager *cm_base,
 	return true;
 }
 
+/*
+ * The direct transformation lets renderers skip the blend-to-output pass
+ * when nothing needs blending. Renderers only ask for it when they are about
+ * to use it, so that it is not built for every surface.
+ */
+static bool
+cmlcms_get_surface_to_output_color_transform(struct weston_color_manager *cm_base,
+					     struct weston_surface *surface,
+					     struct weston_output *output,
+					     struct weston_color_transform **xform_out)
+{
+	struct weston_color_manager_lcms *cm = get_cmlcms(cm_base);
+	struct cmlcms_color_transform *xform;
+
+	struct cmlcms_color_transform_search_param param = {
+		.category = CMLCMS_CATEGORY_INPUT_TO_OUTPUT,
+		.input_profile = get_cprof_or_stock_sRGB(cm, NULL /* TODO: surface->color_profile */),
+		.output_profile = get_cprof_or_stock_sRGB(cm, output->color_profile),
+	};
+	param.intent_output = cmlcms_get_render_intent(param.category,
+						       surface, output);
+
+	xform = cmlcms_color_transform_get_async(cm, &param);
+	if (!xform)
+		return false;
+
+	*xform_out = &xform->base;
+	return true;
+}
+
 static bool
 cmlcms_get_blend_to_output_color_transform(struct weston_color_manager_lcms *cm,
 					   struct weston_output *output,
@@ -381,6 +412,9 @@ cmlcms_destroy(struct weston_color_manager *cm_base)
 {
 	struct weston_color_manager_lcms *cm = get_cmlcms(cm_base);
 
+	cmlcms_worker_fini(cm);
+	cmlcms_color_transform_flush_unused(cm);
+
 	if (cm->sRGB_profile)
 		cmlcms_color_profile_destroy(cm->sRGB_profile);
 	assert(wl_list_empty(&cm->color_transform_list));
@@ -407,7 +441,9 @@ transforms_scope_new_sub(struct weston_log_subscription *subs, void *data)
 
 	weston_log_subscription_printf(subs, "Existent:\n");
 	wl_list_for_each(xform, &cm->color_transform_list, link) {
-		weston_log_subscription_printf(subs, "Color transformation %p:\n", xform);
+		weston_log_subscription_printf(subs, "Color transformation %p%s:\n",
+					       xform, xform->base.ref_count ?
+					       "" : " (unused)");
 
 		str = cmlcms_color_transform_search_param_string(&xform->search_key);
 		weston_log_subscription_printf(subs, "%s", str);
@@ -443,6 +479,7 @@ WL_EXPORT struct weston_color_manager *
 weston_color_manager_create(struct weston_compositor *compositor)
 {
 	struct weston_color_manager_lcms *cm;
+	unsigned i;
 
 	cm = zalloc(sizeof *cm);
 	if (!cm)
@@ -457,10 +494,17 @@ weston_color_manager_create(struct weston_compositor *compositor)
 	cm->base.get_color_profile_from_icc = cmlcms_get_color_profile_from_icc;
 	cm->base.destroy_color_transform = cmlcms_destroy_color_transform;
 	cm->base.get_surface_color_transform = cmlcms_get_surface_color_transform;
+	cm->base.get_surface_to_output_color_transform =
+		cmlcms_get_surface_to_output_color_transform;
 	cm->base.create_output_color_outcome = cmlcms_create_output_color_outcome;
 
 	wl_list_init(&cm->color_transform_list);
+	wl_list_init(&cm->unused_transform_list);
 	wl_list_init(&cm->color_profile_list);
+	for (i = 0; i < CMLCMS_HASH_BUCKETS; i++) {
+		wl_list_init(&cm->color_transform_hash[i]);
+		wl_list_init(&cm->color_profile_hash[i]);
+	}
 
 	cm->transforms_scope =
 		weston_compositor_add_log_scope(compositor, "color-lcms-transformations",
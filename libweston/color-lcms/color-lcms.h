@@ -28,12 +28,19 @@
 #define WESTON_COLOR_LCMS_H
 
 #include <lcms2.h>
+#include <pthread.h>
 #include <libweston/libweston.h>
 #include <libweston/weston-log.h>
 
 #include "color.h"
 #include "shared/helpers.h"
 
+/** Number of hash buckets for the profile and transform lookups */
+#define CMLCMS_HASH_BUCKETS 64
+
+/** How many unreferenced color transformations are kept for reuse */
+#define CMLCMS_UNUSED_TRANSFORMS_MAX 16
+
 struct weston_color_manager_lcms {
 	struct weston_color_manager base;
 	struct weston_log_scope *profiles_scope;
@@ -42,8 +49,43 @@ struct weston_color_manager_lcms {
 	cmsContext lcms_ctx;
 
 	struct wl_list color_transform_list; /* cmlcms_color_transform::link */
+	/* cmlcms_color_transform::hash_link */
+	struct wl_list color_transform_hash[CMLCMS_HASH_BUCKETS];
+
+	/**
+	 * Transformations nobody references anymore, most recently released
+	 * first. They are still in color_transform_list and the hash, so
+	 * that switching back and forth between surfaces does not rebuild
+	 * their pipelines. Uses cmlcms_color_transform::unused_link.
+	 */
+	struct wl_list unused_transform_list;
+	unsigned unused_transform_count;
+
 	struct wl_list color_profile_list; /* cmlcms_color_profile::link */
+	/* cmlcms_color_profile::hash_link */
+	struct wl_list color_profile_hash[CMLCMS_HASH_BUCKETS];
 	struct cmlcms_color_profile *sRGB_profile; /* stock profile */
+
+	/** Background realization of color transformations
+	 *
+	 * Started on first use. The thread takes transformations from
+	 * 'queue' and puts them on 'done' once realized, both lists using
+	 * cmlcms_color_transform::worker_link and protected by 'mutex'.
+	 * The main loop is woken through 'eventfd'.
+	 */
+	struct {
+		bool disabled;
+		bool running;
+		bool stop;
+		pthread_t thread;
+		pthread_mutex_t mutex;
+		pthread_cond_t work_cond;
+		pthread_cond_t done_cond;
+		struct wl_list queue;
+		struct wl_list done;
+		int eventfd;
+		struct wl_event_source *source;
+	} worker;
 };
 
 static inline struct weston_color_manager_lcms *
@@ -62,6 +104,9 @@ struct cmlcms_color_profile {
 	/* struct weston_color_manager_lcms::color_profile_list */
 	struct wl_list link;
 
+	/* struct weston_color_manager_lcms::color_profile_hash */
+	struct wl_list hash_link;
+
 	cmsHPROFILE profile;
 	struct cmlcms_md5_sum md5sum;
 
@@ -152,6 +197,12 @@ struct cmlcms_color_transform {
 	/* weston_color_manager_lcms::color_transform_list */
 	struct wl_list link;
 
+	/* weston_color_manager_lcms::color_transform_hash */
+	struct wl_list hash_link;
+
+	/* weston_color_manager_lcms::unused_transform_list */
+	struct wl_list unused_link;
+
 	struct cmlcms_color_transform_search_param search_key;
 
 	/*
@@ -178,6 +229,39 @@ struct cmlcms_color_transform {
 	 */
 	cmsContext lcms_ctx;
 
+	/**
+	 * 3D LUT sampled by the worker thread, cmlcms_reasonable_3D_points()
+	 * along each dimension, or NULL.
+	 */
+	float *lut3d;
+
+	/** Asynchronous realization state, see cmlcms_color_transform_get() */
+
+	/** The precise transformation being realized for this approximation */
+	struct cmlcms_color_transform *pending;
+
+	/** The approximation standing in while this one is being realized */
+	struct cmlcms_color_transform *approx;
+
+	/** Replaced by a precise transformation, destroy when released */
+	bool superseded;
+
+	/** Owned by the worker thread, must not log or touch the lists */
+	bool on_worker;
+
+	/** Set by the worker thread when done */
+	bool realized;
+	bool realized_ok;
+
+	/** First LittleCMS error raised on the worker thread */
+	char *worker_error;
+
+	/** Why transform_factory() declined on the worker thread, if it did */
+	const char *worker_decline;
+
+	/* weston_color_manager_lcms::worker queue or done */
+	struct wl_list worker_link;
+
 	/**
 	 * The result of pipeline construction, optimization, and analysis.
 	 */
@@ -206,9 +290,22 @@ struct cmlcms_color_transform *
 cmlcms_color_transform_get(struct weston_color_manager_lcms *cm,
 			   const struct cmlcms_color_transform_search_param *param);
 
+struct cmlcms_color_transform *
+cmlcms_color_transform_get_async(struct weston_color_manager_lcms *cm,
+				 const struct cmlcms_color_transform_search_param *param);
+
+void
+cmlcms_worker_fini(struct weston_color_manager_lcms *cm);
+
 void
 cmlcms_color_transform_destroy(struct cmlcms_color_transform *xform);
 
+void
+cmlcms_color_transform_release(struct cmlcms_color_transform *xform);
+
+void
+cmlcms_color_transform_flush_unused(struct weston_color_manager_lcms *cm);
+
 char *
 cmlcms_color_transform_search_param_string(const struct cmlcms_color_transform_search_param *search_key);
 
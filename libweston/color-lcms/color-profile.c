@@ -284,13 +284,25 @@ validate_icc_profile(cmsHPROFILE profile, char **errmsg)
 	return true;
 }
 
+static struct wl_list *
+md5_bucket(struct weston_color_manager_lcms *cm,
+	   const struct cmlcms_md5_sum *md5sum)
+{
+	uint32_t h;
+
+	/* MD5 is uniformly distributed, any of its bytes will do. */
+	memcpy(&h, md5sum->bytes, sizeof h);
+
+	return &cm->color_profile_hash[h % CMLCMS_HASH_BUCKETS];
+}
+
 static struct cmlcms_color_profile *
-cmlcms_find_color_profile_by_md5(const struct weston_color_manager_lcms *cm,
+cmlcms_find_color_profile_by_md5(struct weston_color_manager_lcms *cm,
 				 const struct cmlcms_md5_sum *md5sum)
 {
 	struct cmlcms_color_profile *cprof;
 
-	wl_list_for_each(cprof, &cm->color_profile_list, link) {
+	wl_list_for_each(cprof, md5_bucket(cm, md5sum), hash_link) {
 		if (memcmp(cprof->md5sum.bytes,
 			   md5sum->bytes, sizeof(md5sum->bytes)) == 0)
 			return cprof;
@@ -328,6 +340,7 @@ cmlcms_color_profile_create(struct weston_color_manager_lcms *cm,
 	cprof->profile = profile;
 	cmsGetHeaderProfileID(profile, cprof->md5sum.bytes);
 	wl_list_insert(&cm->color_profile_list, &cprof->link);
+	wl_list_insert(md5_bucket(cm, &cprof->md5sum), &cprof->hash_link);
 
 	weston_log_scope_printf(cm->profiles_scope,
 				"New color profile: %p\n", cprof);
@@ -345,6 +358,7 @@ cmlcms_color_profile_destroy(struct cmlcms_color_profile *cprof)
 	struct weston_color_manager_lcms *cm = get_cmlcms(cprof->base.cm);
 
 	wl_list_remove(&cprof->link);
+	wl_list_remove(&cprof->hash_link);
 	cmsFreeToneCurveTriple(cprof->vcgt);
 	cmsFreeToneCurveTriple(cprof->eotf);
 	cmsFreeToneCurveTriple(cprof->output_inv_eotf_vcgt);
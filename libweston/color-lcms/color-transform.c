@@ -27,6 +27,12 @@
 #include "config.h"
 
 #include <assert.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
 #include <libweston/libweston.h>
 #include <lcms2_plugin.h>
 
@@ -143,6 +149,11 @@ cmlcms_fill_in_3dlut(struct weston_color_transform *xform_base,
 	assert(xform->search_key.category == CMLCMS_CATEGORY_INPUT_TO_BLEND ||
 	       xform->search_key.category == CMLCMS_CATEGORY_INPUT_TO_OUTPUT);
 
+	if (xform->lut3d && len == cmlcms_reasonable_3D_points()) {
+		memcpy(lut, xform->lut3d, 3 * len * len * len * sizeof *lut);
+		return;
+	}
+
 	for (value_b = 0; value_b < len; value_b++) {
 		for (value_g = 0; value_g < len; value_g++) {
 			for (value_r = 0; value_r < len; value_r++) {
@@ -166,7 +177,24 @@ cmlcms_color_transform_destroy(struct cmlcms_color_transform *xform)
 {
 	struct weston_color_manager_lcms *cm = get_cmlcms(xform->base.cm);
 
+	assert(!xform->on_worker);
+
+	wl_signal_emit(&xform->base.destroy_signal, &xform->base);
+
 	wl_list_remove(&xform->link);
+	wl_list_remove(&xform->hash_link);
+	if (!wl_list_empty(&xform->unused_link))
+		cm->unused_transform_count--;
+	wl_list_remove(&xform->unused_link);
+
+	/* The worker still owns the precise one, it is dropped when done. */
+	if (xform->pending)
+		xform->pending->approx = NULL;
+	if (xform->approx)
+		xform->approx->pending = NULL;
+
+	free(xform->lut3d);
+	free(xform->worker_error);
 
 	cmsFreeToneCurveTriple(xform->pre_curve);
 
@@ -710,6 +738,21 @@ pipeline_print(cmsPipeline **lut, cmsContext context_id,
 	}
 }
 
+static cmsBool
+transform_factory_decline(struct cmlcms_color_transform *xform,
+			  const char *reason)
+{
+	/* Logged by the main thread once the worker is done. */
+	if (xform->on_worker) {
+		if (!xform->worker_decline)
+			xform->worker_decline = reason;
+		return FALSE;
+	}
+
+	weston_log("color-lcms debug: %s.", reason);
+	return FALSE;
+}
+
 /** LittleCMS transform plugin entry point
  *
  * This function is called by LittleCMS when it is creating a new
@@ -764,29 +807,30 @@ transform_factory(_cmsTransform2Fn *xform_fn,
 	cmsContext context_id;
 	bool ret;
 
-	if (T_CHANNELS(*input_format) != 3) {
-		weston_log("color-lcms debug: input format is not 3-channel.");
-		return FALSE;
-	}
-	if (T_CHANNELS(*output_format) != 3) {
-		weston_log("color-lcms debug: output format is not 3-channel.");
-		return FALSE;
-	}
-	if (!T_FLOAT(*input_format)) {
-		weston_log("color-lcms debug: input format is not float.");
-		return FALSE;
-	}
-	if (!T_FLOAT(*output_format)) {
-		weston_log("color-lcms debug: output format is not float.");
-		return FALSE;
-	}
 	context_id = cmsGetPipelineContextID(*lut);
 	assert(context_id);
 	xform = cmsGetContextUserData(context_id);
 	assert(xform);
 
+	if (T_CHANNELS(*input_format) != 3)
+		return transform_factory_decline(xform,
+						 "input format is not 3-channel");
+	if (T_CHANNELS(*output_format) != 3)
+		return transform_factory_decline(xform,
+						 "output format is not 3-channel");
+	if (!T_FLOAT(*input_format))
+		return transform_factory_decline(xform,
+						 "input format is not float");
+	if (!T_FLOAT(*output_format))
+		return transform_factory_decline(xform,
+						 "output format is not float");
+
 	cm = get_cmlcms(xform->base.cm);
 
+	/* Log scopes belong to the main thread. */
+	if (xform->on_worker)
+		return optimize_float_pipeline(lut, context_id, xform);
+
 	/* Print pipeline before optimization */
 	weston_log_scope_printf(cm->optimizer_scope,
 				"  transform pipeline before optimization:\n");
@@ -826,6 +870,13 @@ lcms_xform_error_logger(cmsContext context_id,
 	in = xform->search_key.input_profile;
 	out = xform->search_key.output_profile;
 
+	if (xform->on_worker) {
+		/* Logged by the main thread once the worker is done. */
+		if (!xform->worker_error)
+			str_printf(&xform->worker_error, "%s", text);
+		return;
+	}
+
 	weston_log("LittleCMS error with color transformation from "
 		   "'%s' to '%s', %s: %s\n",
 		   in ? in->base.description : "(none)",
@@ -852,45 +903,48 @@ profile_from_rgb_curves(cmsContext ctx, cmsToneCurve *const curveset[3])
 static bool
 xform_realize_chain(struct cmlcms_color_transform *xform)
 {
-	struct weston_color_manager_lcms *cm = get_cmlcms(xform->base.cm);
 	struct cmlcms_color_profile *output_profile = xform->search_key.output_profile;
 	cmsHPROFILE chain[5];
 	unsigned chain_len = 0;
 	cmsHPROFILE extra = NULL;
 
+	/**
+	 * Binding to our LittleCMS plug-in occurs here.
+	 * If you want to disable the plug-in while debugging,
+	 * replace &transform_plugin with NULL.
+	 *
+	 * The context is private to this transformation, so that the
+	 * realization can run on the worker thread.
+	 */
+	xform->lcms_ctx = cmsCreateContext(&transform_plugin, xform);
+	abort_oom_if_null(xform->lcms_ctx);
+	cmsSetLogErrorHandlerTHR(xform->lcms_ctx, lcms_xform_error_logger);
+
 	chain[chain_len++] = xform->search_key.input_profile->profile;
 	chain[chain_len++] = output_profile->profile;
 
 	switch (xform->search_key.category) {
 	case CMLCMS_CATEGORY_INPUT_TO_BLEND:
 		/* Add linearization step to make blending well-defined. */
-		extra = profile_from_rgb_curves(cm->lcms_ctx, output_profile->eotf);
+		extra = profile_from_rgb_curves(xform->lcms_ctx,
+						output_profile->eotf);
 		chain[chain_len++] = extra;
 		break;
 	case CMLCMS_CATEGORY_INPUT_TO_OUTPUT:
 		/* Just add VCGT if it is provided. */
 		if (output_profile->vcgt[0]) {
-			extra = profile_from_rgb_curves(cm->lcms_ctx,
+			extra = profile_from_rgb_curves(xform->lcms_ctx,
 							output_profile->vcgt);
 			chain[chain_len++] = extra;
 		}
 		break;
 	case CMLCMS_CATEGORY_BLEND_TO_OUTPUT:
 		assert(0 && "category handled in the caller");
-		return false;
+		goto failed;
 	}
 
 	assert(chain_len <= ARRAY_LENGTH(chain));
 
-	/**
-	 * Binding to our LittleCMS plug-in occurs here.
-	 * If you want to disable the plug-in while debugging,
-	 * replace &transform_plugin with NULL.
-	 */
-	xform->lcms_ctx = cmsCreateContext(&transform_plugin, xform);
-	abort_oom_if_null(xform->lcms_ctx);
-	cmsSetLogErrorHandlerTHR(xform->lcms_ctx, lcms_xform_error_logger);
-
 	assert(xform->status == CMLCMS_TRANSFORM_FAILED);
 	/* transform_factory() is invoked by this call. */
 	xform->cmap_3dlut = cmsCreateMultiprofileTransformTHR(xform->lcms_ctx,
@@ -953,21 +1007,449 @@ cmlcms_color_transform_search_param_string(const struct cmlcms_color_transform_s
 	return str;
 }
 
+static struct wl_list *
+search_param_bucket(struct weston_color_manager_lcms *cm,
+		    const struct cmlcms_color_transform_search_param *param)
+{
+	uint64_t h;
+
+	h = (uintptr_t)param->input_profile;
+	h = h * 31 + (uintptr_t)param->output_profile;
+	h = h * 31 + param->category;
+	h = h * 31 + param->intent_output;
+
+	/* Profiles are heap pointers, fold the low alignment bits away. */
+	h ^= h >> 29;
+	h *= 0x9e3779b97f4a7c15ull;
+
+	return &cm->color_transform_hash[(h >> 32) % CMLCMS_HASH_BUCKETS];
+}
+
 static struct cmlcms_color_transform *
-cmlcms_color_transform_create(struct weston_color_manager_lcms *cm,
-			      const struct cmlcms_color_transform_search_param *search_param)
+cmlcms_color_transform_alloc(struct weston_color_manager_lcms *cm,
+			     const struct cmlcms_color_transform_search_param *search_param)
 {
 	struct cmlcms_color_transform *xform;
-	const char *err_msg;
-	char *str;
 
 	xform = xzalloc(sizeof *xform);
 	weston_color_transform_init(&xform->base, &cm->base);
 	wl_list_init(&xform->link);
+	wl_list_init(&xform->hash_link);
+	wl_list_init(&xform->unused_link);
+	wl_list_init(&xform->worker_link);
 	xform->search_key = *search_param;
 	xform->search_key.input_profile = ref_cprof(search_param->input_profile);
 	xform->search_key.output_profile = ref_cprof(search_param->output_profile);
 
+	return xform;
+}
+
+static void
+cmlcms_color_transform_insert(struct weston_color_manager_lcms *cm,
+			      struct cmlcms_color_transform *xform)
+{
+	wl_list_insert(&cm->color_transform_list, &xform->link);
+	wl_list_insert(search_param_bucket(cm, &xform->search_key),
+		       &xform->hash_link);
+}
+
+static bool
+profile_get_rgb_to_xyz(cmsHPROFILE profile, cmsMAT3 *mat)
+{
+	static const cmsTagSignature tags[] = {
+		cmsSigRedColorantTag,
+		cmsSigGreenColorantTag,
+		cmsSigBlueColorantTag,
+	};
+	const cmsCIEXYZ *xyz;
+	unsigned c;
+
+	for (c = 0; c < 3; c++) {
+		xyz = cmsReadTag(profile, tags[c]);
+		if (!xyz)
+			return false;
+
+		mat->v[0].n[c] = xyz->X;
+		mat->v[1].n[c] = xyz->Y;
+		mat->v[2].n[c] = xyz->Z;
+	}
+
+	return true;
+}
+
+/**
+ * Make a cheap stand-in for a transformation being realized
+ *
+ * Uses only the matrix-shaper part of the profiles: input TRC, input
+ * colorants, inverse output colorants and, for INPUT_TO_OUTPUT, the output
+ * inverse EOTF + VCGT. This ignores any LUT-based parts the real
+ * transformation would use, but is close enough for a few frames.
+ */
+static bool
+xform_set_approximation(struct cmlcms_color_transform *xform)
+{
+	static const cmsTagSignature trc_tags[] = {
+		cmsSigRedTRCTag, cmsSigGreenTRCTag, cmsSigBlueTRCTag
+	};
+	struct cmlcms_color_profile *in = xform->search_key.input_profile;
+	struct cmlcms_color_profile *out = xform->search_key.output_profile;
+	cmsMAT3 in_mat, out_mat, out_inv, mat;
+	const cmsToneCurve *trc;
+	unsigned c, r;
+
+	if (!profile_get_rgb_to_xyz(in->profile, &in_mat) ||
+	    !profile_get_rgb_to_xyz(out->profile, &out_mat) ||
+	    !_cmsMAT3inverse(&out_mat, &out_inv))
+		return false;
+
+	_cmsMAT3per(&mat, &out_inv, &in_mat);
+
+	for (c = 0; c < 3; c++) {
+		trc = cmsReadTag(in->profile, trc_tags[c]);
+		if (!trc)
+			goto fail;
+
+		xform->pre_curve[c] = cmsDupToneCurve(trc);
+		abort_oom_if_null(xform->pre_curve[c]);
+	}
+
+	xform->base.pre_curve.type = WESTON_COLOR_CURVE_TYPE_LUT_3x1D;
+	xform->base.pre_curve.u.lut_3x1d.fill_in = cmlcms_fill_in_pre_curve;
+	xform->base.pre_curve.u.lut_3x1d.optimal_len =
+		cmlcms_reasonable_1D_points();
+
+	/* Column-major, like translate_matrix_element(). */
+	xform->base.mapping.type = WESTON_COLOR_MAPPING_TYPE_MATRIX;
+	for (c = 0; c < 3; c++)
+		for (r = 0; r < 3; r++)
+			xform->base.mapping.u.mat.matrix[c * 3 + r] =
+				mat.v[r].n[c];
+
+	xform->base.post_curve.type = WESTON_COLOR_CURVE_TYPE_IDENTITY;
+	if (xform->search_key.category == CMLCMS_CATEGORY_INPUT_TO_OUTPUT) {
+		for (c = 0; c < 3; c++) {
+			xform->post_curve[c] =
+				cmsDupToneCurve(out->output_inv_eotf_vcgt[c]);
+			abort_oom_if_null(xform->post_curve[c]);
+		}
+		xform->base.post_curve.type = WESTON_COLOR_CURVE_TYPE_LUT_3x1D;
+		xform->base.post_curve.u.lut_3x1d.fill_in =
+			cmlcms_fill_in_post_curve;
+		xform->base.post_curve.u.lut_3x1d.optimal_len =
+			cmlcms_reasonable_1D_points();
+	}
+
+	xform->status = CMLCMS_TRANSFORM_OPTIMIZED;
+
+	return true;
+
+fail:
+	cmsFreeToneCurveTriple(xform->pre_curve);
+	memset(xform->pre_curve, 0, sizeof xform->pre_curve);
+
+	return false;
+}
+
+static void *
+cmlcms_worker_thread(void *data)
+{
+	struct weston_color_manager_lcms *cm = data;
+	struct cmlcms_color_transform *xform;
+	unsigned len = cmlcms_reasonable_3D_points();
+	uint64_t one = 1;
+	ssize_t ret;
+	float *lut;
+	bool ok;
+
+	pthread_mutex_lock(&cm->worker.mutex);
+	for (;;) {
+		while (!cm->worker.stop && wl_list_empty(&cm->worker.queue))
+			pthread_cond_wait(&cm->worker.work_cond,
+					  &cm->worker.mutex);
+		if (cm->worker.stop)
+			break;
+
+		xform = wl_container_of(cm->worker.queue.next, xform,
+					worker_link);
+		wl_list_remove(&xform->worker_link);
+		pthread_mutex_unlock(&cm->worker.mutex);
+
+		ok = xform_realize_chain(xform);
+		if (ok && xform->status == CMLCMS_TRANSFORM_3DLUT) {
+			lut = xzalloc(3 * len * len * len * sizeof *lut);
+			cmlcms_fill_in_3dlut(&xform->base, lut, len);
+			xform->lut3d = lut;
+		}
+
+		pthread_mutex_lock(&cm->worker.mutex);
+		xform->realized = true;
+		xform->realized_ok = ok;
+		wl_list_insert(cm->worker.done.prev, &xform->worker_link);
+		pthread_cond_broadcast(&cm->worker.done_cond);
+
+		/* Fails only on counter overflow, a wakeup is pending then. */
+		ret = write(cm->worker.eventfd, &one, sizeof one);
+		(void)ret;
+	}
+	pthread_mutex_unlock(&cm->worker.mutex);
+
+	return NULL;
+}
+
+/** Swap in a transformation the worker has realized
+ *
+ * The precise transformation takes over the approximation's place in the
+ * cache, and every paint node still using the approximation is sent back to
+ * the color manager, with its surface damaged.
+ */
+static void
+cmlcms_color_transform_finish(struct weston_color_manager_lcms *cm,
+			      struct cmlcms_color_transform *xform)
+{
+	struct cmlcms_color_transform *approx = xform->approx;
+	char *str;
+
+	xform->on_worker = false;
+
+	if (xform->worker_decline)
+		weston_log("color-lcms debug: %s.", xform->worker_decline);
+
+	if (xform->worker_error)
+		weston_log("LittleCMS error with color transformation %p: %s\n",
+			   xform, xform->worker_error);
+
+	if (!xform->realized_ok) {
+		/*
+		 * Realizing synchronously would have failed just the same,
+		 * the approximation is the best we can do.
+		 */
+		weston_log("color-lcms error: failed to realize a color "
+			   "transformation, keeping its approximation.\n");
+		cmlcms_color_transform_destroy(xform);
+		return;
+	}
+
+	cmlcms_color_transform_insert(cm, xform);
+
+	weston_log_scope_printf(cm->transforms_scope,
+				"Realized color transformation %p for %p\n",
+				xform, approx);
+	str = weston_color_transform_string(&xform->base);
+	weston_log_scope_printf(cm->transforms_scope, "  %s", str);
+	free(str);
+
+	if (approx) {
+		approx->pending = NULL;
+		xform->approx = NULL;
+
+		wl_list_remove(&approx->hash_link);
+		wl_list_init(&approx->hash_link);
+		approx->superseded = true;
+
+		if (approx->base.ref_count == 0)
+			cmlcms_color_transform_destroy(approx);
+		else
+			weston_color_transform_replaced(&approx->base);
+	}
+
+	/* Nobody uses it yet, keep it around for the next lookup. */
+	weston_color_transform_unref(&xform->base);
+}
+
+static void
+cmlcms_worker_dispatch(struct weston_color_manager_lcms *cm)
+{
+	struct cmlcms_color_transform *xform;
+	struct wl_list done;
+
+	wl_list_init(&done);
+
+	pthread_mutex_lock(&cm->worker.mutex);
+	wl_list_insert_list(&done, &cm->worker.done);
+	wl_list_init(&cm->worker.done);
+	pthread_mutex_unlock(&cm->worker.mutex);
+
+	while (!wl_list_empty(&done)) {
+		xform = wl_container_of(done.next, xform, worker_link);
+		wl_list_remove(&xform->worker_link);
+		wl_list_init(&xform->worker_link);
+		cmlcms_color_transform_finish(cm, xform);
+	}
+}
+
+static int
+cmlcms_worker_handle_event(int fd, uint32_t mask, void *data)
+{
+	struct weston_color_manager_lcms *cm = data;
+	uint64_t count;
+
+	if (read(fd, &count, sizeof count) < 0 && errno != EAGAIN)
+		weston_log("color-lcms: reading worker eventfd failed: %s\n",
+			   strerror(errno));
+
+	cmlcms_worker_dispatch(cm);
+
+	return 0;
+}
+
+static bool
+cmlcms_worker_start(struct weston_color_manager_lcms *cm)
+{
+	struct wl_event_loop *loop;
+	const char *env;
+
+	if (cm->worker.running)
+		return true;
+	if (cm->worker.disabled)
+		return false;
+
+	env = getenv("WESTON_COLOR_LCMS_SYNC");
+	if (env && strcmp(env, "1") == 0)
+		goto disable;
+
+	cm->worker.eventfd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (cm->worker.eventfd < 0)
+		goto disable;
+
+	loop = wl_display_get_event_loop(cm->base.compositor->wl_display);
+	cm->worker.source = wl_event_loop_add_fd(loop, cm->worker.eventfd,
+						 WL_EVENT_READABLE,
+						 cmlcms_worker_handle_event,
+						 cm);
+	if (!cm->worker.source)
+		goto err_fd;
+
+	pthread_mutex_init(&cm->worker.mutex, NULL);
+	pthread_cond_init(&cm->worker.work_cond, NULL);
+	pthread_cond_init(&cm->worker.done_cond, NULL);
+	wl_list_init(&cm->worker.queue);
+	wl_list_init(&cm->worker.done);
+	cm->worker.stop = false;
+
+	if (pthread_create(&cm->worker.thread, NULL,
+			   cmlcms_worker_thread, cm) != 0) {
+		pthread_cond_destroy(&cm->worker.done_cond);
+		pthread_cond_destroy(&cm->worker.work_cond);
+		pthread_mutex_destroy(&cm->worker.mutex);
+		wl_event_source_remove(cm->worker.source);
+		goto err_fd;
+	}
+
+	cm->worker.running = true;
+
+	return true;
+
+err_fd:
+	close(cm->worker.eventfd);
+disable:
+	cm->worker.disabled = true;
+	return false;
+}
+
+void
+cmlcms_worker_fini(struct weston_color_manager_lcms *cm)
+{
+	struct cmlcms_color_transform *xform, *tmp;
+
+	if (!cm->worker.running)
+		return;
+
+	pthread_mutex_lock(&cm->worker.mutex);
+	cm->worker.stop = true;
+	pthread_cond_signal(&cm->worker.work_cond);
+	pthread_mutex_unlock(&cm->worker.mutex);
+	pthread_join(cm->worker.thread, NULL);
+
+	wl_list_insert_list(&cm->worker.done, &cm->worker.queue);
+	wl_list_for_each_safe(xform, tmp, &cm->worker.done, worker_link) {
+		wl_list_remove(&xform->worker_link);
+		wl_list_init(&xform->worker_link);
+		xform->on_worker = false;
+		cmlcms_color_transform_destroy(xform);
+	}
+
+	wl_event_source_remove(cm->worker.source);
+	close(cm->worker.eventfd);
+	pthread_cond_destroy(&cm->worker.done_cond);
+	pthread_cond_destroy(&cm->worker.work_cond);
+	pthread_mutex_destroy(&cm->worker.mutex);
+	cm->worker.running = false;
+}
+
+/** Block until the worker has realized a given transformation */
+static void
+cmlcms_worker_wait(struct weston_color_manager_lcms *cm,
+		   struct cmlcms_color_transform *xform)
+{
+	pthread_mutex_lock(&cm->worker.mutex);
+	while (!xform->realized)
+		pthread_cond_wait(&cm->worker.done_cond, &cm->worker.mutex);
+	pthread_mutex_unlock(&cm->worker.mutex);
+
+	cmlcms_worker_dispatch(cm);
+}
+
+/**
+ * Realize a transformation in the background if it is worth it
+ *
+ * Only transformations that LittleCMS would build from a CLUT are slow
+ * enough to bother, and the approximation needs matrix-shaper tags on both
+ * profiles. Debugging the optimizer needs the main thread for logging, so
+ * that disables the worker too.
+ */
+static bool
+cmlcms_color_transform_start_async(struct weston_color_manager_lcms *cm,
+				   struct cmlcms_color_transform *approx)
+{
+	struct cmlcms_color_profile *in = approx->search_key.input_profile;
+	struct cmlcms_color_profile *out = approx->search_key.output_profile;
+	cmsUInt32Number intent = approx->search_key.intent_output;
+	struct cmlcms_color_transform *xform;
+
+	if (weston_log_scope_is_enabled(cm->optimizer_scope))
+		return false;
+
+	if (!cmsIsCLUT(in->profile, intent, LCMS_USED_AS_INPUT) &&
+	    !cmsIsCLUT(out->profile, intent, LCMS_USED_AS_OUTPUT))
+		return false;
+
+	if (!cmsIsMatrixShaper(in->profile) || !cmsIsMatrixShaper(out->profile))
+		return false;
+
+	if (!cmlcms_worker_start(cm))
+		return false;
+
+	if (!xform_set_approximation(approx))
+		return false;
+
+	xform = cmlcms_color_transform_alloc(cm, &approx->search_key);
+	xform->approx = approx;
+	xform->on_worker = true;
+	approx->pending = xform;
+
+	weston_log_scope_printf(cm->transforms_scope,
+				"  approximated, realizing %p in the background\n",
+				xform);
+
+	pthread_mutex_lock(&cm->worker.mutex);
+	wl_list_insert(cm->worker.queue.prev, &xform->worker_link);
+	pthread_cond_signal(&cm->worker.work_cond);
+	pthread_mutex_unlock(&cm->worker.mutex);
+
+	return true;
+}
+
+static struct cmlcms_color_transform *
+cmlcms_color_transform_create(struct weston_color_manager_lcms *cm,
+			      const struct cmlcms_color_transform_search_param *search_param,
+			      bool allow_async)
+{
+	struct cmlcms_color_transform *xform;
+	const char *err_msg;
+	char *str;
+
+	xform = cmlcms_color_transform_alloc(cm, search_param);
+
 	weston_log_scope_printf(cm->transforms_scope,
 				"New color transformation: %p\n", xform);
 	str = cmlcms_color_transform_search_param_string(&xform->search_key);
@@ -995,6 +1477,10 @@ cmlcms_color_transform_create(struct weston_color_manager_lcms *cm,
 	switch (search_param->category) {
 	case CMLCMS_CATEGORY_INPUT_TO_BLEND:
 	case CMLCMS_CATEGORY_INPUT_TO_OUTPUT:
+		if (allow_async &&
+		    cmlcms_color_transform_start_async(cm, xform))
+			break;
+
 		if (!xform_realize_chain(xform)) {
 			err_msg = "xform_realize_chain failed";
 			goto error;
@@ -1009,7 +1495,7 @@ cmlcms_color_transform_create(struct weston_color_manager_lcms *cm,
 		break;
 	}
 
-	wl_list_insert(&cm->color_transform_list, &xform->link);
+	cmlcms_color_transform_insert(cm, xform);
 	assert(xform->status != CMLCMS_TRANSFORM_FAILED);
 
 	str = weston_color_transform_string(&xform->base);
@@ -1040,22 +1526,132 @@ transform_matches_params(const struct cmlcms_color_transform *xform,
 	return true;
 }
 
-struct cmlcms_color_transform *
-cmlcms_color_transform_get(struct weston_color_manager_lcms *cm,
-			   const struct cmlcms_color_transform_search_param *param)
+static struct cmlcms_color_transform *
+color_transform_lookup(struct weston_color_manager_lcms *cm,
+		       const struct cmlcms_color_transform_search_param *param)
 {
 	struct cmlcms_color_transform *xform;
 
-	wl_list_for_each(xform, &cm->color_transform_list, link) {
-		if (transform_matches_params(xform, param)) {
-			weston_color_transform_ref(&xform->base);
+	wl_list_for_each(xform, search_param_bucket(cm, param), hash_link) {
+		if (transform_matches_params(xform, param))
 			return xform;
+	}
+
+	return NULL;
+}
+
+static struct cmlcms_color_transform *
+color_transform_get(struct weston_color_manager_lcms *cm,
+		    const struct cmlcms_color_transform_search_param *param,
+		    bool allow_async)
+{
+	struct cmlcms_color_transform *xform;
+
+	xform = color_transform_lookup(cm, param);
+
+	if (xform && xform->pending && !allow_async) {
+		/* Swaps in the precise transformation. */
+		cmlcms_worker_wait(cm, xform->pending);
+		xform = color_transform_lookup(cm, param);
+	}
+
+	if (xform) {
+		if (xform->base.ref_count == 0) {
+			/*
+			 * Revive a released transformation. Its destroy
+			 * signal has not been emitted, so the LittleCMS
+			 * pipeline and the renderer state attached to it,
+			 * such as an uploaded 3D LUT, are reused as is.
+			 */
+			wl_list_remove(&xform->unused_link);
+			wl_list_init(&xform->unused_link);
+			cm->unused_transform_count--;
+			xform->base.ref_count = 1;
+		} else {
+			weston_color_transform_ref(&xform->base);
 		}
+
+		return xform;
 	}
 
-	xform = cmlcms_color_transform_create(cm, param);
+	xform = cmlcms_color_transform_create(cm, param, allow_async);
 	if (!xform)
 		weston_log("color-lcms error: failed to create a color transformation.\n");
 
 	return xform;
 }
+
+/** Get a fully realized color transformation
+ *
+ * Creating a new transformation realizes it synchronously. If the worker is
+ * still realizing one for the same parameters, this waits for it.
+ */
+struct cmlcms_color_transform *
+cmlcms_color_transform_get(struct weston_color_manager_lcms *cm,
+			   const struct cmlcms_color_transform_search_param *param)
+{
+	return color_transform_get(cm, param, false);
+}
+
+/** Get a color transformation, possibly an approximation
+ *
+ * When creating the transformation would need an expensive 3D LUT, this
+ * returns a matrix-shaper approximation right away and realizes the
+ * precise transformation on a worker thread. Once that is done, the users
+ * of the approximation are told to look up the transformation again via
+ * weston_color_transform_replaced().
+ */
+struct cmlcms_color_transform *
+cmlcms_color_transform_get_async(struct weston_color_manager_lcms *cm,
+				 const struct cmlcms_color_transform_search_param *param)
+{
+	return color_transform_get(cm, param, true);
+}
+
+/** Release a color transformation nobody references anymore
+ *
+ * Rather than destroying it, the transformation is kept on the unused list
+ * so that cmlcms_color_transform_get() can revive it, along with whatever
+ * renderers attached to it. Only the
+ * least recently released ones beyond CMLCMS_UNUSED_TRANSFORMS_MAX are
+ * destroyed.
+ */
+void
+cmlcms_color_transform_release(struct cmlcms_color_transform *xform)
+{
+	struct weston_color_manager_lcms *cm = get_cmlcms(xform->base.cm);
+	struct cmlcms_color_transform *oldest;
+
+	assert(xform->base.ref_count == 0);
+
+	if (xform->superseded) {
+		cmlcms_color_transform_destroy(xform);
+		return;
+	}
+
+	wl_list_insert(&cm->unused_transform_list, &xform->unused_link);
+	cm->unused_transform_count++;
+
+	weston_log_scope_printf(cm->transforms_scope,
+				"Released color transformation %p, "
+				"%u kept for reuse.\n", xform,
+				cm->unused_transform_count);
+
+	while (cm->unused_transform_count > CMLCMS_UNUSED_TRANSFORMS_MAX) {
+		oldest = wl_container_of(cm->unused_transform_list.prev,
+					 oldest, unused_link);
+		cmlcms_color_transform_destroy(oldest);
+	}
+}
+
+void
+cmlcms_color_transform_flush_unused(struct weston_color_manager_lcms *cm)
+{
+	struct cmlcms_color_transform *xform, *tmp;
+
+	wl_list_for_each_safe(xform, tmp, &cm->unused_transform_list,
+			      unused_link)
+		cmlcms_color_transform_destroy(xform);
+
+	assert(cm->unused_transform_count == 0);
+}
@@ -134,6 +134,9 @@ weston_color_transform_ref(struct weston_color_transform *xform)
  * Decrease and potentially destroy the color transform object
  *
  * \param xform The color transform. NULL is accepted too.
+ *
+ * The color manager may keep an unreferenced transform around for reuse.
+ * destroy_signal is only emitted when it really goes away.
  */
 WL_EXPORT void
 weston_color_transform_unref(struct weston_color_transform *xform)
@@ -145,7 +148,6 @@ weston_color_transform_unref(struct weston_color_transform *xform)
 	if (--xform->ref_count > 0)
 		return;
 
-	wl_signal_emit(&xform->destroy_signal, xform);
 	xform->cm->destroy_color_transform(xform);
 }
 
@@ -255,6 +257,7 @@ weston_surface_color_transform_copy(struct weston_surface_color_transform *dst,
 {
 	*dst = *src;
 	dst->transform = weston_color_transform_ref(src->transform);
+	dst->to_output = weston_color_transform_ref(src->to_output);
 }
 
 /** Unref contents */
@@ -263,6 +266,9 @@ weston_surface_color_transform_fini(struct weston_surface_color_transform *surf_
 {
 	weston_color_transform_unref(surf_xform->transform);
 	surf_xform->transform = NULL;
+	weston_color_transform_unref(surf_xform->to_output);
+	surf_xform->to_output = NULL;
+	surf_xform->to_output_tried = false;
 	surf_xform->identity_pipeline = false;
 }
 
@@ -314,6 +320,80 @@ weston_paint_node_ensure_color_transform(struct weston_paint_node *pnode)
 	}
 }
 
+/**
+ * Ensure the direct surface to output color transformation of a paint node
+ *
+ * \param pnode Paint node defining the surface and the output. All
+ * paint nodes with the same surface and output will be ensured.
+ * \return The transformation, or NULL if the color manager has none.
+ *
+ * Building the transformation can be costly, so renderers call this only
+ * once they know they can use it. The color manager is asked at most once
+ * until the surface color transformation is invalidated.
+ */
+WL_EXPORT struct weston_color_transform *
+weston_paint_node_ensure_to_output_color_transform(struct weston_paint_node *pnode)
+{
+	struct weston_surface *surface = pnode->surface;
+	struct weston_output *output = pnode->output;
+	struct weston_color_manager *cm = surface->compositor->color_manager;
+	struct weston_color_transform *xform = NULL;
+	struct weston_paint_node *it;
+
+	if (!pnode->surf_xform_valid || pnode->surf_xform.to_output_tried)
+		return pnode->surf_xform.to_output;
+
+	if (cm->get_surface_to_output_color_transform &&
+	    !cm->get_surface_to_output_color_transform(cm, surface, output,
+							&xform))
+		xform = NULL;
+
+	wl_list_for_each(it, &surface->paint_node_list, surface_link) {
+		if (it->output == output) {
+			assert(it->surf_xform.to_output == NULL);
+			it->surf_xform.to_output =
+				weston_color_transform_ref(xform);
+			it->surf_xform.to_output_tried = true;
+		}
+	}
+
+	weston_color_transform_unref(xform);
+
+	return pnode->surf_xform.to_output;
+}
+
+/**
+ * Drop all paint node references to a superseded color transformation
+ *
+ * \param xform The color transformation that has been replaced.
+ *
+ * A color manager calls this when a better transformation has become
+ * available for the same parameters, e.g. after realizing it in the
+ * background. The affected paint nodes ask the color manager again on the
+ * next repaint, and their surfaces are damaged to get that repaint.
+ *
+ * This may release the last reference to \c xform.
+ */
+WL_EXPORT void
+weston_color_transform_replaced(struct weston_color_transform *xform)
+{
+	struct weston_compositor *compositor = xform->cm->compositor;
+	struct weston_output *output;
+	struct weston_paint_node *pnode;
+
+	wl_list_for_each(output, &compositor->output_list, link) {
+		wl_list_for_each(pnode, &output->paint_node_list, output_link) {
+			if (pnode->surf_xform.transform != xform &&
+			    pnode->surf_xform.to_output != xform)
+				continue;
+
+			weston_surface_color_transform_fini(&pnode->surf_xform);
+			pnode->surf_xform_valid = false;
+			weston_surface_damage(pnode->surface);
+		}
+	}
+}
+
 /**
  * Load ICC profile file
  *
@@ -236,6 +236,17 @@ struct weston_surface_color_transform {
 	/** Transformation from source to blending space */
 	struct weston_color_transform *transform;
 
+	/**
+	 * Transformation from source straight to the output color space,
+	 * or NULL. Renderers may use this instead of transform followed by
+	 * weston_output_color_outcome::from_blend_to_output when nothing
+	 * gets blended. Only created on demand, see
+	 * weston_paint_node_ensure_to_output_color_transform().
+	 */
+	struct weston_color_transform *to_output;
+	/** The color manager has been asked for to_output already */
+	bool to_output_tried;
+
 	/** True, if source colorspace is identical to monitor color space */
 	bool identity_pipeline;
 };
@@ -287,7 +298,12 @@ struct weston_color_manager {
 				      struct weston_color_profile **cprof_out,
 				      char **errmsg);
 
-	/** Destroy a color transform after refcount fell to zero */
+	/** Destroy a color transform after refcount fell to zero
+	 *
+	 * The color manager may also keep it for reuse. Either way, it must
+	 * emit weston_color_transform::destroy_signal right before freeing
+	 * the object.
+	 */
 	void
 	(*destroy_color_transform)(struct weston_color_transform *xform);
 
@@ -308,6 +324,23 @@ struct weston_color_manager {
 				       struct weston_output *output,
 				       struct weston_surface_color_transform *surf_xform);
 
+	/** Get surface to output's color space transformation
+	 *
+	 * \param cm The color manager.
+	 * \param surface The surface for the source color space.
+	 * \param output The output for the destination color space.
+	 * \param xform_out On success, a new reference to the transformation
+	 * is stored here.
+	 * \return True on success, false if not available.
+	 *
+	 * Optional, NULL if the color manager never offers one.
+	 */
+	bool
+	(*get_surface_to_output_color_transform)(struct weston_color_manager *cm,
+						 struct weston_surface *surface,
+						 struct weston_output *output,
+						 struct weston_color_transform **xform_out);
+
 	/** Compute derived color properties for an output
 	 *
 	 * \param cm The color manager.
@@ -352,6 +385,12 @@ struct weston_paint_node;
 void
 weston_paint_node_ensure_color_transform(struct weston_paint_node *pnode);
 
+struct weston_color_transform *
+weston_paint_node_ensure_to_output_color_transform(struct weston_paint_node *pnode);
+
+void
+weston_color_transform_replaced(struct weston_color_transform *xform);
+
 struct weston_color_manager *
 weston_color_manager_noop_create(struct weston_compositor *compositor);
 
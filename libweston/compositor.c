@@ -55,6 +55,10 @@
 #include <drm_fourcc.h>
 
 #include "timeline.h"
+#include "client-stats.h"
+#include "frame-stats.h"
+#include "memory-stats.h"
+#include "profiler.h"
 
 #include <libweston/libweston.h>
 #include <libweston/weston-log.h>
@@ -154,8 +158,14 @@ paint_node_update(struct weston_paint_node *pnode)
 	bool output_dirty = pnode->status & PAINT_NODE_OUTPUT_DIRTY;
 
 	if (view_dirty || output_dirty) {
+		struct weston_matrix old = *mat;
+
 		weston_view_buffer_to_output_matrix(pnode->view,
 						    pnode->output, mat);
+		if (memcmp(old.d, mat->d, sizeof old.d) != 0 ||
+		    old.type != mat->type)
+			pnode->geometry_serial++;
+
 		weston_matrix_invert(&pnode->output_to_buffer_matrix, mat);
 		pnode->needs_filtering = weston_matrix_needs_filtering(mat);
 
@@ -206,6 +216,7 @@ weston_paint_node_create(struct weston_surface *surface,
 	wl_list_insert(&output->paint_node_list, &pnode->output_link);
 
 	wl_list_init(&pnode->z_order_link);
+	wl_signal_init(&pnode->destroy_signal);
 
 	pnode->status = PAINT_NODE_ALL_DIRTY;
 	paint_node_update(pnode);
@@ -216,6 +227,8 @@ weston_paint_node_create(struct weston_surface *surface,
 static void
 weston_paint_node_destroy(struct weston_paint_node *pnode)
 {
+	wl_signal_emit(&pnode->destroy_signal, pnode);
+
 	assert(pnode->view->surface == pnode->surface);
 	wl_list_remove(&pnode->surface_link);
 	wl_list_remove(&pnode->view_link);
@@ -3161,14 +3174,22 @@ weston_output_repaint(struct weston_output *output)
 	uint32_t frame_time_msec;
 	enum weston_hdcp_protection highest_requested = WESTON_HDCP_DISABLE;
 	struct timespec now;
+	struct timespec stats_begin;
+	bool stats;
+	int paint_nodes = 0;
+	int64_t damage = 0;
 
 	if (output->destroying)
 		return 0;
 
 	TL_POINT(ec, "core_repaint_begin", TLP_OUTPUT(output), TLP_END);
+	weston_input_latency_repaint_begin(output);
+	stats = weston_frame_stats_start(ec, &stats_begin);
 
 	/* Rebuild the surface list and update surface transforms up front. */
+	WESTON_PROFILE_BEGIN(BUILD_VIEW_LIST);
 	weston_compositor_build_view_list(ec, output);
+	WESTON_PROFILE_END(ec, BUILD_VIEW_LIST);
 
 	if (ec->warm_up) {
 		weston_log("holding display for the first app...\n");
@@ -3195,7 +3216,9 @@ weston_output_repaint(struct weston_output *output)
 	output->desired_protection = highest_requested;
 
 	if (output->assign_planes && !output->disable_planes) {
+		WESTON_PROFILE_BEGIN(ASSIGN_PLANES);
 		output->assign_planes(output);
+		WESTON_PROFILE_END(ec, ASSIGN_PLANES);
 	} else {
 		wl_list_for_each(pnode, &output->paint_node_z_order_list,
 				 z_order_link) {
@@ -3223,7 +3246,9 @@ weston_output_repaint(struct weston_output *output)
 		}
 	}
 
+	WESTON_PROFILE_BEGIN(ACCUMULATE_DAMAGE);
 	output_accumulate_damage(output);
+	WESTON_PROFILE_END(ec, ACCUMULATE_DAMAGE);
 
 	pixman_region32_init(&output_damage);
 	pixman_region32_intersect(&output_damage,
@@ -3231,6 +3256,23 @@ weston_output_repaint(struct weston_output *output)
 	pixman_region32_subtract(&output_damage,
 				 &output_damage, &ec->primary_plane.clip);
 
+	if (stats) {
+		pixman_box32_t *rects;
+		int n_rects, i;
+
+		wl_list_for_each(pnode, &output->paint_node_z_order_list,
+				 z_order_link) {
+			if ((pnode->view->output_mask & (1u << output->id)) &&
+			    pnode->view->plane == &ec->primary_plane)
+				paint_nodes++;
+		}
+
+		rects = pixman_region32_rectangles(&output_damage, &n_rects);
+		for (i = 0; i < n_rects; i++)
+			damage += (int64_t)(rects[i].x2 - rects[i].x1) *
+				  (rects[i].y2 - rects[i].y1);
+	}
+
 	output->repaint_needed = false;
 	r = output->repaint(output, &output_damage);
 
@@ -3249,10 +3291,12 @@ weston_output_repaint(struct weston_output *output)
 
 	frame_time_msec = timespec_to_msec(&output->frame_time);
 
+	WESTON_PROFILE_BEGIN(CLIENT_EVENTS);
 	wl_resource_for_each_safe(cb, cnext, &frame_callback_list) {
 		wl_callback_send_done(cb, frame_time_msec);
 		wl_resource_destroy(cb);
 	}
+	WESTON_PROFILE_END(ec, CLIENT_EVENTS);
 
 	weston_compositor_read_presentation_clock(ec, &now);
 	wl_list_for_each_safe(animation, next, &output->animation_list, link) {
@@ -3264,6 +3308,10 @@ weston_output_repaint(struct weston_output *output)
 
 	TL_POINT(ec, "core_repaint_posted", TLP_OUTPUT(output), TLP_END);
 
+	if (stats)
+		weston_frame_stats_repaint(output, &stats_begin,
+					   paint_nodes, damage);
+
 	return r;
 }
 
@@ -3393,6 +3441,9 @@ output_repaint_timer_handler(void *data)
 	struct timespec now;
 	int ret = 0, repainted = 0;
 
+	/* Whatever request was dispatched last, its client is done now */
+	weston_client_stats_dispatch_end(compositor);
+
 	if (!access(getenv("WESTON_FREEZE_DISPLAY") ? : "", F_OK)) {
 		usleep(DEFAULT_REPAINT_WINDOW * 1000);
 		weston_compositor_build_view_list(compositor, NULL);
@@ -3510,6 +3561,7 @@ weston_output_finish_frame(struct weston_output *output,
 	 * timebase to work against, so any delay just wastes time. Push a
 	 * repaint as soon as possible so we can get on with it. */
 	if (!stamp) {
+		weston_input_latency_presented(output, NULL);
 		output->next_repaint = now;
 		goto out;
 	}
@@ -3519,17 +3571,30 @@ weston_output_finish_frame(struct weston_output *output,
 							 CLOCK_MONOTONIC);
 	TL_POINT(compositor, "core_repaint_finished", TLP_OUTPUT(output),
 		 TLP_VBLANK(&vblank_monotonic), TLP_END);
+	weston_input_latency_presented(output, &vblank_monotonic);
+	weston_frame_stats_presented(output, &vblank_monotonic);
 
 	refresh_nsec = millihz_to_nsec(output->current_mode->refresh);
+
+	/* With variable refresh the display has no constant refresh rate,
+	 * which the protocol expresses with a zero refresh. */
+	WESTON_PROFILE_BEGIN(CLIENT_EVENTS);
 	weston_presentation_feedback_present_list(&output->feedback_list,
-						  output, refresh_nsec, stamp,
-						  output->msc,
-						  presented_flags);
+						  output,
+						  (presented_flags & WESTON_FINISH_FRAME_VRR) ?
+						  0 : refresh_nsec,
+						  stamp, output->msc,
+						  presented_flags &
+						  ~WESTON_FINISH_FRAME_VRR);
+	WESTON_PROFILE_END(compositor, CLIENT_EVENTS);
 
 	output->frame_time = *stamp;
 
-	/* If we're tearing just repaint right away */
-	if (presented_flags & WESTON_FINISH_FRAME_TEARING) {
+	/* If we're tearing, or the content drives the refresh, just repaint
+	 * right away: the next flip will be shown as soon as it is ready
+	 * instead of on a fixed-rate vblank slot. */
+	if (presented_flags & (WESTON_FINISH_FRAME_TEARING |
+			       WESTON_FINISH_FRAME_VRR)) {
 		output->next_repaint = now;
 		goto out;
 	}
@@ -3885,6 +3950,9 @@ surface_frame(struct wl_client *client,
 
 	wl_list_insert(surface->pending.frame_callback_list.prev,
 		       wl_resource_get_link(cb));
+
+	weston_client_stats_add(surface->compositor, client,
+				WESTON_CLIENT_STAT_FRAME_CALLBACKS, 1);
 }
 
 static void
@@ -4208,8 +4276,10 @@ weston_surface_commit_state(struct weston_surface *surface,
 
 	/* wl_surface.damage and wl_surface.damage_buffer */
 	if (pixman_region32_not_empty(&state->damage_surface) ||
-	     pixman_region32_not_empty(&state->damage_buffer))
+	     pixman_region32_not_empty(&state->damage_buffer)) {
 		TL_POINT(surface->compositor, "core_commit_damage", TLP_SURFACE(surface), TLP_END);
+		weston_input_latency_commit(surface);
+	}
 
 	pixman_region32_union(&surface->damage, &surface->damage,
 			      &state->damage_surface);
@@ -4269,6 +4339,8 @@ weston_surface_commit_state(struct weston_surface *surface,
 static void
 weston_surface_commit(struct weston_surface *surface)
 {
+	WESTON_PROFILE_BEGIN(SURFACE_COMMIT);
+
 	weston_surface_commit_state(surface, &surface->pending);
 
 	weston_surface_commit_subsurface_order(surface);
@@ -4278,6 +4350,8 @@ weston_surface_commit(struct weston_surface *surface)
 		weston_compositor_build_view_list(surface->compositor, NULL);
 
 	weston_surface_schedule_repaint(surface);
+
+	WESTON_PROFILE_END(surface->compositor, SURFACE_COMMIT);
 }
 
 static void
@@ -4346,6 +4420,8 @@ surface_commit(struct wl_client *client, struct wl_resource *resource)
 		return;
 	}
 
+	weston_client_stats_commit(surface);
+
 	if (sub) {
 		weston_subsurface_commit(sub);
 		return;
@@ -8804,6 +8880,18 @@ weston_compositor_create(struct wl_display *display,
 						weston_timeline_create_subscription,
 						weston_timeline_destroy_subscription,
 						ec);
+	ec->timeline_binary =
+		weston_compositor_add_log_scope(ec, "timeline-binary",
+						"Timeline event points, binary "
+						"encoded for weston-timeline\n",
+						weston_timeline_binary_create_subscription,
+						weston_timeline_binary_destroy_subscription,
+						ec);
+	weston_input_latency_init(ec);
+	weston_frame_stats_init(ec);
+	weston_profiler_init(ec);
+	weston_client_stats_init(ec);
+	weston_memory_stats_init(ec);
 	ec->libseat_debug =
 		weston_compositor_add_log_scope(ec, "libseat-debug",
 						"libseat debug messages\n",
@@ -8876,6 +8964,25 @@ weston_compositor_exit_with_code(struct weston_compositor *compositor,
 	weston_compositor_exit(compositor);
 }
 
+/** Prints the durations of the hot path stages into the log
+ *
+ * \param compositor The compositor.
+ *
+ * The durations are only collected when libweston is built with the
+ * profiler meson option, otherwise this only logs that they are not.
+ *
+ * \ingroup compositor
+ */
+WL_EXPORT void
+weston_compositor_log_profile(struct weston_compositor *compositor)
+{
+#ifdef ENABLE_PROFILER
+	weston_profiler_log(compositor);
+#else
+	weston_log("libweston was built without the profiler\n");
+#endif
+}
+
 /** weston_compositor_set_default_pointer_grab
  * \ingroup compositor
  */
@@ -9207,6 +9314,15 @@ weston_compositor_destroy(struct weston_compositor *compositor)
 	weston_log_scope_destroy(compositor->timeline);
 	compositor->timeline = NULL;
 
+	weston_log_scope_destroy(compositor->timeline_binary);
+	compositor->timeline_binary = NULL;
+
+	weston_input_latency_fini(compositor);
+	weston_frame_stats_fini(compositor);
+	weston_profiler_fini(compositor);
+	weston_client_stats_fini(compositor);
+	weston_memory_stats_fini(compositor);
+
 	weston_log_scope_destroy(compositor->libseat_debug);
 	compositor->libseat_debug = NULL;
 
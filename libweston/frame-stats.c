@@ -0,0 +1,412 @@
+/*
+ * Copyright 2024 Collabora, Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <libweston/libweston.h>
+#include <libweston/weston-log.h>
+#include "libweston-internal.h"
+#include "frame-stats.h"
+#include "shared/helpers.h"
+#include "shared/timespec-util.h"
+#include "shared/xalloc.h"
+
+/* Frame statistics
+ *
+ * While the 'frame-stats' scope has subscribers, every output keeps the
+ * values of its most recent frames, up to FRAME_STATS_MAX_SAMPLES for each
+ * kind of value. Every FRAME_STATS_PERIOD_MSEC the percentiles of each
+ * kind are printed to the subscribers and the values are dropped.
+ *
+ * Without subscribers, the hooks only check the scope and return, and no
+ * memory is kept for the outputs.
+ */
+
+#define FRAME_STATS_PERIOD_MSEC 5000
+#define FRAME_STATS_MAX_SAMPLES 2048
+
+struct frame_stats_series {
+	int64_t values[FRAME_STATS_MAX_SAMPLES];
+	unsigned count;
+	unsigned next;
+};
+
+struct frame_stats_output {
+	struct weston_frame_stats *stats;
+	struct wl_list link;		/**< weston_frame_stats::outputs */
+	struct wl_listener destroy_listener;
+	struct weston_output *output;
+
+	struct frame_stats_series series[WESTON_FRAME_STAT_COUNT];
+	uint64_t frames;
+	uint64_t missed_vblanks;
+
+	/* Start of the repaint waiting for its vblank */
+	bool repaint_pending;
+	struct timespec repaint_begin;
+};
+
+struct weston_frame_stats {
+	struct weston_compositor *compositor;
+	struct weston_log_scope *scope;
+	struct wl_event_source *timer;
+	bool timer_armed;
+	struct wl_list outputs;		/**< frame_stats_output::link */
+};
+
+static const struct {
+	const char *name;
+	double scale;			/**< printed value per unit */
+	const char *unit;
+} frame_stat_info[WESTON_FRAME_STAT_COUNT] = {
+	[WESTON_FRAME_STAT_REPAINT] = { "repaint", 1e-3, "us" },
+	[WESTON_FRAME_STAT_RENDERER] = { "renderer", 1e-3, "us" },
+	[WESTON_FRAME_STAT_GPU] = { "gpu", 1e-3, "us" },
+	[WESTON_FRAME_STAT_COMMIT] = { "commit", 1e-3, "us" },
+	[WESTON_FRAME_STAT_PAINT_NODES] = { "paint nodes", 1.0, "" },
+	[WESTON_FRAME_STAT_DAMAGE] = { "damage", 1.0, "px" },
+};
+
+static void
+frame_stats_output_destroy(struct frame_stats_output *fso)
+{
+	wl_list_remove(&fso->destroy_listener.link);
+	wl_list_remove(&fso->link);
+	free(fso);
+}
+
+static void
+frame_stats_output_handle_destroy(struct wl_listener *listener, void *data)
+{
+	struct frame_stats_output *fso =
+		container_of(listener, struct frame_stats_output,
+			     destroy_listener);
+
+	frame_stats_output_destroy(fso);
+}
+
+static struct frame_stats_output *
+frame_stats_output_get(struct weston_frame_stats *stats,
+		       struct weston_output *output)
+{
+	struct frame_stats_output *fso;
+
+	wl_list_for_each(fso, &stats->outputs, link) {
+		if (fso->output == output)
+			return fso;
+	}
+
+	fso = xzalloc(sizeof *fso);
+	fso->stats = stats;
+	fso->output = output;
+	fso->destroy_listener.notify = frame_stats_output_handle_destroy;
+	wl_signal_add(&output->destroy_signal, &fso->destroy_listener);
+	wl_list_insert(stats->outputs.prev, &fso->link);
+
+	return fso;
+}
+
+static void
+frame_stats_destroy_outputs(struct weston_frame_stats *stats)
+{
+	struct frame_stats_output *fso, *tmp;
+
+	wl_list_for_each_safe(fso, tmp, &stats->outputs, link)
+		frame_stats_output_destroy(fso);
+}
+
+/** Whether frame statistics are being collected
+ *
+ * \param compositor The compositor.
+ * \return True if the 'frame-stats' scope has subscribers.
+ */
+WL_EXPORT bool
+weston_frame_stats_enabled(struct weston_compositor *compositor)
+{
+	return compositor->frame_stats &&
+	       weston_log_scope_is_enabled(compositor->frame_stats->scope);
+}
+
+/** Starts timing a value, if frame statistics are being collected
+ *
+ * \param compositor The compositor.
+ * \param begin Set to the current CLOCK_MONOTONIC time, if collecting.
+ * \return True if collecting, in which case the caller passes 'begin' to
+ * weston_frame_stats_add_since() when done.
+ */
+WL_EXPORT bool
+weston_frame_stats_start(struct weston_compositor *compositor,
+			 struct timespec *begin)
+{
+	if (!weston_frame_stats_enabled(compositor))
+		return false;
+
+	clock_gettime(CLOCK_MONOTONIC, begin);
+
+	return true;
+}
+
+/** Adds a value to the statistics of an output
+ *
+ * \param output The output the value belongs to.
+ * \param stat The kind of the value.
+ * \param value The value, in the unit of the kind.
+ *
+ * Does nothing if nobody is subscribed to the 'frame-stats' scope.
+ */
+WL_EXPORT void
+weston_frame_stats_add(struct weston_output *output,
+		       enum weston_frame_stat stat, int64_t value)
+{
+	struct weston_compositor *compositor = output->compositor;
+	struct frame_stats_series *series;
+
+	if (!weston_frame_stats_enabled(compositor))
+		return;
+
+	series = &frame_stats_output_get(compositor->frame_stats,
+					 output)->series[stat];
+	series->values[series->next] = value;
+	series->next = (series->next + 1) % FRAME_STATS_MAX_SAMPLES;
+	if (series->count < FRAME_STATS_MAX_SAMPLES)
+		series->count++;
+}
+
+/** Adds the time elapsed since 'begin' to the statistics of an output
+ *
+ * \param output The output the value belongs to.
+ * \param stat The kind of the value.
+ * \param begin The time from weston_frame_stats_start().
+ */
+WL_EXPORT void
+weston_frame_stats_add_since(struct weston_output *output,
+			     enum weston_frame_stat stat,
+			     const struct timespec *begin)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	weston_frame_stats_add(output, stat, timespec_sub_to_nsec(&now, begin));
+}
+
+/** Records a finished weston_output_repaint()
+ *
+ * \param output The repainted output.
+ * \param begin The time from weston_frame_stats_start() at repaint begin.
+ * \param paint_nodes The number of paint nodes on the primary plane.
+ * \param damage The number of damaged pixels.
+ */
+void
+weston_frame_stats_repaint(struct weston_output *output,
+			   const struct timespec *begin,
+			   int paint_nodes, int64_t damage)
+{
+	struct weston_compositor *compositor = output->compositor;
+	struct frame_stats_output *fso;
+
+	if (!weston_frame_stats_enabled(compositor))
+		return;
+
+	weston_frame_stats_add_since(output, WESTON_FRAME_STAT_REPAINT, begin);
+	weston_frame_stats_add(output, WESTON_FRAME_STAT_PAINT_NODES,
+			       paint_nodes);
+	weston_frame_stats_add(output, WESTON_FRAME_STAT_DAMAGE, damage);
+
+	fso = frame_stats_output_get(compositor->frame_stats, output);
+	fso->repaint_pending = true;
+	fso->repaint_begin = *begin;
+}
+
+/** Counts a presented frame, and whether it missed its vblank
+ *
+ * \param output The output that finished a frame.
+ * \param vblank The vblank time of the frame, CLOCK_MONOTONIC.
+ *
+ * A repaint starts ahead of the vblank it aims for by the repaint window,
+ * which is less than a refresh period. A frame presented more than a
+ * refresh period after its repaint started has therefore missed a vblank.
+ */
+void
+weston_frame_stats_presented(struct weston_output *output,
+			     const struct timespec *vblank)
+{
+	struct weston_compositor *compositor = output->compositor;
+	struct frame_stats_output *fso;
+	uint32_t refresh = output->current_mode->refresh;
+
+	if (!weston_frame_stats_enabled(compositor))
+		return;
+
+	fso = frame_stats_output_get(compositor->frame_stats, output);
+	if (!fso->repaint_pending)
+		return;
+	fso->repaint_pending = false;
+	fso->frames++;
+
+	if (refresh > 0 &&
+	    timespec_sub_to_nsec(vblank, &fso->repaint_begin) >
+	    millihz_to_nsec(refresh))
+		fso->missed_vblanks++;
+}
+
+static int
+compare_int64(const void *a, const void *b)
+{
+	int64_t va = *(const int64_t *)a;
+	int64_t vb = *(const int64_t *)b;
+
+	return (va > vb) - (va < vb);
+}
+
+/* Nearest-rank percentile of sorted values */
+static int64_t
+percentile(const int64_t *sorted, unsigned count, unsigned p)
+{
+	unsigned rank = (count * p + 99) / 100;
+
+	return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+static void
+frame_stats_print_output(struct weston_frame_stats *stats,
+			 struct frame_stats_output *fso)
+{
+	int64_t sorted[FRAME_STATS_MAX_SAMPLES];
+	unsigned i;
+
+	weston_log_scope_printf(stats->scope,
+				"output %s: %" PRIu64 " frames, "
+				"%" PRIu64 " missed vblanks\n",
+				fso->output->name, fso->frames,
+				fso->missed_vblanks);
+	weston_log_scope_printf(stats->scope, "\t%-12s %10s %10s %10s %10s\n",
+				"", "p50", "p90", "p99", "max");
+
+	for (i = 0; i < WESTON_FRAME_STAT_COUNT; i++) {
+		struct frame_stats_series *series = &fso->series[i];
+		double scale = frame_stat_info[i].scale;
+		unsigned n = series->count;
+
+		if (n == 0)
+			continue;
+
+		memcpy(sorted, series->values, n * sizeof sorted[0]);
+		qsort(sorted, n, sizeof sorted[0], compare_int64);
+
+		weston_log_scope_printf(stats->scope,
+					"\t%-12s %10.1f %10.1f %10.1f %10.1f %s\n",
+					frame_stat_info[i].name,
+					percentile(sorted, n, 50) * scale,
+					percentile(sorted, n, 90) * scale,
+					percentile(sorted, n, 99) * scale,
+					sorted[n - 1] * scale,
+					frame_stat_info[i].unit);
+	}
+}
+
+static int
+frame_stats_timer_handler(void *data)
+{
+	struct weston_frame_stats *stats = data;
+	struct frame_stats_output *fso;
+
+	if (!weston_log_scope_is_enabled(stats->scope)) {
+		frame_stats_destroy_outputs(stats);
+		stats->timer_armed = false;
+		return 0;
+	}
+
+	wl_list_for_each(fso, &stats->outputs, link)
+		frame_stats_print_output(stats, fso);
+
+	/* Start the next period from scratch */
+	frame_stats_destroy_outputs(stats);
+	wl_event_source_timer_update(stats->timer, FRAME_STATS_PERIOD_MSEC);
+
+	return 0;
+}
+
+static void
+frame_stats_new_subscription(struct weston_log_subscription *sub, void *data)
+{
+	struct weston_frame_stats *stats = data;
+
+	weston_log_subscription_printf(sub,
+				       "Frame statistics of the last %d ms, "
+				       "per output\n", FRAME_STATS_PERIOD_MSEC);
+
+	if (stats->timer_armed)
+		return;
+
+	wl_event_source_timer_update(stats->timer, FRAME_STATS_PERIOD_MSEC);
+	stats->timer_armed = true;
+}
+
+void
+weston_frame_stats_init(struct weston_compositor *compositor)
+{
+	struct weston_frame_stats *stats;
+	struct wl_event_loop *loop;
+
+	stats = xzalloc(sizeof *stats);
+	stats->compositor = compositor;
+	wl_list_init(&stats->outputs);
+
+	loop = wl_display_get_event_loop(compositor->wl_display);
+	stats->timer = wl_event_loop_add_timer(loop, frame_stats_timer_handler,
+					       stats);
+	stats->scope =
+		weston_compositor_add_log_scope(compositor, "frame-stats",
+						"Per-output frame time "
+						"percentiles, printed "
+						"periodically\n",
+						frame_stats_new_subscription,
+						NULL, stats);
+
+	compositor->frame_stats = stats;
+}
+
+void
+weston_frame_stats_fini(struct weston_compositor *compositor)
+{
+	struct weston_frame_stats *stats = compositor->frame_stats;
+
+	if (!stats)
+		return;
+
+	weston_log_scope_destroy(stats->scope);
+	frame_stats_destroy_outputs(stats);
+	if (stats->timer)
+		wl_event_source_remove(stats->timer);
+
+	free(stats);
+	compositor->frame_stats = NULL;
+}
@@ -0,0 +1,78 @@
+/*
+ * Copyright 2024 Collabora, Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef WESTON_FRAME_STATS_H
+#define WESTON_FRAME_STATS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+struct weston_compositor;
+struct weston_output;
+
+/** Per-frame values collected by the 'frame-stats' debug scope */
+enum weston_frame_stat {
+	WESTON_FRAME_STAT_REPAINT = 0,	/**< weston_output_repaint, ns */
+	WESTON_FRAME_STAT_RENDERER,	/**< renderer repaint_output, ns */
+	WESTON_FRAME_STAT_GPU,		/**< GPU time of a repaint, ns */
+	WESTON_FRAME_STAT_COMMIT,	/**< KMS commit, ns */
+	WESTON_FRAME_STAT_PAINT_NODES,	/**< paint nodes on the primary plane */
+	WESTON_FRAME_STAT_DAMAGE,	/**< damaged pixels */
+	WESTON_FRAME_STAT_COUNT,
+};
+
+bool
+weston_frame_stats_enabled(struct weston_compositor *compositor);
+
+bool
+weston_frame_stats_start(struct weston_compositor *compositor,
+			 struct timespec *begin);
+
+void
+weston_frame_stats_add(struct weston_output *output,
+		       enum weston_frame_stat stat, int64_t value);
+
+void
+weston_frame_stats_add_since(struct weston_output *output,
+			     enum weston_frame_stat stat,
+			     const struct timespec *begin);
+
+void
+weston_frame_stats_init(struct weston_compositor *compositor);
+
+void
+weston_frame_stats_fini(struct weston_compositor *compositor);
+
+void
+weston_frame_stats_repaint(struct weston_output *output,
+			   const struct timespec *begin,
+			   int paint_nodes, int64_t damage);
+
+void
+weston_frame_stats_presented(struct weston_output *output,
+			     const struct timespec *vblank);
+
+#endif /* WESTON_FRAME_STATS_H */
@@ -0,0 +1,616 @@
+/*
+ * Copyright 2024 Collabora, Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <libweston/libweston.h>
+#include <libweston/weston-log.h>
+#include "libweston-internal.h"
+#include "timeline.h"
+#include "shared/helpers.h"
+#include "shared/timespec-util.h"
+#include "shared/xalloc.h"
+
+/* Input-to-present latency
+ *
+ * An input event delivered to a client starts a sample for that client,
+ * unless the client already has one in flight. The sample then follows
+ * the chain
+ *
+ *	input event -> first commit with damage by the client
+ *		    -> repaint of an output showing the committed surface
+ *		    -> vblank of that repaint
+ *
+ * and is accounted to the client and to the output when the vblank is
+ * reported. Every link of the chain is also a timeline point carrying the
+ * id of the sample, so that a whole chain can be picked out of a trace.
+ *
+ * A sample that does not make it through the chain, because the client
+ * never commits or the surface is not on any output, is dropped when the
+ * client receives input again after SAMPLE_TIMEOUT_NSEC. A sample whose
+ * repaint is never presented is dropped right away.
+ *
+ * Samples are only taken while the 'input-latency' scope or a timeline
+ * scope has subscribers. The histograms are printed to the 'input-latency'
+ * subscribers every INPUT_LATENCY_PERIOD_MSEC, and dropped once the last
+ * one leaves.
+ */
+
+#define SAMPLE_TIMEOUT_NSEC (1000 * 1000 * 1000LL)
+#define INPUT_LATENCY_PERIOD_MSEC 5000
+
+/* Upper bounds of the histogram buckets, in milliseconds; the last bucket
+ * counts everything above. */
+static const unsigned latency_bucket_ms[] = {
+	2, 4, 6, 8, 10, 12, 16, 20, 25, 33, 50, 66, 100, 200,
+};
+
+#define N_LATENCY_BUCKETS (ARRAY_LENGTH(latency_bucket_ms) + 1)
+
+struct latency_histogram {
+	uint64_t count;
+	uint64_t buckets[N_LATENCY_BUCKETS];
+	int64_t max_nsec;
+	int64_t sum_nsec;
+	int64_t sum_commit_nsec;	/**< input to commit */
+	int64_t sum_repaint_nsec;	/**< commit to repaint begin */
+	int64_t sum_present_nsec;	/**< repaint begin to vblank */
+};
+
+enum latency_sample_state {
+	SAMPLE_NONE = 0,
+	SAMPLE_PENDING,		/**< waiting for a commit */
+	SAMPLE_COMMITTED,	/**< waiting for a repaint */
+	SAMPLE_REPAINTING,	/**< waiting for the vblank */
+};
+
+struct latency_sample {
+	enum latency_sample_state state;
+	uint32_t id;
+	struct timespec input;
+	struct timespec commit;
+	struct timespec repaint;
+	uint32_t output_mask;		/**< outputs of the committed surface */
+	struct weston_output *output;	/**< output being repainted */
+};
+
+struct latency_client {
+	struct weston_input_latency *latency;
+	struct wl_list link;		/**< weston_input_latency::clients */
+	struct wl_listener destroy_listener;
+	pid_t pid;
+	char label[64];
+	struct latency_sample sample;
+	struct latency_histogram histogram;
+};
+
+struct latency_output {
+	struct weston_input_latency *latency;
+	struct wl_list link;		/**< weston_input_latency::outputs */
+	struct wl_listener destroy_listener;
+	struct weston_output *output;
+	struct latency_histogram histogram;
+};
+
+struct weston_input_latency {
+	struct weston_compositor *compositor;
+	struct weston_log_scope *scope;
+	struct wl_event_source *timer;
+	bool timer_armed;
+	uint32_t next_id;
+	struct wl_list clients;		/**< latency_client::link */
+	struct wl_list outputs;		/**< latency_output::link */
+};
+
+static void
+latency_histogram_add(struct latency_histogram *hist,
+		      const struct latency_sample *sample,
+		      const struct timespec *vblank)
+{
+	int64_t total = timespec_sub_to_nsec(vblank, &sample->input);
+	unsigned i;
+
+	for (i = 0; i < ARRAY_LENGTH(latency_bucket_ms); i++) {
+		if (total < (int64_t)latency_bucket_ms[i] * 1000000)
+			break;
+	}
+
+	hist->count++;
+	hist->buckets[i]++;
+	hist->max_nsec = MAX(hist->max_nsec, total);
+	hist->sum_nsec += total;
+	hist->sum_commit_nsec +=
+		timespec_sub_to_nsec(&sample->commit, &sample->input);
+	hist->sum_repaint_nsec +=
+		timespec_sub_to_nsec(&sample->repaint, &sample->commit);
+	hist->sum_present_nsec +=
+		timespec_sub_to_nsec(vblank, &sample->repaint);
+}
+
+static void
+latency_client_destroy(struct latency_client *lc)
+{
+	wl_list_remove(&lc->destroy_listener.link);
+	wl_list_remove(&lc->link);
+	free(lc);
+}
+
+static void
+latency_client_handle_destroy(struct wl_listener *listener, void *data)
+{
+	struct latency_client *lc =
+		container_of(listener, struct latency_client, destroy_listener);
+
+	latency_client_destroy(lc);
+}
+
+static struct latency_client *
+latency_client_get(struct weston_input_latency *latency,
+		   struct wl_client *client, bool create)
+{
+	struct wl_listener *listener;
+	struct latency_client *lc;
+
+	listener = wl_client_get_destroy_listener(client,
+						  latency_client_handle_destroy);
+	if (listener)
+		return container_of(listener, struct latency_client,
+				    destroy_listener);
+	if (!create)
+		return NULL;
+
+	lc = xzalloc(sizeof *lc);
+	lc->latency = latency;
+	wl_client_get_credentials(client, &lc->pid, NULL, NULL);
+	lc->destroy_listener.notify = latency_client_handle_destroy;
+	wl_client_add_destroy_listener(client, &lc->destroy_listener);
+	wl_list_insert(latency->clients.prev, &lc->link);
+
+	return lc;
+}
+
+static void
+latency_output_destroy(struct latency_output *lo)
+{
+	wl_list_remove(&lo->destroy_listener.link);
+	wl_list_remove(&lo->link);
+	free(lo);
+}
+
+static void
+latency_output_handle_destroy(struct wl_listener *listener, void *data)
+{
+	struct latency_output *lo =
+		container_of(listener, struct latency_output, destroy_listener);
+	struct latency_client *lc;
+
+	wl_list_for_each(lc, &lo->latency->clients, link) {
+		if (lc->sample.output == lo->output)
+			lc->sample.state = SAMPLE_NONE;
+	}
+
+	latency_output_destroy(lo);
+}
+
+static struct latency_output *
+latency_output_get(struct weston_input_latency *latency,
+		   struct weston_output *output)
+{
+	struct latency_output *lo;
+
+	wl_list_for_each(lo, &latency->outputs, link) {
+		if (lo->output == output)
+			return lo;
+	}
+
+	lo = xzalloc(sizeof *lo);
+	lo->latency = latency;
+	lo->output = output;
+	lo->destroy_listener.notify = latency_output_handle_destroy;
+	wl_signal_add(&output->destroy_signal, &lo->destroy_listener);
+	wl_list_insert(latency->outputs.prev, &lo->link);
+
+	return lo;
+}
+
+/* Whether anybody wants the samples, see the top comment */
+static bool
+latency_enabled(struct weston_compositor *compositor)
+{
+	struct weston_input_latency *latency = compositor->input_latency;
+
+	return latency &&
+	       (weston_log_scope_is_enabled(latency->scope) ||
+		weston_log_scope_is_enabled(compositor->timeline) ||
+		weston_log_scope_is_enabled(compositor->timeline_binary));
+}
+
+/* Starts a sample for the client of 'surface', for input at 'time' */
+static void
+latency_input(struct weston_compositor *compositor,
+	      struct weston_surface *surface, const struct timespec *time)
+{
+	struct weston_input_latency *latency = compositor->input_latency;
+	struct latency_client *lc;
+	struct latency_sample *sample;
+
+	if (!surface || !surface->resource)
+		return;
+
+	lc = latency_client_get(latency,
+				wl_resource_get_client(surface->resource), true);
+	sample = &lc->sample;
+
+	if (sample->state != SAMPLE_NONE &&
+	    timespec_sub_to_nsec(time, &sample->input) < SAMPLE_TIMEOUT_NSEC)
+		return;
+
+	sample->state = SAMPLE_PENDING;
+	sample->id = ++latency->next_id;
+	sample->input = *time;
+	sample->output = NULL;
+
+	if (!surface->get_label ||
+	    surface->get_label(surface, lc->label, sizeof lc->label) < 0)
+		lc->label[0] = '\0';
+
+	TL_POINT(compositor, "input_event", TLP_SURFACE(surface),
+		 TLP_INPUT(&sample->id), TLP_END);
+}
+
+/** Starts a latency sample for pointer input
+ *
+ * \param seat The seat the pointer event was delivered on.
+ * \param time The time of the input event, CLOCK_MONOTONIC.
+ *
+ * Called by input backends after notifying the event. The sample is
+ * accounted to the client of the surface with pointer focus.
+ */
+void
+weston_input_latency_pointer(struct weston_seat *seat,
+			     const struct timespec *time)
+{
+	struct weston_pointer *pointer;
+
+	if (!latency_enabled(seat->compositor))
+		return;
+
+	pointer = weston_seat_get_pointer(seat);
+	if (!pointer || !pointer->focus)
+		return;
+
+	latency_input(seat->compositor, pointer->focus->surface, time);
+}
+
+/** Starts a latency sample for keyboard input
+ *
+ * \param seat The seat the key event was delivered on.
+ * \param time The time of the input event, CLOCK_MONOTONIC.
+ *
+ * Called by input backends after notifying the event. The sample is
+ * accounted to the client of the surface with keyboard focus.
+ */
+void
+weston_input_latency_keyboard(struct weston_seat *seat,
+			      const struct timespec *time)
+{
+	struct weston_keyboard *keyboard;
+
+	if (!latency_enabled(seat->compositor))
+		return;
+
+	keyboard = weston_seat_get_keyboard(seat);
+	if (!keyboard)
+		return;
+
+	latency_input(seat->compositor, keyboard->focus, time);
+}
+
+/** Moves the sample of the surface's client past the commit
+ *
+ * Called for a commit that carries damage.
+ */
+void
+weston_input_latency_commit(struct weston_surface *surface)
+{
+	struct weston_compositor *compositor = surface->compositor;
+	struct latency_client *lc;
+	struct latency_sample *sample;
+
+	if (!latency_enabled(compositor) || !surface->resource)
+		return;
+
+	lc = latency_client_get(compositor->input_latency,
+				wl_resource_get_client(surface->resource),
+				false);
+	if (!lc || lc->sample.state != SAMPLE_PENDING)
+		return;
+
+	sample = &lc->sample;
+	if (surface->output_mask == 0) {
+		sample->state = SAMPLE_NONE;
+		return;
+	}
+
+	sample->state = SAMPLE_COMMITTED;
+	sample->output_mask = surface->output_mask;
+	clock_gettime(CLOCK_MONOTONIC, &sample->commit);
+
+	TL_POINT(compositor, "input_commit", TLP_SURFACE(surface),
+		 TLP_INPUT(&sample->id), TLP_END);
+}
+
+/** Ties committed samples to the output starting its repaint
+ *
+ * A sample whose surface is on several outputs goes with the first one
+ * to repaint.
+ */
+void
+weston_input_latency_repaint_begin(struct weston_output *output)
+{
+	struct weston_compositor *compositor = output->compositor;
+	struct weston_input_latency *latency = compositor->input_latency;
+	struct latency_client *lc;
+	struct timespec now;
+
+	if (!latency_enabled(compositor))
+		return;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	wl_list_for_each(lc, &latency->clients, link) {
+		struct latency_sample *sample = &lc->sample;
+
+		if (sample->state != SAMPLE_COMMITTED ||
+		    !(sample->output_mask & (1u << output->id)))
+			continue;
+
+		/* Drops the sample if the output goes away */
+		latency_output_get(latency, output);
+
+		sample->state = SAMPLE_REPAINTING;
+		sample->output = output;
+		sample->repaint = now;
+
+		TL_POINT(compositor, "input_repaint_begin", TLP_OUTPUT(output),
+			 TLP_INPUT(&sample->id), TLP_END);
+	}
+}
+
+/** Completes the samples repainted on the output
+ *
+ * \param output The output that finished a frame.
+ * \param vblank The vblank time of the frame, CLOCK_MONOTONIC, or NULL if
+ * the frame was not presented.
+ */
+void
+weston_input_latency_presented(struct weston_output *output,
+			       const struct timespec *vblank)
+{
+	struct weston_compositor *compositor = output->compositor;
+	struct weston_input_latency *latency = compositor->input_latency;
+	struct latency_output *lo = NULL;
+	struct latency_client *lc;
+
+	if (!latency)
+		return;
+
+	wl_list_for_each(lc, &latency->clients, link) {
+		struct latency_sample *sample = &lc->sample;
+
+		if (sample->state != SAMPLE_REPAINTING ||
+		    sample->output != output)
+			continue;
+
+		/* Nothing to measure against, the chain is broken */
+		if (!vblank) {
+			sample->state = SAMPLE_NONE;
+			continue;
+		}
+
+		if (!lo)
+			lo = latency_output_get(latency, output);
+
+		latency_histogram_add(&lc->histogram, sample, vblank);
+		latency_histogram_add(&lo->histogram, sample, vblank);
+		sample->state = SAMPLE_NONE;
+
+		TL_POINT(compositor, "input_presented", TLP_OUTPUT(output),
+			 TLP_INPUT(&sample->id), TLP_VBLANK(vblank), TLP_END);
+	}
+}
+
+static double
+nsec_to_ms(int64_t nsec)
+{
+	return nsec / 1000000.0;
+}
+
+static void
+latency_histogram_print(struct weston_log_scope *scope,
+			const struct latency_histogram *hist)
+{
+	unsigned lower = 0;
+	unsigned i;
+
+	if (hist->count == 0) {
+		weston_log_scope_printf(scope, "\tno samples\n");
+		return;
+	}
+
+	weston_log_scope_printf(scope,
+		"\t%" PRIu64 " samples, mean %.2f ms, max %.2f ms\n"
+		"\tmean input to commit %.2f ms, commit to repaint %.2f ms, "
+		"repaint to vblank %.2f ms\n",
+		hist->count,
+		nsec_to_ms(hist->sum_nsec) / hist->count,
+		nsec_to_ms(hist->max_nsec),
+		nsec_to_ms(hist->sum_commit_nsec) / hist->count,
+		nsec_to_ms(hist->sum_repaint_nsec) / hist->count,
+		nsec_to_ms(hist->sum_present_nsec) / hist->count);
+
+	for (i = 0; i < N_LATENCY_BUCKETS; i++) {
+		if (i < ARRAY_LENGTH(latency_bucket_ms)) {
+			weston_log_scope_printf(scope,
+				"\t%4u - %4u ms: %" PRIu64 "\n",
+				lower, latency_bucket_ms[i], hist->buckets[i]);
+			lower = latency_bucket_ms[i];
+		} else {
+			weston_log_scope_printf(scope,
+				"\t%4u -      ms: %" PRIu64 "\n",
+				lower, hist->buckets[i]);
+		}
+	}
+}
+
+static void
+input_latency_print(struct weston_input_latency *latency)
+{
+	struct weston_log_scope *scope = latency->scope;
+	struct latency_output *lo;
+	struct latency_client *lc;
+
+	weston_log_scope_printf(scope,
+		"Latency from input event to vblank, per output:\n");
+	wl_list_for_each(lo, &latency->outputs, link) {
+		weston_log_scope_printf(scope, "Output %s:\n",
+					lo->output->name);
+		latency_histogram_print(scope, &lo->histogram);
+	}
+
+	weston_log_scope_printf(scope, "\nPer client:\n");
+	wl_list_for_each(lc, &latency->clients, link) {
+		weston_log_scope_printf(scope, "Client PID %d, %s:\n",
+					(int)lc->pid,
+					lc->label[0] ? lc->label :
+					"[no description available]");
+		latency_histogram_print(scope, &lc->histogram);
+	}
+	weston_log_scope_printf(scope, "\n");
+}
+
+static void
+input_latency_destroy_all(struct weston_input_latency *latency)
+{
+	struct latency_client *lc, *lc_tmp;
+	struct latency_output *lo, *lo_tmp;
+
+	wl_list_for_each_safe(lc, lc_tmp, &latency->clients, link)
+		latency_client_destroy(lc);
+	wl_list_for_each_safe(lo, lo_tmp, &latency->outputs, link)
+		latency_output_destroy(lo);
+}
+
+static int
+input_latency_timer_handler(void *data)
+{
+	struct weston_input_latency *latency = data;
+
+	if (!weston_log_scope_is_enabled(latency->scope)) {
+		input_latency_destroy_all(latency);
+		latency->timer_armed = false;
+		return 0;
+	}
+
+	input_latency_print(latency);
+	wl_event_source_timer_update(latency->timer,
+				     INPUT_LATENCY_PERIOD_MSEC);
+
+	return 0;
+}
+
+/**
+ * Called when the 'input-latency' debug scope is bound by a client. The
+ * histograms collected since the first subscription are printed every
+ * INPUT_LATENCY_PERIOD_MSEC.
+ */
+static void
+input_latency_new_subscription(struct weston_log_subscription *sub,
+			       void *data)
+{
+	struct weston_input_latency *latency = data;
+
+	weston_log_subscription_printf(sub,
+				       "Input latency histograms, printed "
+				       "every %d ms\n",
+				       INPUT_LATENCY_PERIOD_MSEC);
+
+	if (latency->timer_armed)
+		return;
+
+	wl_event_source_timer_update(latency->timer,
+				     INPUT_LATENCY_PERIOD_MSEC);
+	latency->timer_armed = true;
+}
+
+void
+weston_input_latency_init(struct weston_compositor *compositor)
+{
+	struct weston_input_latency *latency;
+	struct wl_event_loop *loop;
+
+	latency = xzalloc(sizeof *latency);
+	latency->compositor = compositor;
+	wl_list_init(&latency->clients);
+	wl_list_init(&latency->outputs);
+
+	loop = wl_display_get_event_loop(compositor->wl_display);
+	latency->timer = wl_event_loop_add_timer(loop,
+						 input_latency_timer_handler,
+						 latency);
+	latency->scope =
+		weston_compositor_add_log_scope(compositor, "input-latency",
+						"Input event to vblank latency "
+						"histograms, printed "
+						"periodically\n",
+						input_latency_new_subscription,
+						NULL, latency);
+
+	compositor->input_latency = latency;
+}
+
+void
+weston_input_latency_fini(struct weston_compositor *compositor)
+{
+	struct weston_input_latency *latency = compositor->input_latency;
+
+	if (!latency)
+		return;
+
+	weston_log_scope_destroy(latency->scope);
+	input_latency_destroy_all(latency);
+	if (latency->timer)
+		wl_event_source_remove(latency->timer);
+
+	free(latency);
+	compositor->input_latency = NULL;
+}
@@ -107,6 +107,7 @@ handle_keyboard_key(struct libinput_device *libinput_device,
 	notify_key(device->seat, &time,
 		   libinput_event_keyboard_get_key(keyboard_event),
 		   key_state, STATE_UPDATE_AUTOMATIC);
+	weston_input_latency_keyboard(device->seat, &time);
 }
 
 static bool
@@ -135,6 +136,7 @@ handle_pointer_motion(struct libinput_device *libinput_device,
 				 libinput_event_pointer_get_dy(pointer_event));
 	event.rel_unaccel = weston_coord(dx_unaccel, dy_unaccel);
 	notify_motion(device->seat, &time, &event);
+	weston_input_latency_pointer(device->seat, &time);
 
 	return true;
 }
@@ -168,6 +170,7 @@ handle_pointer_motion_absolute(
 							      height);
 	pos = weston_coord_global_from_output_point(x, y, output);
 	notify_motion_absolute(device->seat, &time, pos);
+	weston_input_latency_pointer(device->seat, &time);
 
 	return true;
 }
@@ -199,6 +202,7 @@ handle_pointer_button(struct libinput_device *libinput_device,
 	notify_button(device->seat, &time,
 	              libinput_event_pointer_get_button(pointer_event),
 	              button_state);
+	weston_input_latency_pointer(device->seat, &time);
 
 	return true;
 }
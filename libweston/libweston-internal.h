@@ -252,6 +252,32 @@ weston_compositor_xkb_destroy(struct weston_compositor *ec);
 int
 weston_input_init(struct weston_compositor *compositor);
 
+/* weston_input_latency, see input-latency.c */
+
+void
+weston_input_latency_init(struct weston_compositor *compositor);
+
+void
+weston_input_latency_fini(struct weston_compositor *compositor);
+
+void
+weston_input_latency_pointer(struct weston_seat *seat,
+			     const struct timespec *time);
+
+void
+weston_input_latency_keyboard(struct weston_seat *seat,
+			      const struct timespec *time);
+
+void
+weston_input_latency_commit(struct weston_surface *surface);
+
+void
+weston_input_latency_repaint_begin(struct weston_output *output);
+
+void
+weston_input_latency_presented(struct weston_output *output,
+			       const struct timespec *vblank);
+
 /* weston_output */
 
 void
@@ -547,6 +573,15 @@ struct weston_paint_node {
 	struct weston_matrix output_to_buffer_matrix;
 	bool needs_filtering;
 
+	/*
+	 * Changes whenever buffer_to_output_matrix does, so that renderers
+	 * can keep data derived from the paint node geometry.
+	 */
+	uint32_t geometry_serial;
+
+	/* Emitted with the paint node as data before it is freed */
+	struct wl_signal destroy_signal;
+
 	bool valid_transform;
 	enum wl_output_transform transform;
 
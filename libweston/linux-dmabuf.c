@@ -34,6 +34,7 @@
 #include <sys/types.h>
 
 #include <libweston/libweston.h>
+#include "client-stats.h"
 #include "linux-dmabuf.h"
 #include "linux-dmabuf-unstable-v1-server-protocol.h"
 #include "shared/os-compatibility.h"
@@ -275,6 +276,9 @@ params_create_common(struct wl_client *client,
 	if (!weston_compositor_import_dmabuf(buffer->compositor, buffer))
 		goto err_failed;
 
+	weston_client_stats_add(buffer->compositor, client,
+				WESTON_CLIENT_STAT_DMABUF_IMPORTS, 1);
+
 avoid_gpu_import:
 	buffer->buffer_resource = wl_resource_create(client,
 						     &wl_buffer_interface,
@@ -0,0 +1,406 @@
+/*
+ * Copyright 2024 Collabora, Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libweston/libweston.h>
+#include <libweston/weston-log.h>
+#include "libweston-internal.h"
+#include "memory-stats.h"
+#include "shared/helpers.h"
+#include "shared/xalloc.h"
+
+/* Memory accounting
+ *
+ * The renderers and backends embed a weston_memory_allocation in the
+ * objects owning their big allocations, textures and framebuffers mostly,
+ * and track it with the size of the allocation. Tracking only links the
+ * record into a list and adds to a few counters, so it is always on.
+ *
+ * The owner of an allocation is resolved into a label and a client PID
+ * when it is tracked, so an allocation outliving its owner is harmless.
+ *
+ * Subscribing to the 'memory' scope prints the current and the peak size
+ * of each category, and the allocations grouped by owner, biggest first.
+ */
+
+static const char *const memory_category_names[] = {
+	[WESTON_MEMORY_SHM_TEXTURE] = "shm-texture",
+	[WESTON_MEMORY_COLOR_IMAGE] = "color-image",
+	[WESTON_MEMORY_SHADOW] = "shadow",
+	[WESTON_MEMORY_RENDERBUFFER] = "renderbuffer",
+	[WESTON_MEMORY_SCANOUT] = "scanout",
+};
+
+struct weston_memory_stats {
+	struct weston_compositor *compositor;
+	struct weston_log_scope *scope;
+	struct wl_list allocations;	/**< weston_memory_allocation::link */
+
+	unsigned count[WESTON_MEMORY_CATEGORY_COUNT];
+	uint64_t current[WESTON_MEMORY_CATEGORY_COUNT];
+	uint64_t peak[WESTON_MEMORY_CATEGORY_COUNT];
+	uint64_t total;
+	uint64_t total_peak;
+
+	/* High-watermark warning, 0 if disabled */
+	uint64_t warning;
+	bool warned;
+	struct weston_log_pacer warning_pacer;
+};
+
+struct memory_owner_row {
+	pid_t pid;
+	const char *owner;
+	unsigned count;
+	uint64_t size;
+};
+
+static void
+memory_stats_check_warning(struct weston_memory_stats *stats)
+{
+	if (stats->warning == 0)
+		return;
+
+	if (stats->total < stats->warning) {
+		stats->warned = false;
+		return;
+	}
+
+	if (stats->warned)
+		return;
+
+	stats->warned = true;
+	weston_log_paced(&stats->warning_pacer, 5, 60 * 60 * 1000,
+			 "Warning: tracked memory use of %.1f MiB went over "
+			 "%.1f MiB, see the 'memory' debug scope.\n",
+			 stats->total / (1024.0 * 1024.0),
+			 stats->warning / (1024.0 * 1024.0));
+}
+
+static void
+memory_track(struct weston_memory_allocation *alloc,
+	     struct weston_memory_stats *stats,
+	     enum weston_memory_category category, uint64_t size)
+{
+	assert(category < WESTON_MEMORY_CATEGORY_COUNT);
+
+	alloc->stats = stats;
+	alloc->category = category;
+	alloc->size = size;
+	wl_list_insert(&stats->allocations, &alloc->link);
+
+	stats->count[category]++;
+	stats->current[category] += size;
+	stats->peak[category] = MAX(stats->peak[category],
+				    stats->current[category]);
+	stats->total += size;
+	stats->total_peak = MAX(stats->total_peak, stats->total);
+
+	memory_stats_check_warning(stats);
+}
+
+/** Accounts an allocation of the compositor itself
+ *
+ * \param alloc The record embedded in the object owning the memory.
+ * \param compositor The compositor.
+ * \param category The kind of memory.
+ * \param size The size of the allocation in bytes.
+ *
+ * If the record is already tracked, it is untracked first, so a resized
+ * allocation can simply be tracked again.
+ */
+WL_EXPORT void
+weston_memory_track(struct weston_memory_allocation *alloc,
+		    struct weston_compositor *compositor,
+		    enum weston_memory_category category, uint64_t size)
+{
+	weston_memory_untrack(alloc);
+
+	if (!compositor->memory_stats)
+		return;
+
+	alloc->pid = 0;
+	snprintf(alloc->owner, sizeof alloc->owner, "compositor");
+	memory_track(alloc, compositor->memory_stats, category, size);
+}
+
+/** Accounts an allocation made for a surface
+ *
+ * \param alloc The record embedded in the object owning the memory.
+ * \param surface The surface the memory is used for.
+ * \param category The kind of memory.
+ * \param size The size of the allocation in bytes.
+ *
+ * The allocation is attributed to the client of the surface, and labelled
+ * with the role of the surface at the time of the call.
+ */
+WL_EXPORT void
+weston_memory_track_surface(struct weston_memory_allocation *alloc,
+			    struct weston_surface *surface,
+			    enum weston_memory_category category,
+			    uint64_t size)
+{
+	struct weston_compositor *compositor = surface->compositor;
+
+	weston_memory_untrack(alloc);
+
+	if (!compositor->memory_stats)
+		return;
+
+	alloc->pid = 0;
+	if (surface->resource)
+		wl_client_get_credentials(wl_resource_get_client(surface->resource),
+					  &alloc->pid, NULL, NULL);
+
+	if (!surface->get_label ||
+	    surface->get_label(surface, alloc->owner, sizeof alloc->owner) <= 0) {
+		if (surface->resource)
+			snprintf(alloc->owner, sizeof alloc->owner,
+				 "wl_surface@%u",
+				 wl_resource_get_id(surface->resource));
+		else
+			snprintf(alloc->owner, sizeof alloc->owner,
+				 "compositor surface");
+	}
+
+	memory_track(alloc, compositor->memory_stats, category, size);
+}
+
+/** Accounts an allocation made for an output
+ *
+ * \param alloc The record embedded in the object owning the memory.
+ * \param output The output the memory is used for.
+ * \param category The kind of memory.
+ * \param size The size of the allocation in bytes.
+ */
+WL_EXPORT void
+weston_memory_track_output(struct weston_memory_allocation *alloc,
+			   struct weston_output *output,
+			   enum weston_memory_category category,
+			   uint64_t size)
+{
+	struct weston_compositor *compositor = output->compositor;
+
+	weston_memory_untrack(alloc);
+
+	if (!compositor->memory_stats)
+		return;
+
+	alloc->pid = 0;
+	snprintf(alloc->owner, sizeof alloc->owner, "output %s", output->name);
+	memory_track(alloc, compositor->memory_stats, category, size);
+}
+
+/** Stops accounting an allocation
+ *
+ * \param alloc The record of the allocation, tracked or not.
+ *
+ * Call this when the memory is freed.
+ */
+WL_EXPORT void
+weston_memory_untrack(struct weston_memory_allocation *alloc)
+{
+	struct weston_memory_stats *stats = alloc->stats;
+
+	if (!stats)
+		return;
+
+	stats->count[alloc->category]--;
+	stats->current[alloc->category] -= alloc->size;
+	stats->total -= alloc->size;
+	wl_list_remove(&alloc->link);
+	alloc->stats = NULL;
+
+	memory_stats_check_warning(stats);
+}
+
+/** Sets the tracked memory size that triggers a warning
+ *
+ * \param compositor The compositor.
+ * \param bytes The size in bytes, or 0 to disable the warning.
+ *
+ * When the memory tracked for the renderers and backends grows over this
+ * size, a warning is logged. It is logged again only after the size has
+ * gone back under the limit.
+ *
+ * \ingroup compositor
+ */
+WL_EXPORT void
+weston_compositor_set_memory_warning(struct weston_compositor *compositor,
+				     uint64_t bytes)
+{
+	struct weston_memory_stats *stats = compositor->memory_stats;
+
+	if (!stats)
+		return;
+
+	stats->warning = bytes;
+	stats->warned = false;
+	memory_stats_check_warning(stats);
+}
+
+static int
+compare_allocations(const void *a, const void *b)
+{
+	const struct weston_memory_allocation *aa =
+		*(const struct weston_memory_allocation * const *)a;
+	const struct weston_memory_allocation *ab =
+		*(const struct weston_memory_allocation * const *)b;
+
+	if (aa->pid != ab->pid)
+		return aa->pid < ab->pid ? -1 : 1;
+
+	return strcmp(aa->owner, ab->owner);
+}
+
+static int
+compare_owner_rows(const void *a, const void *b)
+{
+	const struct memory_owner_row *ra = a;
+	const struct memory_owner_row *rb = b;
+
+	if (ra->size != rb->size)
+		return ra->size < rb->size ? 1 : -1;
+
+	return ra->pid - rb->pid;
+}
+
+static void
+memory_stats_print_owners(struct weston_memory_stats *stats,
+			  struct weston_log_subscription *sub)
+{
+	struct weston_memory_allocation *alloc, **allocs;
+	struct memory_owner_row *rows;
+	unsigned count, nrows = 0, i;
+
+	count = wl_list_length(&stats->allocations);
+	if (count == 0)
+		return;
+
+	allocs = xcalloc(count, sizeof *allocs);
+	rows = xcalloc(count, sizeof *rows);
+
+	i = 0;
+	wl_list_for_each(alloc, &stats->allocations, link)
+		allocs[i++] = alloc;
+	qsort(allocs, count, sizeof *allocs, compare_allocations);
+
+	for (i = 0; i < count; i++) {
+		if (nrows == 0 ||
+		    compare_allocations(&allocs[i], &allocs[i - 1]) != 0) {
+			rows[nrows].pid = allocs[i]->pid;
+			rows[nrows].owner = allocs[i]->owner;
+			nrows++;
+		}
+		rows[nrows - 1].count++;
+		rows[nrows - 1].size += allocs[i]->size;
+	}
+	qsort(rows, nrows, sizeof *rows, compare_owner_rows);
+
+	weston_log_subscription_printf(sub, "\n%7s %6s %12s  %s\n",
+				       "PID", "COUNT", "KiB", "OWNER");
+	for (i = 0; i < nrows; i++)
+		weston_log_subscription_printf(sub, "%7d %6u %12.1f  %s\n",
+					       (int)rows[i].pid, rows[i].count,
+					       rows[i].size / 1024.0,
+					       rows[i].owner);
+
+	free(rows);
+	free(allocs);
+}
+
+static void
+memory_stats_new_subscription(struct weston_log_subscription *sub,
+			      void *data)
+{
+	struct weston_memory_stats *stats = data;
+	int i;
+
+	weston_log_subscription_printf(sub, "%-14s %6s %12s %12s\n",
+				       "CATEGORY", "COUNT", "KiB", "PEAK KiB");
+	for (i = 0; i < WESTON_MEMORY_CATEGORY_COUNT; i++)
+		weston_log_subscription_printf(sub, "%-14s %6u %12.1f %12.1f\n",
+					       memory_category_names[i],
+					       stats->count[i],
+					       stats->current[i] / 1024.0,
+					       stats->peak[i] / 1024.0);
+	weston_log_subscription_printf(sub, "%-14s %6u %12.1f %12.1f\n",
+				       "total",
+				       wl_list_length(&stats->allocations),
+				       stats->total / 1024.0,
+				       stats->total_peak / 1024.0);
+
+	memory_stats_print_owners(stats, sub);
+
+	weston_log_subscription_complete(sub);
+}
+
+void
+weston_memory_stats_init(struct weston_compositor *compositor)
+{
+	struct weston_memory_stats *stats;
+
+	stats = xzalloc(sizeof *stats);
+	stats->compositor = compositor;
+	wl_list_init(&stats->allocations);
+
+	stats->scope =
+		weston_compositor_add_log_scope(compositor, "memory",
+						"Memory used by the renderers "
+						"and backends, by category "
+						"and owner\n",
+						memory_stats_new_subscription,
+						NULL, stats);
+
+	compositor->memory_stats = stats;
+}
+
+void
+weston_memory_stats_fini(struct weston_compositor *compositor)
+{
+	struct weston_memory_stats *stats = compositor->memory_stats;
+	struct weston_memory_allocation *alloc, *tmp;
+
+	if (!stats)
+		return;
+
+	/* Whatever is still tracked is not accounted anymore */
+	wl_list_for_each_safe(alloc, tmp, &stats->allocations, link) {
+		wl_list_remove(&alloc->link);
+		alloc->stats = NULL;
+	}
+
+	weston_log_scope_destroy(stats->scope);
+
+	free(stats);
+	compositor->memory_stats = NULL;
+}
@@ -0,0 +1,88 @@
+/*
+ * Copyright 2024 Collabora, Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef WESTON_MEMORY_STATS_H
+#define WESTON_MEMORY_STATS_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <wayland-util.h>
+
+struct weston_compositor;
+struct weston_memory_stats;
+struct weston_output;
+struct weston_surface;
+
+/** Kinds of memory allocated by the renderers and backends */
+enum weston_memory_category {
+	WESTON_MEMORY_SHM_TEXTURE = 0,	/**< GL textures of SHM buffers */
+	WESTON_MEMORY_COLOR_IMAGE,	/**< color transformed surface copies */
+	WESTON_MEMORY_SHADOW,		/**< renderer shadow framebuffers */
+	WESTON_MEMORY_RENDERBUFFER,	/**< renderer allocated output buffers */
+	WESTON_MEMORY_SCANOUT,		/**< dumb and GBM KMS framebuffers */
+	WESTON_MEMORY_CATEGORY_COUNT,
+};
+
+/** An allocation accounted in the 'memory' debug scope
+ *
+ * Embedded in the object owning the memory. A zero-initialized record is
+ * not tracked, and untracking it does nothing.
+ */
+struct weston_memory_allocation {
+	struct weston_memory_stats *stats;
+	struct wl_list link;		/**< weston_memory_stats::allocations */
+	enum weston_memory_category category;
+	uint64_t size;
+	pid_t pid;			/**< owning client, or 0 */
+	char owner[48];
+};
+
+void
+weston_memory_track(struct weston_memory_allocation *alloc,
+		    struct weston_compositor *compositor,
+		    enum weston_memory_category category, uint64_t size);
+
+void
+weston_memory_track_surface(struct weston_memory_allocation *alloc,
+			    struct weston_surface *surface,
+			    enum weston_memory_category category,
+			    uint64_t size);
+
+void
+weston_memory_track_output(struct weston_memory_allocation *alloc,
+			   struct weston_output *output,
+			   enum weston_memory_category category,
+			   uint64_t size);
+
+void
+weston_memory_untrack(struct weston_memory_allocation *alloc);
+
+void
+weston_memory_stats_init(struct weston_compositor *compositor);
+
+void
+weston_memory_stats_fini(struct weston_compositor *compositor);
+
+#endif /* WESTON_MEMORY_STATS_H */
@@ -34,10 +34,16 @@
 
 #include "pixman-renderer.h"
 #include "color.h"
+#include "color-cpu.h"
+#include "frame-stats.h"
+#include "memory-stats.h"
 #include "pixel-formats.h"
+#include "profiler.h"
 #include "output-capture.h"
+#include "timeline.h"
 #include "shared/helpers.h"
 #include "shared/signal.h"
+#include "shared/string-helpers.h"
 #include "shared/weston-drm-fourcc.h"
 #include "shared/xalloc.h"
 
@@ -64,6 +70,7 @@
 
 struct pixman_output_state {
 	pixman_image_t *shadow_image;
+	struct weston_memory_allocation shadow_mem;
 	const struct pixel_format_info *shadow_format;
 	pixman_image_t *hw_buffer;
 	const struct pixel_format_info *hw_format;
@@ -81,12 +88,38 @@ struct pixman_surface_state {
 	struct wl_listener buffer_destroy_listener;
 	struct wl_listener surface_destroy_listener;
 	struct wl_listener renderer_destroy_listener;
+
+	/* premultiplied RGBA of a solid color image */
+	float solid_color[4];
+
+	/* pixman_color_image::link, most recently used first */
+	struct wl_list color_images;
+};
+
+/* Keep no more converted copies of a surface than outputs it is likely
+ * to be shown on at once. */
+#define PIXMAN_COLOR_IMAGE_MAX 4
+
+/*
+ * The image of a surface run through a color transformation, see
+ * get_color_image(). damage is in buffer coordinates and not yet converted.
+ */
+struct pixman_color_image {
+	struct wl_list link;
+
+	pixman_image_t *image;
+	struct weston_memory_allocation mem;
+	struct weston_color_transform *xform;
+	struct wl_listener xform_destroy_listener;
+	pixman_region32_t damage;
 };
 
 struct pixman_renderbuffer {
 	struct weston_renderbuffer base;
 
 	pixman_image_t *image;
+	/* Only accounted when the renderer allocated the image */
+	struct weston_memory_allocation mem;
 	struct wl_list link;
 };
 
@@ -101,6 +134,10 @@ struct pixman_renderer {
 
 	struct weston_drm_format_array supported_formats;
 
+	/* for color transformations, created on first use */
+	struct weston_cpu_color_pool *color_pool;
+	bool color_pool_inited;
+
 #ifdef ENABLE_EGL
 	PFNEGLBINDWAYLANDDISPLAYWL bind_display;
 	PFNEGLUNBINDWAYLANDDISPLAYWL unbind_display;
@@ -355,9 +392,285 @@ composite_clipped(struct weston_output *output,
 	}
 }
 
+static struct weston_cpu_color_pool *
+get_color_pool(struct pixman_renderer *pr)
+{
+	const char *env;
+	int32_t n_threads;
+
+	if (pr->color_pool_inited)
+		return pr->color_pool;
+
+	pr->color_pool_inited = true;
+
+	/* The repaint thread takes part in the work as well. */
+	env = getenv("WESTON_PIXMAN_COLOR_THREADS");
+	if (!env || !safe_strtoint(env, &n_threads))
+		n_threads = MIN(sysconf(_SC_NPROCESSORS_ONLN), 4) - 1;
+
+	if (n_threads > 0)
+		pr->color_pool = weston_cpu_color_pool_create(n_threads);
+
+	return pr->color_pool;
+}
+
+/** Run a color transformation over a region of an image, in place
+ *
+ * \param pr The pixman renderer.
+ * \param cxf The CPU color transformation.
+ * \param image The image, with no clip region set.
+ * \param region The region to transform, in image coordinates.
+ *
+ * 32-bit RGB images are transformed directly, other formats go through
+ * a temporary copy.
+ */
+static void
+transform_image_region(struct pixman_renderer *pr,
+		       struct weston_cpu_color_transform *cxf,
+		       pixman_image_t *image,
+		       pixman_region32_t *region)
+{
+	struct weston_cpu_color_pool *pool = get_color_pool(pr);
+	pixman_format_code_t format = pixman_image_get_format(image);
+	uint32_t *data = pixman_image_get_data(image);
+	int stride = pixman_image_get_stride(image) / 4;
+	pixman_region32_t clipped;
+	pixman_box32_t *boxes;
+	int n_box;
+	int i;
+
+	pixman_region32_init(&clipped);
+	pixman_region32_intersect_rect(&clipped, region, 0, 0,
+				       pixman_image_get_width(image),
+				       pixman_image_get_height(image));
+
+	boxes = pixman_region32_rectangles(&clipped, &n_box);
+	for (i = 0; i < n_box; i++) {
+		int width = boxes[i].x2 - boxes[i].x1;
+		int height = boxes[i].y2 - boxes[i].y1;
+		pixman_image_t *tmp;
+
+		if (format == PIXMAN_a8r8g8b8 || format == PIXMAN_x8r8g8b8) {
+			weston_cpu_color_transform_run(cxf, pool,
+				data + boxes[i].y1 * stride + boxes[i].x1,
+				stride, width, height,
+				format == PIXMAN_x8r8g8b8);
+			continue;
+		}
+
+		tmp = pixman_image_create_bits_no_clear(PIXMAN_a8r8g8b8,
+							width, height,
+							NULL, 0);
+		abort_oom_if_null(tmp);
+
+		pixman_image_composite32(PIXMAN_OP_SRC, image, NULL, tmp,
+					 boxes[i].x1, boxes[i].y1,
+					 0, 0, 0, 0, width, height);
+		weston_cpu_color_transform_run(cxf, pool,
+					       pixman_image_get_data(tmp),
+					       width, width, height,
+					       PIXMAN_FORMAT_A(format) == 0);
+		pixman_image_composite32(PIXMAN_OP_SRC, tmp, NULL, image,
+					 0, 0, 0, 0,
+					 boxes[i].x1, boxes[i].y1,
+					 width, height);
+
+		pixman_image_unref(tmp);
+	}
+
+	pixman_region32_fini(&clipped);
+}
+
+static void
+pixman_color_image_destroy(struct pixman_color_image *ci)
+{
+	wl_list_remove(&ci->xform_destroy_listener.link);
+	wl_list_remove(&ci->link);
+
+	if (ci->image)
+		pixman_image_unref(ci->image);
+	weston_memory_untrack(&ci->mem);
+
+	pixman_region32_fini(&ci->damage);
+	free(ci);
+}
+
+static void
+color_image_handle_xform_destroy(struct wl_listener *listener, void *data)
+{
+	struct pixman_color_image *ci;
+
+	ci = container_of(listener, struct pixman_color_image,
+			  xform_destroy_listener);
+
+	pixman_color_image_destroy(ci);
+}
+
+static struct pixman_color_image *
+surface_state_get_color_image(struct pixman_surface_state *ps,
+			      struct weston_color_transform *xform)
+{
+	struct pixman_color_image *ci;
+	int count = 0;
+
+	wl_list_for_each(ci, &ps->color_images, link) {
+		if (ci->xform == xform) {
+			wl_list_remove(&ci->link);
+			wl_list_insert(&ps->color_images, &ci->link);
+			return ci;
+		}
+		count++;
+	}
+
+	if (count >= PIXMAN_COLOR_IMAGE_MAX) {
+		ci = container_of(ps->color_images.prev,
+				  struct pixman_color_image, link);
+		pixman_color_image_destroy(ci);
+	}
+
+	ci = xzalloc(sizeof *ci);
+	ci->xform = xform;
+	ci->xform_destroy_listener.notify = color_image_handle_xform_destroy;
+	wl_signal_add(&xform->destroy_signal, &ci->xform_destroy_listener);
+	pixman_region32_init(&ci->damage);
+	wl_list_insert(&ps->color_images, &ci->link);
+
+	return ci;
+}
+
+static void
+surface_state_drop_color_images(struct pixman_surface_state *ps)
+{
+	struct pixman_color_image *ci, *tmp;
+
+	wl_list_for_each_safe(ci, tmp, &ps->color_images, link)
+		pixman_color_image_destroy(ci);
+}
+
+static void
+surface_state_damage_color_images(struct pixman_surface_state *ps,
+				  pixman_region32_t *buffer_damage)
+{
+	struct pixman_color_image *ci;
+
+	wl_list_for_each(ci, &ps->color_images, link)
+		pixman_region32_union(&ci->damage, &ci->damage, buffer_damage);
+}
+
+static pixman_image_t *
+create_color_solid_image(struct pixman_surface_state *ps,
+			 struct weston_cpu_color_transform *cxf)
+{
+	float a = ps->solid_color[3];
+	float rgb[3] = { 0.0f, 0.0f, 0.0f };
+	pixman_color_t color;
+	int i;
+
+	if (a > 0.0f) {
+		for (i = 0; i < 3; i++)
+			rgb[i] = ps->solid_color[i] / a;
+
+		weston_cpu_color_transform_eval(cxf, rgb);
+
+		for (i = 0; i < 3; i++)
+			rgb[i] = CLIP(rgb[i], 0.0f, 1.0f) * a;
+	}
+
+	color.red = rgb[0] * 0xffff;
+	color.green = rgb[1] * 0xffff;
+	color.blue = rgb[2] * 0xffff;
+	color.alpha = a * 0xffff;
+
+	return pixman_image_create_solid_fill(&color);
+}
+
+/** Get the surface image in blending space
+ *
+ * \param pnode The paint node with a color transformation.
+ * \return A new reference to the image, or NULL on failure.
+ *
+ * The transformed image is kept per transformation, so a surface shown on
+ * outputs with different transformations keeps one copy for each, and
+ * only the surface damage is converted again on later calls. The least
+ * recently used copy is dropped beyond PIXMAN_COLOR_IMAGE_MAX.
+ */
+static pixman_image_t *
+get_color_image(struct weston_paint_node *pnode)
+{
+	struct pixman_renderer *pr = get_renderer(pnode->surface->compositor);
+	struct pixman_surface_state *ps = get_surface_state(pnode->surface);
+	struct weston_color_transform *xform = pnode->surf_xform.transform;
+	struct weston_cpu_color_transform *cxf;
+	struct pixman_color_image *ci;
+	pixman_format_code_t format;
+	int width, height;
+
+	cxf = weston_cpu_color_transform_get(xform);
+	if (!cxf)
+		return NULL;
+
+	if (!pixman_image_get_data(ps->image))
+		return create_color_solid_image(ps, cxf);
+
+	ci = surface_state_get_color_image(ps, xform);
+
+	format = pixman_image_get_format(ps->image);
+	width = pixman_image_get_width(ps->image);
+	height = pixman_image_get_height(ps->image);
+
+	if (!ci->image ||
+	    pixman_image_get_width(ci->image) != width ||
+	    pixman_image_get_height(ci->image) != height) {
+		if (ci->image)
+			pixman_image_unref(ci->image);
+
+		ci->image = pixman_image_create_bits_no_clear(
+			PIXMAN_FORMAT_A(format) ? PIXMAN_a8r8g8b8 :
+						  PIXMAN_x8r8g8b8,
+			width, height, NULL, 0);
+		abort_oom_if_null(ci->image);
+		weston_memory_track_surface(&ci->mem, ps->surface,
+					    WESTON_MEMORY_COLOR_IMAGE,
+					    (uint64_t)width * height * 4);
+
+		pixman_region32_fini(&ci->damage);
+		pixman_region32_init_rect(&ci->damage, 0, 0, width, height);
+	}
+
+	pixman_region32_intersect_rect(&ci->damage, &ci->damage,
+				       0, 0, width, height);
+
+	if (pixman_region32_not_empty(&ci->damage)) {
+		pixman_image_set_transform(ps->image, NULL);
+		pixman_image_set_filter(ps->image, PIXMAN_FILTER_NEAREST,
+					NULL, 0);
+		pixman_image_set_repeat(ps->image, PIXMAN_REPEAT_NONE);
+
+		if (ps->buffer_ref.buffer &&
+		    ps->buffer_ref.buffer->type == WESTON_BUFFER_SHM)
+			wl_shm_buffer_begin_access(ps->buffer_ref.buffer->shm_buffer);
+
+		pixman_image_set_clip_region32(ci->image, &ci->damage);
+		pixman_image_composite32(PIXMAN_OP_SRC, ps->image, NULL,
+					 ci->image,
+					 0, 0, 0, 0, 0, 0, width, height);
+		pixman_image_set_clip_region32(ci->image, NULL);
+
+		if (ps->buffer_ref.buffer &&
+		    ps->buffer_ref.buffer->type == WESTON_BUFFER_SHM)
+			wl_shm_buffer_end_access(ps->buffer_ref.buffer->shm_buffer);
+
+		transform_image_region(pr, cxf, ci->image, &ci->damage);
+		pixman_region32_clear(&ci->damage);
+	}
+
+	return pixman_image_ref(ci->image);
+}
+
 /** Paint an intersected region
  *
  * \param pnode The paint node to be painted.
+ * \param src_image The surface image, in blending space.
  * \param repaint_output The region to be painted in output coordinates.
  * \param source_clip The region of the source image to use, in source image
  *                    coordinates. If NULL, use the whole source image.
@@ -365,6 +678,7 @@ composite_clipped(struct weston_output *output,
  */
 static void
 repaint_region(struct weston_paint_node *pnode,
+	       pixman_image_t *src_image,
 	       pixman_region32_t *repaint_output,
 	       pixman_region32_t *source_clip,
 	       pixman_op_t pixman_op)
@@ -429,10 +743,10 @@ repaint_region(struct weston_paint_node *pnode,
 	}
 
 	if (source_clip)
-		composite_clipped(output, ps->image, mask_image, target_image,
+		composite_clipped(output, src_image, mask_image, target_image,
 				  &transform, filter, source_clip);
 	else
-		composite_whole(pixman_op, ps->image, mask_image,
+		composite_whole(pixman_op, src_image, mask_image,
 				target_image, &transform, filter);
 
 	if (mask_image)
@@ -458,6 +772,7 @@ repaint_region(struct weston_paint_node *pnode,
 
 static void
 draw_node_translated(struct weston_paint_node *pnode,
+		     pixman_image_t *src_image,
 		     pixman_region32_t *repaint_global)
 {
 	struct weston_output *output = pnode->output;
@@ -490,8 +805,8 @@ draw_node_translated(struct weston_paint_node *pnode,
 						       output,
 						       &repaint_output);
 
-			repaint_region(pnode, &repaint_output, NULL,
-				       PIXMAN_OP_SRC);
+			repaint_region(pnode, src_image, &repaint_output,
+				       NULL, PIXMAN_OP_SRC);
 		}
 	}
 
@@ -503,7 +818,8 @@ draw_node_translated(struct weston_paint_node *pnode,
 					       output,
 					       &repaint_output);
 
-		repaint_region(pnode, &repaint_output, NULL, PIXMAN_OP_OVER);
+		repaint_region(pnode, src_image, &repaint_output, NULL,
+			       PIXMAN_OP_OVER);
 	}
 
 	pixman_region32_fini(&surface_blend);
@@ -512,6 +828,7 @@ draw_node_translated(struct weston_paint_node *pnode,
 
 static void
 draw_node_source_clipped(struct weston_paint_node *pnode,
+			 pixman_image_t *src_image,
 			 pixman_region32_t *repaint_global)
 {
 	struct weston_surface *surface = pnode->surface;
@@ -540,7 +857,8 @@ draw_node_source_clipped(struct weston_paint_node *pnode,
 	weston_region_global_to_output(&repaint_output, output,
 				       &repaint_output);
 
-	repaint_region(pnode, &repaint_output, &buffer_region, PIXMAN_OP_OVER);
+	repaint_region(pnode, src_image, &repaint_output, &buffer_region,
+		       PIXMAN_OP_OVER);
 
 	pixman_region32_fini(&repaint_output);
 	pixman_region32_fini(&buffer_region);
@@ -554,12 +872,12 @@ draw_paint_node(struct weston_paint_node *pnode,
 	struct pixman_surface_state *ps = get_surface_state(pnode->surface);
 	/* repaint bounding region in global coordinates: */
 	pixman_region32_t repaint;
+	/* surface image in blending space: */
+	pixman_image_t *src_image = NULL;
 
 	if (!pnode->surf_xform_valid)
 		return;
 
-	assert(pnode->surf_xform.transform == NULL);
-
 	/* No buffer attached */
 	if (!ps->image)
 		return;
@@ -585,6 +903,14 @@ draw_paint_node(struct weston_paint_node *pnode,
 	if (!pixman_region32_not_empty(&repaint))
 		goto out;
 
+	if (pnode->surf_xform.transform)
+		src_image = get_color_image(pnode);
+	else
+		src_image = pixman_image_ref(ps->image);
+
+	if (!src_image)
+		goto out;
+
 	if (view_transformation_is_translation(pnode->view)) {
 		/* The simple case: The surface regions opaque, non-opaque,
 		 * etc. are convertible to global coordinate space.
@@ -593,7 +919,7 @@ draw_paint_node(struct weston_paint_node *pnode,
 		 * Also the boundingbox is accurate rather than an
 		 * approximation.
 		 */
-		draw_node_translated(pnode, &repaint);
+		draw_node_translated(pnode, src_image, &repaint);
 	} else {
 		/* The complex case: the view transformation does not allow
 		 * converting opaque etc. regions into global coordinate space.
@@ -602,10 +928,12 @@ draw_paint_node(struct weston_paint_node *pnode,
 		 * to be used whole. Source clipping does not work with
 		 * PIXMAN_OP_SRC.
 		 */
-		draw_node_source_clipped(pnode, &repaint);
+		draw_node_source_clipped(pnode, src_image, &repaint);
 	}
 
 out:
+	if (src_image)
+		pixman_image_unref(src_image);
 	pixman_region32_fini(&repaint);
 }
 static void
@@ -624,7 +952,11 @@ repaint_surfaces(struct weston_output *output, pixman_region32_t *damage)
 static void
 copy_to_hw_buffer(struct weston_output *output, pixman_region32_t *region)
 {
+	struct pixman_renderer *pr = get_renderer(output->compositor);
 	struct pixman_output_state *po = get_output_state(output);
+	struct weston_color_transform *xform =
+		output->color_outcome->from_blend_to_output;
+	struct weston_cpu_color_transform *cxf;
 	pixman_region32_t output_region;
 
 	pixman_region32_init(&output_region);
@@ -642,7 +974,6 @@ copy_to_hw_buffer(struct weston_output *output, pixman_region32_t *region)
 	}
 
 	pixman_image_set_clip_region32 (po->hw_buffer, &output_region);
-	pixman_region32_fini(&output_region);
 
 	pixman_image_composite32(PIXMAN_OP_SRC,
 				 po->shadow_image, /* src */
@@ -655,6 +986,15 @@ copy_to_hw_buffer(struct weston_output *output, pixman_region32_t *region)
 				 po->fb_size.height /* height */);
 
 	pixman_image_set_clip_region32 (po->hw_buffer, NULL);
+
+	if (xform && !output->from_blend_to_output_by_backend) {
+		cxf = weston_cpu_color_transform_get(xform);
+		if (cxf)
+			transform_image_region(pr, cxf, po->hw_buffer,
+					       &output_region);
+	}
+
+	pixman_region32_fini(&output_region);
 }
 
 static void
@@ -725,6 +1065,8 @@ pixman_renderer_repaint_output(struct weston_output *output,
 {
 	struct pixman_output_state *po = get_output_state(output);
 	struct pixman_renderbuffer *rb;
+	struct timespec stats_begin;
+	bool stats;
 
 	assert(renderbuffer);
 
@@ -733,11 +1075,17 @@ pixman_renderer_repaint_output(struct weston_output *output,
 	pixman_renderer_output_set_buffer(output, rb->image);
 
 	assert(output->from_blend_to_output_by_backend ||
-	       output->color_outcome->from_blend_to_output == NULL);
+	       output->color_outcome->from_blend_to_output == NULL ||
+	       po->shadow_image);
 
 	if (!po->hw_buffer)
  		return;
 
+	TL_POINT(output->compositor, "renderer_cpu_begin", TLP_OUTPUT(output),
+		 TLP_END);
+	WESTON_PROFILE_BEGIN(RENDERER_REPAINT);
+	stats = weston_frame_stats_start(output->compositor, &stats_begin);
+
 	/* Accumulate damage in all renderbuffers */
 	wl_list_for_each(rb, &po->renderbuffer_list, link) {
 		pixman_region32_union(&rb->base.damage,
@@ -759,6 +1107,13 @@ pixman_renderer_repaint_output(struct weston_output *output,
 					 po->hw_buffer, po->hw_format);
 	pixman_region32_clear(&renderbuffer->damage);
 
+	if (stats)
+		weston_frame_stats_add_since(output, WESTON_FRAME_STAT_RENDERER,
+					     &stats_begin);
+	WESTON_PROFILE_END(output->compositor, RENDERER_REPAINT);
+	TL_POINT(output->compositor, "renderer_cpu_end", TLP_OUTPUT(output),
+		 TLP_END);
+
 	wl_signal_emit(&output->frame_signal, output_damage);
 
 	/* Actual flip should be done by caller */
@@ -768,7 +1123,18 @@ static void
 pixman_renderer_flush_damage(struct weston_surface *surface,
 			     struct weston_buffer *buffer)
 {
-	/* No-op for pixman renderer */
+	struct pixman_surface_state *ps = get_surface_state(surface);
+	pixman_region32_t buffer_damage;
+
+	/* Only the color transformed copies of the image need updating. */
+	if (wl_list_empty(&ps->color_images))
+		return;
+
+	pixman_region32_init(&buffer_damage);
+	weston_surface_to_buffer_region(surface, &surface->damage,
+					&buffer_damage);
+	surface_state_damage_color_images(ps, &buffer_damage);
+	pixman_region32_fini(&buffer_damage);
 }
 
 static void
@@ -794,6 +1160,11 @@ pixman_renderer_surface_set_color(struct weston_surface *es,
 	struct pixman_surface_state *ps = get_surface_state(es);
 	pixman_color_t color;
 
+	ps->solid_color[0] = red;
+	ps->solid_color[1] = green;
+	ps->solid_color[2] = blue;
+	ps->solid_color[3] = alpha;
+
 	color.red = red * 0xffff;
 	color.green = green * 0xffff;
 	color.blue = blue * 0xffff;
@@ -1020,6 +1391,16 @@ pixman_renderer_attach(struct weston_surface *es, struct weston_buffer *buffer)
 	if (!buffer)
 		return;
 
+	/* Damage is only flushed for SHM buffers. */
+	if (buffer->type != WESTON_BUFFER_SHM) {
+		pixman_region32_t buffer_damage;
+
+		pixman_region32_init_rect(&buffer_damage, 0, 0,
+					  buffer->width, buffer->height);
+		surface_state_damage_color_images(ps, &buffer_damage);
+		pixman_region32_fini(&buffer_damage);
+	}
+
 	if (buffer->type == WESTON_BUFFER_SOLID) {
 		pixman_renderer_surface_set_color(es,
 						  buffer->solid.r,
@@ -1170,6 +1551,8 @@ pixman_renderer_surface_state_destroy(struct pixman_surface_state *ps)
 
 	ps->surface->renderer_state = NULL;
 
+	surface_state_drop_color_images(ps);
+
 	if (ps->image) {
 		pixman_image_unref(ps->image);
 		ps->image = NULL;
@@ -1216,6 +1599,8 @@ pixman_renderer_create_surface(struct weston_surface *surface)
 
 	ps->surface = surface;
 
+	wl_list_init(&ps->color_images);
+
 	ps->surface_destroy_listener.notify =
 		surface_state_handle_surface_destroy;
 	wl_signal_add(&surface->destroy_signal,
@@ -1255,6 +1640,8 @@ pixman_renderer_destroy(struct weston_compositor *ec)
 	wl_signal_emit(&pr->destroy_signal, pr);
 	weston_binding_destroy(pr->debug_binding);
 
+	weston_cpu_color_pool_destroy(pr->color_pool);
+
 	weston_drm_format_array_fini(&pr->supported_formats);
 
 	free(pr);
@@ -1344,6 +1731,14 @@ pixman_renderer_resize_output(struct weston_output *output,
 		pixman_image_create_bits_no_clear(po->shadow_format->pixman_format,
 						  fb_size->width, fb_size->height,
 						  NULL, 0);
+	if (po->shadow_image)
+		weston_memory_track_output(&po->shadow_mem, output,
+					   WESTON_MEMORY_SHADOW,
+					   (uint64_t)fb_size->width *
+					   fb_size->height *
+					   po->shadow_format->bpp / 8);
+	else
+		weston_memory_untrack(&po->shadow_mem);
 
 	weston_output_update_capture_info(output,
 					  WESTON_OUTPUT_CAPTURE_SOURCE_BLENDING,
@@ -1552,6 +1947,7 @@ pixman_renderer_init(struct weston_compositor *ec)
 	ec->renderer = &renderer->base;
 	ec->capabilities |= WESTON_CAP_ROTATION_ANY;
 	ec->capabilities |= WESTON_CAP_VIEW_CLIP_MASK;
+	ec->capabilities |= WESTON_CAP_COLOR_OPS;
 
 	weston_drm_format_array_init(&renderer->supported_formats);
 
@@ -1651,7 +2047,10 @@ pixman_renderer_output_create(struct weston_output *output,
 
 	output->renderer_state = po;
 
-	if (options->use_shadow)
+	/* The color transformation is applied when copying from the shadow. */
+	if (options->use_shadow ||
+	    (output->color_outcome->from_blend_to_output != NULL &&
+	     output->from_blend_to_output_by_backend == false))
 		po->shadow_format = options->format;
 
 	wl_list_init(&po->renderbuffer_list);
@@ -1684,6 +2083,7 @@ pixman_renderer_output_destroy(struct weston_output *output)
 
 	po->shadow_image = NULL;
 	po->hw_buffer = NULL;
+	weston_memory_untrack(&po->shadow_mem);
 
 	wl_list_for_each_safe(renderbuffer, tmp, &po->renderbuffer_list, link) {
 		wl_list_remove(&renderbuffer->link);
@@ -1761,6 +2161,9 @@ pixman_renderer_create_image(struct weston_output *output,
 		free(renderbuffer);
 		return NULL;
 	}
+	weston_memory_track_output(&renderbuffer->mem, output,
+				   WESTON_MEMORY_RENDERBUFFER,
+				   (uint64_t)width * height * format->bpp / 8);
 
 	pixman_region32_init(&renderbuffer->base.damage);
 	renderbuffer->base.refcount = 2;
@@ -1777,6 +2180,7 @@ pixman_renderer_renderbuffer_destroy(struct weston_renderbuffer *renderbuffer)
 
 	rb = container_of(renderbuffer, struct pixman_renderbuffer, base);
 	pixman_image_unref(rb->image);
+	weston_memory_untrack(&rb->mem);
 	pixman_region32_fini(&rb->base.damage);
 	free(rb);
 }
@@ -0,0 +1,275 @@
+/*
+ * Copyright 2024 Collabora, Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "config.h"
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <libweston/libweston.h>
+#include <libweston/weston-log.h>
+#include "libweston-internal.h"
+#include "profiler.h"
+#include "shared/helpers.h"
+#include "shared/timespec-util.h"
+#include "shared/xalloc.h"
+
+/* Built-in profiler
+ *
+ * Only built with -Dprofiler=true; otherwise the WESTON_PROFILE_BEGIN()
+ * and WESTON_PROFILE_END() macros expand to nothing and this file is not
+ * compiled.
+ *
+ * Each stage keeps a histogram of its durations with power of two
+ * nanosecond buckets, from startup on. The 'profiler' debug scope prints
+ * them, and so does weston_compositor_log_profile() into the log.
+ */
+
+/* Bucket i counts durations of [2^(i-1), 2^i) ns, bucket 0 counts 0 ns */
+#define PROFILER_BUCKETS 40
+
+struct profiler_stage {
+	uint64_t count;
+	uint64_t sum_nsec;
+	uint64_t min_nsec;
+	uint64_t max_nsec;
+	uint64_t buckets[PROFILER_BUCKETS];
+};
+
+struct weston_profiler {
+	struct weston_compositor *compositor;
+	struct weston_log_scope *scope;
+	struct timespec start;
+	struct profiler_stage stages[WESTON_PROFILE_STAGE_COUNT];
+};
+
+static const char *const profiler_stage_name[WESTON_PROFILE_STAGE_COUNT] = {
+	[WESTON_PROFILE_SURFACE_COMMIT] = "surface commit",
+	[WESTON_PROFILE_BUILD_VIEW_LIST] = "build view list",
+	[WESTON_PROFILE_ACCUMULATE_DAMAGE] = "accumulate damage",
+	[WESTON_PROFILE_ASSIGN_PLANES] = "assign planes",
+	[WESTON_PROFILE_RENDERER_REPAINT] = "renderer repaint",
+	[WESTON_PROFILE_ATOMIC_COMMIT] = "atomic commit",
+	[WESTON_PROFILE_CLIENT_EVENTS] = "client events",
+};
+
+static unsigned
+profiler_bucket(uint64_t nsec)
+{
+	unsigned bucket;
+
+	if (nsec == 0)
+		return 0;
+
+	bucket = 64 - __builtin_clzll(nsec);
+
+	return MIN(bucket, PROFILER_BUCKETS - 1);
+}
+
+/** Records the duration of one run of a stage
+ *
+ * \param compositor The compositor.
+ * \param stage The stage that ran.
+ * \param begin CLOCK_MONOTONIC time the stage started at.
+ *
+ * Use through WESTON_PROFILE_END().
+ */
+WL_EXPORT void
+weston_profiler_record(struct weston_compositor *compositor,
+		       enum weston_profile_stage stage,
+		       const struct timespec *begin)
+{
+	struct weston_profiler *profiler = compositor->profiler;
+	struct profiler_stage *ps;
+	struct timespec now;
+	int64_t elapsed;
+	uint64_t nsec;
+
+	if (!profiler)
+		return;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	elapsed = timespec_sub_to_nsec(&now, begin);
+	nsec = elapsed > 0 ? elapsed : 0;
+
+	ps = &profiler->stages[stage];
+	if (ps->count == 0 || nsec < ps->min_nsec)
+		ps->min_nsec = nsec;
+	if (nsec > ps->max_nsec)
+		ps->max_nsec = nsec;
+	ps->count++;
+	ps->sum_nsec += nsec;
+	ps->buckets[profiler_bucket(nsec)]++;
+}
+
+/* Upper bound of the bucket holding the p-th percentile */
+static uint64_t
+profiler_stage_percentile(const struct profiler_stage *ps, unsigned p)
+{
+	uint64_t rank = (ps->count * p + 99) / 100;
+	uint64_t seen = 0;
+	unsigned i;
+
+	for (i = 0; i < PROFILER_BUCKETS; i++) {
+		seen += ps->buckets[i];
+		if (seen >= rank && seen > 0)
+			return MIN((uint64_t)1 << i, ps->max_nsec);
+	}
+
+	return ps->max_nsec;
+}
+
+static void
+profiler_print(struct weston_profiler *profiler, FILE *fp)
+{
+	struct timespec now;
+	unsigned i, b;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	fprintf(fp, "Profile of %.1f s since startup, times in us\n",
+		timespec_sub_to_nsec(&now, &profiler->start) / 1e9);
+	fprintf(fp, "%-18s %10s %10s %10s %10s %10s %10s\n", "stage",
+		"count", "mean", "min", "p50", "p99", "max");
+
+	for (i = 0; i < WESTON_PROFILE_STAGE_COUNT; i++) {
+		const struct profiler_stage *ps = &profiler->stages[i];
+
+		if (ps->count == 0) {
+			fprintf(fp, "%-18s %10d\n", profiler_stage_name[i], 0);
+			continue;
+		}
+
+		fprintf(fp, "%-18s %10" PRIu64 " %10.1f %10.1f %10.1f "
+			"%10.1f %10.1f\n", profiler_stage_name[i], ps->count,
+			(double)ps->sum_nsec / ps->count / 1e3,
+			ps->min_nsec / 1e3,
+			profiler_stage_percentile(ps, 50) / 1e3,
+			profiler_stage_percentile(ps, 99) / 1e3,
+			ps->max_nsec / 1e3);
+	}
+
+	for (i = 0; i < WESTON_PROFILE_STAGE_COUNT; i++) {
+		const struct profiler_stage *ps = &profiler->stages[i];
+
+		if (ps->count == 0)
+			continue;
+
+		fprintf(fp, "%s:\n", profiler_stage_name[i]);
+		for (b = 0; b < PROFILER_BUCKETS; b++) {
+			if (ps->buckets[b] == 0)
+				continue;
+
+			fprintf(fp, "\t< %12.3f us: %10" PRIu64 " (%5.1f%%)\n",
+				((uint64_t)1 << b) / 1e3, ps->buckets[b],
+				100.0 * ps->buckets[b] / ps->count);
+		}
+	}
+}
+
+static char *
+profiler_print_to_string(struct weston_profiler *profiler)
+{
+	FILE *fp;
+	char *str = NULL;
+	size_t size = 0;
+
+	fp = open_memstream(&str, &size);
+	if (!fp)
+		return NULL;
+
+	profiler_print(profiler, fp);
+	fclose(fp);
+
+	return str;
+}
+
+static void
+profiler_new_subscription(struct weston_log_subscription *sub, void *data)
+{
+	struct weston_profiler *profiler = data;
+	char *str;
+
+	str = profiler_print_to_string(profiler);
+	if (str) {
+		weston_log_subscription_printf(sub, "%s", str);
+		free(str);
+	}
+
+	weston_log_subscription_complete(sub);
+}
+
+/** Prints the profile into the compositor log
+ *
+ * \param compositor The compositor.
+ */
+void
+weston_profiler_log(struct weston_compositor *compositor)
+{
+	char *str;
+
+	if (!compositor->profiler)
+		return;
+
+	str = profiler_print_to_string(compositor->profiler);
+	if (str) {
+		weston_log("%s", str);
+		free(str);
+	}
+}
+
+void
+weston_profiler_init(struct weston_compositor *compositor)
+{
+	struct weston_profiler *profiler;
+
+	profiler = xzalloc(sizeof *profiler);
+	profiler->compositor = compositor;
+	clock_gettime(CLOCK_MONOTONIC, &profiler->start);
+	profiler->scope =
+		weston_compositor_add_log_scope(compositor, "profiler",
+						"Hot path stage durations "
+						"since startup\n",
+						profiler_new_subscription,
+						NULL, profiler);
+
+	compositor->profiler = profiler;
+}
+
+void
+weston_profiler_fini(struct weston_compositor *compositor)
+{
+	struct weston_profiler *profiler = compositor->profiler;
+
+	if (!profiler)
+		return;
+
+	weston_log_scope_destroy(profiler->scope);
+	free(profiler);
+	compositor->profiler = NULL;
+}
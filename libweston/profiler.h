@@ -0,0 +1,94 @@
+/*
+ * Copyright 2024 Collabora, Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#ifndef WESTON_PROFILER_H
+#define WESTON_PROFILER_H
+
+#include <time.h>
+
+struct weston_compositor;
+
+/** Hot path stages timed by the built-in profiler */
+enum weston_profile_stage {
+	WESTON_PROFILE_SURFACE_COMMIT = 0,	/**< weston_surface_commit */
+	WESTON_PROFILE_BUILD_VIEW_LIST,		/**< view list for a repaint */
+	WESTON_PROFILE_ACCUMULATE_DAMAGE,	/**< output_accumulate_damage */
+	WESTON_PROFILE_ASSIGN_PLANES,		/**< backend assign_planes */
+	WESTON_PROFILE_RENDERER_REPAINT,	/**< renderer repaint_output */
+	WESTON_PROFILE_ATOMIC_COMMIT,		/**< KMS atomic commit */
+	WESTON_PROFILE_CLIENT_EVENTS,		/**< frame and presentation events */
+	WESTON_PROFILE_STAGE_COUNT,
+};
+
+#ifdef ENABLE_PROFILER
+
+/** Starts timing a stage
+ *
+ * Declares the start time in the current block, so it must be used as a
+ * statement of the block that also contains the matching
+ * WESTON_PROFILE_END(), and at most once per stage in that block.
+ */
+#define WESTON_PROFILE_BEGIN(stage) \
+	struct timespec weston_profile_begin_##stage; \
+	clock_gettime(CLOCK_MONOTONIC, &weston_profile_begin_##stage)
+
+/** Records the time since the matching WESTON_PROFILE_BEGIN() */
+#define WESTON_PROFILE_END(compositor, stage) \
+	weston_profiler_record((compositor), WESTON_PROFILE_##stage, \
+			       &weston_profile_begin_##stage)
+
+void
+weston_profiler_record(struct weston_compositor *compositor,
+		       enum weston_profile_stage stage,
+		       const struct timespec *begin);
+
+void
+weston_profiler_init(struct weston_compositor *compositor);
+
+void
+weston_profiler_fini(struct weston_compositor *compositor);
+
+void
+weston_profiler_log(struct weston_compositor *compositor);
+
+#else /* ENABLE_PROFILER */
+
+#define WESTON_PROFILE_BEGIN(stage) do { } while (0)
+#define WESTON_PROFILE_END(compositor, stage) do { } while (0)
+
+static inline void
+weston_profiler_init(struct weston_compositor *compositor)
+{
+}
+
+static inline void
+weston_profiler_fini(struct weston_compositor *compositor)
+{
+}
+
+#endif /* ENABLE_PROFILER */
+
+#endif /* WESTON_PROFILER_H */
@@ -81,6 +81,12 @@ precision HIGHPRECISION float;
 compile_const int c_color_swap = DEF_COLOR_SWAP;
 compile_const int c_variant = DEF_VARIANT;
 compile_const bool c_input_is_premult = DEF_INPUT_IS_PREMULT;
+compile_const bool c_input_is_opaque = DEF_INPUT_IS_OPAQUE ||
+	c_variant == SHADER_VARIANT_RGBX ||
+	c_variant == SHADER_VARIANT_Y_U_V ||
+	c_variant == SHADER_VARIANT_Y_UV ||
+	c_variant == SHADER_VARIANT_Y_XUXV ||
+	c_variant == SHADER_VARIANT_XYUV;
 compile_const bool c_green_tint = DEF_GREEN_TINT;
 compile_const int c_color_pre_curve = DEF_COLOR_PRE_CURVE;
 compile_const int c_color_mapping = DEF_COLOR_MAPPING;
@@ -129,18 +135,48 @@ uniform sampler2D tex;
 varying HIGHPRECISION vec2 v_texcoord;
 uniform sampler2D tex1;
 uniform sampler2D tex2;
+uniform HIGHPRECISION sampler2D color_pre_curve_lut_2d;
+uniform HIGHPRECISION sampler2D color_post_curve_lut_2d;
+
+/*
+ * Uniforms a variant does not use are replaced with constants, so that the
+ * code using them folds away instead of costing ALU time per pixel.
+ */
+
+#if DEF_APPLY_VIEW_ALPHA
 uniform float view_alpha;
+#else
+const float view_alpha = 1.0;
+#endif
+
+#if DEF_VARIANT == SHADER_VARIANT_SOLID
 uniform vec4 unicolor;
-uniform HIGHPRECISION sampler2D color_pre_curve_lut_2d;
+#else
+const vec4 unicolor = vec4(0.0);
+#endif
+
+#if DEF_COLOR_PRE_CURVE == SHADER_COLOR_CURVE_LUT_3x1D
 uniform HIGHPRECISION vec2 color_pre_curve_lut_scale_offset;
-uniform HIGHPRECISION sampler2D color_post_curve_lut_2d;
+#else
+const HIGHPRECISION vec2 color_pre_curve_lut_scale_offset = vec2(1.0, 0.0);
+#endif
+
+#if DEF_COLOR_POST_CURVE == SHADER_COLOR_CURVE_LUT_3x1D
 uniform HIGHPRECISION vec2 color_post_curve_lut_scale_offset;
+#else
+const HIGHPRECISION vec2 color_post_curve_lut_scale_offset = vec2(1.0, 0.0);
+#endif
 
 #if DEF_COLOR_MAPPING == SHADER_COLOR_MAPPING_3DLUT
 uniform HIGHPRECISION sampler3D color_mapping_lut_3d;
 uniform HIGHPRECISION vec2 color_mapping_lut_scale_offset;
 #endif
+
+#if DEF_COLOR_MAPPING == SHADER_COLOR_MAPPING_MATRIX
 uniform HIGHPRECISION mat3 color_mapping_matrix;
+#else
+const HIGHPRECISION mat3 color_mapping_matrix = mat3(1.0);
+#endif
 
 vec4
 sample_input_texture()
@@ -290,7 +326,7 @@ vec4
 color_pipeline(vec4 color)
 {
 	/* Ensure straight alpha */
-	if (c_input_is_premult) {
+	if (c_input_is_premult && !c_input_is_opaque) {
 		if (color.a == 0.0)
 			color.rgb = vec3(0, 0, 0);
 		else
@@ -319,16 +355,18 @@ main()
 	else if (c_color_swap == SHADER_COLOR_SWAP_ALL)
 		color.abgr = color;
 
-	if (c_variant == SHADER_VARIANT_RGBX)
+	/* Straight and pre-multiplied alpha are the same when opaque. */
+	if (c_input_is_opaque)
 		color.a = 1.0;
 
 	if (c_need_color_pipeline)
 		color = color_pipeline(color); /* Produces straight alpha */
-	else if (color.a == 0.0)
+	else if (!c_input_is_opaque && color.a == 0.0)
 		color.rgb = vec3(0, 0, 0);
 
 	/* Ensure pre-multiplied for blending */
-	if (!c_input_is_premult || c_need_color_pipeline)
+	if (!c_input_is_opaque &&
+	    (!c_input_is_premult || c_need_color_pipeline))
 		color.rgb *= color.a;
 
 	color *= view_alpha;
@@ -0,0 +1,397 @@
+/*
+ * Copyright 2024 Collabora, Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <libweston/libweston.h>
+#include <libweston/weston-log.h>
+
+#include "gl-renderer.h"
+#include "gl-renderer-internal.h"
+#include "shared/helpers.h"
+
+/*
+ * On-disk cache of linked GL programs, using GL_OES_get_program_binary.
+ *
+ * Every cached program lives in its own file named after the cache salt
+ * and the gl_shader_requirements bits. The salt covers the weston version,
+ * the GL driver identification strings and the GLSL sources including the
+ * #defines made from the requirements, so a weston, driver or shader
+ * update never loads a stale binary. Drivers are free to reject a binary
+ * anyway, in which case the caller falls back to compiling from source.
+ */
+
+#define GL_PROGRAM_CACHE_MAGIC 0x50474c57 /* "WLGP" */
+#define GL_PROGRAM_CACHE_VERSION 1
+#define GL_PROGRAM_CACHE_MAX_BINARY (4 * 1024 * 1024)
+
+struct gl_program_cache_header {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t salt;
+	struct gl_shader_requirements key;
+	uint32_t format;
+	uint32_t length;
+	uint32_t reserved;
+};
+static_assert(sizeof(struct gl_program_cache_header) == 32,
+	      "struct gl_program_cache_header must not contain implicit padding");
+
+uint64_t
+gl_program_cache_hash(uint64_t hash, const void *data, size_t len)
+{
+	const uint8_t *p = data;
+	size_t i;
+
+	/* 64-bit FNV-1a */
+	for (i = 0; i < len; i++) {
+		hash ^= p[i];
+		hash *= 0x100000001b3ull;
+	}
+
+	return hash;
+}
+
+static uint64_t
+gl_program_cache_hash_string(uint64_t hash, const char *str)
+{
+	if (!str)
+		str = "";
+
+	/* Include the terminator so that "ab" + "c" != "a" + "bc". */
+	return gl_program_cache_hash(hash, str, strlen(str) + 1);
+}
+
+static int
+mkdir_parents(char *path)
+{
+	char *p;
+
+	for (p = path + 1; *p; p++) {
+		if (*p != '/')
+			continue;
+
+		*p = '\0';
+		if (mkdir(path, 0700) < 0 && errno != EEXIST) {
+			*p = '/';
+			return -1;
+		}
+		*p = '/';
+	}
+
+	if (mkdir(path, 0700) < 0 && errno != EEXIST)
+		return -1;
+
+	return 0;
+}
+
+static char *
+gl_program_cache_get_dir(void)
+{
+	const char *base;
+	const char *suffix;
+	char *dir;
+
+	base = getenv("XDG_CACHE_HOME");
+	suffix = "weston/gl-programs";
+	if (!base || base[0] != '/') {
+		base = getenv("HOME");
+		suffix = ".cache/weston/gl-programs";
+	}
+	if (!base || base[0] != '/')
+		return NULL;
+
+	if (asprintf(&dir, "%s/%s", base, suffix) < 0)
+		return NULL;
+
+	return dir;
+}
+
+/** Set up the on-disk program cache directory
+ *
+ * \param gr The GL renderer, with a current context.
+ * \param source_hash Hash of the GLSL sources the programs are built from,
+ * see gl_shader_source_hash().
+ *
+ * The directory holds the program binaries, which need
+ * GL_OES_get_program_binary, and the record of used shader variants.
+ * Leaves the cache disabled on any failure, which only costs the startup
+ * compilations.
+ *
+ * Setting WESTON_GL_PROGRAM_CACHE=0 in the environment disables the cache.
+ */
+void
+gl_program_cache_init(struct gl_renderer *gr, uint64_t source_hash)
+{
+	const char *env;
+	uint64_t salt = 0xcbf29ce484222325ull; /* FNV offset basis */
+	char *dir;
+
+	assert(!gr->program_cache_dir);
+
+	env = getenv("WESTON_GL_PROGRAM_CACHE");
+	if (env && strcmp(env, "0") == 0)
+		return;
+
+	dir = gl_program_cache_get_dir();
+	if (!dir)
+		return;
+
+	if (mkdir_parents(dir) < 0) {
+		weston_log("GL program cache: cannot create %s: %s\n",
+			   dir, strerror(errno));
+		free(dir);
+		return;
+	}
+
+	salt = gl_program_cache_hash_string(salt, PACKAGE_VERSION);
+	salt = gl_program_cache_hash_string(salt,
+			(const char *) glGetString(GL_VENDOR));
+	salt = gl_program_cache_hash_string(salt,
+			(const char *) glGetString(GL_RENDERER));
+	salt = gl_program_cache_hash_string(salt,
+			(const char *) glGetString(GL_VERSION));
+	salt = gl_program_cache_hash_string(salt,
+			(const char *) glGetString(GL_SHADING_LANGUAGE_VERSION));
+	salt = gl_program_cache_hash(salt, &source_hash, sizeof source_hash);
+
+	gr->program_cache_dir = dir;
+	gr->program_cache_salt = salt;
+}
+
+void
+gl_program_cache_fini(struct gl_renderer *gr)
+{
+	free(gr->program_cache_dir);
+	gr->program_cache_dir = NULL;
+}
+
+static char *
+gl_program_cache_path(struct gl_renderer *gr,
+		      const struct gl_shader_requirements *req)
+{
+	uint32_t key;
+	char *path;
+
+	static_assert(sizeof key == sizeof *req,
+		      "gl_shader_requirements does not fit the file name");
+	memcpy(&key, req, sizeof key);
+
+	if (asprintf(&path, "%s/%016llx-%08x.bin", gr->program_cache_dir,
+		     (unsigned long long) gr->program_cache_salt, key) < 0)
+		return NULL;
+
+	return path;
+}
+
+static bool
+read_all(int fd, void *buf, size_t len)
+{
+	uint8_t *p = buf;
+	ssize_t ret;
+
+	while (len > 0) {
+		ret = read(fd, p, len);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret <= 0)
+			return false;
+		p += ret;
+		len -= ret;
+	}
+
+	return true;
+}
+
+static bool
+write_all(int fd, const void *buf, size_t len)
+{
+	const uint8_t *p = buf;
+	ssize_t ret;
+
+	while (len > 0) {
+		ret = write(fd, p, len);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret <= 0)
+			return false;
+		p += ret;
+		len -= ret;
+	}
+
+	return true;
+}
+
+/** Try to create a linked program from the on-disk cache
+ *
+ * \param gr The GL renderer.
+ * \param req The shader requirements the program was built for.
+ * \return A linked program object, or 0 on a cache miss.
+ *
+ * The attribute locations are part of the program binary, so the returned
+ * program is ready for glGetUniformLocation(). A binary the driver refuses
+ * is removed from the cache, so it gets replaced on the next store.
+ */
+GLuint
+gl_program_cache_load(struct gl_renderer *gr,
+		      const struct gl_shader_requirements *req)
+{
+	struct gl_program_cache_header hdr;
+	GLuint program = 0;
+	GLint status;
+	void *binary = NULL;
+	char *path;
+	int fd;
+
+	if (!gr->program_cache_dir || !gr->has_program_binary)
+		return 0;
+
+	path = gl_program_cache_path(gr, req);
+	if (!path)
+		return 0;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		goto out;
+
+	if (!read_all(fd, &hdr, sizeof hdr) ||
+	    hdr.magic != GL_PROGRAM_CACHE_MAGIC ||
+	    hdr.version != GL_PROGRAM_CACHE_VERSION ||
+	    hdr.salt != gr->program_cache_salt ||
+	    memcmp(&hdr.key, req, sizeof *req) != 0 ||
+	    hdr.length == 0 || hdr.length > GL_PROGRAM_CACHE_MAX_BINARY)
+		goto invalid;
+
+	binary = malloc(hdr.length);
+	if (!binary || !read_all(fd, binary, hdr.length))
+		goto invalid;
+
+	program = glCreateProgram();
+	gr->program_binary(program, hdr.format, binary, hdr.length);
+	glGetProgramiv(program, GL_LINK_STATUS, &status);
+	if (status)
+		goto out;
+
+	glDeleteProgram(program);
+	program = 0;
+
+invalid:
+	unlink(path);
+
+out:
+	if (fd >= 0)
+		close(fd);
+	free(binary);
+	free(path);
+
+	return program;
+}
+
+/** Save a linked program to the on-disk cache
+ *
+ * \param gr The GL renderer.
+ * \param req The shader requirements the program was built for.
+ * \param program A successfully linked program object.
+ *
+ * The file is written under a temporary name and renamed into place, so
+ * concurrent compositors and crashes never leave a torn entry behind.
+ */
+void
+gl_program_cache_store(struct gl_renderer *gr,
+		       const struct gl_shader_requirements *req,
+		       GLuint program)
+{
+	struct gl_program_cache_header hdr = {
+		.magic = GL_PROGRAM_CACHE_MAGIC,
+		.version = GL_PROGRAM_CACHE_VERSION,
+		.salt = gr->program_cache_salt,
+	};
+	GLint length = 0;
+	GLsizei written = 0;
+	GLenum format;
+	void *binary;
+	char *path;
+	char *tmp = NULL;
+	int fd;
+
+	if (!gr->program_cache_dir || !gr->has_program_binary)
+		return;
+
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH_OES, &length);
+	if (length <= 0 || length > GL_PROGRAM_CACHE_MAX_BINARY)
+		return;
+
+	binary = malloc(length);
+	if (!binary)
+		return;
+
+	gr->get_program_binary(program, length, &written, &format, binary);
+	if (written <= 0)
+		goto out_binary;
+
+	hdr.key = *req;
+	hdr.format = format;
+	hdr.length = written;
+
+	path = gl_program_cache_path(gr, req);
+	if (!path)
+		goto out_binary;
+
+	if (asprintf(&tmp, "%s.XXXXXX", path) < 0) {
+		tmp = NULL;
+		goto out_path;
+	}
+
+	fd = mkstemp(tmp);
+	if (fd < 0)
+		goto out_path;
+
+	if (!write_all(fd, &hdr, sizeof hdr) ||
+	    !write_all(fd, binary, written)) {
+		close(fd);
+		unlink(tmp);
+		goto out_path;
+	}
+
+	close(fd);
+	if (rename(tmp, path) < 0)
+		unlink(tmp);
+
+out_path:
+	free(tmp);
+	free(path);
+out_binary:
+	free(binary);
+}
@@ -30,6 +30,7 @@
 #define GL_RENDERER_INTERNAL_H
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <time.h>
 
 #include <wayland-util.h>
@@ -91,11 +92,18 @@ struct gl_shader_requirements
 	unsigned color_post_curve:1; /* enum gl_shader_color_curve */
 	unsigned color_swap:2; /* enum gl_shader_color_swap */
 
+	/*
+	 * Specializations derived from gl_shader_config when the program is
+	 * chosen, see gl_renderer_use_program().
+	 */
+	bool input_is_opaque:1; /* no alpha channel, or solid alpha 1.0 */
+	bool apply_view_alpha:1; /* view_alpha below 1.0 */
+
 	/*
 	 * The total size of all bitfields plus pad_bits_ must fill up exactly
 	 * how many bytes the compiler allocates for them together.
 	 */
-	unsigned pad_bits_:20;
+	unsigned pad_bits_:18;
 };
 static_assert(sizeof(struct gl_shader_requirements) ==
 	      4 /* total bitfield size in bytes */,
@@ -133,6 +141,8 @@ struct gl_renderer {
 
 	bool fragment_shader_debug;
 	bool fan_debug;
+	/* Skip the shadow framebuffer when nothing needs blending. */
+	bool fuse_output_transform;
 	struct weston_binding *fragment_binding;
 	struct weston_binding *fan_binding;
 
@@ -223,6 +233,21 @@ struct gl_renderer {
 
 	bool gl_supports_color_transforms;
 
+	bool has_program_binary;
+	PFNGLGETPROGRAMBINARYOESPROC get_program_binary;
+	PFNGLPROGRAMBINARYOESPROC program_binary;
+
+	/** On-disk program binary cache directory, NULL if disabled */
+	char *program_cache_dir;
+	uint64_t program_cache_salt;
+
+	/** Programs linked from source, to be stored from an idle callback
+	 *
+	 * Array of struct gl_shader_requirements.
+	 */
+	struct wl_array program_cache_pending;
+	struct wl_event_source *program_cache_store_source;
+
 	/** Shader program cache in most recently used order
 	 *
 	 * Uses struct gl_shader::link.
@@ -230,6 +255,16 @@ struct gl_renderer {
 	struct wl_list shader_list;
 	struct weston_log_scope *shader_scope;
 
+	/** Shader variants used in this and earlier sessions
+	 *
+	 * Array of struct gl_shader_requirements, persisted in the program
+	 * cache directory and compiled ahead of time on the next start-up.
+	 */
+	struct wl_array shader_variants;
+	struct wl_event_source *shader_variants_save_source;
+	struct wl_event_source *shader_warm_up_source;
+	size_t shader_warm_up_next;
+
 	bool is_mali_egl;
 };
 
@@ -289,6 +324,36 @@ gl_renderer_use_program(struct gl_renderer *gr,
 struct weston_log_scope *
 gl_shader_scope_create(struct gl_renderer *gr);
 
+void
+gl_renderer_precompile_programs(struct gl_renderer *gr);
+
+void
+gl_renderer_warm_up_programs(struct gl_renderer *gr);
+
+void
+gl_renderer_shader_variants_fini(struct gl_renderer *gr);
+
+uint64_t
+gl_shader_source_hash(void);
+
+uint64_t
+gl_program_cache_hash(uint64_t hash, const void *data, size_t len);
+
+void
+gl_program_cache_init(struct gl_renderer *gr, uint64_t source_hash);
+
+void
+gl_program_cache_fini(struct gl_renderer *gr);
+
+GLuint
+gl_program_cache_load(struct gl_renderer *gr,
+		      const struct gl_shader_requirements *req);
+
+void
+gl_program_cache_store(struct gl_renderer *gr,
+		       const struct gl_shader_requirements *req,
+		       GLuint program);
+
 bool
 gl_shader_config_set_color_transform(struct gl_shader_config *sconf,
 				     struct weston_color_transform *xform);
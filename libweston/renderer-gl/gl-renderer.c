@@ -32,6 +32,7 @@
 #include <GLES3/gl3.h>
 
 #include <stdbool.h>
+#include <inttypes.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
@@ -42,7 +43,11 @@
 #include <linux/input.h>
 #include <unistd.h>
 
+#include "client-stats.h"
+#include "frame-stats.h"
 #include "linux-sync-file.h"
+#include "memory-stats.h"
+#include "profiler.h"
 #include "timeline.h"
 
 #include "color.h"
@@ -65,6 +70,7 @@
 #include "shared/xalloc.h"
 
 #define BUFFER_DAMAGE_COUNT 2
+#define SHADOW_DAMAGE_COUNT 8
 
 enum gl_border_status {
 	BORDER_STATUS_CLEAN = 0,
@@ -96,6 +102,9 @@ struct gl_output_state {
 
 	EGLSurface egl_surface;
 	EGLSurface default_egl_surface;
+	/* Only accounted for pbuffers, at 4 bytes per pixel, other
+	 * surfaces belong to a window */
+	struct weston_memory_allocation egl_surface_mem;
 
 	pixman_region32_t buffer_damage[BUFFER_DAMAGE_COUNT];
 	int buffer_damage_index;
@@ -114,6 +123,17 @@ struct gl_output_state {
 
 	const struct pixel_format_info *shadow_format;
 	struct gl_fbo_texture shadow;
+	struct weston_memory_allocation shadow_mem;
+	/* True while surfaces are drawn straight to the output, see
+	 * output_can_fuse_color_transform(). */
+	bool fused_color_transform;
+	/* Shadow contents are outdated after fused repaints. */
+	bool shadow_stale;
+	/* Changes of the shadow contents, newest first, see
+	 * output_get_shadow_blit_damage(). */
+	pixman_region32_t shadow_damage[SHADOW_DAMAGE_COUNT];
+	int shadow_damage_index;
+	int shadow_damage_count;
 
 	struct wl_list renderbuffer_list;
 };
@@ -164,6 +184,7 @@ struct gl_buffer_state {
 	GLenum gl_pixel_type;
 	GLenum gl_format[3];
 	int offset[3]; /* per-plane pitch in bytes */
+	int cpp[3]; /* per-plane bytes per texel */
 
 	EGLImageKHR images[3];
 	int num_images;
@@ -173,6 +194,9 @@ struct gl_buffer_state {
 	GLuint textures[3];
 	int num_textures;
 
+	/* Texture memory of SHM buffers */
+	struct weston_memory_allocation mem;
+
 	struct wl_listener destroy_listener;
 };
 
@@ -194,6 +218,35 @@ struct gl_surface_state {
 	struct wl_listener renderer_destroy_listener;
 };
 
+/* Vertices of one repaint_region() call, kept in a buffer object */
+struct gl_vertex_cache {
+	bool valid;
+
+	/* What the vertices were generated from */
+	uint32_t geometry_serial;
+	int32_t buffer_width;
+	int32_t buffer_height;
+	enum weston_buffer_origin buffer_origin;
+	pixman_region32_t region; /* global coordinates */
+	pixman_region32_t surf_region; /* surface coordinates */
+
+	GLuint vbo;
+	struct wl_array vtxcnt; /* unsigned int per triangle fan */
+};
+
+/* The opaque and the blended part of a view */
+#define GL_VERTEX_CACHE_COUNT 2
+
+struct gl_paint_node_state {
+	struct weston_paint_node *pnode;
+
+	struct gl_vertex_cache vertex_cache[GL_VERTEX_CACHE_COUNT];
+	unsigned last_used_cache;
+
+	struct wl_listener pnode_destroy_listener;
+	struct wl_listener renderer_destroy_listener;
+};
+
 struct timeline_render_point {
 	struct wl_list link; /* gl_output_state::timeline_render_point_list */
 
@@ -263,6 +316,18 @@ shadow_exists(const struct gl_output_state *go)
 	return go->shadow.fbo != 0;
 }
 
+/* Transformation from sRGB to the space the current repaint draws in */
+static struct weston_color_transform *
+output_get_from_sRGB_transform(struct weston_output *output)
+{
+	struct gl_output_state *go = get_output_state(output);
+
+	if (go->fused_color_transform)
+		return output->color_outcome->from_sRGB_to_output;
+
+	return output->color_outcome->from_sRGB_to_blend;
+}
+
 struct yuv_format_descriptor yuv_formats[] = {
 	{
 		.format = DRM_FORMAT_YUYV,
@@ -336,10 +401,19 @@ struct yuv_format_descriptor yuv_formats[] = {
 	}
 };
 
+/* Whether anybody wants the GPU time of repaints */
+static bool
+timeline_gpu_time_wanted(struct gl_renderer *gr)
+{
+	return weston_log_scope_is_enabled(gr->compositor->timeline) ||
+	       weston_log_scope_is_enabled(gr->compositor->timeline_binary) ||
+	       weston_frame_stats_enabled(gr->compositor);
+}
+
 static void
 timeline_begin_render_query(struct gl_renderer *gr, GLuint query)
 {
-	if (weston_log_scope_is_enabled(gr->compositor->timeline) &&
+	if (timeline_gpu_time_wanted(gr) &&
 	    gr->has_native_fence_sync &&
 	    gr->has_disjoint_timer_query)
 		gr->begin_query(GL_TIME_ELAPSED_EXT, query);
@@ -348,7 +422,7 @@ timeline_begin_render_query(struct gl_renderer *gr, GLuint query)
 static void
 timeline_end_render_query(struct gl_renderer *gr)
 {
-	if (weston_log_scope_is_enabled(gr->compositor->timeline) &&
+	if (timeline_gpu_time_wanted(gr) &&
 	    gr->has_native_fence_sync &&
 	    gr->has_disjoint_timer_query)
 		gr->end_query(GL_TIME_ELAPSED_EXT);
@@ -394,6 +468,8 @@ timeline_render_point_handler(int fd, uint32_t mask, void *data)
 			 TLP_GPU(&begin), TLP_OUTPUT(trp->output), TLP_END);
 		TL_POINT(trp->output->compositor, "renderer_gpu_end",
 			 TLP_GPU(&end), TLP_OUTPUT(trp->output), TLP_END);
+		weston_frame_stats_add(trp->output, WESTON_FRAME_STAT_GPU,
+				       elapsed);
 	}
 
 	timeline_render_point_destroy(trp);
@@ -424,7 +500,7 @@ timeline_submit_render_sync(struct gl_renderer *gr,
 	int fd;
 	struct timeline_render_point *trp;
 
-	if (!weston_log_scope_is_enabled(gr->compositor->timeline) ||
+	if (!timeline_gpu_time_wanted(gr) ||
 	    !gr->has_native_fence_sync ||
 	    !gr->has_disjoint_timer_query ||
 	    sync == EGL_NO_SYNC_KHR)
@@ -454,6 +530,34 @@ timeline_submit_render_sync(struct gl_renderer *gr,
 	wl_list_insert(&go->timeline_render_point_list, &trp->link);
 }
 
+/* Transform 'surf_rect' from surface coordinates into global coordinates */
+static void
+surface_rect_to_global(struct weston_view *ev, pixman_box32_t *surf_rect,
+		       struct polygon8 *surf)
+{
+	struct weston_surface *es = ev->surface;
+	struct weston_coord_surface tmp[4] = {
+		weston_coord_surface(surf_rect->x1, surf_rect->y1, es),
+		weston_coord_surface(surf_rect->x2, surf_rect->y1, es),
+		weston_coord_surface(surf_rect->x2, surf_rect->y2, es),
+		weston_coord_surface(surf_rect->x1, surf_rect->y2, es),
+	};
+	int i;
+
+	surf->n = 4;
+	for (i = 0; i < surf->n; i++)
+		surf->pos[i] = weston_coord_surface_to_global(ev, tmp[i]).c;
+}
+
+static void
+clip_box_from_rect(struct clip_box *box, pixman_box32_t *rect)
+{
+	box->x1 = rect->x1;
+	box->y1 = rect->y1;
+	box->x2 = rect->x2;
+	box->y2 = rect->y2;
+}
+
 /*
  * Compute the boundary vertices of the intersection of the global coordinate
  * aligned rectangle 'rect', and an arbitrary quadrilateral produced from
@@ -471,25 +575,12 @@ calculate_edges(struct weston_view *ev, pixman_box32_t *rect,
 	struct clip_context ctx;
 	int i, n;
 	GLfloat min_x, max_x, min_y, max_y;
-	struct weston_surface *es = ev->surface;
-	struct weston_coord_surface tmp[4] = {
-		weston_coord_surface(surf_rect->x1, surf_rect->y1, es),
-		weston_coord_surface(surf_rect->x2, surf_rect->y1, es),
-		weston_coord_surface(surf_rect->x2, surf_rect->y2, es),
-		weston_coord_surface(surf_rect->x1, surf_rect->y2, es),
-	};
 	struct polygon8 surf;
 
-	surf.n = 4;
-
-	ctx.clip.x1 = rect->x1;
-	ctx.clip.y1 = rect->y1;
-	ctx.clip.x2 = rect->x2;
-	ctx.clip.y2 = rect->y2;
+	clip_box_from_rect(&ctx.clip, rect);
 
 	/* transform surface to screen space: */
-	for (i = 0; i < surf.n; i++)
-		surf.pos[i] = weston_coord_surface_to_global(ev, tmp[i]).c;
+	surface_rect_to_global(ev, surf_rect, &surf);
 
 	/* find bounding box: */
 	min_x = max_x = surf.pos[0].x;
@@ -592,6 +683,10 @@ texture_region(struct weston_paint_node *pnode,
 	unsigned int *vtxcnt, nvtx = 0;
 	pixman_box32_t *rects, *surf_rects;
 	pixman_box32_t *raw_rects;
+	struct polygon8 *quads = NULL;
+	struct clip_box *boxes = NULL;
+	struct weston_coord *clipped = NULL;
+	int *counts = NULL;
 	int i, j, k, nrects, nsurf, raw_nrects;
 	bool used_band_compression;
 	raw_rects = pixman_region32_rectangles(region, &raw_nrects);
@@ -614,11 +709,37 @@ texture_region(struct weston_paint_node *pnode,
 	inv_width = 1.0 / buffer->width;
 	inv_height = 1.0 / buffer->height;
 
+	/* Transformed views clip all pairs of rects in one batch, with each
+	 * surface rect transformed only once. Without memory for that,
+	 * calculate_edges() handles the pairs one at a time.
+	 */
+	if (ev->transform.enabled && nrects > 0 && nsurf > 0) {
+		quads = malloc(nsurf * sizeof *quads);
+		boxes = malloc(nrects * sizeof *boxes);
+		clipped = malloc(nrects * nsurf * 8 * sizeof *clipped);
+		counts = malloc(nrects * nsurf * sizeof *counts);
+
+		if (quads && boxes && clipped && counts) {
+			for (j = 0; j < nsurf; j++)
+				surface_rect_to_global(ev, &surf_rects[j],
+						       &quads[j]);
+			for (i = 0; i < nrects; i++)
+				clip_box_from_rect(&boxes[i], &rects[i]);
+
+			clip_transformed_batch(quads, nsurf, boxes, nrects,
+					       clipped, counts);
+		} else {
+			free(counts);
+			counts = NULL;
+		}
+	}
+
 	for (i = 0; i < nrects; i++) {
 		pixman_box32_t *rect = &rects[i];
 		for (j = 0; j < nsurf; j++) {
 			pixman_box32_t *surf_rect = &surf_rects[j];
-			struct weston_coord e[8];      /* edge points in screen space */
+			struct weston_coord edges[8];
+			struct weston_coord *e = edges; /* edge points in screen space */
 			int n;
 
 			/* The transformed surface, after clipping to the clip region,
@@ -635,7 +756,12 @@ texture_region(struct weston_paint_node *pnode,
 			 * form the intersection of the clip rect and the transformed
 			 * surface.
 			 */
-			n = calculate_edges(ev, rect, surf_rect, e);
+			if (counts) {
+				n = counts[i * nsurf + j];
+				e = &clipped[(i * nsurf + j) * 8];
+			} else {
+				n = calculate_edges(ev, rect, surf_rect, e);
+			}
 			if (n < 3)
 				continue;
 
@@ -667,11 +793,191 @@ texture_region(struct weston_paint_node *pnode,
 		}
 	}
 
+	free(quads);
+	free(boxes);
+	free(clipped);
+	free(counts);
+
 	if (used_band_compression)
 		free(rects);
 	return nvtx;
 }
 
+static void
+paint_node_state_destroy(struct gl_paint_node_state *pns)
+{
+	unsigned i;
+
+	wl_list_remove(&pns->pnode_destroy_listener.link);
+	wl_list_remove(&pns->renderer_destroy_listener.link);
+
+	for (i = 0; i < GL_VERTEX_CACHE_COUNT; i++) {
+		struct gl_vertex_cache *cache = &pns->vertex_cache[i];
+
+		if (cache->vbo)
+			glDeleteBuffers(1, &cache->vbo);
+		pixman_region32_fini(&cache->region);
+		pixman_region32_fini(&cache->surf_region);
+		wl_array_release(&cache->vtxcnt);
+	}
+
+	free(pns);
+}
+
+static void
+paint_node_state_handle_pnode_destroy(struct wl_listener *listener,
+				      void *data)
+{
+	struct gl_paint_node_state *pns;
+
+	pns = container_of(listener, struct gl_paint_node_state,
+			   pnode_destroy_listener);
+	assert(pns->pnode == data);
+
+	paint_node_state_destroy(pns);
+}
+
+static void
+paint_node_state_handle_renderer_destroy(struct wl_listener *listener,
+					 void *data)
+{
+	struct gl_paint_node_state *pns;
+
+	pns = container_of(listener, struct gl_paint_node_state,
+			   renderer_destroy_listener);
+
+	paint_node_state_destroy(pns);
+}
+
+static struct gl_paint_node_state *
+get_paint_node_state(struct weston_paint_node *pnode)
+{
+	struct gl_renderer *gr = get_renderer(pnode->surface->compositor);
+	struct gl_paint_node_state *pns;
+	struct wl_listener *l;
+	unsigned i;
+
+	l = wl_signal_get(&pnode->destroy_signal,
+			  paint_node_state_handle_pnode_destroy);
+	if (l)
+		return container_of(l, struct gl_paint_node_state,
+				    pnode_destroy_listener);
+
+	pns = zalloc(sizeof *pns);
+	if (!pns)
+		return NULL;
+
+	pns->pnode = pnode;
+	for (i = 0; i < GL_VERTEX_CACHE_COUNT; i++) {
+		pixman_region32_init(&pns->vertex_cache[i].region);
+		pixman_region32_init(&pns->vertex_cache[i].surf_region);
+		wl_array_init(&pns->vertex_cache[i].vtxcnt);
+	}
+
+	pns->pnode_destroy_listener.notify =
+		paint_node_state_handle_pnode_destroy;
+	wl_signal_add(&pnode->destroy_signal, &pns->pnode_destroy_listener);
+
+	pns->renderer_destroy_listener.notify =
+		paint_node_state_handle_renderer_destroy;
+	wl_signal_add(&gr->destroy_signal, &pns->renderer_destroy_listener);
+
+	return pns;
+}
+
+static bool
+vertex_cache_matches(const struct gl_vertex_cache *cache,
+		     struct weston_paint_node *pnode,
+		     const struct weston_buffer *buffer,
+		     pixman_region32_t *region,
+		     pixman_region32_t *surf_region)
+{
+	return cache->valid &&
+	       cache->geometry_serial == pnode->geometry_serial &&
+	       cache->buffer_width == buffer->width &&
+	       cache->buffer_height == buffer->height &&
+	       cache->buffer_origin == buffer->buffer_origin &&
+	       pixman_region32_equal(&cache->region, region) &&
+	       pixman_region32_equal(&cache->surf_region, surf_region);
+}
+
+/** Get the triangle fans for texture_region() from a buffer object
+ *
+ * The vertices only depend on the paint node geometry, the buffer size and
+ * the two regions, so for views that do not move they are generated and
+ * uploaded once instead of on every repaint. Paint node dirty flags change
+ * the geometry serial, which invalidates the cache.
+ *
+ * Returns NULL on allocation failure, in which case the caller needs to
+ * fall back to texture_region() with client-side arrays.
+ */
+static struct gl_vertex_cache *
+paint_node_get_vertices(struct gl_renderer *gr,
+			struct weston_paint_node *pnode,
+			pixman_region32_t *region,
+			pixman_region32_t *surf_region)
+{
+	struct gl_surface_state *gs = get_surface_state(pnode->surface);
+	struct weston_buffer *buffer = gs->buffer_ref.buffer;
+	struct gl_paint_node_state *pns;
+	struct gl_vertex_cache *cache;
+	unsigned int *vtxcnt;
+	unsigned i;
+	int nfans;
+
+	pns = get_paint_node_state(pnode);
+	if (!pns)
+		return NULL;
+
+	for (i = 0; i < GL_VERTEX_CACHE_COUNT; i++) {
+		cache = &pns->vertex_cache[i];
+		if (vertex_cache_matches(cache, pnode, buffer,
+					 region, surf_region)) {
+			pns->last_used_cache = i;
+			glBindBuffer(GL_ARRAY_BUFFER, cache->vbo);
+			return cache;
+		}
+	}
+
+	/* Replace the entry that was not used last. */
+	i = (pns->last_used_cache + 1) % GL_VERTEX_CACHE_COUNT;
+	cache = &pns->vertex_cache[i];
+	cache->valid = false;
+
+	if (!cache->vbo)
+		glGenBuffers(1, &cache->vbo);
+
+	cache->vtxcnt.size = 0;
+	nfans = texture_region(pnode, region, surf_region);
+	if (nfans > 0) {
+		vtxcnt = wl_array_add(&cache->vtxcnt, nfans * sizeof *vtxcnt);
+		if (!vtxcnt) {
+			gr->vertices.size = 0;
+			gr->vtxcnt.size = 0;
+			return NULL;
+		}
+		memcpy(vtxcnt, gr->vtxcnt.data, nfans * sizeof *vtxcnt);
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, cache->vbo);
+	glBufferData(GL_ARRAY_BUFFER, gr->vertices.size, gr->vertices.data,
+		     GL_STATIC_DRAW);
+
+	gr->vertices.size = 0;
+	gr->vtxcnt.size = 0;
+
+	cache->geometry_serial = pnode->geometry_serial;
+	cache->buffer_width = buffer->width;
+	cache->buffer_height = buffer->height;
+	cache->buffer_origin = buffer->buffer_origin;
+	pixman_region32_copy(&cache->region, region);
+	pixman_region32_copy(&cache->surf_region, surf_region);
+	cache->valid = true;
+	pns->last_used_cache = i;
+
+	return cache;
+}
+
 /** Create a texture and a framebuffer object
  *
  * \param fbotex To be initialized.
@@ -913,7 +1219,7 @@ triangle_fan_debug(struct gl_renderer *gr,
 		.unicolor = { col[0], col[1], col[2], col[3] },
 	};
 
-	ctransf = output->color_outcome->from_sRGB_to_blend;
+	ctransf = output_get_from_sRGB_transform(output);
 	if (!gl_shader_config_set_color_transform(&alt, ctransf)) {
 		weston_log("GL-renderer: %s failed to generate a color transformation.\n",
 			   __func__);
@@ -950,6 +1256,8 @@ repaint_region(struct gl_renderer *gr,
 	       const struct gl_shader_config *sconf)
 {
 	struct weston_output *output = pnode->output;
+	struct gl_vertex_cache *cache;
+	const GLvoid *position, *texcoord;
 	GLfloat *v;
 	unsigned int *vtxcnt;
 	int i, first, nfans;
@@ -962,15 +1270,25 @@ repaint_region(struct gl_renderer *gr,
 	 * polygon for each pair, and store it as a triangle fan if
 	 * it has a non-zero area (at least 3 vertices, actually).
 	 */
-	nfans = texture_region(pnode, region, surf_region);
-
-	v = gr->vertices.data;
-	vtxcnt = gr->vtxcnt.data;
+	cache = paint_node_get_vertices(gr, pnode, region, surf_region);
+	if (cache) {
+		/* Offsets into the bound buffer object */
+		vtxcnt = cache->vtxcnt.data;
+		nfans = cache->vtxcnt.size / sizeof *vtxcnt;
+		position = (const GLvoid *) 0;
+		texcoord = (const GLvoid *) (2 * sizeof *v);
+	} else {
+		nfans = texture_region(pnode, region, surf_region);
+		v = gr->vertices.data;
+		vtxcnt = gr->vtxcnt.data;
+		position = &v[0];
+		texcoord = &v[2];
+	}
 
 	/* position: */
-	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof *v, &v[0]);
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof *v, position);
 	/* texcoord: */
-	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof *v, &v[2]);
+	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof *v, texcoord);
 
 	if (!gl_renderer_use_program(gr, sconf)) {
 		gl_renderer_send_shader_error(pnode);
@@ -984,6 +1302,9 @@ repaint_region(struct gl_renderer *gr,
 		first += vtxcnt[i];
 	}
 
+	if (cache)
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+
 	gr->vertices.size = 0;
 	gr->vtxcnt.size = 0;
 }
@@ -1092,7 +1413,7 @@ censor_override(struct gl_shader_config *sconf,
 		.unicolor = { 0.40, 0.0, 0.0, 1.0 },
 	};
 
-	ctransf = output->color_outcome->from_sRGB_to_blend;
+	ctransf = output_get_from_sRGB_transform(output);
 	if (!gl_shader_config_set_color_transform(&alt, ctransf)) {
 		weston_log("GL-renderer: %s failed to generate a color transformation.\n",
 			   __func__);
@@ -1168,6 +1489,7 @@ gl_shader_config_init_for_paint_node(struct gl_shader_config *sconf,
 {
 	struct gl_surface_state *gs = get_surface_state(pnode->surface);
 	struct gl_output_state *go = get_output_state(pnode->output);
+	struct weston_color_transform *ctransf;
 
 	if (!pnode->surf_xform_valid)
 		return false;
@@ -1180,7 +1502,12 @@ gl_shader_config_init_for_paint_node(struct gl_shader_config *sconf,
 
 	gl_shader_config_set_input_textures(sconf, gs);
 
-	if (!gl_shader_config_set_color_transform(sconf, pnode->surf_xform.transform)) {
+	if (go->fused_color_transform)
+		ctransf = pnode->surf_xform.to_output;
+	else
+		ctransf = pnode->surf_xform.transform;
+
+	if (!gl_shader_config_set_color_transform(sconf, ctransf)) {
 		weston_log("GL-renderer: failed to generate a color transformation.\n");
 		return false;
 	}
@@ -1568,15 +1895,13 @@ output_get_border_damage(struct weston_output *output,
 	}
 }
 
-static void
-output_get_damage(struct weston_output *output,
-		  pixman_region32_t *buffer_damage, uint32_t *border_damage)
+static EGLint
+output_get_buffer_age(struct weston_output *output)
 {
 	struct gl_output_state *go = get_output_state(output);
 	struct gl_renderer *gr = get_renderer(output->compositor);
 	EGLint buffer_age = 0;
 	EGLBoolean ret;
-	int i;
 
 	if (gr->has_egl_buffer_age &&
 	    go->egl_surface == go->default_egl_surface) {
@@ -1585,11 +1910,22 @@ output_get_damage(struct weston_output *output,
 		if (ret == EGL_FALSE) {
 			weston_log("buffer age query failed.\n");
 			gl_renderer_print_egl_error_state();
+			buffer_age = 0;
 		}
 	} else if (go->swap_behavior_is_preserved) {
 		buffer_age = 1;
 	}
 
+	return buffer_age;
+}
+
+static void
+output_get_damage(struct weston_output *output, EGLint buffer_age,
+		  pixman_region32_t *buffer_damage, uint32_t *border_damage)
+{
+	struct gl_output_state *go = get_output_state(output);
+	int i;
+
 	if (buffer_age == 0 || buffer_age - 1 > BUFFER_DAMAGE_COUNT) {
 		pixman_region32_copy(buffer_damage, &output->region);
 		*border_damage = BORDER_ALL_DIRTY;
@@ -1629,6 +1965,56 @@ output_rotate_damage(struct weston_output *output,
 	go->border_damage[go->buffer_damage_index] = border_status;
 }
 
+/* Record the area of the shadow that changes in this repaint */
+static void
+output_rotate_shadow_damage(struct weston_output *output,
+			    pixman_region32_t *shadow_damage)
+{
+	struct gl_output_state *go = get_output_state(output);
+
+	go->shadow_damage_index += SHADOW_DAMAGE_COUNT - 1;
+	go->shadow_damage_index %= SHADOW_DAMAGE_COUNT;
+
+	pixman_region32_copy(&go->shadow_damage[go->shadow_damage_index],
+			     shadow_damage);
+	go->shadow_damage_count = MIN(go->shadow_damage_count + 1,
+				      SHADOW_DAMAGE_COUNT);
+}
+
+/** Compute the area to blit from the shadow into the back buffer
+ *
+ * \param output The output being repainted.
+ * \param buffer_age The age of the back buffer, 0 if unknown.
+ * \param border_damage Border changes since the back buffer was last used.
+ * \param blit_damage The resulting region, in global coordinates.
+ *
+ * The back buffer needs everything that changed in the shadow since it was
+ * last written, the current repaint included. The shadow history goes
+ * further back than the buffer damage history, so deeper swap chains do not
+ * fall back to converting the whole output on every frame.
+ *
+ * Must be called after output_rotate_shadow_damage().
+ */
+static void
+output_get_shadow_blit_damage(struct weston_output *output,
+			      EGLint buffer_age, uint32_t border_damage,
+			      pixman_region32_t *blit_damage)
+{
+	struct gl_output_state *go = get_output_state(output);
+	int i;
+
+	if (buffer_age == 0 || buffer_age > go->shadow_damage_count ||
+	    (border_damage & BORDER_SIZE_CHANGED)) {
+		pixman_region32_copy(blit_damage, &output->region);
+		return;
+	}
+
+	pixman_region32_clear(blit_damage);
+	for (i = 0; i < buffer_age; i++)
+		pixman_region32_union(blit_damage, blit_damage,
+				      &go->shadow_damage[(go->shadow_damage_index + i) % SHADOW_DAMAGE_COUNT]);
+}
+
 /**
  * Given a region in Weston's (top-left-origin) global co-ordinate space,
  * translate it to the co-ordinate space used by GL for our output
@@ -1642,12 +2028,14 @@ output_rotate_damage(struct weston_output *output,
  *
  * @param output The output whose co-ordinate space we are after
  * @param global_region The affected region in global co-ordinate space
+ * @param border_status The borders to add to the region
  * @param[out] rects Y-inverted quads in {x,y,w,h} order; caller must free
  * @param[out] nrects Number of quads (4x number of co-ordinates)
  */
 static void
 pixman_region_to_egl_y_invert(struct weston_output *output,
 			      struct pixman_region32 *global_region,
+			      enum gl_border_status border_status,
 			      EGLint **rects,
 			      EGLint *nrects)
 {
@@ -1669,7 +2057,7 @@ pixman_region_to_egl_y_invert(struct weston_output *output,
 	if (output_has_borders(output)) {
 		pixman_region32_translate(&transformed,
 					  go->area.x, go->area.y);
-		output_get_border_damage(output, go->border_status,
+		output_get_border_damage(output, border_status,
 					 &transformed);
 	}
 
@@ -1772,6 +2160,187 @@ blit_shadow_to_output(struct weston_output *output,
 	pixman_region32_fini(&translated_damage);
 }
 
+/* Fill what no view covers when the shadow is skipped. The shadow holds
+ * black there, which the shadow blit passes through the blend-to-output
+ * transformation, so do the same. */
+static void
+draw_fused_background(struct weston_output *output,
+		      pixman_region32_t *output_damage)
+{
+	struct gl_output_state *go = get_output_state(output);
+	struct gl_shader_config sconf = {
+		.req = {
+			.variant = SHADER_VARIANT_SOLID,
+			.input_is_premult = true,
+		},
+		.projection = {
+			.d = { /* transpose */
+				 2.0f,  0.0f, 0.0f, 0.0f,
+				 0.0f,  2.0f, 0.0f, 0.0f,
+				 0.0f,  0.0f, 1.0f, 0.0f,
+				-1.0f, -1.0f, 0.0f, 1.0f
+			},
+			.type = WESTON_MATRIX_TRANSFORM_SCALE |
+				WESTON_MATRIX_TRANSFORM_TRANSLATE,
+		},
+		.view_alpha = 1.0f,
+		.unicolor = { 0.0f, 0.0f, 0.0f, 1.0f },
+	};
+	struct weston_compositor *compositor = output->compositor;
+	struct gl_renderer *gr = get_renderer(compositor);
+	struct weston_color_transform *ctransf;
+	struct weston_paint_node *pnode;
+	double width = go->area.width;
+	double height = go->area.height;
+	pixman_region32_t uncovered;
+	pixman_box32_t *rects;
+	int n_rects;
+	int i;
+	GLfloat verts[4 * 2];
+
+	/* output_damage is in global coordinates */
+	pixman_region32_init(&uncovered);
+	pixman_region32_intersect(&uncovered, output_damage, &output->region);
+
+	/* Views drawn here are all opaque, see
+	 * output_can_fuse_color_transform() */
+	wl_list_for_each(pnode, &output->paint_node_z_order_list,
+			 z_order_link) {
+		if (pnode->view->plane != &compositor->primary_plane ||
+		    !pnode->surf_xform_valid)
+			continue;
+
+		pixman_region32_subtract(&uncovered, &uncovered,
+					 &pnode->view->transform.boundingbox);
+	}
+
+	if (!pixman_region32_not_empty(&uncovered))
+		goto out;
+
+	ctransf = output->color_outcome->from_blend_to_output;
+	if (!gl_shader_config_set_color_transform(&sconf, ctransf)) {
+		weston_log("GL-renderer: %s failed to generate a color transformation.\n", __func__);
+		goto out;
+	}
+
+	/* Convert to output pixel coordinates in-place */
+	weston_region_global_to_output(&uncovered, output, &uncovered);
+
+	gl_renderer_use_program(gr, &sconf);
+	glDisable(GL_BLEND);
+
+	glEnableVertexAttribArray(0);
+	glEnableVertexAttribArray(1);
+
+	rects = pixman_region32_rectangles(&uncovered, &n_rects);
+	for (i = 0; i < n_rects; i++) {
+		verts[0] = rects[i].x1 / width;
+		verts[1] = (height - rects[i].y1) / height;
+		verts[2] = rects[i].x2 / width;
+		verts[3] = (height - rects[i].y1) / height;
+
+		verts[4] = rects[i].x2 / width;
+		verts[5] = (height - rects[i].y2) / height;
+		verts[6] = rects[i].x1 / width;
+		verts[7] = (height - rects[i].y2) / height;
+
+		/* position: */
+		glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, verts);
+		/* texcoord: */
+		glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, verts);
+
+		glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+	}
+
+	glDisableVertexAttribArray(1);
+	glDisableVertexAttribArray(0);
+
+out:
+	pixman_region32_fini(&uncovered);
+}
+
+/** Check if the shadow framebuffer can be skipped in this repaint
+ *
+ * The blend-to-output transformation can be folded into the per-surface
+ * shaders when all surfaces share the same source-to-output
+ * transformation. Blending has to happen in the blending space though, so
+ * this is only done when every surface is opaque and nothing gets blended.
+ * Then the extra full-output pass through the shadow is not needed.
+ */
+static bool
+output_can_fuse_color_transform(struct weston_output *output)
+{
+	struct weston_compositor *compositor = output->compositor;
+	struct gl_renderer *gr = get_renderer(compositor);
+	struct gl_output_state *go = get_output_state(output);
+	struct weston_color_transform *to_output = NULL;
+	struct weston_paint_node *pnode;
+
+	if (!gr->fuse_output_transform || !shadow_exists(go) ||
+	    output->from_blend_to_output_by_backend ||
+	    !output->color_outcome->from_blend_to_output)
+		return false;
+
+	if (compositor->test_data.test_quirks.gl_force_full_redraw_of_shadow_fb)
+		return false;
+
+	wl_list_for_each(pnode, &output->paint_node_z_order_list,
+			 z_order_link) {
+		if (pnode->view->plane != &compositor->primary_plane)
+			continue;
+
+		if (!pnode->surf_xform_valid)
+			continue;
+
+		if (!weston_view_is_opaque(pnode->view,
+					   &pnode->view->transform.boundingbox))
+			return false;
+	}
+
+	/* Only now have the direct transformations built. */
+	wl_list_for_each(pnode, &output->paint_node_z_order_list,
+			 z_order_link) {
+		struct weston_color_transform *xform;
+
+		if (pnode->view->plane != &compositor->primary_plane)
+			continue;
+
+		if (!pnode->surf_xform_valid)
+			continue;
+
+		xform = weston_paint_node_ensure_to_output_color_transform(pnode);
+		if (!xform || (to_output && xform != to_output))
+			return false;
+
+		to_output = xform;
+	}
+
+	return true;
+}
+
+/* Shadow area neither drawn nor blitted thanks to a fused repaint */
+static void
+log_skipped_shadow_pass(struct weston_output *output,
+			pixman_region32_t *damage)
+{
+	struct gl_renderer *gr = get_renderer(output->compositor);
+	pixman_box32_t *rects;
+	uint64_t pixels = 0;
+	int n, i;
+
+	if (!weston_log_scope_is_enabled(gr->renderer_scope))
+		return;
+
+	rects = pixman_region32_rectangles(damage, &n);
+	for (i = 0; i < n; i++)
+		pixels += (uint64_t)(rects[i].x2 - rects[i].x1) *
+			  (rects[i].y2 - rects[i].y1);
+
+	weston_log_scope_printf(gr->renderer_scope,
+		"Output %s: fused color transformation, skipped shadow "
+		"pass of %" PRIu64 " pixels\n", output->name, pixels);
+}
+
 /* NOTE: We now allow falling back to ARGB gl visuals when XRGB is
  * unavailable, so we're assuming the background has no transparency
  * and that everything with a blend, like drop shadows, will have something
@@ -1795,9 +2364,12 @@ gl_renderer_repaint_output(struct weston_output *output,
 	/* total area we need to repaint this time */
 	pixman_region32_t total_damage;
 	enum gl_border_status border_status = BORDER_STATUS_CLEAN;
+	EGLint buffer_age;
 	struct weston_paint_node *pnode;
 	const int32_t area_inv_y =
 		go->fb_size.height - go->area.y - go->area.height;
+	struct timespec stats_begin;
+	bool stats;
 
 	assert(output->from_blend_to_output_by_backend ||
 	       output->color_outcome->from_blend_to_output == NULL ||
@@ -1814,6 +2386,9 @@ gl_renderer_repaint_output(struct weston_output *output,
 	if (use_output(output) < 0)
 		return;
 
+	WESTON_PROFILE_BEGIN(RENDERER_REPAINT);
+	stats = weston_frame_stats_start(compositor, &stats_begin);
+
 	/* Clear the used_in_output_repaint flag, so that we can properly track
 	 * which surfaces were used in this output repaint. */
 	wl_list_for_each_reverse(pnode, &output->paint_node_z_order_list,
@@ -1839,8 +2414,10 @@ gl_renderer_repaint_output(struct weston_output *output,
 			    2.0 / go->area.width,
 			    -2.0 / go->area.height, 1);
 
+	go->fused_color_transform = output_can_fuse_color_transform(output);
+
 	/* If using shadow, redirect all drawing to it first. */
-	if (shadow_exists(go)) {
+	if (shadow_exists(go) && !go->fused_color_transform) {
 		glBindFramebuffer(GL_FRAMEBUFFER, go->shadow.fbo);
 		glViewport(0, 0, go->area.width, go->area.height);
 	} else {
@@ -1871,7 +2448,8 @@ gl_renderer_repaint_output(struct weston_output *output,
 
 	/* Update previous_damage using buffer_age (if available), and store
 	 * current damaged region for future use. */
-	output_get_damage(output, &previous_damage, &border_status);
+	buffer_age = output_get_buffer_age(output);
+	output_get_damage(output, buffer_age, &previous_damage, &border_status);
 	output_rotate_damage(output, output_damage, go->border_status);
 
 	/* Redraw both areas which have changed since we last used this buffer,
@@ -1880,6 +2458,20 @@ gl_renderer_repaint_output(struct weston_output *output,
 	pixman_region32_union(&total_damage, &previous_damage, output_damage);
 	border_status |= go->border_status;
 
+	/* With a shadow, the back buffer only gets what changed in the
+	 * shadow since the buffer was last written. */
+	if (shadow_exists(go) && !go->fused_color_transform) {
+		if (go->shadow_stale) {
+			go->shadow_damage_count = 0;
+			output_rotate_shadow_damage(output, &output->region);
+		} else {
+			output_rotate_shadow_damage(output, output_damage);
+		}
+
+		output_get_shadow_blit_damage(output, buffer_age,
+					      border_status, &total_damage);
+	}
+
 	if (gr->has_egl_partial_update && !gr->fan_debug) {
 		int n_egl_rects;
 		EGLint *egl_rects;
@@ -1888,25 +2480,35 @@ gl_renderer_repaint_output(struct weston_output *output,
 		 * changed since we last rendered into this specific buffer;
 		 * this is total_damage. */
 		pixman_region_to_egl_y_invert(output, &total_damage,
+					      border_status,
 					      &egl_rects, &n_egl_rects);
 		gr->set_damage_region(gr->egl_display, go->egl_surface,
 				      egl_rects, n_egl_rects);
 		free(egl_rects);
 	}
 
-	if (shadow_exists(go)) {
+	if (shadow_exists(go) && !go->fused_color_transform) {
 		/* Repaint into shadow. */
-		if (compositor->test_data.test_quirks.gl_force_full_redraw_of_shadow_fb)
+		if (compositor->test_data.test_quirks.gl_force_full_redraw_of_shadow_fb ||
+		    go->shadow_stale)
 			repaint_views(output, &output->region);
 		else
 			repaint_views(output, output_damage);
+		go->shadow_stale = false;
 
 		glBindFramebuffer(GL_FRAMEBUFFER, 0);
 		glViewport(go->area.x, area_inv_y,
 			   go->area.width, go->area.height);
 		blit_shadow_to_output(output, &total_damage);
 	} else {
+		if (go->fused_color_transform)
+			draw_fused_background(output, &total_damage);
 		repaint_views(output, &total_damage);
+
+		if (shadow_exists(go)) {
+			go->shadow_stale = true;
+			log_skipped_shadow_pass(output, &total_damage);
+		}
 	}
 
 	pixman_region32_fini(&total_damage);
@@ -1934,6 +2536,7 @@ gl_renderer_repaint_output(struct weston_output *output,
 		 * which has changed since the previous SwapBuffers on this
 		 * surface - this is output_damage. */
 		pixman_region_to_egl_y_invert(output, output_damage,
+					      go->border_status,
 					      &egl_rects, &n_egl_rects);
 		ret = gr->swap_buffers_with_damage(gr->egl_display,
 						   go->egl_surface,
@@ -1960,6 +2563,11 @@ gl_renderer_repaint_output(struct weston_output *output,
 	update_buffer_release_fences(compositor, output);
 
 	gl_renderer_garbage_collect_programs(gr);
+
+	if (stats)
+		weston_frame_stats_add_since(output, WESTON_FRAME_STAT_RENDERER,
+					     &stats_begin);
+	WESTON_PROFILE_END(compositor, RENDERER_REPAINT);
 }
 
 static int
@@ -2020,6 +2628,7 @@ gl_renderer_flush_damage(struct weston_surface *surface,
 	pixman_box32_t *rectangles;
 	uint8_t *data;
 	int i, j, n;
+	uint64_t uploaded = 0;
 
 	assert(buffer && gb);
 
@@ -2074,6 +2683,8 @@ gl_renderer_flush_damage(struct weston_surface *surface,
 				     gl_format_from_internal(gb->gl_format[j]),
 				     gb->gl_pixel_type,
 				     data + gb->offset[j]);
+			uploaded += (uint64_t)(gb->pitch / hsub) *
+				    (buffer->height / vsub) * gb->cpp[j];
 		}
 		wl_shm_buffer_end_access(buffer->shm_buffer);
 
@@ -2100,6 +2711,8 @@ gl_renderer_flush_damage(struct weston_surface *surface,
 				     gl_format_from_internal(gb->gl_format[j]),
 				     gb->gl_pixel_type,
 				     data + gb->offset[j]);
+			uploaded += (uint64_t)(buffer->width / hsub) *
+				    (buffer->height / vsub) * gb->cpp[j];
 		}
 		wl_shm_buffer_end_access(buffer->shm_buffer);
 		goto done;
@@ -2129,11 +2742,18 @@ gl_renderer_flush_damage(struct weston_surface *surface,
 					gl_format_from_internal(gb->gl_format[j]),
 					gb->gl_pixel_type,
 					data + gb->offset[j]);
+			uploaded += (uint64_t)((r.x2 - r.x1) / hsub) *
+				    ((r.y2 - r.y1) / vsub) * gb->cpp[j];
 		}
 	}
 	wl_shm_buffer_end_access(buffer->shm_buffer);
 
 done:
+	if (uploaded > 0 && surface->resource)
+		weston_client_stats_add(surface->compositor,
+					wl_resource_get_client(surface->resource),
+					WESTON_CLIENT_STAT_SHM_BYTES, uploaded);
+
 	pixman_region32_fini(&gb->texture_damage);
 	pixman_region32_init(&gb->texture_damage);
 	gb->needs_full_upload = false;
@@ -2149,6 +2769,7 @@ destroy_buffer_state(struct gl_buffer_state *gb)
 	int i;
 
 	glDeleteTextures(gb->num_textures, gb->textures);
+	weston_memory_untrack(&gb->mem);
 
 	for (i = 0; i < gb->num_images; i++)
 		gb->gr->destroy_image(gb->gr->egl_display, gb->images[i]);
@@ -2191,6 +2812,31 @@ ensure_textures(struct gl_buffer_state *gb, GLenum target, int num_textures)
 	glBindTexture(target, 0);
 }
 
+/* Accounts the textures of a SHM buffer, sized as gl_renderer_flush_damage()
+ * allocates them: every plane, subsampled, and as wide as the pitch when the
+ * rows can't be unpacked individually. */
+static void
+gl_buffer_state_track_shm(struct gl_buffer_state *gb,
+			  struct weston_surface *es,
+			  struct weston_buffer *buffer)
+{
+	struct gl_renderer *gr = gb->gr;
+	int width = gr->has_unpack_subimage ? buffer->width : gb->pitch;
+	uint64_t size = 0;
+	int j;
+
+	for (j = 0; j < gb->num_textures; j++) {
+		int hsub = pixel_format_hsub(buffer->pixel_format, j);
+		int vsub = pixel_format_vsub(buffer->pixel_format, j);
+
+		size += (uint64_t)(width / hsub) * (buffer->height / vsub) *
+			gb->cpp[j];
+	}
+
+	weston_memory_track_surface(&gb->mem, es, WESTON_MEMORY_SHM_TEXTURE,
+				    size);
+}
+
 static bool
 gl_renderer_attach_shm(struct weston_surface *es, struct weston_buffer *buffer)
 {
@@ -2205,6 +2851,7 @@ gl_renderer_attach_shm(struct weston_surface *es, struct weston_buffer *buffer)
 	enum gl_shader_texture_variant shader_variant;
 	int pitch;
 	int offset[3] = { 0, 0, 0 };
+	int cpp[3] = { 0, 0, 0 };
 	unsigned int num_planes;
 	unsigned int i;
 	bool using_glesv2 = gr->gl_version < gr_gl_version(3, 0);
@@ -2265,6 +2912,7 @@ gl_renderer_attach_shm(struct weston_surface *es, struct weston_buffer *buffer)
 
 			gl_format[out] = sub_info->gl_format;
 			offset[out] = shm_offset[yuv->plane[out].plane_index];
+			cpp[out] = sub_info->bpp / 8;
 		}
 	} else {
 		int bpp = buffer->pixel_format->bpp;
@@ -2279,6 +2927,7 @@ gl_renderer_attach_shm(struct weston_surface *es, struct weston_buffer *buffer)
 
 		assert(bpp > 0 && !(bpp & 7));
 		pitch = wl_shm_buffer_get_stride(shm_buffer) / (bpp / 8);
+		cpp[0] = bpp / 8;
 
 		gl_format[0] = buffer->pixel_format->gl_format;
 		gl_pixel_type = buffer->pixel_format->gl_type;
@@ -2345,6 +2994,7 @@ gl_renderer_attach_shm(struct weston_surface *es, struct weston_buffer *buffer)
 	    buffer->pixel_format == old_buffer->pixel_format) {
 		gs->buffer->pitch = pitch;
 		memcpy(gs->buffer->offset, offset, sizeof(offset));
+		gl_buffer_state_track_shm(gs->buffer, es, buffer);
 		return true;
 	}
 
@@ -2365,6 +3015,7 @@ gl_renderer_attach_shm(struct weston_surface *es, struct weston_buffer *buffer)
 	gb->pitch = pitch;
 	gb->shader_variant = shader_variant;
 	ARRAY_COPY(gb->offset, offset);
+	ARRAY_COPY(gb->cpp, cpp);
 	ARRAY_COPY(gb->gl_format, gl_format);
 	gb->gl_pixel_type = gl_pixel_type;
 	gb->needs_full_upload = true;
@@ -2373,6 +3024,7 @@ gl_renderer_attach_shm(struct weston_surface *es, struct weston_buffer *buffer)
 	gs->surface = es;
 
 	ensure_textures(gb, GL_TEXTURE_2D, num_planes);
+	gl_buffer_state_track_shm(gb, es, buffer);
 
 	return true;
 }
@@ -3538,10 +4190,12 @@ gl_renderer_output_set_border(struct weston_output *output,
 	struct gl_output_state *go = get_output_state(output);
 
 	if (go->borders[side].width != width ||
-	    go->borders[side].height != height)
+	    go->borders[side].height != height) {
 		/* In this case, we have to blow everything and do a full
 		 * repaint. */
 		go->border_status |= BORDER_SIZE_CHANGED | BORDER_ALL_DIRTY;
+		go->shadow_damage_count = 0;
+	}
 
 	if (data == NULL) {
 		width = 0;
@@ -3593,6 +4247,14 @@ gl_renderer_resize_output(struct weston_output *output,
 
 	ret = gl_fbo_texture_init(&go->shadow, area->width, area->height,
 				  shfmt->gl_format, GL_RGBA, shfmt->gl_type);
+	go->shadow_stale = true;
+	if (ret)
+		weston_memory_track_output(&go->shadow_mem, output,
+					   WESTON_MEMORY_SHADOW,
+					   (uint64_t)area->width * area->height *
+					   shfmt->bpp / 8);
+	else
+		weston_memory_untrack(&go->shadow_mem);
 
 	return ret;
 }
@@ -3652,6 +4314,8 @@ gl_renderer_output_create(struct weston_output *output,
 
 	for (i = 0; i < BUFFER_DAMAGE_COUNT; i++)
 		pixman_region32_init(&go->buffer_damage[i]);
+	for (i = 0; i < SHADOW_DAMAGE_COUNT; i++)
+		pixman_region32_init(&go->shadow_damage[i]);
 
 	if (gr->has_disjoint_timer_query)
 		gr->gen_queries(1, &go->render_query);
@@ -3814,6 +4478,10 @@ gl_renderer_output_pbuffer_create(struct weston_output *output,
 	} else {
 		go = get_output_state(output);
 		go->swap_behavior_is_preserved = true;
+		weston_memory_track_output(&go->egl_surface_mem, output,
+					   WESTON_MEMORY_RENDERBUFFER,
+					   (uint64_t)options->fb_size.width *
+					   options->fb_size.height * 4);
 	}
 
 	return ret;
@@ -3833,9 +4501,12 @@ gl_renderer_output_destroy(struct weston_output *output)
 
 	for (i = 0; i < 2; i++)
 		pixman_region32_fini(&go->buffer_damage[i]);
+	for (i = 0; i < SHADOW_DAMAGE_COUNT; i++)
+		pixman_region32_fini(&go->shadow_damage[i]);
 
 	if (shadow_exists(go))
 		gl_fbo_texture_fini(&go->shadow);
+	weston_memory_untrack(&go->shadow_mem);
 
 	eglMakeCurrent(gr->egl_display,
 		       gr->dummy_surface, gr->dummy_surface, gr->egl_context);
@@ -3843,6 +4514,7 @@ gl_renderer_output_destroy(struct weston_output *output)
 	if (go->default_egl_surface != EGL_NO_SURFACE)
 		weston_platform_destroy_egl_surface(gr->egl_display,
 						    go->default_egl_surface);
+	weston_memory_untrack(&go->egl_surface_mem);
 
 	if (!wl_list_empty(&go->timeline_render_point_list))
 		weston_log("warning: discarding pending timeline render"
@@ -3893,6 +4565,7 @@ gl_renderer_destroy(struct weston_compositor *ec)
 	if (gr->has_bind_display)
 		gr->unbind_display(gr->egl_display, ec->wl_display);
 
+	gl_renderer_shader_variants_fini(gr);
 	gl_renderer_shader_list_destroy(gr);
 	if (gr->fallback_shader)
 		gl_shader_destroy(gr, gr->fallback_shader);
@@ -3922,6 +4595,8 @@ gl_renderer_destroy(struct weston_compositor *ec)
 	if (gr->fan_binding)
 		weston_binding_destroy(gr->fan_binding);
 
+	gl_program_cache_fini(gr);
+
 	weston_log_scope_destroy(gr->shader_scope);
 	weston_log_scope_destroy(gr->renderer_scope);
 	free(gr);
@@ -4004,7 +4679,11 @@ gl_renderer_display_create(struct weston_compositor *ec,
 
 	gr->compositor = ec;
 	wl_list_init(&gr->shader_list);
+	wl_array_init(&gr->shader_variants);
+	wl_array_init(&gr->program_cache_pending);
 	gr->platform = options->egl_platform;
+	gr->fuse_output_transform = !getenv("WESTON_GL_FUSE_OUTPUT_TRANSFORM") ||
+		strcmp(getenv("WESTON_GL_FUSE_OUTPUT_TRANSFORM"), "0") != 0;
 
 	gr->renderer_scope = weston_compositor_add_log_scope(ec, "gl-renderer",
 		"GL-renderer verbose messages\n", NULL, NULL, gr);
@@ -4149,6 +4828,8 @@ fail_terminate:
 	weston_drm_format_array_fini(&gr->supported_formats);
 	eglTerminate(gr->egl_display);
 fail:
+	gl_renderer_shader_variants_fini(gr);
+	gl_program_cache_fini(gr);
 	weston_log_scope_destroy(gr->shader_scope);
 	weston_log_scope_destroy(gr->renderer_scope);
 	free(gr);
@@ -4361,6 +5042,22 @@ gl_renderer_setup(struct weston_compositor *ec, EGLSurface egl_surface)
 			   "missing GL_EXT_disjoint_timer_query extension\n");
 	}
 
+	if (weston_check_egl_extension(extensions, "GL_OES_get_program_binary")) {
+		GLint num_formats = 0;
+
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS_OES, &num_formats);
+		if (num_formats > 0) {
+			gr->get_program_binary =
+				(void *) eglGetProcAddress("glGetProgramBinaryOES");
+			gr->program_binary =
+				(void *) eglGetProcAddress("glProgramBinaryOES");
+			assert(gr->get_program_binary);
+			assert(gr->program_binary);
+			gr->has_program_binary = true;
+		}
+	}
+	gl_program_cache_init(gr, gl_shader_source_hash());
+
 	glActiveTexture(GL_TEXTURE0);
 
 	gr->fallback_shader = gl_renderer_create_fallback_shader(gr);
@@ -4369,6 +5066,9 @@ gl_renderer_setup(struct weston_compositor *ec, EGLSurface egl_surface)
 		return -1;
 	}
 
+	gl_renderer_precompile_programs(gr);
+	gl_renderer_warm_up_programs(gr);
+
 	gr->fragment_binding =
 		weston_compositor_add_debug_binding(ec, KEY_S,
 						    fragment_debug_binding,
@@ -4397,6 +5097,9 @@ gl_renderer_setup(struct weston_compositor *ec, EGLSurface egl_surface)
 			    yesno(gr->has_egl_image_external));
 	weston_log_continue(STAMP_SPACE "wl_shm sub-image to texture: %s\n",
 			    gr->has_unpack_subimage ? "yes" : "no");
+	weston_log_continue(STAMP_SPACE "program binary cache: %s\n",
+			    yesno(gr->has_program_binary &&
+				  gr->program_cache_dir));
 
 	return 0;
 }
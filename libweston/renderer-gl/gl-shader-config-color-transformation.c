@@ -30,6 +30,7 @@
 #include <GLES2/gl2ext.h>
 
 #include <assert.h>
+#include <math.h>
 #include <string.h>
 
 #include <libweston/libweston.h>
@@ -132,6 +133,44 @@ gl_renderer_color_transform_get(struct weston_color_transform *xform)
 			    destroy_listener);
 }
 
+/*
+ * Tolerance for recognizing identity curves and matrices. Far below what
+ * any output encoding can represent, so folding them away is invisible.
+ */
+#define GL_COLOR_IDENTITY_TOLERANCE 1e-5f
+
+static bool
+lut_3x1d_is_identity(const float *lut, unsigned len)
+{
+	unsigned c, i;
+
+	for (c = 0; c < 3; c++) {
+		for (i = 0; i < len; i++) {
+			float x = (float)i / (len - 1);
+
+			if (fabsf(lut[c * len + i] - x) > GL_COLOR_IDENTITY_TOLERANCE)
+				return false;
+		}
+	}
+
+	return true;
+}
+
+static bool
+matrix_is_identity(const float matrix[9])
+{
+	unsigned i;
+
+	for (i = 0; i < 9; i++) {
+		float expected = (i % 4 == 0) ? 1.0f : 0.0f;
+
+		if (fabsf(matrix[i] - expected) > GL_COLOR_IDENTITY_TOLERANCE)
+			return false;
+	}
+
+	return true;
+}
+
 static bool
 gl_color_curve_lut_3x1d(struct gl_renderer_color_curve *gl_curve,
 			const struct weston_color_curve *curve,
@@ -154,6 +193,16 @@ gl_color_curve_lut_3x1d(struct gl_renderer_color_curve *gl_curve,
 
 	curve->u.lut_3x1d.fill_in(xform, lut, lut_len);
 
+	/* An identity curve costs nothing when the shader leaves it out. */
+	if (lut_len > 1 && lut_3x1d_is_identity(lut, lut_len)) {
+		free(lut);
+		gl_curve->type = SHADER_COLOR_CURVE_IDENTITY;
+		gl_curve->tex = 0;
+		gl_curve->scale = 0.0f;
+		gl_curve->offset = 0.0f;
+		return true;
+	}
+
 	glActiveTexture(GL_TEXTURE0);
 	glGenTextures(1, &tex);
 	glBindTexture(GL_TEXTURE_2D, tex);
@@ -279,8 +328,12 @@ gl_renderer_color_transform_from(struct weston_color_transform *xform)
 		ok = gl_3d_lut(gl_xform, xform);
 		break;
 	case WESTON_COLOR_MAPPING_TYPE_MATRIX:
-		gl_xform->mapping.type = SHADER_COLOR_MAPPING_MATRIX;
-		gl_xform->mapping.mat = xform->mapping.u.mat;
+		if (matrix_is_identity(xform->mapping.u.mat.matrix)) {
+			gl_xform->mapping = no_op_gl_xform.mapping;
+		} else {
+			gl_xform->mapping.type = SHADER_COLOR_MAPPING_MATRIX;
+			gl_xform->mapping.mat = xform->mapping.u.mat;
+		}
 		ok = true;
 		break;
 	}
@@ -30,9 +30,13 @@
 
 #include "config.h"
 
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <unistd.h>
 
 #include <libweston/libweston.h>
 #include <libweston/weston-log.h>
@@ -54,11 +58,11 @@
 struct gl_shader {
 	struct gl_shader_requirements key;
 	GLuint program;
-	GLuint vertex_shader, fragment_shader;
 	GLint proj_uniform;
 	GLint tex_uniforms[3];
 	GLint view_alpha_uniform;
 	GLint color_uniform;
+	bool recorded; /* listed in gl_renderer::shader_variants */
 	GLint color_pre_curve_lut_2d_uniform;
 	GLint color_pre_curve_lut_scale_offset_uniform;
 	union {
@@ -201,12 +205,15 @@ create_shader_description_string(const struct gl_shader_requirements *req)
 	int size;
 	char *str;
 
-	size = asprintf(&str, "%s %s %s %s %cinput_is_premult %cgreen",
+	size = asprintf(&str, "%s %s %s %s %cinput_is_premult "
+			"%cinput_is_opaque %cview_alpha %cgreen",
 			gl_shader_texture_variant_to_string(req->variant),
 			gl_shader_color_curve_to_string(req->color_pre_curve),
 			gl_shader_color_mapping_to_string(req->color_mapping),
 			gl_shader_color_curve_to_string(req->color_post_curve),
 			req->input_is_premult ? '+' : '-',
+			req->input_is_opaque ? '+' : '-',
+			req->apply_view_alpha ? '+' : '-',
 			req->green_tint ? '+' : '-');
 	if (size < 0)
 		return NULL;
@@ -222,6 +229,8 @@ create_shader_config_string(const struct gl_shader_requirements *req)
 	size = asprintf(&str,
 			"#define DEF_GREEN_TINT %s\n"
 			"#define DEF_INPUT_IS_PREMULT %s\n"
+			"#define DEF_INPUT_IS_OPAQUE %s\n"
+			"#define DEF_APPLY_VIEW_ALPHA %d\n"
 			"#define DEF_COLOR_PRE_CURVE %s\n"
 			"#define DEF_COLOR_MAPPING %s\n"
 			"#define DEF_COLOR_POST_CURVE %s\n"
@@ -229,6 +238,8 @@ create_shader_config_string(const struct gl_shader_requirements *req)
 			"#define DEF_VARIANT %s\n",
 			req->green_tint ? "true" : "false",
 			req->input_is_premult ? "true" : "false",
+			req->input_is_opaque ? "true" : "false",
+			req->apply_view_alpha ? 1 : 0,
 			gl_shader_color_curve_to_string(req->color_pre_curve),
 			gl_shader_color_mapping_to_string(req->color_mapping),
 			gl_shader_color_curve_to_string(req->color_post_curve),
@@ -239,69 +250,172 @@ create_shader_config_string(const struct gl_shader_requirements *req)
 	return str;
 }
 
+static GLuint
+gl_shader_link_program(const struct gl_shader_requirements *requirements)
+{
+	GLuint vertex, fragment, program;
+	char msg[512];
+	GLint status;
+	const char *sources[3];
+	char *conf;
+
+	sources[0] = vertex_shader;
+	vertex = compile_shader(GL_VERTEX_SHADER, 1, sources);
+	if (vertex == GL_NONE)
+		return GL_NONE;
+
+	conf = create_shader_config_string(requirements);
+	if (!conf) {
+		glDeleteShader(vertex);
+		return GL_NONE;
+	}
+
+	sources[0] = "#version 100\n";
+	sources[1] = conf;
+	sources[2] = fragment_shader;
+	fragment = compile_shader(GL_FRAGMENT_SHADER, 3, sources);
+	free(conf);
+	if (fragment == GL_NONE) {
+		glDeleteShader(vertex);
+		return GL_NONE;
+	}
+
+	program = glCreateProgram();
+	glAttachShader(program, vertex);
+	glAttachShader(program, fragment);
+	glBindAttribLocation(program, 0, "position");
+	glBindAttribLocation(program, 1, "texcoord");
+
+	glLinkProgram(program);
+	glDeleteShader(vertex);
+	glDeleteShader(fragment);
+
+	glGetProgramiv(program, GL_LINK_STATUS, &status);
+	if (!status) {
+		glGetProgramInfoLog(program, sizeof msg, NULL, msg);
+		weston_log("link info: %s\n", msg);
+		glDeleteProgram(program);
+		return GL_NONE;
+	}
+
+	return program;
+}
+
+static int
+gl_shader_requirements_cmp(const struct gl_shader_requirements *a,
+			   const struct gl_shader_requirements *b)
+{
+	return memcmp(a, b, sizeof(*a));
+}
+
+static void
+gl_renderer_store_pending_programs(struct gl_renderer *gr)
+{
+	const struct gl_shader_requirements *req;
+	struct gl_shader *shader;
+
+	wl_array_for_each(req, &gr->program_cache_pending) {
+		/* The program may have been garbage collected meanwhile. */
+		wl_list_for_each(shader, &gr->shader_list, link) {
+			if (gl_shader_requirements_cmp(req, &shader->key) == 0) {
+				gl_program_cache_store(gr, req,
+						       shader->program);
+				break;
+			}
+		}
+	}
+
+	wl_array_release(&gr->program_cache_pending);
+	wl_array_init(&gr->program_cache_pending);
+}
+
+static void
+gl_renderer_store_programs_idle(void *data)
+{
+	struct gl_renderer *gr = data;
+
+	gr->program_cache_store_source = NULL;
+	gl_renderer_store_pending_programs(gr);
+}
+
+/** Store a freshly linked program in the on-disk cache later
+ *
+ * Writing the binary out costs file system round trips, so it is left to
+ * an idle callback instead of stalling the repaint that needed the program.
+ */
+static void
+gl_renderer_queue_program_store(struct gl_renderer *gr,
+				const struct gl_shader_requirements *req)
+{
+	struct gl_shader_requirements *pending;
+	struct wl_event_loop *loop;
+
+	if (!gr->program_cache_dir || !gr->has_program_binary)
+		return;
+
+	pending = wl_array_add(&gr->program_cache_pending, sizeof *pending);
+	if (!pending)
+		return;
+	*pending = *req;
+
+	if (gr->program_cache_store_source)
+		return;
+
+	loop = wl_display_get_event_loop(gr->compositor->wl_display);
+	gr->program_cache_store_source =
+		wl_event_loop_add_idle(loop, gl_renderer_store_programs_idle, gr);
+}
+
 static struct gl_shader *
 gl_shader_create(struct gl_renderer *gr,
 		 const struct gl_shader_requirements *requirements)
 {
 	bool verbose = weston_log_scope_is_enabled(gr->shader_scope);
 	struct gl_shader *shader = NULL;
-	char msg[512];
-	GLint status;
-	const char *sources[3];
-	char *conf = NULL;
+	struct timespec begin, end;
+	const char *origin = "cache";
+	char *desc = NULL;
 
 	shader = zalloc(sizeof *shader);
 	if (!shader) {
 		weston_log("could not create shader\n");
-		goto error_vertex;
+		return NULL;
 	}
 
 	wl_list_init(&shader->link);
 	shader->key = *requirements;
 
 	if (verbose) {
-		char *desc;
-
 		desc = create_shader_description_string(requirements);
 		weston_log_scope_printf(gr->shader_scope,
 					"Compiling shader program for: %s\n",
 					desc);
-		free(desc);
+		weston_compositor_read_presentation_clock(gr->compositor,
+							  &begin);
 	}
 
-	sources[0] = vertex_shader;
-	shader->vertex_shader = compile_shader(GL_VERTEX_SHADER, 1, sources);
-	if (shader->vertex_shader == GL_NONE)
-		goto error_vertex;
-
-	conf = create_shader_config_string(&shader->key);
-	if (!conf)
-		goto error_fragment;
-
-	sources[0] = "#version 100\n";
-	sources[1] = conf;
-	sources[2] = fragment_shader;
-	shader->fragment_shader = compile_shader(GL_FRAGMENT_SHADER,
-						 3, sources);
-	if (shader->fragment_shader == GL_NONE)
-		goto error_fragment;
-
-	shader->program = glCreateProgram();
-	glAttachShader(shader->program, shader->vertex_shader);
-	glAttachShader(shader->program, shader->fragment_shader);
-	glBindAttribLocation(shader->program, 0, "position");
-	glBindAttribLocation(shader->program, 1, "texcoord");
-
-	glLinkProgram(shader->program);
-	glGetProgramiv(shader->program, GL_LINK_STATUS, &status);
-	if (!status) {
-		glGetProgramInfoLog(shader->program, sizeof msg, NULL, msg);
-		weston_log("link info: %s\n", msg);
-		goto error_link;
+	shader->program = gl_program_cache_load(gr, &shader->key);
+	if (shader->program == GL_NONE) {
+		origin = "source";
+		shader->program = gl_shader_link_program(&shader->key);
+		if (shader->program == GL_NONE) {
+			free(desc);
+			free(shader);
+			return NULL;
+		}
+		gl_renderer_queue_program_store(gr, &shader->key);
 	}
 
-	glDeleteShader(shader->vertex_shader);
-	glDeleteShader(shader->fragment_shader);
+	if (verbose) {
+		weston_compositor_read_presentation_clock(gr->compositor,
+							  &end);
+		weston_log_scope_printf(gr->shader_scope,
+					"Program %u for %s built from %s "
+					"in %.1f ms\n", shader->program, desc,
+					origin,
+					timespec_sub_to_nsec(&end, &begin) / 1e6);
+		free(desc);
+	}
 
 	shader->proj_uniform = glGetUniformLocation(shader->program, "proj");
 	shader->tex_uniforms[0] = glGetUniformLocation(shader->program, "tex");
@@ -342,23 +456,53 @@ gl_shader_create(struct gl_renderer *gr,
 	case SHADER_COLOR_MAPPING_IDENTITY:
 		break;
 	}
-	free(conf);
 
 	wl_list_insert(&gr->shader_list, &shader->link);
 
 	return shader;
+}
 
-error_link:
-	glDeleteProgram(shader->program);
-	glDeleteShader(shader->fragment_shader);
-
-error_fragment:
-	glDeleteShader(shader->vertex_shader);
+/** Hash of the GLSL sources every program is built from
+ *
+ * Used to salt the on-disk program binary cache, so that binaries built
+ * from an older vertex.glsl or fragment.glsl are never loaded. The
+ * #defines made from the requirements are part of the sources too, so
+ * every value of every requirement field goes through
+ * create_shader_config_string() into the hash.
+ */
+uint64_t
+gl_shader_source_hash(void)
+{
+	uint64_t hash = 0xcbf29ce484222325ull;
+	unsigned i;
+	char *conf;
+
+	hash = gl_program_cache_hash(hash, vertex_shader,
+				     strlen(vertex_shader));
+	hash = gl_program_cache_hash(hash, fragment_shader,
+				     strlen(fragment_shader));
+
+	for (i = 0; i <= SHADER_VARIANT_EXTERNAL; i++) {
+		struct gl_shader_requirements req = {
+			.variant = i,
+			.input_is_premult = i & 1,
+			.green_tint = i & 1,
+			.color_pre_curve = MIN(i, SHADER_COLOR_CURVE_LUT_3x1D),
+			.color_mapping = MIN(i, SHADER_COLOR_MAPPING_MATRIX),
+			.color_post_curve = MIN(i, SHADER_COLOR_CURVE_LUT_3x1D),
+			.color_swap = MIN(i, SHADER_COLOR_SWAP_ALL),
+			.input_is_opaque = i & 1,
+			.apply_view_alpha = i & 1,
+		};
+
+		conf = create_shader_config_string(&req);
+		if (!conf)
+			continue;
+		hash = gl_program_cache_hash(hash, conf, strlen(conf));
+		free(conf);
+	}
 
-error_vertex:
-	free(conf);
-	free(shader);
-	return NULL;
+	return hash;
 }
 
 void
@@ -388,11 +532,287 @@ gl_renderer_shader_list_destroy(struct gl_renderer *gr)
 		gl_shader_destroy(gr, shader);
 }
 
+static struct gl_shader *
+gl_renderer_get_program(struct gl_renderer *gr,
+			const struct gl_shader_requirements *requirements);
+
+#define GL_SHADER_VARIANTS_MAX 64
+
+/* Delay between two warm-up compilations, letting clients get a word in. */
+#define GL_SHADER_WARM_UP_INTERVAL_MS 1
+
+static bool
+gl_renderer_variant_is_recorded(struct gl_renderer *gr,
+				const struct gl_shader_requirements *req)
+{
+	const struct gl_shader_requirements *v;
+
+	wl_array_for_each(v, &gr->shader_variants) {
+		if (gl_shader_requirements_cmp(v, req) == 0)
+			return true;
+	}
+
+	return false;
+}
+
+static char *
+gl_shader_variants_path(struct gl_renderer *gr)
+{
+	char *path;
+
+	if (!gr->program_cache_dir)
+		return NULL;
+
+	if (asprintf(&path, "%s/variants", gr->program_cache_dir) < 0)
+		return NULL;
+
+	return path;
+}
+
+/*
+ * One variant per line: the raw requirements key in hex, followed by its
+ * create_shader_description_string(). The description is checked on load,
+ * so that a changed struct gl_shader_requirements layout invalidates the
+ * record instead of warming up the wrong programs.
+ */
+static void
+gl_shader_variants_save(struct gl_renderer *gr)
+{
+	const struct gl_shader_requirements *v;
+	char *path, *tmp = NULL;
+	uint32_t key;
+	char *desc;
+	FILE *fp;
+	int fd;
+
+	path = gl_shader_variants_path(gr);
+	if (!path)
+		return;
+
+	if (asprintf(&tmp, "%s.XXXXXX", path) < 0) {
+		tmp = NULL;
+		goto out;
+	}
+
+	fd = mkstemp(tmp);
+	if (fd < 0)
+		goto out;
+
+	fp = fdopen(fd, "w");
+	if (!fp) {
+		close(fd);
+		unlink(tmp);
+		goto out;
+	}
+
+	wl_array_for_each(v, &gr->shader_variants) {
+		desc = create_shader_description_string(v);
+		if (!desc)
+			continue;
+		memcpy(&key, v, sizeof key);
+		fprintf(fp, "%08x %s\n", key, desc);
+		free(desc);
+	}
+
+	if (fclose(fp) != 0 || rename(tmp, path) < 0)
+		unlink(tmp);
+
+out:
+	free(tmp);
+	free(path);
+}
+
+static void
+gl_shader_variants_save_idle(void *data)
+{
+	struct gl_renderer *gr = data;
+
+	gr->shader_variants_save_source = NULL;
+	gl_shader_variants_save(gr);
+}
+
+/** Add a variant to the record of variants used in this session
+ *
+ * The record is written out from an idle callback, never from within
+ * a repaint.
+ */
+static void
+gl_renderer_record_variant(struct gl_renderer *gr, struct gl_shader *shader)
+{
+	struct gl_shader_requirements *v;
+	struct wl_event_loop *loop;
+
+	/* The debug tint is not worth keeping around. */
+	if (shader->key.green_tint)
+		return;
+
+	if (gr->shader_variants.size / sizeof *v >= GL_SHADER_VARIANTS_MAX)
+		return;
+
+	v = wl_array_add(&gr->shader_variants, sizeof *v);
+	if (!v)
+		return;
+	*v = shader->key;
+	shader->recorded = true;
+
+	if (!gr->program_cache_dir || gr->shader_variants_save_source)
+		return;
+
+	loop = wl_display_get_event_loop(gr->compositor->wl_display);
+	gr->shader_variants_save_source =
+		wl_event_loop_add_idle(loop, gl_shader_variants_save_idle, gr);
+}
+
 static int
-gl_shader_requirements_cmp(const struct gl_shader_requirements *a,
-			   const struct gl_shader_requirements *b)
+gl_renderer_warm_up_timer(void *data)
 {
-	return memcmp(a, b, sizeof(*a));
+	struct gl_renderer *gr = data;
+	const struct gl_shader_requirements *variants = gr->shader_variants.data;
+	size_t count = gr->shader_variants.size / sizeof *variants;
+	struct gl_shader *shader;
+
+	/* Compile one program per dispatch, so clients are not starved. */
+	while (gr->shader_warm_up_next < count) {
+		const struct gl_shader_requirements *req =
+			&variants[gr->shader_warm_up_next++];
+		bool found = false;
+
+		wl_list_for_each(shader, &gr->shader_list, link) {
+			if (gl_shader_requirements_cmp(req, &shader->key) == 0) {
+				found = true;
+				break;
+			}
+		}
+		if (found)
+			continue;
+
+		if (!gl_renderer_get_program(gr, req))
+			weston_log("warning: failed to warm up a shader "
+				   "program.\n");
+		break;
+	}
+
+	if (gr->shader_warm_up_next < count) {
+		wl_event_source_timer_update(gr->shader_warm_up_source,
+					     GL_SHADER_WARM_UP_INTERVAL_MS);
+		return 0;
+	}
+
+	wl_event_source_remove(gr->shader_warm_up_source);
+	gr->shader_warm_up_source = NULL;
+
+	return 0;
+}
+
+static bool
+gl_shader_variant_parse(const char *line, struct gl_shader_requirements *req)
+{
+	unsigned long key;
+	char *end;
+	char *desc;
+	bool ok;
+
+	errno = 0;
+	key = strtoul(line, &end, 16);
+	if (errno != 0 || end == line || *end != ' ' || key > UINT32_MAX)
+		return false;
+
+	memcpy(req, &(uint32_t){ key }, sizeof *req);
+	if (req->pad_bits_ != 0 || req->variant == SHADER_VARIANT_NONE ||
+	    req->variant > SHADER_VARIANT_EXTERNAL || req->green_tint)
+		return false;
+
+	desc = create_shader_description_string(req);
+	if (!desc)
+		return false;
+	ok = strcmp(end + 1, desc) == 0;
+	free(desc);
+
+	return ok;
+}
+
+/** Schedule warming up the shader variants used in previous sessions
+ *
+ * Reads the record written by earlier sessions and compiles the listed
+ * programs one by one from a timer, after start-up but before clients
+ * usually get to map anything. Those programs are then exempt from
+ * gl_renderer_garbage_collect_programs(), so that launching an application
+ * never waits for a shader compilation.
+ */
+void
+gl_renderer_warm_up_programs(struct gl_renderer *gr)
+{
+	struct gl_shader_requirements req;
+	struct gl_shader_requirements *v;
+	struct wl_event_loop *loop;
+	char *line = NULL;
+	size_t size = 0;
+	ssize_t len;
+	char *path;
+	FILE *fp;
+
+	path = gl_shader_variants_path(gr);
+	if (!path)
+		return;
+
+	fp = fopen(path, "re");
+	free(path);
+	if (!fp)
+		return;
+
+	while ((len = getline(&line, &size, fp)) > 0) {
+		if (line[len - 1] == '\n')
+			line[len - 1] = '\0';
+
+		if (!gl_shader_variant_parse(line, &req) ||
+		    gl_renderer_variant_is_recorded(gr, &req))
+			continue;
+
+		if (gr->shader_variants.size / sizeof *v >=
+		    GL_SHADER_VARIANTS_MAX)
+			break;
+
+		v = wl_array_add(&gr->shader_variants, sizeof *v);
+		if (!v)
+			break;
+		*v = req;
+	}
+	free(line);
+	fclose(fp);
+
+	if (gr->shader_variants.size == 0)
+		return;
+
+	loop = wl_display_get_event_loop(gr->compositor->wl_display);
+	gr->shader_warm_up_next = 0;
+	gr->shader_warm_up_source =
+		wl_event_loop_add_timer(loop, gl_renderer_warm_up_timer, gr);
+	if (gr->shader_warm_up_source)
+		wl_event_source_timer_update(gr->shader_warm_up_source,
+					     GL_SHADER_WARM_UP_INTERVAL_MS);
+}
+
+void
+gl_renderer_shader_variants_fini(struct gl_renderer *gr)
+{
+	if (gr->shader_warm_up_source)
+		wl_event_source_remove(gr->shader_warm_up_source);
+	gr->shader_warm_up_source = NULL;
+
+	if (gr->shader_variants_save_source) {
+		wl_event_source_remove(gr->shader_variants_save_source);
+		gr->shader_variants_save_source = NULL;
+		gl_shader_variants_save(gr);
+	}
+
+	if (gr->program_cache_store_source) {
+		wl_event_source_remove(gr->program_cache_store_source);
+		gr->program_cache_store_source = NULL;
+	}
+	gl_renderer_store_pending_programs(gr);
+
+	wl_array_release(&gr->shader_variants);
+	wl_array_init(&gr->shader_variants);
 }
 
 static void
@@ -491,10 +911,55 @@ gl_renderer_get_program(struct gl_renderer *gr,
 	}
 
 	shader = gl_shader_create(gr, &reqs);
-	if (shader)
-		return shader;
+	if (!shader)
+		return NULL;
+
+	shader->recorded = gl_renderer_variant_is_recorded(gr, &reqs);
+
+	return shader;
+}
+
+/** Build the programs nearly every session needs
+ *
+ * Called once at start-up, before the first repaint, so that the first
+ * client buffers of the common kinds do not stall a repaint on shader
+ * compilation. With the program binary cache this is mostly file reads.
+ */
+void
+gl_renderer_precompile_programs(struct gl_renderer *gr)
+{
+	/* Keys as gl_shader_requirements_specialize() leaves them for views
+	 * drawn at full alpha, or the programs would never be looked up. */
+	static const struct gl_shader_requirements common[] = {
+		{ .variant = SHADER_VARIANT_RGBA, .input_is_premult = true },
+		{ .variant = SHADER_VARIANT_RGBX, .input_is_premult = true,
+		  .input_is_opaque = true },
+		{ .variant = SHADER_VARIANT_SOLID, .input_is_premult = true },
+		{ .variant = SHADER_VARIANT_SOLID, .input_is_premult = true,
+		  .input_is_opaque = true },
+		{ .variant = SHADER_VARIANT_Y_UV, .input_is_premult = true,
+		  .input_is_opaque = true },
+		{ .variant = SHADER_VARIANT_Y_U_V, .input_is_premult = true,
+		  .input_is_opaque = true },
+		{ .variant = SHADER_VARIANT_Y_XUXV, .input_is_premult = true,
+		  .input_is_opaque = true },
+		{ .variant = SHADER_VARIANT_XYUV, .input_is_premult = true,
+		  .input_is_opaque = true },
+		{ .variant = SHADER_VARIANT_EXTERNAL, .input_is_premult = true },
+	};
+	struct gl_shader *shader;
+	unsigned i;
+
+	for (i = 0; i < ARRAY_LENGTH(common); i++) {
+		if (common[i].variant == SHADER_VARIANT_EXTERNAL &&
+		    !gr->has_egl_image_external)
+			continue;
 
-	return NULL;
+		shader = gl_renderer_get_program(gr, &common[i]);
+		if (!shader)
+			weston_log("warning: failed to precompile a shader "
+				   "program.\n");
+	}
 }
 
 void
@@ -508,6 +973,10 @@ gl_renderer_garbage_collect_programs(struct gl_renderer *gr)
 		if (count++ < 10)
 			continue;
 
+		/* Keep the variants warmed up at start-up. */
+		if (shader->recorded)
+			continue;
+
 		/* Keep everything used in the past 1 minute. */
 		if (timespec_sub_to_msec(&gr->compositor->last_repaint_start,
 					 &shader->last_used) < 60000)
@@ -560,7 +1029,8 @@ gl_shader_load_config(struct gl_shader *shader,
 	if (shader->color_uniform != -1)
 		glUniform4fv(shader->color_uniform, 1, sconf->unicolor);
 
-	glUniform1f(shader->view_alpha_uniform, sconf->view_alpha);
+	if (shader->view_alpha_uniform != -1)
+		glUniform1f(shader->view_alpha_uniform, sconf->view_alpha);
 
 	in_tgt = gl_shader_texture_variant_get_target(sconf->req.variant);
 	for (i = 0; i < GL_SHADER_INPUT_TEX_MAX; i++) {
@@ -635,14 +1105,48 @@ gl_shader_load_config(struct gl_shader *shader,
 	}
 }
 
+/*
+ * Narrow the requirements down with what the configuration reveals, so that
+ * the program leaves out what would not change the result.
+ */
+static void
+gl_shader_requirements_specialize(struct gl_shader_requirements *req,
+				  const struct gl_shader_config *sconf)
+{
+	switch (req->variant) {
+	case SHADER_VARIANT_RGBX:
+	case SHADER_VARIANT_Y_U_V:
+	case SHADER_VARIANT_Y_UV:
+	case SHADER_VARIANT_Y_XUXV:
+	case SHADER_VARIANT_XYUV:
+		req->input_is_opaque = true;
+		break;
+	case SHADER_VARIANT_SOLID:
+		req->input_is_opaque = sconf->unicolor[3] == 1.0f;
+		break;
+	default:
+		req->input_is_opaque = false;
+		break;
+	}
+
+	/* Straight and pre-multiplied alpha are the same when opaque. */
+	if (req->input_is_opaque)
+		req->input_is_premult = true;
+
+	req->apply_view_alpha = sconf->view_alpha != 1.0f;
+}
+
 bool
 gl_renderer_use_program(struct gl_renderer *gr,
 			const struct gl_shader_config *sconf)
 {
 	static const GLfloat fallback_shader_color[4] = { 0.2, 0.1, 0.0, 1.0 };
+	struct gl_shader_requirements req = sconf->req;
 	struct gl_shader *shader;
 
-	shader = gl_renderer_get_program(gr, &sconf->req);
+	gl_shader_requirements_specialize(&req, sconf);
+
+	shader = gl_renderer_get_program(gr, &req);
 	if (!shader) {
 		weston_log("Error: failed to generate shader program.\n");
 		gr->current_shader = NULL;
@@ -658,7 +1162,6 @@ gl_renderer_use_program(struct gl_renderer *gr,
 		shader = gr->fallback_shader;
 		glUseProgram(shader->program);
 		glUniform4fv(shader->color_uniform, 1, fallback_shader_color);
-		glUniform1f(shader->view_alpha_uniform, 1.0f);
 		return false;
 	}
 
@@ -669,6 +1172,9 @@ gl_renderer_use_program(struct gl_renderer *gr,
 	}
 	shader->last_used = gr->compositor->last_repaint_start;
 
+	if (!shader->recorded && shader != gr->fallback_shader)
+		gl_renderer_record_variant(gr, shader);
+
 	if (gr->current_shader != shader) {
 		glUseProgram(shader->program);
 		gr->current_shader = shader;
@@ -28,6 +28,7 @@
 
 #include <stdio.h>
 #include <errno.h>
+#include <stdlib.h>
 #include <string.h>
 #include <time.h>
 #include <assert.h>
@@ -36,6 +37,8 @@
 #include <libweston/weston-log.h>
 #include "timeline.h"
 #include "weston-log-internal.h"
+#include "shared/timeline-binary.h"
+#include "shared/timespec-util.h"
 
 /**
  * Timeline itself is not a subscriber but a scope (a producer of data), and it
@@ -106,6 +109,16 @@ weston_timeline_destroy_subscription_object(struct weston_timeline_subscription_
 	free(sub_obj);
 }
 
+static void
+weston_timeline_subscription_release_objects(struct weston_timeline_subscription *tl_sub)
+{
+	struct weston_timeline_subscription_object *sub_obj, *tmp_sub_obj;
+
+	wl_list_for_each_safe(sub_obj, tmp_sub_obj,
+			      &tl_sub->objects, subscription_link)
+		weston_timeline_destroy_subscription_object(sub_obj);
+}
+
 /** Destroy the timeline subscription and all timeline subscription objects
  * associated with it.
  *
@@ -119,15 +132,11 @@ weston_timeline_destroy_subscription(struct weston_log_subscription *sub,
 {
 	struct weston_timeline_subscription *tl_sub =
 		weston_log_subscription_get_data(sub);
-	struct weston_timeline_subscription_object *sub_obj, *tmp_sub_obj;
 
 	if (!tl_sub)
 		return;
 
-	wl_list_for_each_safe(sub_obj, tmp_sub_obj,
-			      &tl_sub->objects, subscription_link)
-		weston_timeline_destroy_subscription_object(sub_obj);
-
+	weston_timeline_subscription_release_objects(tl_sub);
 	free(tl_sub);
 }
 
@@ -341,6 +350,16 @@ emit_gpu_timestamp(struct timeline_emit_context *ctx, void *obj)
 	return 1;
 }
 
+static int
+emit_input_id(struct timeline_emit_context *ctx, void *obj)
+{
+	const uint32_t *id = obj;
+
+	fprintf(ctx->cur, "\"input\":%" PRIu32, *id);
+
+	return 1;
+}
+
 static struct weston_timeline_subscription_object *
 weston_timeline_get_subscription_object(struct weston_log_subscription *sub,
 		void *object)
@@ -370,14 +389,22 @@ WL_EXPORT void
 weston_timeline_refresh_subscription_objects(struct weston_compositor *wc,
 					     void *object)
 {
-	struct weston_log_subscription *sub = NULL;
+	struct weston_log_scope *scopes[] = { wc->timeline, wc->timeline_binary };
+	unsigned i;
 
-	while ((sub = weston_log_subscription_iterate(wc->timeline, sub))) {
-		struct weston_timeline_subscription_object *sub_obj;
+	for (i = 0; i < ARRAY_LENGTH(scopes); i++) {
+		struct weston_log_subscription *sub = NULL;
 
-		sub_obj = weston_timeline_get_subscription_object(sub, object);
-		if (sub_obj)
-			sub_obj->force_refresh = true;
+		if (!scopes[i])
+			continue;
+
+		while ((sub = weston_log_subscription_iterate(scopes[i], sub))) {
+			struct weston_timeline_subscription_object *sub_obj;
+
+			sub_obj = weston_timeline_get_subscription_object(sub, object);
+			if (sub_obj)
+				sub_obj->force_refresh = true;
+		}
 	}
 }
 
@@ -388,6 +415,7 @@ static const type_func type_dispatch[] = {
 	[TLT_SURFACE] = emit_weston_surface,
 	[TLT_VBLANK] = emit_vblank_timestamp,
 	[TLT_GPU] = emit_gpu_timestamp,
+	[TLT_INPUT] = emit_input_id,
 };
 
 /** Disseminates the message to all subscriptions of the scope \c
@@ -459,3 +487,419 @@ weston_timeline_point(struct weston_log_scope *timeline_scope,
 
 	}
 }
+
+/*
+ * Binary timeline
+ *
+ * The 'timeline-binary' scope carries the same points as 'timeline', but
+ * encoded as fixed-size records (see shared/timeline-binary.h) instead of
+ * JSON. Point names are interned by their address, and objects get the
+ * same per-subscription ids as in the JSON timeline.
+ *
+ * Records are not written to the subscription directly. They go into a
+ * ring buffer owned by the subscription, which is drained from the event
+ * loop: by a timer shortly after the ring stops being empty, or by an idle
+ * callback once it is half full. The ring has a single producer and a
+ * single consumer and synchronizes only through its head and tail, so the
+ * drain does not need to run on the compositor thread. When the ring is
+ * full, records are dropped and counted, and the count is reported with a
+ * WESTON_TIMELINE_RECORD_LOST record once there is room again.
+ */
+
+#define TIMELINE_RING_SIZE (256 * 1024)
+#define TIMELINE_DRAIN_DELAY_MS 100
+#define TIMELINE_NAME_SLOTS 128
+
+struct timeline_ring {
+	uint8_t *data;
+	uint64_t head; /**< bytes produced, written by the producer only */
+	uint64_t tail; /**< bytes consumed, written by the consumer only */
+};
+
+struct timeline_name {
+	const char *name;
+	uint32_t id;
+};
+
+/** Data of a 'timeline-binary' subscription
+ *
+ * @ingroup internal-log
+ */
+struct weston_timeline_binary_subscription {
+	/* must be first, for weston_timeline_get_subscription_object() */
+	struct weston_timeline_subscription base;
+
+	struct weston_log_subscription *sub;
+	struct timeline_ring ring;
+	uint64_t lost;
+
+	struct timeline_name names[TIMELINE_NAME_SLOTS];
+	uint32_t next_name_id;
+
+	struct wl_event_loop *loop;
+	struct wl_event_source *drain_timer;
+	struct wl_event_source *drain_idle;
+};
+
+static size_t
+timeline_record_size(const char *str)
+{
+	size_t size = sizeof(struct weston_timeline_record);
+
+	if (str)
+		size += (strlen(str) + 1 + 7) & ~(size_t)7;
+
+	return size;
+}
+
+static void
+timeline_ring_copy_in(struct timeline_ring *ring, uint64_t pos,
+		      const void *data, size_t len)
+{
+	size_t offset = pos & (TIMELINE_RING_SIZE - 1);
+	size_t first = MIN(len, TIMELINE_RING_SIZE - offset);
+
+	memcpy(ring->data + offset, data, first);
+	memcpy(ring->data, (const uint8_t *)data + first, len - first);
+}
+
+static void
+timeline_binary_drain(struct weston_timeline_binary_subscription *bsub)
+{
+	struct timeline_ring *ring = &bsub->ring;
+	uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+	uint64_t tail = ring->tail;
+
+	while (tail != head) {
+		size_t offset = tail & (TIMELINE_RING_SIZE - 1);
+		size_t len = MIN(head - tail, TIMELINE_RING_SIZE - offset);
+
+		weston_log_subscription_write(bsub->sub,
+					      (const char *)ring->data + offset,
+					      len);
+		tail += len;
+	}
+
+	__atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+}
+
+static int
+timeline_binary_drain_timer(void *data)
+{
+	struct weston_timeline_binary_subscription *bsub = data;
+
+	timeline_binary_drain(bsub);
+
+	return 0;
+}
+
+static void
+timeline_binary_drain_idle(void *data)
+{
+	struct weston_timeline_binary_subscription *bsub = data;
+
+	bsub->drain_idle = NULL;
+	timeline_binary_drain(bsub);
+}
+
+/** Append a record and an optional string to the ring
+ *
+ * @return false if the record had to be dropped.
+ */
+static bool
+timeline_binary_emit(struct weston_timeline_binary_subscription *bsub,
+		     struct weston_timeline_record *rec, const char *str)
+{
+	static const uint8_t zeros[8];
+	struct timeline_ring *ring = &bsub->ring;
+	uint64_t head = ring->head;
+	uint64_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+	size_t size = timeline_record_size(str);
+	size_t needed = size;
+	uint64_t used = head - tail;
+
+	if (bsub->lost)
+		needed += sizeof(struct weston_timeline_record);
+
+	if (used + needed > TIMELINE_RING_SIZE) {
+		bsub->lost++;
+		return false;
+	}
+
+	if (bsub->lost) {
+		struct weston_timeline_record lost = {
+			.type = WESTON_TIMELINE_RECORD_LOST,
+			.size = sizeof lost,
+			.time_ns = rec->time_ns,
+			.aux = bsub->lost,
+		};
+
+		timeline_ring_copy_in(ring, head, &lost, sizeof lost);
+		head += sizeof lost;
+		bsub->lost = 0;
+	}
+
+	rec->size = size;
+	timeline_ring_copy_in(ring, head, rec, sizeof *rec);
+	if (str) {
+		size_t len = strlen(str) + 1;
+
+		timeline_ring_copy_in(ring, head + sizeof *rec, str, len);
+		timeline_ring_copy_in(ring, head + sizeof *rec + len, zeros,
+				      size - sizeof *rec - len);
+	}
+	head += size;
+
+	__atomic_store_n(&ring->head, head, __ATOMIC_RELEASE);
+
+	/* Going from empty to non-empty, drain in a while */
+	if (used == 0 && bsub->drain_timer)
+		wl_event_source_timer_update(bsub->drain_timer,
+					     TIMELINE_DRAIN_DELAY_MS);
+
+	/* Crossing half full, drain as soon as the compositor is idle */
+	if (used < TIMELINE_RING_SIZE / 2 &&
+	    used + needed >= TIMELINE_RING_SIZE / 2 &&
+	    !bsub->drain_idle && bsub->loop)
+		bsub->drain_idle =
+			wl_event_loop_add_idle(bsub->loop,
+					       timeline_binary_drain_idle,
+					       bsub);
+
+	return true;
+}
+
+static uint32_t
+timeline_binary_name_id(struct weston_timeline_binary_subscription *bsub,
+			const char *name, uint64_t time_ns)
+{
+	uintptr_t hash = ((uintptr_t)name >> 3) * 2654435761u;
+	unsigned i;
+
+	for (i = 0; i < TIMELINE_NAME_SLOTS; i++) {
+		struct timeline_name *slot;
+		struct weston_timeline_record rec = {
+			.type = WESTON_TIMELINE_RECORD_NAME,
+			.time_ns = time_ns,
+		};
+
+		slot = &bsub->names[(hash + i) & (TIMELINE_NAME_SLOTS - 1)];
+		if (slot->name == name)
+			return slot->id;
+		if (slot->name)
+			continue;
+
+		/* First use of the name; retried later if dropped */
+		rec.id = bsub->next_name_id + 1;
+		if (!timeline_binary_emit(bsub, &rec, name))
+			return 0;
+
+		slot->name = name;
+		slot->id = ++bsub->next_name_id;
+		return slot->id;
+	}
+
+	/* Out of slots, the point stays anonymous */
+	return 0;
+}
+
+static uint32_t
+timeline_binary_output_id(struct weston_timeline_binary_subscription *bsub,
+			  struct weston_output *output, uint64_t time_ns)
+{
+	struct weston_timeline_subscription_object *sub_obj;
+	struct weston_timeline_record rec = {
+		.type = WESTON_TIMELINE_RECORD_OUTPUT,
+		.time_ns = time_ns,
+	};
+
+	sub_obj = weston_timeline_subscription_output_ensure(&bsub->base,
+							     output);
+	if (weston_timeline_check_object_refresh(sub_obj)) {
+		rec.id = sub_obj->id;
+		if (!timeline_binary_emit(bsub, &rec, output->name))
+			sub_obj->force_refresh = true;
+	}
+
+	return sub_obj->id;
+}
+
+static uint32_t
+timeline_binary_surface_id(struct weston_timeline_binary_subscription *bsub,
+			   struct weston_surface *surface, uint64_t time_ns)
+{
+	struct weston_timeline_subscription_object *sub_obj;
+	struct weston_timeline_record rec = {
+		.type = WESTON_TIMELINE_RECORD_SURFACE,
+		.time_ns = time_ns,
+	};
+	struct weston_surface *mains;
+	char desc[512];
+
+	sub_obj = weston_timeline_subscription_surface_ensure(&bsub->base,
+							      surface);
+	if (!weston_timeline_check_object_refresh(sub_obj))
+		return sub_obj->id;
+
+	mains = weston_surface_get_main_surface(surface);
+	if (mains != surface)
+		rec.surface = timeline_binary_surface_id(bsub, mains, time_ns);
+
+	if (!surface->get_label ||
+	    surface->get_label(surface, desc, sizeof(desc)) < 0)
+		desc[0] = '\0';
+
+	rec.id = sub_obj->id;
+	if (!timeline_binary_emit(bsub, &rec, desc))
+		sub_obj->force_refresh = true;
+
+	return sub_obj->id;
+}
+
+/** Create a binary timeline subscription and hang it off the subscription
+ *
+ * Called when the subscription is created.
+ *
+ * @param user_data the weston_compositor
+ *
+ * @ingroup internal-log
+ */
+void
+weston_timeline_binary_create_subscription(struct weston_log_subscription *sub,
+					   void *user_data)
+{
+	struct weston_compositor *compositor = user_data;
+	struct weston_timeline_binary_subscription *bsub;
+	struct weston_timeline_record rec = {
+		.type = WESTON_TIMELINE_RECORD_STREAM,
+		.aux = WESTON_TIMELINE_BINARY_VERSION,
+	};
+	struct timespec ts;
+
+	bsub = zalloc(sizeof(*bsub));
+	if (!bsub)
+		return;
+
+	bsub->ring.data = malloc(TIMELINE_RING_SIZE);
+	if (!bsub->ring.data) {
+		free(bsub);
+		return;
+	}
+
+	wl_list_init(&bsub->base.objects);
+	bsub->sub = sub;
+	bsub->loop = wl_display_get_event_loop(compositor->wl_display);
+	bsub->drain_timer = wl_event_loop_add_timer(bsub->loop,
+						    timeline_binary_drain_timer,
+						    bsub);
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	rec.time_ns = timespec_to_nsec(&ts);
+	timeline_binary_emit(bsub, &rec, WESTON_TIMELINE_BINARY_MAGIC);
+
+	weston_log_subscription_set_data(sub, bsub);
+}
+
+/** Flush and destroy a binary timeline subscription
+ *
+ * Called when (before) the subscription is destroyed.
+ *
+ * @ingroup internal-log
+ */
+void
+weston_timeline_binary_destroy_subscription(struct weston_log_subscription *sub,
+					    void *user_data)
+{
+	struct weston_timeline_binary_subscription *bsub =
+		weston_log_subscription_get_data(sub);
+
+	if (!bsub)
+		return;
+
+	timeline_binary_drain(bsub);
+
+	if (bsub->drain_idle)
+		wl_event_source_remove(bsub->drain_idle);
+	if (bsub->drain_timer)
+		wl_event_source_remove(bsub->drain_timer);
+
+	weston_timeline_subscription_release_objects(&bsub->base);
+	free(bsub->ring.data);
+	free(bsub);
+}
+
+/** Record a timeline point in all subscriptions of \c timeline_scope
+ *
+ * The binary counterpart of weston_timeline_point(), takes the same
+ * arguments. TL_POINT() calls both.
+ *
+ * @param timeline_scope the binary timeline scope
+ * @param name the name of the timeline point; interned by its address, so
+ * it must stay valid and should be a string literal.
+ *
+ * @ingroup log
+ */
+WL_EXPORT void
+weston_timeline_binary_point(struct weston_log_scope *timeline_scope,
+			     const char *name, ...)
+{
+	struct weston_log_subscription *sub = NULL;
+	struct timespec ts;
+	uint64_t time_ns;
+
+	if (!weston_log_scope_is_enabled(timeline_scope))
+		return;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	time_ns = timespec_to_nsec(&ts);
+
+	while ((sub = weston_log_subscription_iterate(timeline_scope, sub))) {
+		struct weston_timeline_binary_subscription *bsub;
+		struct weston_timeline_record rec = {
+			.type = WESTON_TIMELINE_RECORD_POINT,
+			.time_ns = time_ns,
+		};
+		enum timeline_type otype;
+		va_list argp;
+		void *obj;
+
+		bsub = weston_log_subscription_get_data(sub);
+		if (!bsub)
+			continue;
+
+		rec.id = timeline_binary_name_id(bsub, name, time_ns);
+
+		va_start(argp, name);
+		while ((otype = va_arg(argp, enum timeline_type)) != TLT_END) {
+			obj = va_arg(argp, void *);
+
+			switch (otype) {
+			case TLT_OUTPUT:
+				rec.output = timeline_binary_output_id(bsub, obj,
+								       time_ns);
+				break;
+			case TLT_SURFACE:
+				rec.surface = timeline_binary_surface_id(bsub, obj,
+									 time_ns);
+				break;
+			case TLT_VBLANK:
+				rec.flags |= WESTON_TIMELINE_POINT_VBLANK;
+				rec.aux = timespec_to_nsec(obj);
+				break;
+			case TLT_GPU:
+				rec.flags |= WESTON_TIMELINE_POINT_GPU;
+				rec.aux = timespec_to_nsec(obj);
+				break;
+			case TLT_INPUT:
+				rec.flags |= WESTON_TIMELINE_POINT_INPUT;
+				rec.input = *(const uint32_t *)obj;
+				break;
+			case TLT_END:
+				break;
+			}
+		}
+		va_end(argp);
+
+		timeline_binary_emit(bsub, &rec, NULL);
+	}
+}
@@ -41,6 +41,7 @@ enum timeline_type {
 	TLT_SURFACE,
 	TLT_VBLANK,
 	TLT_GPU,
+	TLT_INPUT,
 };
 
 /** Timeline subscription created for each subscription
@@ -80,10 +81,12 @@ struct weston_timeline_subscription_object {
 #define TLP_SURFACE(s) TLT_SURFACE, TYPEVERIFY(struct weston_surface *, (s))
 #define TLP_VBLANK(t) TLT_VBLANK, TYPEVERIFY(const struct timespec *, (t))
 #define TLP_GPU(t) TLT_GPU, TYPEVERIFY(const struct timespec *, (t))
+#define TLP_INPUT(id) TLT_INPUT, TYPEVERIFY(const uint32_t *, (id))
 
 /** This macro is used to add timeline points.
  *
- * Use TLP_END when done for the vargs.
+ * Use TLP_END when done for the vargs. The point goes to both the JSON
+ * 'timeline' and the 'timeline-binary' scopes.
  *
  * @param ec weston_compositor instance
  *
@@ -91,10 +94,15 @@ struct weston_timeline_subscription_object {
  */
 #define TL_POINT(ec, ...) do { \
 	weston_timeline_point(ec->timeline, __VA_ARGS__); \
+	weston_timeline_binary_point(ec->timeline_binary, __VA_ARGS__); \
 } while (0)
 
 void
 weston_timeline_point(struct weston_log_scope *timeline_scope,
 		      const char *name, ...);
 
+void
+weston_timeline_binary_point(struct weston_log_scope *timeline_scope,
+			     const char *name, ...);
+
 #endif /* WESTON_TIMELINE_H */
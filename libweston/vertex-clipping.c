@@ -25,16 +25,25 @@
 #include <assert.h>
 #include <float.h>
 #include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
 
 #include "shared/helpers.h"
 #include "vertex-clipping.h"
 
+/* http://www.altdevblogaday.com/2012/02/22/comparing-floating-point-numbers-2012-edition/ */
+static const float max_diff = 4.0f * FLT_MIN;
+static const float max_rel_diff = 4.0e-5;
+
 WESTON_EXPORT_FOR_TESTS float
 float_difference(float a, float b)
 {
-	/* http://www.altdevblogaday.com/2012/02/22/comparing-floating-point-numbers-2012-edition/ */
-	static const float max_diff = 4.0f * FLT_MIN;
-	static const float max_rel_diff = 4.0e-5;
 	float diff = a - b;
 	float adiff = fabsf(diff);
 
@@ -291,20 +300,12 @@ clip_simple(struct clip_context *ctx,
 	return surf->n;
 }
 
-WESTON_EXPORT_FOR_TESTS int
-clip_transformed(struct clip_context *ctx,
-		 struct polygon8 *surf,
-		 struct weston_coord *e)
+/* Get rid of duplicate vertices */
+static int
+clip_remove_duplicates(const struct polygon8 *surf, struct weston_coord *e)
 {
-	struct polygon8 polygon;
 	int i, n;
 
-	polygon.n = clip_polygon_left(ctx, surf, polygon.pos);
-	surf->n = clip_polygon_right(ctx, &polygon, surf->pos);
-	polygon.n = clip_polygon_top(ctx, surf, polygon.pos);
-	surf->n = clip_polygon_bottom(ctx, &polygon, surf->pos);
-
-	/* Get rid of duplicate vertices */
 	e[0] = surf->pos[0];
 	n = 1;
 	for (i = 1; i < surf->n; i++) {
@@ -320,3 +321,383 @@ clip_transformed(struct clip_context *ctx,
 
 	return n;
 }
+
+WESTON_EXPORT_FOR_TESTS int
+clip_transformed(struct clip_context *ctx,
+		 struct polygon8 *surf,
+		 struct weston_coord *e)
+{
+	struct polygon8 polygon;
+
+	polygon.n = clip_polygon_left(ctx, surf, polygon.pos);
+	surf->n = clip_polygon_right(ctx, &polygon, surf->pos);
+	polygon.n = clip_polygon_top(ctx, surf, polygon.pos);
+	surf->n = clip_polygon_bottom(ctx, &polygon, surf->pos);
+
+	return clip_remove_duplicates(surf, e);
+}
+
+/*
+ * Batched clipping of many quads against many boxes.
+ *
+ * The stages below perform exactly the same float operations as
+ * clip_polygon_left() and friends, so the results are bit-exact with
+ * clip_transformed(). The inside tests and the edge intersections are
+ * evaluated four vertices at a time; only the compaction, which depends
+ * on the path transitions, is done vertex by vertex.
+ */
+
+#if defined(__SSE2__)
+
+typedef __m128 vf4;
+typedef __m128 vm4;
+
+static inline vf4 vf4_load(const float *p) { return _mm_loadu_ps(p); }
+static inline void vf4_store(float *p, vf4 a) { _mm_storeu_ps(p, a); }
+static inline vf4 vf4_splat(float f) { return _mm_set1_ps(f); }
+static inline vf4 vf4_add(vf4 a, vf4 b) { return _mm_add_ps(a, b); }
+static inline vf4 vf4_sub(vf4 a, vf4 b) { return _mm_sub_ps(a, b); }
+static inline vf4 vf4_mul(vf4 a, vf4 b) { return _mm_mul_ps(a, b); }
+static inline vf4 vf4_div(vf4 a, vf4 b) { return _mm_div_ps(a, b); }
+static inline vf4 vf4_max(vf4 a, vf4 b) { return _mm_max_ps(a, b); }
+static inline vm4 vf4_ge(vf4 a, vf4 b) { return _mm_cmpge_ps(a, b); }
+static inline vm4 vf4_lt(vf4 a, vf4 b) { return _mm_cmplt_ps(a, b); }
+static inline vm4 vf4_le(vf4 a, vf4 b) { return _mm_cmple_ps(a, b); }
+static inline vm4 vm4_or(vm4 a, vm4 b) { return _mm_or_ps(a, b); }
+static inline unsigned vm4_bits(vm4 m) { return _mm_movemask_ps(m); }
+
+static inline vf4
+vf4_abs(vf4 a)
+{
+	return _mm_andnot_ps(_mm_set1_ps(-0.0f), a);
+}
+
+static inline vf4
+vf4_select(vm4 m, vf4 a, vf4 b)
+{
+	return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b));
+}
+
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+
+typedef float32x4_t vf4;
+typedef uint32x4_t vm4;
+
+static inline vf4 vf4_load(const float *p) { return vld1q_f32(p); }
+static inline void vf4_store(float *p, vf4 a) { vst1q_f32(p, a); }
+static inline vf4 vf4_splat(float f) { return vdupq_n_f32(f); }
+static inline vf4 vf4_add(vf4 a, vf4 b) { return vaddq_f32(a, b); }
+static inline vf4 vf4_sub(vf4 a, vf4 b) { return vsubq_f32(a, b); }
+static inline vf4 vf4_mul(vf4 a, vf4 b) { return vmulq_f32(a, b); }
+static inline vf4 vf4_div(vf4 a, vf4 b) { return vdivq_f32(a, b); }
+static inline vf4 vf4_max(vf4 a, vf4 b) { return vmaxq_f32(a, b); }
+static inline vm4 vf4_ge(vf4 a, vf4 b) { return vcgeq_f32(a, b); }
+static inline vm4 vf4_lt(vf4 a, vf4 b) { return vcltq_f32(a, b); }
+static inline vm4 vf4_le(vf4 a, vf4 b) { return vcleq_f32(a, b); }
+static inline vm4 vm4_or(vm4 a, vm4 b) { return vorrq_u32(a, b); }
+static inline vf4 vf4_abs(vf4 a) { return vabsq_f32(a); }
+static inline vf4 vf4_select(vm4 m, vf4 a, vf4 b) { return vbslq_f32(m, a, b); }
+
+static inline unsigned
+vm4_bits(vm4 m)
+{
+	static const uint32_t weights[4] = { 1, 2, 4, 8 };
+
+	return vaddvq_u32(vandq_u32(m, vld1q_u32(weights)));
+}
+
+#else /* portable fallback */
+
+typedef struct { float f[4]; } vf4;
+typedef struct { bool b[4]; } vm4;
+
+#define VF4_MAP(expr) \
+	vf4 r; \
+	int i; \
+	for (i = 0; i < 4; i++) \
+		r.f[i] = (expr); \
+	return r
+
+#define VM4_MAP(expr) \
+	vm4 r; \
+	int i; \
+	for (i = 0; i < 4; i++) \
+		r.b[i] = (expr); \
+	return r
+
+static inline vf4 vf4_load(const float *p) { VF4_MAP(p[i]); }
+static inline vf4 vf4_splat(float f) { VF4_MAP(f); }
+static inline vf4 vf4_add(vf4 a, vf4 b) { VF4_MAP(a.f[i] + b.f[i]); }
+static inline vf4 vf4_sub(vf4 a, vf4 b) { VF4_MAP(a.f[i] - b.f[i]); }
+static inline vf4 vf4_mul(vf4 a, vf4 b) { VF4_MAP(a.f[i] * b.f[i]); }
+static inline vf4 vf4_div(vf4 a, vf4 b) { VF4_MAP(a.f[i] / b.f[i]); }
+static inline vf4 vf4_abs(vf4 a) { VF4_MAP(fabsf(a.f[i])); }
+static inline vf4 vf4_max(vf4 a, vf4 b) { VF4_MAP(a.f[i] > b.f[i] ? a.f[i] : b.f[i]); }
+static inline vf4 vf4_select(vm4 m, vf4 a, vf4 b) { VF4_MAP(m.b[i] ? a.f[i] : b.f[i]); }
+static inline vm4 vf4_ge(vf4 a, vf4 b) { VM4_MAP(a.f[i] >= b.f[i]); }
+static inline vm4 vf4_lt(vf4 a, vf4 b) { VM4_MAP(a.f[i] < b.f[i]); }
+static inline vm4 vf4_le(vf4 a, vf4 b) { VM4_MAP(a.f[i] <= b.f[i]); }
+static inline vm4 vm4_or(vm4 a, vm4 b) { VM4_MAP(a.b[i] || b.b[i]); }
+
+static inline void
+vf4_store(float *p, vf4 a)
+{
+	int i;
+
+	for (i = 0; i < 4; i++)
+		p[i] = a.f[i];
+}
+
+static inline unsigned
+vm4_bits(vm4 m)
+{
+	return m.b[0] | m.b[1] << 1 | m.b[2] << 2 | m.b[3] << 3;
+}
+
+#undef VF4_MAP
+#undef VM4_MAP
+
+#endif
+
+/* Room for 8 vertices after slot 0, rounded up to whole vectors */
+#define CLIP_BATCH_SLOTS 12
+
+/*
+ * A polygon in structure-of-arrays form. Slot 0 repeats the last vertex,
+ * the vertices themselves start at slot 1, so the previous vertex of the
+ * vertex at slot i + 1 is at slot i.
+ */
+struct clip_batch_polygon {
+	float x[CLIP_BATCH_SLOTS];
+	float y[CLIP_BATCH_SLOTS];
+	int n;
+};
+
+/* Fill slot 0 and the unused lanes of the last vector */
+static void
+clip_batch_finish(float *a, float *b, int n)
+{
+	int i;
+
+	if (n == 0)
+		return;
+
+	a[0] = a[n];
+	b[0] = b[n];
+	for (i = n + 1; i <= ((n + 3) & ~3); i++)
+		a[i] = b[i] = 0.0f;
+}
+
+/*
+ * Clip against the line a = clip, where 'a' is x for the left and right
+ * edges and y for the top and bottom edges, and 'b' is the other
+ * coordinate. The kept side is a < clip if 'keep_below', a >= clip
+ * otherwise. Returns the number of vertices written to dst_a and dst_b.
+ */
+static int
+clip_batch_stage(const float *src_a, const float *src_b, int n,
+		 float clip, bool keep_below, float *dst_a, float *dst_b)
+{
+	const vf4 vclip = vf4_splat(clip);
+	const vf4 vmax_diff = vf4_splat(max_diff);
+	const vf4 vmax_rel_diff = vf4_splat(max_rel_diff);
+	float bi[CLIP_BATCH_SLOTS];
+	unsigned inside = 0;
+	unsigned prev_inside;
+	unsigned full;
+	int i, m = 0;
+
+	if (n < 2)
+		return 0;
+
+	for (i = 0; i < n; i += 4) {
+		vf4 ca = vf4_load(&src_a[i + 1]);
+
+		inside |= vm4_bits(keep_below ? vf4_lt(ca, vclip) :
+						vf4_ge(ca, vclip)) << i;
+	}
+
+	full = (1u << n) - 1;
+	inside &= full;
+
+	/* Every vertex is outside, so the polygon is clipped away */
+	if (inside == 0)
+		return 0;
+
+	if (inside == full) {
+		for (i = 0; i <= ((n + 3) & ~3); i++) {
+			dst_a[i] = src_a[i];
+			dst_b[i] = src_b[i];
+		}
+		return n;
+	}
+
+	for (i = 0; i < n; i += 4) {
+		vf4 pa = vf4_load(&src_a[i]);
+		vf4 pb = vf4_load(&src_b[i]);
+		vf4 ca = vf4_load(&src_a[i + 1]);
+		vf4 cb = vf4_load(&src_b[i + 1]);
+		vf4 diff, adiff, t;
+		vm4 flat;
+
+		/* float_difference(prev a, a) == 0.0f */
+		diff = vf4_sub(pa, ca);
+		adiff = vf4_abs(diff);
+		flat = vm4_or(vf4_le(adiff, vmax_diff),
+			      vf4_le(adiff,
+				     vf4_mul(vf4_max(vf4_abs(pa), vf4_abs(ca)),
+					     vmax_rel_diff)));
+
+		/* clip_intersect_y() or clip_intersect_x() */
+		t = vf4_div(vf4_sub(vclip, ca), diff);
+		t = vf4_add(cb, vf4_mul(vf4_sub(pb, cb), t));
+		vf4_store(&bi[i], vf4_select(flat, cb, t));
+	}
+
+	prev_inside = ((inside << 1) | (inside >> (n - 1))) & full;
+
+	for (i = 0; i < n; i++) {
+		enum path_transition trans;
+
+		trans = ((prev_inside >> i) & 1) << 1 | ((inside >> i) & 1);
+
+		switch (trans) {
+		case PATH_TRANSITION_IN_TO_IN:
+			m++;
+			dst_a[m] = src_a[i + 1];
+			dst_b[m] = src_b[i + 1];
+			break;
+		case PATH_TRANSITION_IN_TO_OUT:
+			m++;
+			dst_a[m] = clip;
+			dst_b[m] = bi[i];
+			break;
+		case PATH_TRANSITION_OUT_TO_IN:
+			m++;
+			dst_a[m] = clip;
+			dst_b[m] = bi[i];
+			m++;
+			dst_a[m] = src_a[i + 1];
+			dst_b[m] = src_b[i + 1];
+			break;
+		case PATH_TRANSITION_OUT_TO_OUT:
+			/* nothing */
+			break;
+		}
+		assert(m <= 8);
+	}
+
+	clip_batch_finish(dst_a, dst_b, m);
+
+	return m;
+}
+
+static int
+clip_batch_one(const struct clip_batch_polygon *quad,
+	       const struct clip_box *box, struct weston_coord *e)
+{
+	struct clip_batch_polygon p, q;
+	struct polygon8 surf;
+	int i;
+
+	p.n = clip_batch_stage(quad->x, quad->y, quad->n, box->x1, false,
+			       p.x, p.y);
+	q.n = clip_batch_stage(p.x, p.y, p.n, box->x2, true, q.x, q.y);
+	p.n = clip_batch_stage(q.y, q.x, q.n, box->y1, false, p.y, p.x);
+	q.n = clip_batch_stage(p.y, p.x, p.n, box->y2, true, q.y, q.x);
+
+	if (q.n == 0)
+		return 0;
+
+	surf.n = q.n;
+	for (i = 0; i < q.n; i++)
+		surf.pos[i] = weston_coord(q.x[i + 1], q.y[i + 1]);
+
+	return clip_remove_duplicates(&surf, e);
+}
+
+/*
+ * Clip each of the 'n_polys' polygons, with at most four vertices each,
+ * against each of the 'n_boxes' boxes. The result for polygon j and box i
+ * is written to 'vertices' starting at index (i * n_polys + j) * 8, with
+ * the number of vertices in 'counts[i * n_polys + j]'.
+ *
+ * Pairs whose bounding boxes do not overlap produce no vertices; all other
+ * results are identical to clip_transformed(). The caller must discard
+ * results with fewer than three vertices. Returns the total number of
+ * vertices produced.
+ */
+WESTON_EXPORT_FOR_TESTS int
+clip_transformed_batch(const struct polygon8 *polys, int n_polys,
+		       const struct clip_box *boxes, int n_boxes,
+		       struct weston_coord *vertices, int *counts)
+{
+	int total = 0;
+	int i, j, k;
+
+	for (j = 0; j < n_polys; j++) {
+		struct clip_batch_polygon quad;
+		float min_x, max_x, min_y, max_y;
+		vf4 vmin_x, vmax_x, vmin_y, vmax_y;
+
+		assert(polys[j].n > 0 && polys[j].n <= 4);
+
+		quad.n = polys[j].n;
+		for (k = 0; k < quad.n; k++) {
+			quad.x[k + 1] = polys[j].pos[k].x;
+			quad.y[k + 1] = polys[j].pos[k].y;
+		}
+		clip_batch_finish(quad.x, quad.y, quad.n);
+
+		min_x = max_x = quad.x[1];
+		min_y = max_y = quad.y[1];
+		for (k = 1; k < quad.n; k++) {
+			min_x = MIN(min_x, quad.x[k + 1]);
+			max_x = MAX(max_x, quad.x[k + 1]);
+			min_y = MIN(min_y, quad.y[k + 1]);
+			max_y = MAX(max_y, quad.y[k + 1]);
+		}
+		vmin_x = vf4_splat(min_x);
+		vmax_x = vf4_splat(max_x);
+		vmin_y = vf4_splat(min_y);
+		vmax_y = vf4_splat(max_y);
+
+		/* Bounding box rejection, four boxes at a time */
+		for (i = 0; i < n_boxes; i += 4) {
+			float x1[4], y1[4], x2[4], y2[4];
+			int chunk = MIN(4, n_boxes - i);
+			unsigned reject;
+			vm4 out;
+
+			for (k = 0; k < 4; k++) {
+				const struct clip_box *box =
+					&boxes[i + MIN(k, chunk - 1)];
+
+				x1[k] = box->x1;
+				y1[k] = box->y1;
+				x2[k] = box->x2;
+				y2[k] = box->y2;
+			}
+
+			out = vm4_or(vm4_or(vf4_ge(vmin_x, vf4_load(x2)),
+					    vf4_le(vmax_x, vf4_load(x1))),
+				     vm4_or(vf4_ge(vmin_y, vf4_load(y2)),
+					    vf4_le(vmax_y, vf4_load(y1))));
+			reject = vm4_bits(out);
+
+			for (k = 0; k < chunk; k++) {
+				int idx = (i + k) * n_polys + j;
+
+				if (reject & (1u << k))
+					counts[idx] = 0;
+				else
+					counts[idx] = clip_batch_one(&quad,
+								     &boxes[i + k],
+								     &vertices[idx * 8]);
+				total += counts[idx];
+			}
+		}
+	}
+
+	return total;
+}
@@ -32,16 +32,18 @@ struct polygon8 {
 	int n;
 };
 
+struct clip_box {
+	float x1, y1;
+	float x2, y2;
+};
+
 struct clip_context {
 	struct {
 		float x;
 		float y;
 	} prev;
 
-	struct {
-		float x1, y1;
-		float x2, y2;
-	} clip;
+	struct clip_box clip;
 
 	struct weston_coord *vertices;
 };
@@ -59,4 +61,9 @@ clip_transformed(struct clip_context *ctx,
 		 struct polygon8 *surf,
 		 struct weston_coord *e);
 
+int
+clip_transformed_batch(const struct polygon8 *polys, int n_polys,
+		       const struct clip_box *boxes, int n_boxes,
+		       struct weston_coord *vertices, int *counts);
+
 #endif
@@ -31,13 +31,62 @@
 
 #include "weston-log-internal.h"
 
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Asynchronous writing
+ *
+ * A subscriber created with weston_log_subscriber_create_log_async() does
+ * not write from the threads that log. Each write is copied into a slot of
+ * a bounded queue, which a writer thread empties into the file.
+ *
+ * The queue is the bounded multi-producer queue of Dmitry Vyukov: each slot
+ * has a sequence number telling whether it is free for the position a
+ * producer claimed, or filled for the position the writer reads next.
+ * Producers claim positions with a compare-and-swap and never wait. When
+ * the queue is full, or holds LOG_FILE_ASYNC_MAX_BYTES already, the write
+ * is dropped and counted; the count is handed over with the next write that
+ * makes it in, and the writer puts a marker line in its place. A line can
+ * be made of several writes, so the marker counts writes, not lines, and
+ * starts a line of its own.
+ *
+ * The semaphore only wakes the writer up, the queue itself tells what is
+ * ready.
+ */
+
+#define LOG_FILE_ASYNC_SLOTS 4096	/* a power of two */
+#define LOG_FILE_ASYNC_MAX_BYTES (4 * 1024 * 1024)
+
+struct log_file_slot {
+	uint64_t seq;
+	char *data;
+	size_t len;
+	uint64_t dropped_before;	/**< writes dropped ahead of this one */
+};
 
 /** File type of stream
  */
 struct weston_debug_log_file {
 	struct weston_log_subscriber base;
 	FILE *file;
+
+	/* Only used by the asynchronous kind */
+	struct log_file_slot *slots;
+	uint64_t enqueue_pos;		/**< next position for producers */
+	uint64_t dequeue_pos;		/**< next position for the writer */
+	uint64_t queued_bytes;
+	uint64_t dropped;
+	bool mid_line;			/**< the writer left a line unfinished */
+	bool exiting;
+	sem_t wakeup;
+	pthread_t thread;
 };
 
 static struct weston_debug_log_file *
@@ -54,15 +103,179 @@ weston_log_file_write(struct weston_log_subscriber *sub,
 	fwrite(data, len, 1, stream->file);
 }
 
+static void
+log_file_drop(struct weston_debug_log_file *stream, size_t len)
+{
+	if (len > 0)
+		__atomic_sub_fetch(&stream->queued_bytes, len,
+				   __ATOMIC_RELAXED);
+	__atomic_add_fetch(&stream->dropped, 1, __ATOMIC_RELAXED);
+}
+
+static void
+weston_log_file_write_async(struct weston_log_subscriber *sub,
+			    const char *data, size_t len)
+{
+	struct weston_debug_log_file *stream = to_weston_debug_log_file(sub);
+	struct log_file_slot *slot;
+	uint64_t pos, seq;
+	int64_t diff;
+	char *copy;
+
+	if (__atomic_add_fetch(&stream->queued_bytes, len, __ATOMIC_RELAXED) >
+	    LOG_FILE_ASYNC_MAX_BYTES) {
+		log_file_drop(stream, len);
+		return;
+	}
+
+	pos = __atomic_load_n(&stream->enqueue_pos, __ATOMIC_RELAXED);
+	for (;;) {
+		slot = &stream->slots[pos & (LOG_FILE_ASYNC_SLOTS - 1)];
+		seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+		diff = (int64_t)(seq - pos);
+
+		if (diff == 0) {
+			if (__atomic_compare_exchange_n(&stream->enqueue_pos,
+							&pos, pos + 1, true,
+							__ATOMIC_RELAXED,
+							__ATOMIC_RELAXED))
+				break;
+		} else if (diff < 0) {
+			/* The writer has not emptied this slot yet */
+			log_file_drop(stream, len);
+			return;
+		} else {
+			pos = __atomic_load_n(&stream->enqueue_pos,
+					      __ATOMIC_RELAXED);
+		}
+	}
+
+	/* The position is ours now and must be filled, even if empty */
+	copy = malloc(len);
+	if (copy) {
+		memcpy(copy, data, len);
+	} else {
+		log_file_drop(stream, len);
+		len = 0;
+	}
+
+	slot->data = copy;
+	slot->len = len;
+	slot->dropped_before = __atomic_exchange_n(&stream->dropped, 0,
+						   __ATOMIC_RELAXED);
+	__atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+
+	sem_post(&stream->wakeup);
+}
+
+static void
+log_file_write_dropped(struct weston_debug_log_file *stream, uint64_t dropped)
+{
+	if (dropped == 0)
+		return;
+
+	fprintf(stream->file, "%s[%" PRIu64 " log writes dropped]\n",
+		stream->mid_line ? "\n" : "", dropped);
+	stream->mid_line = false;
+}
+
+/* Writes out the slots that are ready, in order */
+static void
+log_file_drain(struct weston_debug_log_file *stream)
+{
+	struct log_file_slot *slot;
+	uint64_t pos = stream->dequeue_pos;
+
+	for (;;) {
+		slot = &stream->slots[pos & (LOG_FILE_ASYNC_SLOTS - 1)];
+		if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != pos + 1)
+			break;
+
+		log_file_write_dropped(stream, slot->dropped_before);
+		if (slot->data && slot->len > 0) {
+			fwrite(slot->data, slot->len, 1, stream->file);
+			stream->mid_line = slot->data[slot->len - 1] != '\n';
+		}
+		free(slot->data);
+		slot->data = NULL;
+		__atomic_sub_fetch(&stream->queued_bytes, slot->len,
+				   __ATOMIC_RELAXED);
+
+		/* Hand the slot over to the producers of the next round */
+		__atomic_store_n(&slot->seq, pos + LOG_FILE_ASYNC_SLOTS,
+				 __ATOMIC_RELEASE);
+		pos++;
+	}
+
+	stream->dequeue_pos = pos;
+	fflush(stream->file);
+}
+
+static void *
+log_file_writer_thread(void *data)
+{
+	struct weston_debug_log_file *stream = data;
+
+	for (;;) {
+		while (sem_wait(&stream->wakeup) < 0 && errno == EINTR)
+			continue;
+
+		log_file_drain(stream);
+
+		if (__atomic_load_n(&stream->exiting, __ATOMIC_ACQUIRE))
+			break;
+	}
+
+	log_file_write_dropped(stream,
+			       __atomic_exchange_n(&stream->dropped, 0,
+						   __ATOMIC_RELAXED));
+	fflush(stream->file);
+
+	return NULL;
+}
+
 static void
 weston_log_subscriber_destroy_log(struct weston_log_subscriber *subscriber)
 {
 	struct weston_debug_log_file *file = to_weston_debug_log_file(subscriber);
 
 	weston_log_subscriber_release(subscriber);
+
+	if (file->slots) {
+		__atomic_store_n(&file->exiting, true, __ATOMIC_RELEASE);
+		sem_post(&file->wakeup);
+		pthread_join(file->thread, NULL);
+		sem_destroy(&file->wakeup);
+		free(file->slots);
+	}
+
 	free(file);
 }
 
+static struct weston_debug_log_file *
+log_file_create(FILE *dump_to)
+{
+	struct weston_debug_log_file *file = zalloc(sizeof(*file));
+
+	if (!file)
+		return NULL;
+
+	if (dump_to)
+		file->file = dump_to;
+	else
+		file->file = stderr;
+
+
+	file->base.write = weston_log_file_write;
+	file->base.destroy = weston_log_subscriber_destroy_log;
+	file->base.destroy_subscription = NULL;
+	file->base.complete = NULL;
+
+	wl_list_init(&file->base.subscription_list);
+
+	return file;
+}
+
 /** Creates a file type of subscriber
  *
  * Should be destroyed using weston_log_subscriber_destroy()
@@ -76,23 +289,67 @@ weston_log_subscriber_destroy_log(struct weston_log_subscriber *subscriber)
 WL_EXPORT struct weston_log_subscriber *
 weston_log_subscriber_create_log(FILE *dump_to)
 {
-	struct weston_debug_log_file *file = zalloc(sizeof(*file));
+	struct weston_debug_log_file *file = log_file_create(dump_to);
 
 	if (!file)
 		return NULL;
 
-	if (dump_to)
-		file->file = dump_to;
-	else
-		file->file = stderr;
+	return &file->base;
+}
 
+/** Creates a file type of subscriber that writes from a thread of its own
+ *
+ * Logging through it never blocks on the file: the data is queued and
+ * written by a background thread. When the queue is full, data is dropped
+ * and a line with the number of dropped writes is put in its place.
+ * Destroying the subscriber writes out everything still queued.
+ *
+ * Should be destroyed using weston_log_subscriber_destroy()
+ *
+ * @param dump_to if specified, used for writing data to
+ * @returns a weston_log_subscriber object or NULL in case of failure
+ *
+ * @sa weston_log_subscriber_create_log
+ *
+ */
+WL_EXPORT struct weston_log_subscriber *
+weston_log_subscriber_create_log_async(FILE *dump_to)
+{
+	struct weston_debug_log_file *file = log_file_create(dump_to);
+	sigset_t set, old_set;
+	uint64_t i;
+	int ret;
 
-	file->base.write = weston_log_file_write;
-	file->base.destroy = weston_log_subscriber_destroy_log;
-	file->base.destroy_subscription = NULL;
-	file->base.complete = NULL;
+	if (!file)
+		return NULL;
 
-	wl_list_init(&file->base.subscription_list);
+	file->slots = calloc(LOG_FILE_ASYNC_SLOTS, sizeof(*file->slots));
+	if (!file->slots)
+		goto err_file;
+
+	for (i = 0; i < LOG_FILE_ASYNC_SLOTS; i++)
+		file->slots[i].seq = i;
+
+	if (sem_init(&file->wakeup, 0, 0) < 0)
+		goto err_slots;
+
+	/* The writer thread must not take the compositor's signals */
+	sigfillset(&set);
+	pthread_sigmask(SIG_BLOCK, &set, &old_set);
+	ret = pthread_create(&file->thread, NULL, log_file_writer_thread, file);
+	pthread_sigmask(SIG_SETMASK, &old_set, NULL);
+	if (ret != 0)
+		goto err_sem;
+
+	file->base.write = weston_log_file_write_async;
 
 	return &file->base;
+
+err_sem:
+	sem_destroy(&file->wakeup);
+err_slots:
+	free(file->slots);
+err_file:
+	free(file);
+	return NULL;
 }
@@ -27,46 +27,101 @@
 
 #include <libweston/weston-log.h>
 #include "shared/helpers.h"
+#include "shared/timespec-util.h"
 #include <libweston/libweston.h>
 
 #include "weston-log-internal.h"
 
 #include <assert.h>
+#include <pthread.h>
 #include <unistd.h>
 #include <stdarg.h>
+#include <stdint.h>
 #include <string.h>
 #include <errno.h>
+#include <time.h>
 #include <sys/time.h>
 
-struct weston_ring_buffer {
-	uint32_t append_pos;	/**< where in the buffer we are */
-	uint32_t size;		/**< max length of the ring buffer */
-	char *buf;		/**< the buffer itself */
-	FILE *file;		/**< where to write in case we need to dump the buf */
-	bool overlap;		/**< in case buff overlaps, hint from where to print buf contents */
+/*
+ * Every thread writing to the flight recorder gets a ring buffer of its
+ * own on its first write. The thread creating the recorder, usually the
+ * main thread, gets the full size; other threads only get the last
+ * FLIGHT_REC_THREAD_RING_SIZE bytes. A ring has a single producer, its
+ * thread, which never waits: when the ring is full, the oldest records are
+ * dropped to make room. Rings are only read when the recorder contents are
+ * displayed, and the records of all rings are then merged by timestamp.
+ *
+ * When a thread exits, its ring is handed back, records included, and the
+ * next new thread takes it over instead of allocating another one.
+ *
+ * The producer publishes 'tail' before overwriting the bytes it no longer
+ * covers, and 'head' after writing the bytes it newly covers. A reader
+ * copies a record out and then checks that 'tail' has not moved past it,
+ * otherwise the copy may be torn and is discarded.
+ *
+ * Rings are only freed together with the recorder, so reading them takes
+ * no locks either, which lets weston_log_flight_recorder_dump_fd() run
+ * from a signal handler.
+ */
+
+/** Header of a record, followed by 'len' bytes padded to a multiple of 8 */
+struct flight_rec_record {
+	uint64_t time_ns;	/**< CLOCK_MONOTONIC */
+	uint32_t len;
+	uint32_t reserved;
 };
 
-/** allows easy access to the ring buffer in case of a core dump
- */
-WL_EXPORT struct weston_ring_buffer *weston_primary_flight_recorder_ring_buffer = NULL;
+struct weston_ring_buffer {
+	struct weston_ring_buffer *next; /**< next ring of the flight recorder */
+	pid_t tid;		/**< the thread writing to this ring */
+	int in_use;		/**< owned by a live thread */
+	uint64_t head;		/**< end of the newest record */
+	uint64_t tail;		/**< start of the oldest record */
+	uint64_t read_pos;	/**< next record to display */
+	uint64_t read_end;	/**< head when displaying started */
+	size_t size;		/**< max length of the ring buffer */
+	char buf[];		/**< the buffer itself */
+};
 
 /** A black box type of stream, used to aggregate data continuously, and
  * when needed, to dump its contents for inspection.
  */
 struct weston_debug_log_flight_recorder {
 	struct weston_log_subscriber base;
-	struct weston_ring_buffer rb;
+	size_t ring_size;	/**< size of the ring of each thread */
+	unsigned int generation;
+	struct weston_ring_buffer *rings; /**< one per thread, push only */
+	FILE *file;		/**< where to write in case we need to dump */
+	int displaying;		/**< set while the rings are being read */
 };
 
-static void
-weston_ring_buffer_init(struct weston_ring_buffer *rb, size_t size, char *buf)
-{
-	rb->append_pos = 0;
-	rb->size = size - 1;
-	rb->buf = buf;
-	rb->overlap = false;
-	rb->file = stderr;
-}
+/** allows easy access to the flight recorder in case of a core dump
+ */
+WL_EXPORT struct weston_debug_log_flight_recorder *weston_primary_flight_recorder = NULL;
+
+/* Tells the rings of successive flight recorders apart */
+static unsigned int flight_rec_generation;
+
+/* The ring of the calling thread, valid while tls_generation matches the
+ * generation of the flight recorder */
+static __thread struct weston_ring_buffer *tls_ring;
+static __thread unsigned int tls_generation;
+
+/* Generation of the live flight recorder, 0 if there is none */
+static unsigned int flight_rec_live_generation;
+
+/* Hands the ring of an exiting thread back */
+static pthread_key_t flight_rec_thread_key;
+static pthread_once_t flight_rec_thread_key_once = PTHREAD_ONCE_INIT;
+
+/* Bytes copied from a ring at a time while displaying */
+#define FLIGHT_REC_CHUNK 256
+
+/* Ring size of the threads other than the creating one */
+#define FLIGHT_REC_THREAD_RING_SIZE (64 * 1024)
+
+typedef void (*flight_rec_output_func)(void *data, const char *buf,
+				       size_t len);
 
 static struct weston_debug_log_flight_recorder *
 to_flight_recorder(struct weston_log_subscriber *sub)
@@ -74,79 +129,182 @@ to_flight_recorder(struct weston_log_subscriber *sub)
 	return container_of(sub, struct weston_debug_log_flight_recorder, base);
 }
 
+static size_t
+flight_rec_record_size(size_t len)
+{
+	return sizeof(struct flight_rec_record) + ((len + 7) & ~(size_t)7);
+}
+
 static void
-weston_log_flight_recorder_adjust_end(struct weston_ring_buffer *rb,
-				      size_t bytes_to_advance)
+weston_ring_buffer_copy_in(struct weston_ring_buffer *rb, uint64_t pos,
+			   const void *data, size_t len)
 {
-	if (rb->append_pos == rb->size - bytes_to_advance)
-		rb->append_pos = 0;
-	else
-		rb->append_pos += bytes_to_advance;
+	size_t offset = pos % rb->size;
+	size_t first = MIN(len, rb->size - offset);
+
+	memcpy(&rb->buf[offset], data, first);
+	memcpy(rb->buf, (const char *)data + first, len - first);
 }
 
 static void
-weston_log_flight_recorder_write_chunks(struct weston_ring_buffer *rb,
-					const char *data, size_t len)
+weston_ring_buffer_copy_out(const struct weston_ring_buffer *rb, uint64_t pos,
+			    void *data, size_t len)
 {
-	/* no of chunks that matches our buffer size */
-	size_t nr_chunks = len / rb->size;
-
-	/* bytes left that do not fill entire buffer */
-	size_t bytes_left_last_chunk = len % rb->size;
-	const char *c_data = data;
-
-	/* might overlap multiple times, memcpy is redundant,
-	 * that's why we don't even modify append_pos */
-	while (nr_chunks-- > 0) {
-		memcpy(&rb->buf[rb->append_pos], c_data, rb->size);
-		c_data += rb->size;
-	}
+	size_t offset = pos % rb->size;
+	size_t first = MIN(len, rb->size - offset);
+
+	memcpy(data, &rb->buf[offset], first);
+	memcpy((char *)data + first, rb->buf, len - first);
+}
+
+/* Whether a copy out from 'pos' onwards was not overwritten meanwhile */
+static bool
+weston_ring_buffer_copy_valid(const struct weston_ring_buffer *rb,
+			      uint64_t pos)
+{
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+	return __atomic_load_n(&rb->tail, __ATOMIC_RELAXED) <= pos;
+}
+
+static struct weston_ring_buffer *
+weston_ring_buffer_create(size_t size)
+{
+	struct weston_ring_buffer *rb;
+
+	rb = zalloc(sizeof(*rb) + size);
+	if (!rb)
+		return NULL;
 
-	if (bytes_left_last_chunk)
-		memcpy(&rb->buf[rb->append_pos], c_data, bytes_left_last_chunk);
+	rb->size = size;
+	rb->tid = gettid();
+
+	/* write some data to the rb such that the memory gets mapped */
+	memset(rb->buf, 0xff, size);
 
-	/* adjust append_pos */
-	weston_log_flight_recorder_adjust_end(rb, bytes_left_last_chunk);
+	return rb;
 }
 
+/* Only ever called by the thread owning the ring */
 static void
-weston_log_flight_recorder_write_chunks_overlap(struct weston_ring_buffer *rb,
-					 const char *data, size_t len)
+weston_ring_buffer_append(struct weston_ring_buffer *rb,
+			  const char *data, size_t len)
 {
-	size_t transfer_remains =
-		(rb->append_pos + len) - rb->size;
-	size_t transfer_to_end = len - transfer_remains;
-	const char *c_data = data;
+	struct flight_rec_record rec = { 0 };
+	struct timespec ts;
+	uint64_t head = __atomic_load_n(&rb->head, __ATOMIC_RELAXED);
+	uint64_t tail = __atomic_load_n(&rb->tail, __ATOMIC_RELAXED);
+	size_t needed;
+
+	/* keep the end of data that does not fit in the ring at all */
+	if (flight_rec_record_size(len) > rb->size) {
+		size_t max = (rb->size - sizeof(rec)) & ~(size_t)7;
+
+		data += len - max;
+		len = max;
+	}
+	needed = flight_rec_record_size(len);
+
+	/* drop the oldest records to make room */
+	if (head + needed - tail > rb->size) {
+		while (head + needed - tail > rb->size) {
+			struct flight_rec_record old;
 
-	/* transfer what remains until the end of the buffer */
-	memcpy(&rb->buf[rb->append_pos], c_data, transfer_to_end);
-	c_data += transfer_to_end;
+			weston_ring_buffer_copy_out(rb, tail, &old, sizeof(old));
+			tail += flight_rec_record_size(old.len);
+		}
 
-	/* reset append_pos as we filled up the buffer */
-	rb->append_pos = 0;
+		/* readers must see the new tail before the new data */
+		__atomic_store_n(&rb->tail, tail, __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_RELEASE);
+	}
 
-	/* transfer what remains */
-	weston_log_flight_recorder_write_chunks(rb, c_data, transfer_remains);
-	rb->overlap = true;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	rec.time_ns = timespec_to_nsec(&ts);
+	rec.len = len;
+
+	weston_ring_buffer_copy_in(rb, head, &rec, sizeof(rec));
+	weston_ring_buffer_copy_in(rb, head + sizeof(rec), data, len);
+
+	__atomic_store_n(&rb->head, head + needed, __ATOMIC_RELEASE);
 }
 
 static void
-weston_log_flight_recorder_write_data(struct weston_ring_buffer *rb,
-				      const char *data, size_t len)
+flight_rec_thread_exit(void *data)
 {
-	/*
-	 * If append_pos is at the beginning of the buffer, we determine if we
-	 * should do it in chunks, and if there are any bytes left we transfer
-	 * those as well.
-	 *
-	 * If the append_pos is somewhere inside the buffer we determine how
-	 * many bytes we need to transfer between we reach the end and overlap,
-	 * then we proceed as in the first step.
-	 */
-	if (rb->append_pos == 0)
-		weston_log_flight_recorder_write_chunks(rb, data, len);
-	else
-		weston_log_flight_recorder_write_chunks_overlap(rb, data, len);
+	struct weston_ring_buffer *rb = data;
+
+	/* The ring went away with its flight recorder */
+	if (tls_generation != __atomic_load_n(&flight_rec_live_generation,
+					      __ATOMIC_ACQUIRE))
+		return;
+
+	/* publishes head and tail to the next owner */
+	__atomic_store_n(&rb->in_use, 0, __ATOMIC_RELEASE);
+}
+
+static void
+flight_rec_thread_key_create(void)
+{
+	pthread_key_create(&flight_rec_thread_key, flight_rec_thread_exit);
+}
+
+/* Takes over the ring of a thread that has exited, if any */
+static struct weston_ring_buffer *
+weston_log_flight_recorder_reuse_ring(struct weston_debug_log_flight_recorder *flight_rec)
+{
+	struct weston_ring_buffer *rb;
+	int in_use;
+
+	rb = __atomic_load_n(&flight_rec->rings, __ATOMIC_ACQUIRE);
+	for (; rb; rb = rb->next) {
+		in_use = 0;
+		if (__atomic_compare_exchange_n(&rb->in_use, &in_use, 1,
+						false, __ATOMIC_ACQUIRE,
+						__ATOMIC_RELAXED))
+			return rb;
+	}
+
+	return NULL;
+}
+
+static struct weston_ring_buffer *
+weston_log_flight_recorder_get_ring(struct weston_debug_log_flight_recorder *flight_rec)
+{
+	struct weston_ring_buffer *rb;
+	size_t size;
+
+	if (tls_ring && tls_generation == flight_rec->generation)
+		return tls_ring;
+
+	pthread_once(&flight_rec_thread_key_once, flight_rec_thread_key_create);
+
+	rb = weston_log_flight_recorder_reuse_ring(flight_rec);
+	if (rb) {
+		rb->tid = gettid();
+	} else {
+		/* the first ring is the one of the creating thread */
+		size = flight_rec->rings ?
+		       MIN(flight_rec->ring_size, FLIGHT_REC_THREAD_RING_SIZE) :
+		       flight_rec->ring_size;
+		rb = weston_ring_buffer_create(size);
+		if (!rb)
+			return NULL;
+		rb->in_use = 1;
+
+		rb->next = __atomic_load_n(&flight_rec->rings, __ATOMIC_RELAXED);
+		while (!__atomic_compare_exchange_n(&flight_rec->rings,
+						    &rb->next, rb, true,
+						    __ATOMIC_RELEASE,
+						    __ATOMIC_RELAXED))
+			;
+	}
+
+	tls_ring = rb;
+	tls_generation = flight_rec->generation;
+	pthread_setspecific(flight_rec_thread_key, rb);
+
+	return rb;
 }
 
 static void
@@ -155,48 +313,136 @@ weston_log_flight_recorder_write(struct weston_log_subscriber *sub,
 {
 	struct weston_debug_log_flight_recorder *flight_rec =
 		to_flight_recorder(sub);
-	struct weston_ring_buffer *rb = &flight_rec->rb;
+	struct weston_ring_buffer *rb;
 
-	/* in case the data is bigger than the size of the buf */
-	if (rb->size < len) {
-		weston_log_flight_recorder_write_data(rb, data, len);
-	} else {
-		/* if we can transfer it without wrapping it do it at once */
-		if (rb->append_pos <= rb->size - len) {
-			memcpy(&rb->buf[rb->append_pos], data, len);
-
-			/*
-			 * adjust append_pos, take care of the situation were
-			 * to fill up the entire buf
-			 */
-			weston_log_flight_recorder_adjust_end(rb, len);
-		} else {
-			weston_log_flight_recorder_write_data(rb, data, len);
+	rb = weston_log_flight_recorder_get_ring(flight_rec);
+	if (rb)
+		weston_ring_buffer_append(rb, data, len);
+}
+
+/* Reads the header of the next record of a ring, skipping what was
+ * overwritten since; false if the ring has no more records to display */
+static bool
+weston_ring_buffer_peek(struct weston_ring_buffer *rb,
+			struct flight_rec_record *rec)
+{
+	while (rb->read_pos < rb->read_end) {
+		weston_ring_buffer_copy_out(rb, rb->read_pos, rec, sizeof(*rec));
+		if (weston_ring_buffer_copy_valid(rb, rb->read_pos))
+			return true;
+
+		rb->read_pos = __atomic_load_n(&rb->tail, __ATOMIC_ACQUIRE);
+	}
+
+	return false;
+}
+
+/* Outputs the data of the record at read_pos; stops at the first chunk
+ * that was overwritten meanwhile */
+static void
+weston_ring_buffer_output_record(struct weston_ring_buffer *rb,
+				 const struct flight_rec_record *rec,
+				 flight_rec_output_func output, void *data)
+{
+	uint64_t pos = rb->read_pos + sizeof(*rec);
+	size_t remains = rec->len;
+	char chunk[FLIGHT_REC_CHUNK];
+
+	while (remains > 0) {
+		size_t len = MIN(remains, sizeof(chunk));
+
+		weston_ring_buffer_copy_out(rb, pos, chunk, len);
+		if (!weston_ring_buffer_copy_valid(rb, rb->read_pos))
+			break;
+
+		output(data, chunk, len);
+		pos += len;
+		remains -= len;
+	}
+
+	rb->read_pos += flight_rec_record_size(rec->len);
+}
+
+/*
+ * Outputs the records of all rings, oldest first. Does not allocate
+ * memory nor take locks, and is async-signal-safe as long as 'output' is.
+ */
+static void
+weston_log_flight_recorder_output(struct weston_debug_log_flight_recorder *flight_rec,
+				  flight_rec_output_func output, void *data)
+{
+	struct weston_ring_buffer *rings, *rb;
+
+	/* one reader at a time, the read positions live in the rings */
+	if (__atomic_exchange_n(&flight_rec->displaying, 1, __ATOMIC_ACQUIRE))
+		return;
+
+	rings = __atomic_load_n(&flight_rec->rings, __ATOMIC_ACQUIRE);
+	for (rb = rings; rb; rb = rb->next) {
+		rb->read_end = __atomic_load_n(&rb->head, __ATOMIC_ACQUIRE);
+		rb->read_pos = __atomic_load_n(&rb->tail, __ATOMIC_ACQUIRE);
+	}
+
+	while (true) {
+		struct weston_ring_buffer *oldest = NULL;
+		struct flight_rec_record rec, oldest_rec;
+
+		for (rb = rings; rb; rb = rb->next) {
+			if (!weston_ring_buffer_peek(rb, &rec))
+				continue;
+
+			if (!oldest || rec.time_ns < oldest_rec.time_ns) {
+				oldest = rb;
+				oldest_rec = rec;
+			}
 		}
+
+		if (!oldest)
+			break;
+
+		weston_ring_buffer_output_record(oldest, &oldest_rec,
+						 output, data);
 	}
 
+	__atomic_store_n(&flight_rec->displaying, 0, __ATOMIC_RELEASE);
 }
 
 static void
-weston_log_subscriber_display_flight_rec_data(struct weston_ring_buffer *rb,
+flight_rec_output_file(void *data, const char *buf, size_t len)
+{
+	FILE *file = data;
+
+	fwrite(buf, sizeof(char), len, file);
+}
+
+static void
+flight_rec_output_fd(void *data, const char *buf, size_t len)
+{
+	int fd = *(int *)data;
+
+	while (len > 0) {
+		ssize_t ret = write(fd, buf, len);
+
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret <= 0)
+			return;
+
+		buf += ret;
+		len -= ret;
+	}
+}
+
+static void
+weston_log_subscriber_display_flight_rec_data(struct weston_debug_log_flight_recorder *flight_rec,
 					      FILE *file)
 {
 	FILE *file_d = stderr;
 	if (file)
 		file_d = file;
 
-	if (!rb->overlap) {
-		if (rb->append_pos)
-			fwrite(rb->buf, sizeof(char), rb->append_pos, file_d);
-		else
-			fwrite(rb->buf, sizeof(char), rb->size, file_d);
-	} else {
-		/* from append_pos to size */
-		fwrite(&rb->buf[rb->append_pos], sizeof(char),
-		       rb->size - rb->append_pos, file_d);
-		/* from 0 to append_pos */
-		fwrite(rb->buf, sizeof(char), rb->append_pos, file_d);
-	}
+	weston_log_flight_recorder_output(flight_rec, flight_rec_output_file,
+					  file_d);
 }
 
 WL_EXPORT void
@@ -204,43 +450,53 @@ weston_log_subscriber_display_flight_rec(struct weston_log_subscriber *sub)
 {
 	struct weston_debug_log_flight_recorder *flight_rec =
 		to_flight_recorder(sub);
-	struct weston_ring_buffer *rb = &flight_rec->rb;
 
-	weston_log_subscriber_display_flight_rec_data(rb, rb->file);
+	weston_log_subscriber_display_flight_rec_data(flight_rec,
+						      flight_rec->file);
 }
 
 static void
 weston_log_subscriber_destroy_flight_rec(struct weston_log_subscriber *sub)
 {
 	struct weston_debug_log_flight_recorder *flight_rec = to_flight_recorder(sub);
+	struct weston_ring_buffer *rb, *next;
+
+	/* Resets weston_primary_flight_recorder to NULL if it is the
+	 * destroyed subscriber */
+	if (weston_primary_flight_recorder == flight_rec)
+		weston_primary_flight_recorder = NULL;
 
-	/* Resets weston_primary_flight_recorder_ring_buffer to NULL if it
-	 * is the destroyed subscriber */
-	if (weston_primary_flight_recorder_ring_buffer == &flight_rec->rb)
-		weston_primary_flight_recorder_ring_buffer = NULL;
+	__atomic_store_n(&flight_rec_live_generation, 0, __ATOMIC_RELEASE);
 
 	weston_log_subscriber_release(sub);
-	free(flight_rec->rb.buf);
+
+	for (rb = flight_rec->rings; rb; rb = next) {
+		next = rb->next;
+		free(rb);
+	}
 	free(flight_rec);
 }
 
 /** Create a flight recorder type of subscriber
  *
- * Allocates both the flight recorder and the underlying ring buffer. Use
- * weston_log_subscriber_destroy() to clean-up.
+ * Allocates the flight recorder. The calling thread gets a ring buffer of
+ * \p size bytes, every other thread writing to it a smaller one of its own,
+ * created on its first write and reused once that thread exits. Threads
+ * may write concurrently without locking, but the flight recorder must
+ * outlive all of them. Use weston_log_subscriber_destroy() to clean-up.
  *
  * @param size specify the maximum size (in bytes) of the backing storage
- * for the flight recorder
+ * for the flight recorder of the calling thread
  * @returns a weston_log_subscriber object or NULL in case of failure
  */
 WL_EXPORT struct weston_log_subscriber *
 weston_log_subscriber_create_flight_rec(size_t size)
 {
 	struct weston_debug_log_flight_recorder *flight_rec;
-	char *weston_rb;
+	struct weston_ring_buffer *rb;
 
 	assert("Can't create more than one flight recorder." &&
-			!weston_primary_flight_recorder_ring_buffer);
+			!weston_primary_flight_recorder);
 
 	flight_rec = zalloc(sizeof(*flight_rec));
 	if (!flight_rec)
@@ -252,17 +508,22 @@ weston_log_subscriber_create_flight_rec(size_t size)
 	flight_rec->base.complete = NULL;
 	wl_list_init(&flight_rec->base.subscription_list);
 
-	weston_rb = zalloc(sizeof(char) * size);
-	if (!weston_rb) {
+	flight_rec->ring_size = MAX(size & ~(size_t)7,
+				    flight_rec_record_size(FLIGHT_REC_CHUNK));
+	flight_rec->generation = ++flight_rec_generation;
+	flight_rec->file = stderr;
+	__atomic_store_n(&flight_rec_live_generation, flight_rec->generation,
+			 __ATOMIC_RELEASE);
+
+	/* the ring of the creating thread, usually the main thread, is
+	 * allocated up front so that it does not fail later */
+	rb = weston_log_flight_recorder_get_ring(flight_rec);
+	if (!rb) {
 		free(flight_rec);
 		return NULL;
 	}
 
-	weston_ring_buffer_init(&flight_rec->rb, size, weston_rb);
-	weston_primary_flight_recorder_ring_buffer = &flight_rec->rb;
-
-	/* write some data to the rb such that the memory gets mapped */
-	memset(flight_rec->rb.buf, 0xff, flight_rec->rb.size);
+	weston_primary_flight_recorder = flight_rec;
 
 	return &flight_rec->base;
 }
@@ -273,15 +534,44 @@ weston_log_subscriber_create_flight_rec(size_t size)
  * @param file a FILE type already opened. Can also pass stderr/stdout under gdb
  * if the program is loaded into memory.
  *
- * Uses the global exposed weston_primary_flight_recorder_ring_buffer.
+ * Uses the global exposed weston_primary_flight_recorder.
  *
  */
 WL_EXPORT void
 weston_log_flight_recorder_display_buffer(FILE *file)
 {
-	if (!weston_primary_flight_recorder_ring_buffer)
+	if (!weston_primary_flight_recorder)
 		return;
 
-	weston_log_subscriber_display_flight_rec_data(weston_primary_flight_recorder_ring_buffer,
+	weston_log_subscriber_display_flight_rec_data(weston_primary_flight_recorder,
 						      file);
 }
+
+/** Write the flight recorder contents to a file descriptor from a signal
+ * handler
+ *
+ * Merges the ring buffers of all threads by timestamp, like
+ * weston_log_flight_recorder_display_buffer(), but is async-signal-safe:
+ * it neither allocates memory nor takes locks, and writes with write(2).
+ * Records that other threads overwrite while they are being read are
+ * skipped.
+ *
+ * Does nothing if the flight recorder is being displayed already, for
+ * instance when the crash happened while displaying it.
+ *
+ * @param fd the file descriptor to write to, e.g. STDERR_FILENO.
+ *
+ * Uses the global exposed weston_primary_flight_recorder.
+ */
+WL_EXPORT void
+weston_log_flight_recorder_dump_fd(int fd)
+{
+	struct weston_debug_log_flight_recorder *flight_rec =
+		weston_primary_flight_recorder;
+
+	if (!flight_rec)
+		return;
+
+	weston_log_flight_recorder_output(flight_rec, flight_rec_output_fd,
+					  &fd);
+}
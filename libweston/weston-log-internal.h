@@ -114,4 +114,12 @@ void
 weston_timeline_destroy_subscription(struct weston_log_subscription *sub,
 				     void *user_data);
 
+void
+weston_timeline_binary_create_subscription(struct weston_log_subscription *sub,
+					   void *user_data);
+
+void
+weston_timeline_binary_destroy_subscription(struct weston_log_subscription *sub,
+					    void *user_data);
+
 #endif /* WESTON_LOG_INTERNAL_H */
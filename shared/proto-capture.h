@@ -0,0 +1,85 @@
+/*
+ * Copyright 2024 Collabora, Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef WESTON_PROTO_CAPTURE_H
+#define WESTON_PROTO_CAPTURE_H
+
+#include <stdint.h>
+
+/*
+ * The stream written to the 'proto-binary' log scope.
+ *
+ * A stream is a sequence of records in host byte order. Every record
+ * starts with struct weston_proto_record, and its size is a multiple of
+ * 8 bytes.
+ *
+ * Interfaces and clients are referred to by ids, defined in the stream
+ * before their first use. Definitions are repeated from time to time, so
+ * that a capture which lost its beginning, like the contents of the flight
+ * recorder, becomes decodable after a while. A decoder must accept
+ * repeated STREAM and definition records.
+ *
+ * The arguments of a message follow its record, encoded like on the wire
+ * with 32-bit words: 'i', 'u', 'f', 'o', 'n' and 'h' take one word ('o' is
+ * the object id, 'h' the file descriptor number in the compositor); 's' and
+ * 'a' take the length in bytes followed by the bytes, padded to a word. The
+ * length of a string includes its NUL terminator, a NULL string is 0.
+ */
+
+#define WESTON_PROTO_CAPTURE_VERSION 1
+
+/* The string carried by STREAM records */
+#define WESTON_PROTO_CAPTURE_MAGIC "weston-proto"
+
+enum weston_proto_record_type {
+	/** Start of a stream: 'object' is the version */
+	WESTON_PROTO_RECORD_STREAM = 1,
+
+	/** Defines interface 'interface', 'object' is its version and the
+	 * name follows, NUL-terminated, cut to 127 bytes and padded with
+	 * zeros */
+	WESTON_PROTO_RECORD_INTERFACE,
+
+	/** Defines client 'client', 'object' is its PID */
+	WESTON_PROTO_RECORD_CLIENT,
+
+	/** A request 'opcode' from 'client' to 'object' */
+	WESTON_PROTO_RECORD_REQUEST,
+
+	/** An event 'opcode' from 'object' to 'client' */
+	WESTON_PROTO_RECORD_EVENT,
+};
+
+struct weston_proto_record {
+	uint16_t type;		/**< enum weston_proto_record_type */
+	uint16_t opcode;	/**< message index in the interface */
+	uint32_t size;		/**< bytes, including the arguments */
+	uint64_t time_ns;	/**< CLOCK_REALTIME */
+	uint64_t client;	/**< client id, 0 if none */
+	uint32_t object;	/**< object id */
+	uint32_t interface;	/**< interface id, 0 if unknown */
+};
+
+#endif /* WESTON_PROTO_CAPTURE_H */
@@ -0,0 +1,96 @@
+/*
+ * Copyright 2024 Collabora, Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef WESTON_TIMELINE_BINARY_H
+#define WESTON_TIMELINE_BINARY_H
+
+#include <stdint.h>
+
+/*
+ * The stream written to the 'timeline-binary' log scope.
+ *
+ * A stream is a sequence of records in host byte order. Every record
+ * starts with struct weston_timeline_record, and its size is a multiple
+ * of 8 bytes. Definition records carry a NUL-terminated string after the
+ * fixed part, padded with zeros.
+ *
+ * Names and objects are referred to by ids, which are defined in the
+ * stream before their first use. Ids are only unique within one stream.
+ */
+
+/*
+ * Version 2 added 'input' and 'reserved' to struct weston_timeline_record,
+ * growing its fixed part from 32 to 40 bytes.
+ */
+#define WESTON_TIMELINE_BINARY_VERSION 2
+
+/* The string carried by the first record of every stream */
+#define WESTON_TIMELINE_BINARY_MAGIC "weston-timeline"
+
+enum weston_timeline_record_type {
+	/** First record of a stream: 'aux' is the version */
+	WESTON_TIMELINE_RECORD_STREAM = 1,
+
+	/** Defines point name 'id' */
+	WESTON_TIMELINE_RECORD_NAME,
+
+	/** Defines output 'id', the string is the output name */
+	WESTON_TIMELINE_RECORD_OUTPUT,
+
+	/** Defines surface 'id', 'surface' is its main surface or 0 */
+	WESTON_TIMELINE_RECORD_SURFACE,
+
+	/** A timeline point named 'id' */
+	WESTON_TIMELINE_RECORD_POINT,
+
+	/** 'aux' records were dropped because the ring buffer was full */
+	WESTON_TIMELINE_RECORD_LOST,
+};
+
+enum weston_timeline_point_flags {
+	/** 'aux' is a vblank timestamp */
+	WESTON_TIMELINE_POINT_VBLANK = 1 << 0,
+
+	/** 'aux' is a GPU timestamp */
+	WESTON_TIMELINE_POINT_GPU = 1 << 1,
+
+	/** 'input' is the id of the input event the point belongs to */
+	WESTON_TIMELINE_POINT_INPUT = 1 << 2,
+};
+
+struct weston_timeline_record {
+	uint8_t type;		/**< enum weston_timeline_record_type */
+	uint8_t flags;		/**< enum weston_timeline_point_flags */
+	uint16_t size;		/**< bytes, including the string */
+	uint32_t id;
+	uint64_t time_ns;	/**< CLOCK_MONOTONIC */
+	uint32_t output;	/**< output id, 0 if none */
+	uint32_t surface;	/**< surface id, 0 if none */
+	uint64_t aux;
+	uint32_t input;		/**< input event id, 0 if none */
+	uint32_t reserved;
+};
+
+#endif /* WESTON_TIMELINE_BINARY_H */
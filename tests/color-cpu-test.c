@@ -0,0 +1,336 @@
+/*
+ * Copyright 2024 Collabora, Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "weston-test-runner.h"
+
+#include "shared/helpers.h"
+#include "color.h"
+#include "color-cpu.h"
+
+/* Some mixing matrix with all coefficients in use, column-major */
+static const float test_matrix[9] = {
+	0.80f, 0.10f, 0.05f,
+	0.15f, 0.85f, 0.05f,
+	0.05f, 0.05f, 0.90f,
+};
+
+static void
+fill_in_gamma(struct weston_color_transform *xform, float *values,
+	      unsigned len)
+{
+	const float exponent[3] = { 2.2f, 2.4f, 1.8f };
+	unsigned c, i;
+
+	for (c = 0; c < 3; c++)
+		for (i = 0; i < len; i++)
+			values[c * len + i] =
+				powf((float)i / (len - 1), exponent[c]);
+}
+
+static void
+fill_in_inv_gamma(struct weston_color_transform *xform, float *values,
+		  unsigned len)
+{
+	unsigned c, i;
+
+	for (c = 0; c < 3; c++)
+		for (i = 0; i < len; i++)
+			values[c * len + i] = powf((float)i / (len - 1),
+						   1.0f / 2.2f);
+}
+
+/* The test matrix sampled into a 3D LUT */
+static void
+fill_in_matrix_3dlut(struct weston_color_transform *xform, float *values,
+		     unsigned len)
+{
+	unsigned ri, gi, bi;
+
+	for (bi = 0; bi < len; bi++)
+	for (gi = 0; gi < len; gi++)
+	for (ri = 0; ri < len; ri++) {
+		float *v = &values[3 * (len * len * bi + len * gi + ri)];
+		float r = (float)ri / (len - 1);
+		float g = (float)gi / (len - 1);
+		float b = (float)bi / (len - 1);
+
+		v[0] = test_matrix[0] * r + test_matrix[3] * g + test_matrix[6] * b;
+		v[1] = test_matrix[1] * r + test_matrix[4] * g + test_matrix[7] * b;
+		v[2] = test_matrix[2] * r + test_matrix[5] * g + test_matrix[8] * b;
+	}
+}
+
+static void
+init_xform(struct weston_color_transform *xform,
+	   enum weston_color_mapping_type mapping)
+{
+	memset(xform, 0, sizeof *xform);
+	wl_signal_init(&xform->destroy_signal);
+
+	xform->pre_curve.type = WESTON_COLOR_CURVE_TYPE_LUT_3x1D;
+	xform->pre_curve.u.lut_3x1d.fill_in = fill_in_gamma;
+	xform->pre_curve.u.lut_3x1d.optimal_len = 1024;
+
+	xform->mapping.type = mapping;
+	switch (mapping) {
+	case WESTON_COLOR_MAPPING_TYPE_IDENTITY:
+		break;
+	case WESTON_COLOR_MAPPING_TYPE_MATRIX:
+		ARRAY_COPY(xform->mapping.u.mat.matrix, test_matrix);
+		break;
+	case WESTON_COLOR_MAPPING_TYPE_3D_LUT:
+		xform->mapping.u.lut3d.fill_in = fill_in_matrix_3dlut;
+		xform->mapping.u.lut3d.optimal_len = 17;
+		break;
+	}
+
+	xform->post_curve.type = WESTON_COLOR_CURVE_TYPE_LUT_3x1D;
+	xform->post_curve.u.lut_3x1d.fill_in = fill_in_inv_gamma;
+	xform->post_curve.u.lut_3x1d.optimal_len = 1024;
+}
+
+static void
+fini_xform(struct weston_color_transform *xform)
+{
+	wl_signal_emit(&xform->destroy_signal, xform);
+}
+
+static uint32_t
+next_random(uint32_t *state)
+{
+	*state = *state * 1103515245u + 12345u;
+	return *state >> 8;
+}
+
+/* Random ARGB pixels, half of them opaque, all validly premultiplied */
+static void
+fill_random_pixels(uint32_t *pixels, size_t count)
+{
+	uint32_t state = 1;
+	size_t i;
+
+	for (i = 0; i < count; i++) {
+		uint32_t v = next_random(&state);
+		uint32_t a = (i & 1) ? 0xff : v & 0xff;
+		uint32_t r = ((v >> 8) & 0xff) * a / 0xff;
+		uint32_t g = ((v >> 16) & 0xff) * a / 0xff;
+		uint32_t b = next_random(&state) % (a + 1);
+
+		pixels[i] = a << 24 | r << 16 | g << 8 | b;
+	}
+}
+
+static int
+channel(uint32_t p, int shift)
+{
+	return (p >> shift) & 0xff;
+}
+
+/* Compare the tiled path against the scalar pipeline, pixel by pixel */
+static void
+check_against_eval(const struct weston_cpu_color_transform *cxf,
+		   const uint32_t *in, const uint32_t *out, size_t count,
+		   bool opaque)
+{
+	size_t i;
+	int c;
+
+	for (i = 0; i < count; i++) {
+		float a = opaque ? 1.0f : channel(in[i], 24) / 255.0f;
+		float rgb[3];
+
+		assert(channel(out[i], 24) == channel(in[i], 24));
+
+		if (a == 0.0f)
+			continue;
+
+		for (c = 0; c < 3; c++)
+			rgb[c] = channel(in[i], 16 - 8 * c) / 255.0f / a;
+
+		weston_cpu_color_transform_eval(cxf, rgb);
+
+		for (c = 0; c < 3; c++) {
+			float v = fminf(fmaxf(rgb[c], 0.0f), 1.0f) * a * 255.0f;
+
+			assert(fabsf(channel(out[i], 16 - 8 * c) - v) <= 1.0f);
+		}
+	}
+}
+
+static void
+run_and_check(enum weston_color_mapping_type mapping,
+	      enum weston_cpu_color_interp interp, bool opaque)
+{
+	const int width = 333;
+	const int height = 7;
+	const int stride = 340;
+	struct weston_color_transform xform;
+	struct weston_cpu_color_transform *cxf;
+	uint32_t *in, *out;
+
+	init_xform(&xform, mapping);
+	cxf = weston_cpu_color_transform_get(&xform);
+	assert(cxf);
+	assert(weston_cpu_color_transform_get(&xform) == cxf);
+	weston_cpu_color_transform_set_interp(cxf, interp);
+
+	in = calloc(stride * height, sizeof *in);
+	out = calloc(stride * height, sizeof *out);
+	assert(in && out);
+
+	fill_random_pixels(in, stride * height);
+	memcpy(out, in, stride * height * sizeof *in);
+
+	weston_cpu_color_transform_run(cxf, NULL, out, stride,
+				       width, height, opaque);
+
+	for (int y = 0; y < height; y++) {
+		check_against_eval(cxf, in + y * stride, out + y * stride,
+				   width, opaque);
+
+		/* Outside of the area must not be touched. */
+		assert(memcmp(in + y * stride + width, out + y * stride + width,
+			      (stride - width) * sizeof *in) == 0);
+	}
+
+	free(in);
+	free(out);
+	fini_xform(&xform);
+}
+
+TEST(color_cpu_identity_mapping)
+{
+	run_and_check(WESTON_COLOR_MAPPING_TYPE_IDENTITY,
+		      WESTON_CPU_COLOR_INTERP_TETRAHEDRAL, false);
+	run_and_check(WESTON_COLOR_MAPPING_TYPE_IDENTITY,
+		      WESTON_CPU_COLOR_INTERP_TETRAHEDRAL, true);
+}
+
+TEST(color_cpu_matrix_mapping)
+{
+	run_and_check(WESTON_COLOR_MAPPING_TYPE_MATRIX,
+		      WESTON_CPU_COLOR_INTERP_TETRAHEDRAL, false);
+	run_and_check(WESTON_COLOR_MAPPING_TYPE_MATRIX,
+		      WESTON_CPU_COLOR_INTERP_TETRAHEDRAL, true);
+}
+
+TEST(color_cpu_3dlut_mapping)
+{
+	run_and_check(WESTON_COLOR_MAPPING_TYPE_3D_LUT,
+		      WESTON_CPU_COLOR_INTERP_TETRAHEDRAL, false);
+	run_and_check(WESTON_COLOR_MAPPING_TYPE_3D_LUT,
+		      WESTON_CPU_COLOR_INTERP_TRILINEAR, false);
+	run_and_check(WESTON_COLOR_MAPPING_TYPE_3D_LUT,
+		      WESTON_CPU_COLOR_INTERP_TRILINEAR, true);
+}
+
+/*
+ * Both interpolations are exact for an affine function, so a 3D LUT
+ * sampled from a matrix must reproduce the matrix.
+ */
+TEST(color_cpu_3dlut_interpolation)
+{
+	struct weston_color_transform xform_lut;
+	struct weston_color_transform xform_mat;
+	struct weston_cpu_color_transform *lut, *mat;
+	enum weston_cpu_color_interp interp;
+	uint32_t state = 7;
+	int i, c;
+
+	init_xform(&xform_lut, WESTON_COLOR_MAPPING_TYPE_3D_LUT);
+	init_xform(&xform_mat, WESTON_COLOR_MAPPING_TYPE_MATRIX);
+	lut = weston_cpu_color_transform_get(&xform_lut);
+	mat = weston_cpu_color_transform_get(&xform_mat);
+	assert(lut && mat);
+
+	for (interp = WESTON_CPU_COLOR_INTERP_TETRAHEDRAL;
+	     interp <= WESTON_CPU_COLOR_INTERP_TRILINEAR; interp++) {
+		weston_cpu_color_transform_set_interp(lut, interp);
+
+		for (i = 0; i < 10000; i++) {
+			float a[3], b[3];
+
+			for (c = 0; c < 3; c++)
+				a[c] = b[c] = (next_random(&state) % 10001) / 10000.0f;
+
+			weston_cpu_color_transform_eval(lut, a);
+			weston_cpu_color_transform_eval(mat, b);
+
+			for (c = 0; c < 3; c++)
+				assert(fabsf(a[c] - b[c]) < 1e-4f);
+		}
+	}
+
+	fini_xform(&xform_lut);
+	fini_xform(&xform_mat);
+}
+
+TEST(color_cpu_pool_matches_single_thread)
+{
+	const int width = 640;
+	const int height = 480;
+	struct weston_color_transform xform;
+	struct weston_cpu_color_transform *cxf;
+	struct weston_cpu_color_pool *pool;
+	uint32_t *single, *threaded;
+	int round;
+
+	init_xform(&xform, WESTON_COLOR_MAPPING_TYPE_3D_LUT);
+	cxf = weston_cpu_color_transform_get(&xform);
+	assert(cxf);
+
+	pool = weston_cpu_color_pool_create(3);
+	assert(pool);
+
+	single = calloc(width * height, sizeof *single);
+	threaded = calloc(width * height, sizeof *threaded);
+	assert(single && threaded);
+
+	/* Several rounds to exercise reusing the pool. */
+	for (round = 0; round < 3; round++) {
+		fill_random_pixels(single, width * height);
+		memcpy(threaded, single, width * height * sizeof *single);
+
+		weston_cpu_color_transform_run(cxf, NULL, single, width,
+					       width, height, false);
+		weston_cpu_color_transform_run(cxf, pool, threaded, width,
+					       width, height, false);
+
+		assert(memcmp(single, threaded,
+			      width * height * sizeof *single) == 0);
+	}
+
+	free(single);
+	free(threaded);
+	weston_cpu_color_pool_destroy(pool);
+	fini_xform(&xform);
+}
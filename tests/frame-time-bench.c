@@ -0,0 +1,648 @@
+/*
+ * Copyright 2024 Collabora, Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Compositor cost per frame of standard scenes on the headless backend.
+ *
+ * For every renderer fixture and scene, the client builds the scene, then
+ * for each frame updates its surfaces, commits and waits for the frame
+ * callback. The compositor runs in this process, so its CPU time is the
+ * process CPU time minus the CPU time of the client thread, and with glibc
+ * its allocations are counted by wrapping malloc, minus those made by the
+ * client thread. With GL-renderer on llvmpipe the CPU time includes the
+ * rendering.
+ *
+ * With color management, GL-renderer also runs with a wide gamut output
+ * profile, once with the output transformation fused into the surface
+ * shaders where possible and once always through the shadow framebuffer,
+ * which shows what the fusing saves.
+ *
+ * The results, one JSON object per scene and renderer, are written as
+ * lines into frame-time-bench.json in $WESTON_TEST_OUTPUT_PATH, or in the
+ * current directory.
+ */
+
+#include "config.h"
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef HAVE_LCMS
+#include <lcms2.h>
+#endif
+
+#include "weston-test-client-helper.h"
+#include "weston-test-fixture-compositor.h"
+#include "shared/string-helpers.h"
+#include "shared/timespec-util.h"
+#include "shared/weston-drm-fourcc.h"
+#include "shared/xalloc.h"
+
+#define OUTPUT_WIDTH 1280
+#define OUTPUT_HEIGHT 720
+#define WARMUP_FRAMES 10
+#define FRAMES 120
+#define MAX_SURFACES 32
+
+#ifdef __SANITIZE_ADDRESS__
+#define HAVE_ASAN 1
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define HAVE_ASAN 1
+#endif
+#endif
+
+/* AddressSanitizer brings its own malloc */
+#if defined(__GLIBC__) && !defined(HAVE_ASAN)
+#define COUNT_ALLOCATIONS 1
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+static uint64_t process_allocs;
+static __thread uint64_t thread_allocs;
+
+static inline void
+count_allocation(void)
+{
+	__atomic_add_fetch(&process_allocs, 1, __ATOMIC_RELAXED);
+	thread_allocs++;
+}
+
+void *
+malloc(size_t size)
+{
+	count_allocation();
+	return __libc_malloc(size);
+}
+
+void *
+calloc(size_t nmemb, size_t size)
+{
+	count_allocation();
+	return __libc_calloc(nmemb, size);
+}
+
+void *
+realloc(void *ptr, size_t size)
+{
+	count_allocation();
+	return __libc_realloc(ptr, size);
+}
+#endif
+
+struct setup_args {
+	struct fixture_metadata meta;
+	enum weston_renderer_type renderer;
+	bool output_profile;
+	bool fuse_output_transform;
+};
+
+static const struct setup_args my_setup_args[] = {
+	{
+		.renderer = WESTON_RENDERER_PIXMAN,
+		.meta.name = "pixman"
+	},
+	{
+		.renderer = WESTON_RENDERER_GL,
+		.meta.name = "GL"
+	},
+#ifdef HAVE_LCMS
+	{
+		.renderer = WESTON_RENDERER_GL,
+		.output_profile = true,
+		.fuse_output_transform = true,
+		.meta.name = "GL output profile"
+	},
+	{
+		.renderer = WESTON_RENDERER_GL,
+		.output_profile = true,
+		.fuse_output_transform = false,
+		.meta.name = "GL output profile, shadow"
+	},
+#endif
+};
+
+static char *
+results_filename(void)
+{
+	const char *path = getenv("WESTON_TEST_OUTPUT_PATH");
+	char *fname;
+
+	str_printf(&fname, "%s/frame-time-bench.json", path ? path : ".");
+	abort_oom_if_null(fname);
+
+	return fname;
+}
+
+#ifdef HAVE_LCMS
+/* An Adobe RGB like output, so that the output transformation is not
+ * an identity */
+static char *
+build_output_profile(void)
+{
+	static const cmsCIExyY white = { 0.3127, 0.3290, 1.0 };
+	static const cmsCIExyYTRIPLE primaries = {
+		{ 0.64, 0.33, 1.0 },
+		{ 0.21, 0.71, 1.0 },
+		{ 0.15, 0.06, 1.0 },
+	};
+	cmsToneCurve *curves[3];
+	cmsHPROFILE profile;
+	char *wd;
+	char *fname;
+	bool saved;
+
+	curves[0] = curves[1] = curves[2] = cmsBuildGamma(NULL, 2.2);
+	assert(curves[0]);
+	profile = cmsCreateRGBProfile(&white, &primaries, curves);
+	assert(profile);
+	cmsFreeToneCurve(curves[0]);
+
+	wd = realpath(".", NULL);
+	assert(wd);
+	str_printf(&fname, "%s/frame-time-bench.icm", wd);
+	abort_oom_if_null(fname);
+	free(wd);
+
+	saved = cmsSaveProfileToFile(profile, fname);
+	assert(saved);
+	cmsCloseProfile(profile);
+
+	return fname;
+}
+#endif
+
+static enum test_result_code
+fixture_setup(struct weston_test_harness *harness, const struct setup_args *arg)
+{
+	struct compositor_setup setup;
+	char *fname;
+	FILE *fp;
+
+	/* Start the results afresh with the first fixture */
+	if (arg == &my_setup_args[0]) {
+		fname = results_filename();
+		fp = fopen(fname, "w");
+		if (fp)
+			fclose(fp);
+		free(fname);
+	}
+
+	compositor_setup_defaults(&setup);
+	setup.renderer = arg->renderer;
+	setup.width = OUTPUT_WIDTH;
+	setup.height = OUTPUT_HEIGHT;
+	setup.shell = SHELL_TEST_DESKTOP;
+
+	/* The compositor runs in this process and reads it at startup */
+	if (arg->fuse_output_transform)
+		unsetenv("WESTON_GL_FUSE_OUTPUT_TRANSFORM");
+	else
+		setenv("WESTON_GL_FUSE_OUTPUT_TRANSFORM", "0", 1);
+
+#ifdef HAVE_LCMS
+	if (arg->output_profile) {
+		fname = build_output_profile();
+		weston_ini_setup(&setup,
+			cfgln("[core]"),
+			cfgln("color-management=true"),
+			cfgln("[output]"),
+			cfgln("name=headless"),
+			cfgln("icc_profile=%s", fname));
+		free(fname);
+	}
+#endif
+
+	return weston_test_harness_execute_as_client(harness, &setup);
+}
+DECLARE_FIXTURE_SETUP_WITH_ARG(fixture_setup, my_setup_args, meta);
+
+struct bench_surface {
+	struct surface *surface;
+	struct wl_subsurface *subsurface;
+	struct wp_viewport *viewport;
+};
+
+struct bench {
+	struct client *client;
+	struct wl_subcompositor *subcompositor;
+	struct wp_viewporter *viewporter;
+	struct bench_surface surfaces[MAX_SURFACES];
+	int count;
+};
+
+typedef void (*update_func_t)(struct bench *bench, int frame);
+
+struct scene {
+	const char *name;
+	void (*setup)(struct bench *bench);
+	/* Must commit surfaces[0], whose frame callback ends the frame */
+	update_func_t update;
+};
+
+static void
+fill_buffer(struct buffer *buffer, uint32_t drm_format, int seed)
+{
+	pixman_image_t *image = buffer->image;
+	uint8_t *data = (uint8_t *)pixman_image_get_data(image);
+	int stride = pixman_image_get_stride(image);
+	int width = pixman_image_get_width(image);
+	int height = pixman_image_get_height(image);
+	uint8_t alpha = drm_format == DRM_FORMAT_ARGB8888 ? 0x80 : 0xff;
+	int x, y;
+
+	for (y = 0; y < height; y++) {
+		uint8_t *row = data + y * stride;
+
+		if (drm_format == DRM_FORMAT_YUYV) {
+			/* Y0 Cb Y1 Cr */
+			for (x = 0; x < width; x++)
+				row[x * 2] = (x + y + seed) & 0xff;
+			for (x = 0; x < width; x += 2) {
+				row[x * 2 + 1] = (x + seed * 32) & 0xff;
+				row[x * 2 + 3] = (y + seed * 64) & 0xff;
+			}
+			continue;
+		}
+
+		/* Premultiplied [31:0] A:R:G:B little endian */
+		for (x = 0; x < width; x++) {
+			uint32_t *pixel = (uint32_t *)row + x;
+
+			*pixel = (uint32_t)alpha << 24 |
+				 (((x + seed * 40) & 0xff) * alpha / 255) << 16 |
+				 (((y + seed * 80) & 0xff) * alpha / 255) << 8 |
+				 ((seed * 50) & 0xff) * alpha / 255;
+		}
+	}
+}
+
+static struct bench_surface *
+bench_add_surface(struct bench *bench, int width, int height,
+		  uint32_t drm_format)
+{
+	struct bench_surface *bs;
+	struct surface *surface;
+	struct rectangle opaque = { 0, 0, width, height };
+
+	assert(bench->count < MAX_SURFACES);
+	bs = &bench->surfaces[bench->count];
+
+	surface = create_test_surface(bench->client);
+	surface->width = width;
+	surface->height = height;
+	surface->buffer = create_shm_buffer(bench->client, width, height,
+					    drm_format);
+	fill_buffer(surface->buffer, drm_format, bench->count);
+	if (drm_format != DRM_FORMAT_ARGB8888)
+		surface_set_opaque_rect(surface, &opaque);
+
+	bs->surface = surface;
+	bench->count++;
+
+	return bs;
+}
+
+/* Adds a top-level surface, shown at (x, y) on its first commit */
+static struct bench_surface *
+bench_add_window(struct bench *bench, int x, int y, int width, int height,
+		 uint32_t drm_format)
+{
+	struct bench_surface *bs;
+
+	bs = bench_add_surface(bench, width, height, drm_format);
+	bs->surface->x = x;
+	bs->surface->y = y;
+	weston_test_move_surface(bench->client->test->weston_test,
+				 bs->surface->wl_surface, x, y);
+
+	return bs;
+}
+
+/* Re-attaches the buffer of a surface, damaging all of it, and commits */
+static void
+bench_surface_redraw(struct bench_surface *bs)
+{
+	struct surface *surface = bs->surface;
+
+	wl_surface_attach(surface->wl_surface, surface->buffer->proxy, 0, 0);
+	wl_surface_damage(surface->wl_surface, 0, 0,
+			  surface->width, surface->height);
+	wl_surface_commit(surface->wl_surface);
+}
+
+static void
+redraw_all(struct bench *bench, int frame)
+{
+	int i;
+
+	/* Subsurfaces come after their parent, so commit bottom-up */
+	for (i = bench->count - 1; i >= 0; i--)
+		bench_surface_redraw(&bench->surfaces[i]);
+}
+
+/* A desktop of opaque windows, all updated every frame */
+static void
+shm_windows_setup(struct bench *bench)
+{
+	const int cols = 4, rows = 4;
+	const int width = OUTPUT_WIDTH / cols, height = OUTPUT_HEIGHT / rows;
+	int i;
+
+	for (i = 0; i < cols * rows; i++)
+		bench_add_window(bench, i % cols * width, i / cols * height,
+				 width, height, DRM_FORMAT_XRGB8888);
+}
+
+/* A window made of two levels of subsurfaces, moving every frame
+ *
+ * surfaces[0] is the window, followed by each child and its leaves.
+ */
+#define TREE_CHILDREN 4
+#define TREE_LEAVES 4
+
+static void
+subsurface_tree_setup(struct bench *bench)
+{
+	struct bench_surface *root, *child, *leaf;
+	int i, j;
+
+	root = bench_add_window(bench, 320, 120, 640, 480,
+				DRM_FORMAT_XRGB8888);
+
+	for (i = 0; i < TREE_CHILDREN; i++) {
+		child = bench_add_surface(bench, 160, 120,
+					  DRM_FORMAT_ARGB8888);
+		child->subsurface =
+			wl_subcompositor_get_subsurface(bench->subcompositor,
+							child->surface->wl_surface,
+							root->surface->wl_surface);
+
+		for (j = 0; j < TREE_LEAVES; j++) {
+			leaf = bench_add_surface(bench, 40, 30,
+						 DRM_FORMAT_ARGB8888);
+			leaf->subsurface =
+				wl_subcompositor_get_subsurface(bench->subcompositor,
+								leaf->surface->wl_surface,
+								child->surface->wl_surface);
+		}
+	}
+}
+
+static void
+subsurface_tree_update(struct bench *bench, int frame)
+{
+	struct bench_surface *bs;
+	int offset = frame % 32;
+	int i, child, leaf;
+
+	/* Subsurfaces come after their parent, so commit bottom-up */
+	for (i = bench->count - 1; i > 0; i--) {
+		bs = &bench->surfaces[i];
+		child = (i - 1) / (TREE_LEAVES + 1);
+		leaf = (i - 1) % (TREE_LEAVES + 1) - 1;
+
+		if (leaf < 0)
+			wl_subsurface_set_position(bs->subsurface,
+						   child % 2 * 320 + offset,
+						   child / 2 * 240 + offset);
+		else
+			wl_subsurface_set_position(bs->subsurface,
+						   leaf * 40,
+						   offset * 2 % 90);
+
+		wl_surface_commit(bs->surface->wl_surface);
+	}
+
+	wl_surface_commit(bench->surfaces[0].surface->wl_surface);
+}
+
+/* Windows scaled by wp_viewport and rotated by the buffer transform */
+static void
+scaled_rotated_setup(struct bench *bench)
+{
+	static const enum wl_output_transform transforms[] = {
+		WL_OUTPUT_TRANSFORM_90,
+		WL_OUTPUT_TRANSFORM_180,
+		WL_OUTPUT_TRANSFORM_270,
+		WL_OUTPUT_TRANSFORM_FLIPPED,
+	};
+	struct bench_surface *bs;
+	int i;
+
+	for (i = 0; i < 8; i++) {
+		bs = bench_add_window(bench, i % 4 * 320, i / 4 * 360,
+				      256, 256, DRM_FORMAT_XRGB8888);
+		wl_surface_set_buffer_transform(bs->surface->wl_surface,
+						transforms[i % 4]);
+
+		/* Up and down scaling, with a different aspect ratio */
+		bs->surface->width = i < 4 ? 300 : 160;
+		bs->surface->height = i < 4 ? 340 : 100;
+		bs->viewport = wp_viewporter_get_viewport(bench->viewporter,
+							  bs->surface->wl_surface);
+		wp_viewport_set_destination(bs->viewport, bs->surface->width,
+					    bs->surface->height);
+	}
+}
+
+/* Video-like YUV windows, all updated every frame */
+static void
+yuv_windows_setup(struct bench *bench)
+{
+	int i;
+
+	for (i = 0; i < 4; i++)
+		bench_add_window(bench, i % 2 * 640 + 160, i / 2 * 360 + 60,
+				 320, 240, DRM_FORMAT_YUYV);
+}
+
+/* Overlapping translucent windows, all blended on each other */
+static void
+alpha_stack_setup(struct bench *bench)
+{
+	int i;
+
+	for (i = 0; i < 8; i++)
+		bench_add_window(bench, 40 * i + 200, 30 * i + 60, 640, 400,
+				 DRM_FORMAT_ARGB8888);
+}
+
+/* A single output-sized YUV surface updated every frame */
+static void
+fullscreen_video_setup(struct bench *bench)
+{
+	bench_add_window(bench, 0, 0, OUTPUT_WIDTH, OUTPUT_HEIGHT,
+			 DRM_FORMAT_YUYV);
+}
+
+static const struct scene scenes[] = {
+	{ "shm-windows", shm_windows_setup, redraw_all },
+	{ "subsurface-tree", subsurface_tree_setup, subsurface_tree_update },
+	{ "scaled-rotated", scaled_rotated_setup, redraw_all },
+	{ "yuv-windows", yuv_windows_setup, redraw_all },
+	{ "alpha-stack", alpha_stack_setup, redraw_all },
+	{ "fullscreen-video", fullscreen_video_setup, redraw_all },
+};
+
+struct sample {
+	int64_t cpu_ns;		/* compositor CPU time */
+	uint64_t allocs;	/* compositor allocations */
+};
+
+static void
+take_sample(struct sample *s)
+{
+	struct timespec process, thread;
+
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &process);
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &thread);
+	s->cpu_ns = timespec_to_nsec(&process) - timespec_to_nsec(&thread);
+#ifdef COUNT_ALLOCATIONS
+	s->allocs = __atomic_load_n(&process_allocs, __ATOMIC_RELAXED) -
+		    thread_allocs;
+#else
+	s->allocs = 0;
+#endif
+}
+
+static void
+bench_frame(struct bench *bench, update_func_t update, int frame)
+{
+	int done;
+
+	frame_callback_set(bench->surfaces[0].surface->wl_surface, &done);
+	update(bench, frame);
+	frame_callback_wait(bench->client, &done);
+}
+
+static int
+compare_int64(const void *a, const void *b)
+{
+	const int64_t *ia = a;
+	const int64_t *ib = b;
+
+	return *ia < *ib ? -1 : *ia > *ib;
+}
+
+static void
+write_results(const struct scene *scene, int64_t *frame_ns,
+	      uint64_t allocs)
+{
+	const char *renderer = my_setup_args[get_test_fixture_index()].meta.name;
+	int64_t sum = 0;
+	char *fname;
+	FILE *fp;
+	int i;
+
+	for (i = 0; i < FRAMES; i++)
+		sum += frame_ns[i];
+	qsort(frame_ns, FRAMES, sizeof *frame_ns, compare_int64);
+
+	testlog("%s %s: %.3f ms per frame, %.1f allocations per frame\n",
+		renderer, scene->name, sum / 1e6 / FRAMES,
+		(double)allocs / FRAMES);
+
+	fname = results_filename();
+	fp = fopen(fname, "a");
+	assert(fp);
+	fprintf(fp, "{\"renderer\": \"%s\", \"scene\": \"%s\", "
+		"\"frames\": %d, \"ns_per_frame\": %" PRId64 ", "
+		"\"p50_ns\": %" PRId64 ", \"p95_ns\": %" PRId64 ", "
+		"\"max_ns\": %" PRId64 ", ",
+		renderer, scene->name, FRAMES, sum / FRAMES,
+		frame_ns[FRAMES / 2], frame_ns[FRAMES * 95 / 100],
+		frame_ns[FRAMES - 1]);
+#ifdef COUNT_ALLOCATIONS
+	fprintf(fp, "\"allocs_per_frame\": %.2f}\n", (double)allocs / FRAMES);
+#else
+	fprintf(fp, "\"allocs_per_frame\": null}\n");
+#endif
+	fclose(fp);
+	free(fname);
+}
+
+static void
+bench_destroy(struct bench *bench)
+{
+	struct bench_surface *bs;
+	int i;
+
+	for (i = bench->count - 1; i >= 0; i--) {
+		bs = &bench->surfaces[i];
+		if (bs->viewport)
+			wp_viewport_destroy(bs->viewport);
+		if (bs->subsurface)
+			wl_subsurface_destroy(bs->subsurface);
+		surface_destroy(bs->surface);
+	}
+
+	wp_viewporter_destroy(bench->viewporter);
+	wl_subcompositor_destroy(bench->subcompositor);
+	client_destroy(bench->client);
+}
+
+TEST_P(frame_time, scenes)
+{
+	const struct scene *scene = data;
+	struct bench bench = { 0 };
+	int64_t frame_ns[FRAMES];
+	struct sample begin, prev, now;
+	int i;
+
+	bench.client = create_client();
+	bench.subcompositor =
+		bind_to_singleton_global(bench.client,
+					 &wl_subcompositor_interface, 1);
+	bench.viewporter =
+		bind_to_singleton_global(bench.client,
+					 &wp_viewporter_interface, 1);
+
+	scene->setup(&bench);
+
+	/* Map everything, then let the caches settle */
+	bench_frame(&bench, redraw_all, 0);
+	for (i = 0; i < WARMUP_FRAMES; i++)
+		bench_frame(&bench, scene->update, i);
+
+	take_sample(&begin);
+	prev = begin;
+	for (i = 0; i < FRAMES; i++) {
+		bench_frame(&bench, scene->update, WARMUP_FRAMES + i);
+		take_sample(&now);
+		frame_ns[i] = now.cpu_ns - prev.cpu_ns;
+		prev = now;
+	}
+
+	write_results(scene, frame_ns, now.allocs - begin.allocs);
+
+	bench_destroy(&bench);
+}
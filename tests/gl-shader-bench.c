@@ -0,0 +1,377 @@
+/*
+ * Copyright 2024 Collabora, Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Per-pixel cost of GL-renderer fragment shader variants.
+ *
+ * Builds programs from the real vertex.glsl and fragment.glsl with the
+ * same DEF_* configuration GL-renderer uses, draws full-viewport quads into
+ * an offscreen framebuffer and reports nanoseconds per pixel. It runs on a
+ * surfaceless EGL display, so with LIBGL_ALWAYS_SOFTWARE=1 the numbers
+ * come from llvmpipe and no GPU is needed.
+ *
+ * Exits with 77 (skip) when no suitable EGL/GLES implementation exists.
+ */
+
+#include "config.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GLES2/gl2.h>
+
+#include "shared/helpers.h"
+#include "shared/timespec-util.h"
+
+/* static const char vertex_shader[]; vertex.glsl */
+#include "vertex-shader.h"
+
+/* static const char fragment_shader[]; fragment.glsl */
+#include "fragment-shader.h"
+
+#define SKIP 77
+
+#define FB_SIZE 512
+#define WARMUP_DRAWS 4
+#define TIMED_DRAWS 64
+
+struct bench_case {
+	const char *name;
+	const char *variant;
+	bool input_is_premult;
+	bool input_is_opaque;
+	bool apply_view_alpha;
+	const char *color_mapping;
+};
+
+static const struct bench_case cases[] = {
+	{ "rgba", "SHADER_VARIANT_RGBA", true, false, false,
+	  "SHADER_COLOR_MAPPING_IDENTITY" },
+	{ "rgba view_alpha", "SHADER_VARIANT_RGBA", true, false, true,
+	  "SHADER_COLOR_MAPPING_IDENTITY" },
+	{ "rgbx", "SHADER_VARIANT_RGBX", true, true, false,
+	  "SHADER_COLOR_MAPPING_IDENTITY" },
+	{ "rgba matrix", "SHADER_VARIANT_RGBA", true, false, false,
+	  "SHADER_COLOR_MAPPING_MATRIX" },
+	{ "rgba matrix view_alpha", "SHADER_VARIANT_RGBA", true, false, true,
+	  "SHADER_COLOR_MAPPING_MATRIX" },
+	{ "rgbx matrix", "SHADER_VARIANT_RGBX", true, true, false,
+	  "SHADER_COLOR_MAPPING_MATRIX" },
+	{ "solid", "SHADER_VARIANT_SOLID", true, false, false,
+	  "SHADER_COLOR_MAPPING_IDENTITY" },
+	{ "solid opaque", "SHADER_VARIANT_SOLID", true, true, false,
+	  "SHADER_COLOR_MAPPING_IDENTITY" },
+};
+
+static GLuint
+compile_shader(GLenum type, int count, const char **sources)
+{
+	char msg[512];
+	GLint status;
+	GLuint s;
+
+	s = glCreateShader(type);
+	glShaderSource(s, count, sources, NULL);
+	glCompileShader(s);
+	glGetShaderiv(s, GL_COMPILE_STATUS, &status);
+	if (!status) {
+		glGetShaderInfoLog(s, sizeof msg, NULL, msg);
+		fprintf(stderr, "shader info: %s\n", msg);
+		glDeleteShader(s);
+		return 0;
+	}
+
+	return s;
+}
+
+/* Mirrors create_shader_config_string() in gl-shaders.c */
+static GLuint
+build_program(const struct bench_case *bc)
+{
+	char conf[512];
+	const char *sources[3];
+	GLuint vertex, fragment, program;
+	GLint status;
+
+	snprintf(conf, sizeof conf,
+		 "#define DEF_GREEN_TINT false\n"
+		 "#define DEF_INPUT_IS_PREMULT %s\n"
+		 "#define DEF_INPUT_IS_OPAQUE %s\n"
+		 "#define DEF_APPLY_VIEW_ALPHA %d\n"
+		 "#define DEF_COLOR_PRE_CURVE SHADER_COLOR_CURVE_IDENTITY\n"
+		 "#define DEF_COLOR_MAPPING %s\n"
+		 "#define DEF_COLOR_POST_CURVE SHADER_COLOR_CURVE_IDENTITY\n"
+		 "#define DEF_COLOR_SWAP SHADER_COLOR_SWAP_NONE\n"
+		 "#define DEF_VARIANT %s\n",
+		 bc->input_is_premult ? "true" : "false",
+		 bc->input_is_opaque ? "true" : "false",
+		 bc->apply_view_alpha ? 1 : 0,
+		 bc->color_mapping, bc->variant);
+
+	sources[0] = vertex_shader;
+	vertex = compile_shader(GL_VERTEX_SHADER, 1, sources);
+	if (!vertex)
+		return 0;
+
+	sources[0] = "#version 100\n";
+	sources[1] = conf;
+	sources[2] = fragment_shader;
+	fragment = compile_shader(GL_FRAGMENT_SHADER, 3, sources);
+	if (!fragment) {
+		glDeleteShader(vertex);
+		return 0;
+	}
+
+	program = glCreateProgram();
+	glAttachShader(program, vertex);
+	glAttachShader(program, fragment);
+	glBindAttribLocation(program, 0, "position");
+	glBindAttribLocation(program, 1, "texcoord");
+	glLinkProgram(program);
+	glDeleteShader(vertex);
+	glDeleteShader(fragment);
+
+	glGetProgramiv(program, GL_LINK_STATUS, &status);
+	if (!status) {
+		glDeleteProgram(program);
+		return 0;
+	}
+
+	return program;
+}
+
+static void
+set_uniforms(GLuint program)
+{
+	static const GLfloat proj[16] = {
+		1.0f, 0.0f, 0.0f, 0.0f,
+		0.0f, 1.0f, 0.0f, 0.0f,
+		0.0f, 0.0f, 1.0f, 0.0f,
+		0.0f, 0.0f, 0.0f, 1.0f,
+	};
+	static const GLfloat matrix[9] = {
+		0.8f, 0.1f, 0.1f,
+		0.1f, 0.8f, 0.1f,
+		0.1f, 0.1f, 0.8f,
+	};
+	GLint loc;
+
+	glUniformMatrix4fv(glGetUniformLocation(program, "proj"),
+			   1, GL_FALSE, proj);
+	glUniform1i(glGetUniformLocation(program, "tex"), 0);
+
+	/* Unused uniforms do not exist in specialized programs. */
+	loc = glGetUniformLocation(program, "view_alpha");
+	if (loc != -1)
+		glUniform1f(loc, 0.9f);
+	loc = glGetUniformLocation(program, "unicolor");
+	if (loc != -1)
+		glUniform4f(loc, 0.2f, 0.4f, 0.6f, 1.0f);
+	loc = glGetUniformLocation(program, "color_mapping_matrix");
+	if (loc != -1)
+		glUniformMatrix3fv(loc, 1, GL_FALSE, matrix);
+}
+
+static void
+draw_quad(void)
+{
+	static const GLfloat pos[] = { -1, -1,  1, -1,  1, 1,  -1, 1 };
+	static const GLfloat tc[] = { 0, 0,  1, 0,  1, 1,  0, 1 };
+
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, pos);
+	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, tc);
+	glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+}
+
+static double
+run_case(const struct bench_case *bc)
+{
+	struct timespec begin, end;
+	GLuint program;
+	int i;
+
+	program = build_program(bc);
+	if (!program)
+		return -1.0;
+
+	glUseProgram(program);
+	set_uniforms(program);
+
+	for (i = 0; i < WARMUP_DRAWS; i++)
+		draw_quad();
+	glFinish();
+
+	clock_gettime(CLOCK_MONOTONIC, &begin);
+	for (i = 0; i < TIMED_DRAWS; i++)
+		draw_quad();
+	glFinish();
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	glUseProgram(0);
+	glDeleteProgram(program);
+
+	return (double)timespec_sub_to_nsec(&end, &begin) /
+	       ((double)TIMED_DRAWS * FB_SIZE * FB_SIZE);
+}
+
+static bool
+setup_egl(EGLDisplay *dpy_out, EGLContext *ctx_out)
+{
+	static const EGLint ctx_attribs[] = {
+		EGL_CONTEXT_CLIENT_VERSION, 2,
+		EGL_NONE
+	};
+	PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display;
+	const char *extensions;
+	EGLDisplay dpy;
+	EGLContext ctx;
+
+	extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+	if (!extensions ||
+	    !strstr(extensions, "EGL_MESA_platform_surfaceless"))
+		return false;
+
+	get_platform_display = (void *)
+		eglGetProcAddress("eglGetPlatformDisplayEXT");
+	if (!get_platform_display)
+		return false;
+
+	dpy = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA,
+				   EGL_DEFAULT_DISPLAY, NULL);
+	if (dpy == EGL_NO_DISPLAY || !eglInitialize(dpy, NULL, NULL))
+		return false;
+
+	extensions = eglQueryString(dpy, EGL_EXTENSIONS);
+	if (!extensions ||
+	    !strstr(extensions, "EGL_KHR_surfaceless_context") ||
+	    !strstr(extensions, "EGL_KHR_no_config_context") ||
+	    !eglBindAPI(EGL_OPENGL_ES_API)) {
+		eglTerminate(dpy);
+		return false;
+	}
+
+	ctx = eglCreateContext(dpy, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT,
+			       ctx_attribs);
+	if (ctx == EGL_NO_CONTEXT ||
+	    !eglMakeCurrent(dpy, EGL_NO_SURFACE, EGL_NO_SURFACE, ctx)) {
+		eglTerminate(dpy);
+		return false;
+	}
+
+	*dpy_out = dpy;
+	*ctx_out = ctx;
+
+	return true;
+}
+
+int
+main(int argc, char *argv[])
+{
+	EGLDisplay dpy;
+	EGLContext ctx;
+	GLuint fbo, target, input;
+	uint32_t *pixels;
+	uint32_t state = 1;
+	unsigned i;
+	int ret = 0;
+
+	if (!setup_egl(&dpy, &ctx)) {
+		fprintf(stderr, "No surfaceless EGL with GLES2, skipping.\n");
+		return SKIP;
+	}
+
+	printf("GL_RENDERER: %s\n", (const char *)glGetString(GL_RENDERER));
+
+	/* Translucent, validly pre-multiplied input */
+	pixels = malloc(FB_SIZE * FB_SIZE * sizeof *pixels);
+	if (!pixels)
+		return 1;
+	for (i = 0; i < FB_SIZE * FB_SIZE; i++) {
+		uint32_t a, c;
+
+		state = state * 1103515245u + 12345u;
+		a = 128 + ((state >> 8) & 0x7f);
+		c = ((state >> 16) & 0xff) * a / 0xff;
+		pixels[i] = a << 24 | c << 16 | c << 8 | c;
+	}
+
+	glGenTextures(1, &input);
+	glBindTexture(GL_TEXTURE_2D, input);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, FB_SIZE, FB_SIZE, 0,
+		     GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+	free(pixels);
+
+	glGenTextures(1, &target);
+	glBindTexture(GL_TEXTURE_2D, target);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, FB_SIZE, FB_SIZE, 0,
+		     GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	glGenFramebuffers(1, &fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+			       GL_TEXTURE_2D, target, 0);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) !=
+	    GL_FRAMEBUFFER_COMPLETE) {
+		fprintf(stderr, "Incomplete framebuffer, skipping.\n");
+		return SKIP;
+	}
+
+	glViewport(0, 0, FB_SIZE, FB_SIZE);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, input);
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+	glEnableVertexAttribArray(0);
+	glEnableVertexAttribArray(1);
+
+	for (i = 0; i < ARRAY_LENGTH(cases); i++) {
+		double ns = run_case(&cases[i]);
+
+		if (ns < 0.0) {
+			fprintf(stderr, "%s: failed to build the program\n",
+				cases[i].name);
+			ret = 1;
+			continue;
+		}
+		printf("%-24s %8.3f ns/pixel\n", cases[i].name, ns);
+	}
+
+	glDeleteFramebuffers(1, &fbo);
+	glDeleteTextures(1, &target);
+	glDeleteTextures(1, &input);
+
+	eglMakeCurrent(dpy, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	eglDestroyContext(dpy, ctx);
+	eglTerminate(dpy);
+
+	return ret;
+}
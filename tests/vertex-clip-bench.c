@@ -0,0 +1,138 @@
+/*
+ * Copyright 2024 Collabora, Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Cost of clipping transformed surface rectangles against damage
+ * rectangles, one pair at a time with clip_transformed() as GL-renderer
+ * used to do it, versus clip_transformed_batch().
+ */
+
+#include "config.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "shared/helpers.h"
+#include "shared/timespec-util.h"
+#include "vertex-clipping.h"
+#include "vertex-clip-random.h"
+
+#define N_POLYS 16
+#define N_BOXES 64
+#define ROUNDS 20000
+
+/* What calculate_edges() in GL-renderer does for one pair */
+static int
+clip_one(const struct polygon8 *quad, const struct clip_box *box,
+	 struct weston_coord *e)
+{
+	struct clip_context ctx = { .clip = *box };
+	struct polygon8 surf = *quad;
+	float min_x, max_x, min_y, max_y;
+	int i;
+
+	min_x = max_x = surf.pos[0].x;
+	min_y = max_y = surf.pos[0].y;
+	for (i = 1; i < surf.n; i++) {
+		min_x = MIN(min_x, surf.pos[i].x);
+		max_x = MAX(max_x, surf.pos[i].x);
+		min_y = MIN(min_y, surf.pos[i].y);
+		max_y = MAX(max_y, surf.pos[i].y);
+	}
+
+	if (min_x >= box->x2 || max_x <= box->x1 ||
+	    min_y >= box->y2 || max_y <= box->y1)
+		return 0;
+
+	return clip_transformed(&ctx, &surf, e);
+}
+
+int
+main(int argc, char *argv[])
+{
+	static struct polygon8 polys[N_POLYS];
+	static struct clip_box boxes[N_BOXES];
+	static struct weston_coord scalar_v[N_POLYS * N_BOXES * 8];
+	static struct weston_coord batch_v[N_POLYS * N_BOXES * 8];
+	static int scalar_n[N_POLYS * N_BOXES];
+	static int batch_n[N_POLYS * N_BOXES];
+	struct timespec begin, end;
+	double scalar_ns, batch_ns;
+	uint32_t state = 1;
+	long sink = 0;
+	int round, i, j, k;
+
+	for (j = 0; j < N_POLYS; j++)
+		random_quad(&state, &polys[j], 1000, 300);
+	for (i = 0; i < N_BOXES; i++)
+		random_box(&state, &boxes[i], 1000, 250);
+
+	clock_gettime(CLOCK_MONOTONIC, &begin);
+	for (round = 0; round < ROUNDS; round++) {
+		for (i = 0; i < N_BOXES; i++) {
+			for (j = 0; j < N_POLYS; j++) {
+				int idx = i * N_POLYS + j;
+
+				scalar_n[idx] = clip_one(&polys[j], &boxes[i],
+							 &scalar_v[idx * 8]);
+				sink += scalar_n[idx];
+			}
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	scalar_ns = timespec_sub_to_nsec(&end, &begin);
+
+	clock_gettime(CLOCK_MONOTONIC, &begin);
+	for (round = 0; round < ROUNDS; round++)
+		sink += clip_transformed_batch(polys, N_POLYS, boxes, N_BOXES,
+					       batch_v, batch_n);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	batch_ns = timespec_sub_to_nsec(&end, &begin);
+
+	for (k = 0; k < N_POLYS * N_BOXES; k++) {
+		bool same = scalar_n[k] == batch_n[k];
+
+		for (i = 0; same && i < scalar_n[k]; i++)
+			same = scalar_v[k * 8 + i].x == batch_v[k * 8 + i].x &&
+			       scalar_v[k * 8 + i].y == batch_v[k * 8 + i].y;
+
+		if (!same) {
+			fprintf(stderr, "pair %d: batch differs from scalar\n", k);
+			return EXIT_FAILURE;
+		}
+	}
+
+	printf("%d quads x %d boxes, %ld vertices\n",
+	       N_POLYS, N_BOXES, sink / (2 * ROUNDS));
+	printf("%-8s %8.2f ns/pair\n", "scalar",
+	       scalar_ns / ((double)ROUNDS * N_POLYS * N_BOXES));
+	printf("%-8s %8.2f ns/pair\n", "batch",
+	       batch_ns / ((double)ROUNDS * N_POLYS * N_BOXES));
+
+	return EXIT_SUCCESS;
+}
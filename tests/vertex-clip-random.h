@@ -0,0 +1,81 @@
+/*
+ * Copyright 2024 Collabora, Ltd.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Deterministic random polygons and clip boxes for the vertex clipping
+ * test and benchmark.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include "vertex-clipping.h"
+
+static inline uint32_t
+next_random(uint32_t *state)
+{
+	*state = *state * 1103515245u + 12345u;
+	return *state >> 8;
+}
+
+static inline double
+random_coord(uint32_t *state, int range)
+{
+	return (double)(next_random(state) % (range * 64)) / 64.0 - range / 2;
+}
+
+/* Parallelograms, i.e. rectangles under an arbitrary affine transform */
+static inline void
+random_quad(uint32_t *state, struct polygon8 *quad, int pos_range,
+	    int size_range)
+{
+	struct weston_coord o, u, v;
+
+	o = weston_coord(random_coord(state, pos_range),
+			 random_coord(state, pos_range));
+	u = weston_coord(random_coord(state, size_range),
+			 random_coord(state, size_range));
+	v = weston_coord(-u.y * 0.75, u.x * 0.75);
+
+	quad->n = 4;
+	quad->pos[0] = o;
+	quad->pos[1] = weston_coord_add(o, u);
+	quad->pos[2] = weston_coord_add(weston_coord_add(o, u), v);
+	quad->pos[3] = weston_coord_add(o, v);
+}
+
+static inline void
+random_box(uint32_t *state, struct clip_box *box, int pos_range,
+	   int size_range)
+{
+	int x = next_random(state) % pos_range - pos_range / 2;
+	int y = next_random(state) % pos_range - pos_range / 2;
+
+	box->x1 = x;
+	box->y1 = y;
+	box->x2 = x + 1 + next_random(state) % size_range;
+	box->y2 = y + 1 + next_random(state) % size_range;
+}
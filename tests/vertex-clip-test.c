@@ -26,12 +26,14 @@
 #include "config.h"
 
 #include <assert.h>
+#include <stdint.h>
 #include <string.h>
 
 #include "weston-test-runner.h"
 
 #include "shared/helpers.h"
 #include "vertex-clipping.h"
+#include "vertex-clip-random.h"
 
 #define BOUNDING_BOX_TOP_Y 100.0f
 #define BOUNDING_BOX_LEFT_X 50.0f
@@ -275,3 +277,87 @@ TEST(float_difference_same)
 	assert(float_difference(1.0f, 1.0f) == 0.0f);
 }
 
+
+TEST_P(clip_polygon_batch_expected_vertices, test_data)
+{
+	struct vertex_clip_test_data *tdata = data;
+	struct clip_box box = {
+		.x1 = BOUNDING_BOX_LEFT_X,
+		.y1 = BOUNDING_BOX_BOTTOM_Y,
+		.x2 = BOUNDING_BOX_RIGHT_X,
+		.y2 = BOUNDING_BOX_TOP_Y,
+	};
+	struct weston_coord vertices[8];
+	int count;
+	int i;
+
+	clip_transformed_batch(&tdata->surface, 1, &box, 1, vertices, &count);
+
+	assert(count == tdata->expected.n);
+	for (i = 0; i < count; i++) {
+		assert(vertices[i].x == tdata->expected.pos[i].x);
+		assert(vertices[i].y == tdata->expected.pos[i].y);
+	}
+}
+
+/* The batched path must match clip_transformed() bit for bit */
+#define BATCH_POLYS 37
+#define BATCH_BOXES 23
+
+TEST(clip_polygon_batch_matches_scalar)
+{
+	const int n_polys = BATCH_POLYS;
+	const int n_boxes = BATCH_BOXES;
+	struct polygon8 polys[BATCH_POLYS];
+	struct clip_box boxes[BATCH_BOXES];
+	struct weston_coord vertices[BATCH_POLYS * BATCH_BOXES * 8];
+	int counts[BATCH_POLYS * BATCH_BOXES];
+	uint32_t state = 1;
+	int round, i, j, k;
+
+	for (round = 0; round < 100; round++) {
+		for (j = 0; j < n_polys; j++)
+			random_quad(&state, &polys[j], 400, 200);
+		for (i = 0; i < n_boxes; i++)
+			random_box(&state, &boxes[i], 400, 200);
+
+		clip_transformed_batch(polys, n_polys, boxes, n_boxes,
+				       vertices, counts);
+
+		for (i = 0; i < n_boxes; i++) {
+			for (j = 0; j < n_polys; j++) {
+				int idx = i * n_polys + j;
+				struct clip_context ctx = { .clip = boxes[i] };
+				struct polygon8 polygon;
+				struct weston_coord e[8];
+				float min_x = polys[j].pos[0].x;
+				float max_x = min_x;
+				float min_y = polys[j].pos[0].y;
+				float max_y = min_y;
+				int n;
+
+				for (k = 1; k < 4; k++) {
+					min_x = MIN(min_x, polys[j].pos[k].x);
+					max_x = MAX(max_x, polys[j].pos[k].x);
+					min_y = MIN(min_y, polys[j].pos[k].y);
+					max_y = MAX(max_y, polys[j].pos[k].y);
+				}
+
+				if (min_x >= boxes[i].x2 || max_x <= boxes[i].x1 ||
+				    min_y >= boxes[i].y2 || max_y <= boxes[i].y1) {
+					assert(counts[idx] == 0);
+					continue;
+				}
+
+				deep_copy_polygon8(&polys[j], &polygon);
+				n = clip_transformed(&ctx, &polygon, e);
+
+				assert(counts[idx] == n);
+				for (k = 0; k < n; k++) {
+					assert(vertices[idx * 8 + k].x == e[k].x);
+					assert(vertices[idx * 8 + k].y == e[k].y);
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,249 @@
+#!/usr/bin/env python3
+#
+# Copyright 2024 Collabora, Ltd.
+#
+# Permission is hereby granted, free of charge, to any person obtaining
+# a copy of this software and associated documentation files (the
+# "Software"), to deal in the Software without restriction, including
+# without limitation the rights to use, copy, modify, merge, publish,
+# distribute, sublicense, and/or sell copies of the Software, and to
+# permit persons to whom the Software is furnished to do so, subject to
+# the following conditions:
+#
+# The above copyright notice and this permission notice (including the
+# next paragraph) shall be included in all copies or substantial
+# portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+# EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+# MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+# NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+# BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+# ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+# CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+
+"""Decode a 'proto-binary' capture into the text of the 'proto' scope.
+
+The stream format is described in shared/proto-capture.h. The names and
+arguments of the messages come from the protocol XML files, found in the
+given directories or files, by default in the system wayland and
+wayland-protocols data directories and in weston's protocol directory.
+
+Capture with, e.g.:
+    weston-debug -o capture.bin proto-binary
+"""
+
+import argparse
+import os
+import struct
+import sys
+import time
+import xml.etree.ElementTree as ET
+
+RECORD = struct.Struct('=HHIQQII')
+WORD = struct.Struct('=I')
+SWORD = struct.Struct('=i')
+
+MAGIC = b'weston-proto'
+VERSION = 1
+
+RECORD_STREAM = 1
+RECORD_INTERFACE = 2
+RECORD_CLIENT = 3
+RECORD_REQUEST = 4
+RECORD_EVENT = 5
+
+DEFAULT_PATHS = [
+    '/usr/share/wayland',
+    '/usr/share/wayland-protocols',
+    os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                 os.pardir, 'protocol'),
+]
+
+
+def load_protocols(paths):
+    """Map interface names to their (requests, events) argument lists"""
+    interfaces = {}
+
+    def load(path):
+        try:
+            root = ET.parse(path).getroot()
+        except (ET.ParseError, OSError):
+            return
+        for iface in root.iter('interface'):
+            messages = ([], [])
+            for msg in iface:
+                if msg.tag not in ('request', 'event'):
+                    continue
+                args = [(arg.get('name'), arg.get('type'),
+                         arg.get('interface'))
+                        for arg in msg.iter('arg')]
+                messages[msg.tag == 'event'].append((msg.get('name'), args))
+            interfaces[iface.get('name')] = messages
+
+    for path in paths:
+        if os.path.isfile(path):
+            load(path)
+            continue
+        for dirpath, _, files in os.walk(path):
+            for name in sorted(files):
+                if name.endswith('.xml'):
+                    load(os.path.join(dirpath, name))
+
+    return interfaces
+
+
+def timestamp(time_ns):
+    secs, nsec = divmod(time_ns, 1000000000)
+    return '[{}.{:03d}]'.format(time.strftime('%H:%M:%S',
+                                              time.localtime(secs)),
+                                nsec // 1000000)
+
+
+class Decoder:
+    def __init__(self, protocols, out):
+        self.protocols = protocols
+        self.out = out
+        self.interfaces = {}
+        self.clients = {}
+        self.objects = {}
+
+    def object_name(self, client, object_id, interface=None):
+        if object_id == 0:
+            return 'nil'
+        if interface is None:
+            interface = self.objects.get((client, object_id), '[unknown]')
+        return '{}@{}'.format(interface, object_id)
+
+    def decode_args(self, client, args, payload):
+        out = []
+        pos = 0
+
+        def word():
+            nonlocal pos
+            value, = WORD.unpack_from(payload, pos)
+            pos += 4
+            return value
+
+        def blob():
+            nonlocal pos
+            size = word()
+            data = payload[pos:pos + size]
+            pos += (size + 3) & ~3
+            return size, data
+
+        for name, kind, interface in args:
+            if kind == 'int':
+                out.append(str(SWORD.unpack_from(payload, pos)[0]))
+                pos += 4
+            elif kind == 'uint':
+                out.append(str(word()))
+            elif kind == 'fixed':
+                out.append('{:f}'.format(SWORD.unpack_from(payload, pos)[0]
+                                         / 256.0))
+                pos += 4
+            elif kind == 'object':
+                out.append(self.object_name(client, word(), interface))
+            elif kind == 'new_id':
+                if interface is None:
+                    # Untyped new_id, like wl_registry.bind, is preceded
+                    # by the interface name and version on the wire.
+                    size, data = blob()
+                    interface = data[:size - 1].decode(errors='replace') \
+                        if size else '[unknown]'
+                    out.append('"{}"'.format(interface))
+                    out.append(str(word()))
+                object_id = word()
+                if object_id:
+                    self.objects[(client, object_id)] = interface
+                    out.append('new id {}@{}'.format(interface, object_id))
+                else:
+                    out.append('new id {}@nil'.format(interface))
+            elif kind == 'string':
+                size, data = blob()
+                out.append('"{}"'.format(data[:size - 1].decode(
+                    errors='replace')) if size else 'nil')
+            elif kind == 'array':
+                blob()
+                out.append('array')
+            elif kind == 'fd':
+                out.append('fd {}'.format(word()))
+
+        return ', '.join(out)
+
+    def message(self, rtype, opcode, time_ns, client, object_id,
+                interface_id, payload):
+        interface = self.interfaces.get(interface_id)
+        name = '{}@{}'.format(interface or '[unknown]', object_id)
+        messages = self.protocols.get(interface)
+        index = 1 if rtype == RECORD_EVENT else 0
+
+        if interface:
+            self.objects[(client, object_id)] = interface
+
+        if messages is None or opcode >= len(messages[index]):
+            call = '{}.[opcode {}]([{} bytes])'.format(name, opcode,
+                                                       len(payload))
+        else:
+            msg_name, args = messages[index][opcode]
+            try:
+                text = self.decode_args(client, args, payload)
+            except struct.error:
+                text = '[truncated]'
+            call = '{}.{}({})'.format(name, msg_name, text)
+
+        self.out.write('{} client {} (PID {}) {} {}\n'.format(
+            timestamp(time_ns), client, self.clients.get(client, 0),
+            'ev' if rtype == RECORD_EVENT else 'rq', call))
+
+    def decode(self, data):
+        pos = 0
+
+        while pos + RECORD.size <= len(data):
+            (rtype, opcode, size, time_ns, client, object_id,
+             interface_id) = RECORD.unpack_from(data, pos)
+            if size < RECORD.size or pos + size > len(data):
+                sys.stderr.write('truncated record at offset {}\n'.format(pos))
+                return
+            payload = data[pos + RECORD.size:pos + size]
+            pos += size
+
+            if rtype == RECORD_STREAM:
+                if not payload.startswith(MAGIC) or object_id != VERSION:
+                    sys.stderr.write('unsupported stream version {}\n'
+                                     .format(object_id))
+                    return
+            elif rtype == RECORD_INTERFACE:
+                name = payload.split(b'\0', 1)[0].decode(errors='replace')
+                self.interfaces[interface_id] = name
+            elif rtype == RECORD_CLIENT:
+                self.clients[client] = object_id
+            elif rtype in (RECORD_REQUEST, RECORD_EVENT):
+                self.message(rtype, opcode, time_ns, client, object_id,
+                             interface_id, payload)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split('\n')[0])
+    parser.add_argument('-p', '--protocol', action='append', default=[],
+                        help='protocol XML file or directory, may be '
+                             'repeated (default: system directories)')
+    parser.add_argument('capture', help="'proto-binary' capture, - for stdin")
+    options = parser.parse_args()
+
+    protocols = load_protocols(options.protocol or DEFAULT_PATHS)
+    if not protocols:
+        sys.exit('no protocol XML files found')
+
+    if options.capture == '-':
+        data = sys.stdin.buffer.read()
+    else:
+        with open(options.capture, 'rb') as f:
+            data = f.read()
+
+    Decoder(protocols, sys.stdout).decode(data)
+
+
+if __name__ == '__main__':
+    main()